@@ -20,6 +20,11 @@ namespace emulator {
         void setEnableJitCallChaining(bool);
         void setJitStatsLevel(int);
         void setOptimizationLevel(int);
+        void setEnableJitTiers(bool);
+        void setJitThreads(int);
+        void setJitCodeCacheSize(unsigned int codeCacheSizeInMB);
+        void setJitCacheDirectory(const std::string&);
+        void setJitTelemetryPath(const std::string&);
         void setEnableShm(bool);
         void setNbCores(int nbCores);
         void setVirtualMemoryAmount(unsigned int virtualMemoryInMB);
@@ -32,6 +37,11 @@ namespace emulator {
         bool enableJitCallChaining_ { false };
         int jitStatsLevel_ { 0 };
         int optimizationLevel_ { 1 };
+        bool enableJitTiers_ { true };
+        int jitThreads_ { 0 };
+        unsigned int jitCodeCacheSizeInMB_ { 256 };
+        std::string jitCacheDirectory_;
+        std::string jitTelemetryPath_;
         bool enableShm_ { false };
         int nbCores_ { 1 };
         unsigned int virtualMemoryInMB_ { 4096};
@@ -57,7 +57,8 @@ namespace emulator {
         void syncThread();
         void enterSyscall();
 
-        void updateJitStats(const x64::CodeSegment&);
+        static bool endsWithIndirectBranch(const x64::CodeSegment&);
+        static void updateJitStats(const x64::CodeSegment&, u64 rip, x64::JitStats* stats);
 
         x64::Cpu cpu_;
         x64::Mmu& mmu_;
@@ -1,6 +1,7 @@
 #ifndef VMTHREAD_H
 #define VMTHREAD_H
 
+#include "x64/compiler/jit.h"
 #include "x64/registers.h"
 #include "x64/flags.h"
 #include "x64/simd.h"
@@ -138,6 +139,7 @@ namespace emulator {
         }
 
         u64* ticks() { return &nbInstructions_; }
+        u64 instructionLimit() const { return instructionLimit_; }
 
         void setSlice(u64 current, u64 sliceDuration) {
             verify(current >= waitTime_ + nbInstructions_);
@@ -168,9 +170,8 @@ namespace emulator {
         };
 
         struct SavedJitState {
-            std::vector<void*> callstack;
-            size_t size { 0 };
-            static constexpr size_t MAX_SIZE = 0x1000;
+            std::array<x64::CallstackEntry, x64::CALLSTACK_SIZE> callstack;
+            u64 size { 0 };
         };
 
         struct Stats {
@@ -207,14 +208,6 @@ namespace emulator {
             ThreadProfileData::didSyscall(time_.ns(), syscallNumber);
         }
 
-        bool requestsAtomic() const { return requestsAtomic_; }
-        void resetAtomicRequest() { requestsAtomic_ = false; }
-
-        void enterAtomic() {
-            yield();
-            requestsAtomic_ = true;
-        }
-
         void pushCallstack(u64 stackptr, u64 from, u64 to) {
             ThreadProfileData::pushCallstack(time_.ns(), to);
             ThreadCallstackData::pushCallstack(stackptr, from, to);
@@ -244,7 +237,6 @@ namespace emulator {
         Stats stats_;
 
         bool requestsSyscall_ { false };
-        bool requestsAtomic_ { false };
     };
 
 }
@@ -37,6 +37,10 @@ namespace host {
 
     ImulResult<u64> imul64(u64 a, u64 b);
 
+    // lock cmpxchg16b: *ptr is replaced by desired if it equals *expected.
+    // Otherwise, *expected receives the current value of *ptr.
+    bool cmpxchg16b(u128* ptr, u128* expected, u128 desired);
+
 
     struct CPUID {
         u32 a, b, c, d;
@@ -45,6 +49,20 @@ namespace host {
 
     bool hasMultibyteNop();
 
+    // Instruction set extensions of the cpu the emulator runs on.
+    // Unlike cpuid, nothing is hidden because the guest cannot use it.
+    struct HostFeatures {
+        bool popcnt { false };
+        bool bmi1 { false };
+        bool bmi2 { false };
+        bool sse42 { false };
+
+        u32 mask() const {
+            return (u32)popcnt << 0 | (u32)bmi1 << 1 | (u32)bmi2 << 2 | (u32)sse42 << 3;
+        }
+    };
+    const HostFeatures& hostFeatures();
+
     struct XGETBV {
         u32 a, d;
     };
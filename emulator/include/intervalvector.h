@@ -38,6 +38,16 @@ public:
         return right;
     }
 
+    std::unique_ptr<T> take(const T* item) {
+        auto it = std::find_if(items_.begin(), items_.end(), [&](const auto& ptr) {
+            return ptr.get() == item;
+        });
+        if(it == items_.end()) return {};
+        std::unique_ptr<T> taken = std::move(*it);
+        items_.erase(it);
+        return taken;
+    }
+
     void sort() {
         auto compareItems = [](const auto& a, const auto& b) {
             return a->start() < b->start();
@@ -74,6 +84,7 @@ public:
 
     void insert(std::unique_ptr<IntervalValue<T>> value);
     void remove(u64 start, u64 end);
+    std::unique_ptr<T> take(const T* item);
 
     void split(u64 value);
 
@@ -86,6 +97,9 @@ public:
     template<typename Func>
     void forEach(u64 start, u64 end, Func&& callback);
 
+    template<typename Func>
+    void forEachMutable(Func&& callback);
+
     template<typename Func>
     void forEachMutable(u64 start, u64 end, Func&& callback);
 
@@ -144,6 +158,18 @@ inline void IntervalVector<T>::remove(u64 start, u64 end) {
     values_.erase(first, afterlast);
 }
 
+template<typename T>
+inline std::unique_ptr<T> IntervalVector<T>::take(const T* item) {
+    // splits move the items that cross the split point to the right
+    auto it = std::lower_bound(values_.begin(), values_.end(), item->start(), [](const auto& value, u64 address) {
+        return value->end() < address;
+    });
+    for(; it != values_.end() && it->get()->start() <= item->end(); ++it) {
+        if(auto taken = it->get()->take(item)) return taken;
+    }
+    return {};
+}
+
 template<typename T>
 inline void IntervalVector<T>::split(u64 value) {
     auto* interval = find(value);
@@ -170,6 +196,14 @@ void IntervalVector<T>::forEach(Func&& callback) const {
     }
 }
 
+template<typename T>
+template<typename Func>
+void IntervalVector<T>::forEachMutable(Func&& callback) {
+    for(auto it = values_.begin(); it != values_.end(); ++it) {
+        it->get()->forEachMutable(callback);
+    }
+}
+
 template<typename T>
 template<typename Func>
 void IntervalVector<T>::forEach(u64 start, u64 end, Func&& callback) {
@@ -7,6 +7,7 @@
 #include <vector>
 
 namespace x64 {
+    class CodeCache;
     class Mmu;
 }
 
@@ -40,6 +41,11 @@ namespace kernel::gnulinux {
         void setEnableJitCallChaining(bool enableJitCallChaining);
         void setJitStatsLevel(int jitStatsLevel);
         void setOptimizationLevel(int level);
+        void setEnableJitTiers(bool enableJitTiers);
+        void setJitThreads(int nbThreads);
+        void setJitCodeCacheSize(unsigned int codeCacheSizeInMB);
+        void setJitCacheDirectory(const std::string& directory);
+        void setJitTelemetryPath(const std::string& path);
         void setEnableShm(bool enableShm);
         void setNbCores(int nbCores);
         void setProcessVirtualMemory(unsigned int virtualMemoryInMB);
@@ -51,6 +57,11 @@ namespace kernel::gnulinux {
         bool isJitCallChainingEnabled() const { return enableJitCallChaining_; }
         int jitStatsLevel() const { return jitStatsLevel_; }
         int optimizationLevel() const { return optimizationLevel_; }
+        bool isJitTiersEnabled() const { return enableJitTiers_; }
+        int jitThreads() const { return jitThreads_; }
+        unsigned int jitCodeCacheSize() const { return jitCodeCacheSizeInMB_; }
+        const std::string& jitCacheDirectory() const { return jitCacheDirectory_; }
+        const std::string& jitTelemetryPath() const { return jitTelemetryPath_; }
         bool isShmEnabled() const { return enableShm_; }
         int nbCores() const { return nbCores_; }
 
@@ -79,6 +90,9 @@ namespace kernel::gnulinux {
             return *processTable_;
         }
 
+        // Only created once a process forks or execs, unless a jit cache directory was given.
+        x64::CodeCache* sharedCodeCache();
+
         void panic();
         bool hasPanicked() const { return hasPanicked_; }
         void dumpPanicInfo() const;
@@ -89,6 +103,7 @@ namespace kernel::gnulinux {
         std::unique_ptr<Scheduler> scheduler_;
         std::unique_ptr<Sys> sys_;
         std::unique_ptr<Timers> timers_;
+        std::unique_ptr<x64::CodeCache> codeCache_;
         std::unique_ptr<ProcessTable> processTable_;
         bool hasPanicked_ { false };
 
@@ -99,6 +114,11 @@ namespace kernel::gnulinux {
         bool enableJitCallChaining_ { false };
         int jitStatsLevel_ { 0 };
         int optimizationLevel_ { 0 };
+        bool enableJitTiers_ { true };
+        int jitThreads_ { 0 };
+        unsigned int jitCodeCacheSizeInMB_ { 256 };
+        std::string jitCacheDirectory_;
+        std::string jitTelemetryPath_;
         bool enableShm_ { false };
         int nbCores_ { 1 };
         unsigned int virtualMemoryInMB_ { 4096 };
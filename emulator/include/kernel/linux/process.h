@@ -9,6 +9,7 @@
 #include "x64/compiler/jitstats.h"
 #include "x64/disassembler/disassemblycache.h"
 #include "x64/codesegment.h"
+#include "x64/jittelemetry.h"
 #include "x64/mmu.h"
 #include "intervalvector.h"
 #include "verify.h"
@@ -18,6 +19,7 @@
 #include <ostream>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace kernel::gnulinux {
@@ -58,6 +60,13 @@ namespace kernel::gnulinux {
 
         x64::CodeSegment* fetchSegment(x64::Mmu& mmu, u64 address);
 
+        // Evicts cold native code once the code cache is full. Jitted code must not be running.
+        void collectJitCode();
+
+        // Drops the segments translated from the code pages written since the last call,
+        // and the native code containing them. Jitted code must not be running.
+        void invalidateWrittenCode(x64::Mmu& mmu);
+
         void dumpGraphviz(std::ostream&) const;
 
         x64::Jit* jit() { return jit_.get(); }
@@ -87,10 +96,29 @@ namespace kernel::gnulinux {
         int jitStatsLevel() const { return jitStatsLevel_; }
         x64::JitStats* jitStats() { return &jitStats_; }
 
+        // The compilation of every segment is written to path when the process ends.
+        void setJitTelemetryPath(std::string path) { jitTelemetryPath_ = std::move(path); }
+
         void setOptimizationLevel(int level) {
             if(!!jit_) jit_->setOptimizationLevel(level);
         }
 
+        void setEnableJitTiers(bool enable) {
+            if(!!jit_) jit_->setTieredCompilation(enable);
+        }
+
+        void setJitThreads(int nbThreads) {
+            if(!!jit_) jit_->setCompilationThreads((u32)std::max(nbThreads, 0));
+        }
+
+        void setJitCodeCacheLimit(u64 bytes) {
+            if(!!jit_) jit_->setCodeCacheLimit(bytes);
+        }
+
+        void setCodeCache(x64::CodeCache* codeCache);
+        // The guest may write to the file mapping at [base, base+length). Its code is then never shared through the code cache.
+        void rememberWritableMapping(u64 base, u64 length);
+
         Process* tryGetChild(int pid) const {
             auto it = std::find_if(children_.begin(), children_.end(), [&](Process* process) {
                 return process->pid() == pid;
@@ -137,6 +165,21 @@ namespace kernel::gnulinux {
         void notifyChildExited(Process* process, int status, std::optional<int> signal);
 
         void dumpJitTelemetry(const std::vector<const x64::CodeSegment*>& blocks);
+        void recordJitTelemetry(u64 base, u64 end);
+        void recordJitTelemetry();
+        void writeJitTelemetry();
+
+        x64::CodeSegment* createSegment(x64::Mmu& mmu, u64 address);
+        void setCacheLocation(const x64::MmuRegion* region, x64::CodeSegment* seg);
+        // Hands seg the entries of the table that it ends by jumping through, without translating them.
+        void linkJumpTable(x64::Mmu& mmu, x64::CodeSegment* seg);
+        static constexpr size_t MAX_JUMP_TABLE_ENTRIES = 1024;
+
+        // Drops the segments of [base, base+length) and the jitted code containing them.
+        void dropCodeSegments(u64 base, u64 length);
+        void discardJitCode(const std::unordered_set<const x64::JitBasicBlock*>& droppedBlocks);
+        void clearSavedJitCallstacks();
+        void forgetCodePages(u64 base, u64 end);
         
         // Information
         int pid_;
@@ -161,6 +204,13 @@ namespace kernel::gnulinux {
         x64::CompilationQueue compilationQueue_;
         x64::JitStats jitStats_;
         int jitStatsLevel_ { 0 };
+        std::string jitTelemetryPath_;
+        // forked processes write their own report, next to the one of the main process
+        bool jitTelemetryNamedByPid_ { false };
+        x64::JitTelemetryReport jitTelemetry_;
+        x64::CodeCache* codeCache_ { nullptr };
+        // file mappings that the guest could write to at some point, as [base, end) ranges
+        std::vector<std::pair<u64, u64>> writableMappings_;
 
         // Cpu
         x64::DisassemblyCache disassemblyCache_;
@@ -169,6 +219,9 @@ namespace kernel::gnulinux {
         std::vector<x64::X64Instruction> blockInstructions_;
         IntervalVector<x64::CodeSegment> codeSegments_;
         std::unordered_map<u64, x64::CodeSegment*> codeSegmentsByAddress_;
+        // start of the segments translated from each watched code page
+        std::unordered_map<u64, std::vector<u64>> segmentsByCodePage_;
+        std::vector<u64> writtenCodePages_;
 
         SymbolProvider symbolProvider_;
         std::unordered_map<u64, std::string> functionNameCache_;
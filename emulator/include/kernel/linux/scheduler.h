@@ -87,7 +87,6 @@ namespace kernel::gnulinux {
         struct Worker {
             int id { 0 };
             bool canRunSyscalls() const { return id == 0; };
-            bool canRunAtomic() const { return id == 0; };
         };
 
         enum class RING {
@@ -95,22 +94,15 @@ namespace kernel::gnulinux {
             USERSPACE,
         };
 
-        enum class ATOMIC {
-            NO,
-            YES,
-        };
-
         struct Job {
             Thread* thread { nullptr };
             RING ring { RING::USERSPACE };
-            ATOMIC atomic { ATOMIC::NO };
         };
 
         std::unique_ptr<TaggedVM> createVM(const Worker& worker);
 
         void runOnWorkerThread(TaggedVM*);
         void runUserspace(Thread* thread);
-        void runUserspaceAtomic(Thread* thread);
         void runKernel(Thread* thread);
 
         struct JobOrCommand {
@@ -131,7 +123,7 @@ namespace kernel::gnulinux {
         void block(Thread*);
         void unblock(Thread*, std::unique_lock<std::mutex>* lock = nullptr);
         
-        bool hasRunnableThread(bool canRunSyscalls, bool canRunAtomics) const;
+        bool hasRunnableThread(bool canRunSyscalls) const;
         bool allThreadsBlocked() const;
         bool allThreadsDead() const;
 
@@ -185,7 +177,6 @@ namespace kernel::gnulinux {
         std::unordered_map<u64, std::string> addressToSymbol_;
 
         static constexpr size_t DEFAULT_TIME_SLICE = 1'000'000;
-        static constexpr size_t ATOMIC_TIME_SLICE = 100;
         PreciseTime currentTime_ { 0, 0 };
     };
 
@@ -27,11 +27,22 @@ namespace x64 {
         u64 start() const;
         u64 end() const;
 
+        void setCacheLocation(const CodeCacheLocation& location) { cacheLocation_ = location; }
+
+        // The guest may write to the code of this segment. Chained code checks the tick limit before entering it,
+        // so that a write from jitted code is seen before the stale translation runs.
+        void setWritable() { writable_ = true; }
+
         CodeSegment* findNext(u64 address);
 
         void addSuccessor(CodeSegment* other);
         void addReturn(CodeSegment* other);
-        void removeFromCaches();
+        // Lets the jitted code of a jmp [base + index*8] go straight to the successors read from its table,
+        // where entry i of the table at base holds targets[i]. Each entry is used once its target is a successor.
+        void setJumpTable(u64 base, const std::vector<u64>& targets);
+        // The native code that contained this segment is added to droppedBlocks. It must not be entered anymore.
+        // So is the native code of predecessors that relied on this segment not reading the flags.
+        void removeFromCaches(std::unordered_set<const JitBasicBlock*>* droppedBlocks);
 
         size_t size() const;
         void onCall(Jit* jit, CompilationQueue& compilationQueue);
@@ -40,14 +51,45 @@ namespace x64 {
         void tryCompile(Jit&, CompilationQueue&);
         void tryPatch(Jit&);
 
+        // Drops the native code to free room in the code cache. The segment may be compiled again later.
+        // The code is only released once the jit collects the blocks that are not owned anymore.
+        void evictJitBasicBlock();
+
+        // Refreshes the native code of the successors of variable destination jumps.
+        void syncBlockLookupTable();
+
         u64 calls() const { return calls_ + (!!jitBasicBlock_ ? jitBasicBlock_->calls() : 0); }
 
+        // Describes the last compilation of this segment, if it was compiled at all.
+        const std::optional<CompileTelemetry>& telemetry() const { return telemetry_; }
+
         void dumpGraphviz(std::ostream&, std::unordered_map<void*, u32>& counter) const;
 
     private:
+        std::vector<CodeSegment*> findTrace() const;
+        void traceBasicBlocks(const std::vector<CodeSegment*>& trace, std::vector<const BasicBlock*>* basicBlocks, std::vector<const void*>* segments) const;
+        CodeCacheLocation traceCacheLocation(const std::vector<CodeSegment*>& trace) const;
+        bool flagsLiveIn() const;
+        bool areFlagsLiveOut(const std::vector<CodeSegment*>& trace) const;
+        void dropCodeRelyingOnDeadFlags(std::unordered_set<const JitBasicBlock*>* droppedBlocks);
+        bool tryLoadFromCache(Jit&, std::vector<CodeSegment*> trace);
+        bool tryCompileAtTier(Jit&, std::vector<CodeSegment*> trace, Jit::Tier tier);
+        void tryTierUp(Jit&);
+        void install(Jit&, JitBasicBlock* compiled, std::vector<CodeSegment*> trace, bool reliesOnDeadFlags, Jit::Tier tier);
+        void retargetPredecessors(Jit&, const JitBasicBlock* from, const JitBasicBlock* to);
+        void setTrace(std::vector<CodeSegment*> trace);
+        void onCompiled(Jit&);
+        bool trySubmitCompilation(Jit&, std::vector<CodeSegment*> trace, Jit::Tier tier);
+        void tryInstallCompilation(Jit&);
+        const CodeSegment* exitSegment() const { return trace_.empty() ? this : trace_.back(); }
+        void removeTrace();
+        void tryPatchJitBasicBlock(Jit&);
+        bool closesLoop(const CodeSegment* next) const;
+
         void removePredecessor(CodeSegment* other);
-        void removeSucessor(CodeSegment* other);
+        void removeSucessor(CodeSegment* other, std::unordered_set<const JitBasicBlock*>* droppedBlocks);
         void removeCallPredecessor(CodeSegment* other);
+        void removeReturn(CodeSegment* other);
 
         BasicBlock cpuBasicBlock_;
         JitBasicBlock* jitBasicBlock_ { nullptr };
@@ -72,24 +114,62 @@ namespace x64 {
             void removeSuccessor(CodeSegment* other);
         } variableDestinationInfo_;
 
+        struct JumpTableInfo {
+            u64 base { 0 };
+            std::vector<CodeSegment*> next;
+            std::vector<JitBasicBlock*> nextJit;
+            std::vector<u64> nextStart;
+
+            void addSuccessor(CodeSegment* other);
+            void removeSuccessor(CodeSegment* other);
+        } jumpTableInfo_;
+
         struct ReturnDestinationInfo {
             CodeSegment* ret { nullptr };
 
             void addReturn(CodeSegment* other);
+            void removeReturn(CodeSegment* other);
         } returnDestinationInfo_;
 
-        void syncBlockLookupTable();
-        
         bool compilationAttempted_ { false };
+        bool cacheLookupAttempted_ { false };
+        bool tierUpAttempted_ { false };
+        Jit::Tier tier_ { Jit::Tier::OPTIMIZED };
 
         u64 calls_ { 0 };
         u64 callsForCompilation_ { 0 };
 
         bool endsWithFixedDestinationJump_ { false };
+        // our jitBasicBlock_ does not preserve the flags, because all known successors overwrite them
+        bool reliesOnDeadFlags_ { false };
+        bool writable_ { false };
+        CodeCacheLocation cacheLocation_;
         std::unordered_map<u64, CodeSegment*> successors_;
         std::unordered_map<u64, CodeSegment*> predecessors_;
         std::unordered_map<u64, CodeSegment*> callPredecessors_;
 
+        // segments compiled after this one in our jitBasicBlock_
+        std::vector<CodeSegment*> trace_;
+        // segments whose jitBasicBlock_ contains this segment
+        std::vector<CodeSegment*> traceHeads_;
+
+        std::optional<CompileTelemetry> telemetry_;
+
+        // compilation running in the background, not shared with copies of this segment
+        struct PendingCompilation {
+            std::shared_ptr<CompilationRequest> request;
+            std::vector<CodeSegment*> trace;
+            Jit::Tier tier { Jit::Tier::OPTIMIZED };
+
+            PendingCompilation() = default;
+            PendingCompilation(const PendingCompilation&) { }
+            PendingCompilation& operator=(const PendingCompilation&) {
+                request.reset();
+                trace.clear();
+                return *this;
+            }
+        } pendingCompilation_;
+
         friend class CodeSegmentTest;
     };
 
@@ -0,0 +1,76 @@
+#ifndef CODEWRITEWATCH_H
+#define CODEWRITEWATCH_H
+
+#include "utils.h"
+#include <array>
+#include <atomic>
+#include <vector>
+#include <signal.h>
+
+namespace x64 {
+
+    class AddressSpace;
+
+    // Detects the writes to the guest pages that code has been translated from.
+    // Watched pages are kept read-only on the host, even when the guest may write to them.
+    // The first write to such a page faults: the page is made writable again and remembered,
+    // so that the translated code can be invalidated before it runs again.
+    class CodeWriteWatch {
+    public:
+        explicit CodeWriteWatch(const AddressSpace& addressSpace);
+        ~CodeWriteWatch();
+
+        static constexpr u64 PAGE_SIZE = 0x1000;
+
+        // Starts watching the page at address. The host protection is only changed when writable is set.
+        void watch(u64 address, bool writable);
+
+        // Forgets the pages of [begin, end), whose code is not executable anymore.
+        void unwatch(u64 begin, u64 end);
+
+        // Restores the host protection of the watched pages of [begin, end), after it has been reset.
+        void rewatch(u64 begin, u64 end);
+
+        bool hasWrittenPages() const { return hasWrittenPages_.load(std::memory_order_relaxed); }
+
+        // Appends the addresses of the pages written since the last call. They are not watched anymore.
+        void takeWrittenPages(std::vector<u64>* pages);
+
+        // While jitted code runs, a write to a watched page sets *tickLimit to 0,
+        // so that the jitted code returns at its next tick limit check.
+        void setTickLimit(u64* tickLimit) { tickLimit_.store(tickLimit, std::memory_order_relaxed); }
+
+    private:
+        CodeWriteWatch(const CodeWriteWatch&) = delete;
+        CodeWriteWatch& operator=(const CodeWriteWatch&) = delete;
+
+        enum State : u8 {
+            UNWATCHED,
+            WATCHED,
+            WRITTEN,
+        };
+
+        bool protect(u64 address, bool watched) const;
+        bool tryHandleWrite(const u8* hostAddress);
+
+        static void registerWatch(CodeWriteWatch* watch);
+        static void unregisterWatch(CodeWriteWatch* watch);
+        static void onSegmentationFault(int sig, siginfo_t* info, void* context);
+
+        const AddressSpace& addressSpace_;
+        std::vector<std::atomic<u8>> states_;
+        u64 watchedPages_ { 0 };
+
+        // filled from the signal handler, so it cannot allocate
+        static constexpr size_t WRITTEN_PAGES_CAPACITY = 256;
+        std::array<u64, WRITTEN_PAGES_CAPACITY> writtenPages_;
+        std::atomic<size_t> nbWrittenPages_ { 0 };
+        std::atomic<bool> writtenPagesOverflow_ { false };
+        std::atomic<bool> hasWrittenPages_ { false };
+
+        std::atomic<u64*> tickLimit_ { nullptr };
+    };
+
+}
+
+#endif
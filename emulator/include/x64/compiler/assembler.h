@@ -15,6 +15,7 @@ namespace x64 {
 
         void patchJumps();
         const std::vector<u8>& code() const { return code_; }
+        const std::vector<size_t>& imm64Offsets() const { return imm64Offsets_; }
 
         void mov(R8 dst, R8 src);
         void mov(R8 dst, u8 imm);
@@ -52,6 +53,12 @@ namespace x64 {
         void add(R32 dst, i32 imm);
         void add(R64 dst, R64 src);
         void add(R64 dst, i32 imm);
+        void add(R32 dst, const M32& src);
+        void add(R64 dst, const M64& src);
+        void add(const M32& dst, R32 src);
+        void add(const M64& dst, R64 src);
+        void add(const M32& dst, i32 imm);
+        void add(const M64& dst, i32 imm);
         void adc(R32 dst, R32 src);
         void adc(R32 dst, i32 imm);
         void sub(R8 dst, R8 src);
@@ -62,6 +69,12 @@ namespace x64 {
         void sub(R32 dst, i32 imm);
         void sub(R64 dst, R64 src);
         void sub(R64 dst, i32 imm);
+        void sub(R32 dst, const M32& src);
+        void sub(R64 dst, const M64& src);
+        void sub(const M32& dst, R32 src);
+        void sub(const M64& dst, R64 src);
+        void sub(const M32& dst, i32 imm);
+        void sub(const M64& dst, i32 imm);
         void sbb(R8 dst, R8 src);
         void sbb(R8 dst, i8 imm);
         void sbb(R32 dst, R32 src);
@@ -76,6 +89,12 @@ namespace x64 {
         void cmp(R32 dst, i32 imm);
         void cmp(R64 lhs, R64 rhs);
         void cmp(R64 dst, i32 imm);
+        void cmp(R32 lhs, const M32& rhs);
+        void cmp(R64 lhs, const M64& rhs);
+        void cmp(const M32& lhs, R32 rhs);
+        void cmp(const M64& lhs, R64 rhs);
+        void cmp(const M32& lhs, i32 imm);
+        void cmp(const M64& lhs, i32 imm);
         void shl_cl(R32 lhs);
         void shl(R32 lhs, R8 rhs);
         void shl(R32 lhs, u8 imm);
@@ -148,6 +167,12 @@ namespace x64 {
         void and_(R32 dst, i32 imm);
         void and_(R64 dst, R64 src);
         void and_(R64 dst, i32 imm);
+        void and_(R32 dst, const M32& src);
+        void and_(R64 dst, const M64& src);
+        void and_(const M32& dst, R32 src);
+        void and_(const M64& dst, R64 src);
+        void and_(const M32& dst, i32 imm);
+        void and_(const M64& dst, i32 imm);
         void or_(R8 dst, R8 src);
         void or_(R8 dst, i8 imm);
         void or_(R16 dst, R16 src);
@@ -156,6 +181,12 @@ namespace x64 {
         void or_(R32 dst, i32 imm);
         void or_(R64 dst, R64 src);
         void or_(R64 dst, i32 imm);
+        void or_(R32 dst, const M32& src);
+        void or_(R64 dst, const M64& src);
+        void or_(const M32& dst, R32 src);
+        void or_(const M64& dst, R64 src);
+        void or_(const M32& dst, i32 imm);
+        void or_(const M64& dst, i32 imm);
         void xor_(R8 dst, R8 src);
         void xor_(R8 dst, i8 imm);
         void xor_(R16 dst, R16 src);
@@ -164,6 +195,12 @@ namespace x64 {
         void xor_(R32 dst, i32 imm);
         void xor_(R64 dst, R64 src);
         void xor_(R64 dst, i32 imm);
+        void xor_(R32 dst, const M32& src);
+        void xor_(R64 dst, const M64& src);
+        void xor_(const M32& dst, R32 src);
+        void xor_(const M64& dst, R64 src);
+        void xor_(const M32& dst, i32 imm);
+        void xor_(const M64& dst, i32 imm);
         void not_(R32 dst);
         void not_(R64 dst);
         void neg(R8 dst);
@@ -180,12 +217,60 @@ namespace x64 {
         void xchg(R16 dst, R16 src);
         void xchg(R32 dst, R32 src);
         void xchg(R64 dst, R64 src);
+        void xchg(const M8& dst, R8 src);
+        void xchg(const M16& dst, R16 src);
+        void xchg(const M32& dst, R32 src);
+        void xchg(const M64& dst, R64 src);
         void cmpxchg(R32 dst, R32 src);
         void cmpxchg(R64 dst, R64 src);
 
+        void lockadd(const M8& dst, R8 src);
+        void lockadd(const M8& dst, i8 imm);
+        void lockadd(const M16& dst, R16 src);
+        void lockadd(const M16& dst, i16 imm);
+        void lockadd(const M32& dst, R32 src);
+        void lockadd(const M32& dst, i32 imm);
+        void lockadd(const M64& dst, R64 src);
+        void lockadd(const M64& dst, i32 imm);
+        void locksub(const M8& dst, R8 src);
+        void locksub(const M8& dst, i8 imm);
+        void locksub(const M16& dst, R16 src);
+        void locksub(const M16& dst, i16 imm);
+        void locksub(const M32& dst, R32 src);
+        void locksub(const M32& dst, i32 imm);
+        void locksub(const M64& dst, R64 src);
+        void locksub(const M64& dst, i32 imm);
+        void lockor(const M8& dst, R8 src);
+        void lockor(const M8& dst, i8 imm);
+        void lockor(const M16& dst, R16 src);
+        void lockor(const M16& dst, i16 imm);
+        void lockor(const M32& dst, R32 src);
+        void lockor(const M32& dst, i32 imm);
+        void lockor(const M64& dst, R64 src);
+        void lockor(const M64& dst, i32 imm);
+        void lockinc(const M8& dst);
+        void lockinc(const M16& dst);
+        void lockinc(const M32& dst);
+        void lockinc(const M64& dst);
+        void lockdec(const M8& dst);
+        void lockdec(const M16& dst);
+        void lockdec(const M32& dst);
+        void lockdec(const M64& dst);
+        void lockbts(const M16& dst, R16 src);
+        void lockbts(const M16& dst, u8 imm);
+        void lockbts(const M32& dst, R32 src);
+        void lockbts(const M32& dst, u8 imm);
+        void lockbts(const M64& dst, R64 src);
+        void lockbts(const M64& dst, u8 imm);
+        void lockcmpxchg(const M8& dst, R8 src);
+        void lockcmpxchg(const M16& dst, R16 src);
         void lockcmpxchg(const M32& dst, R32 src);
         void lockcmpxchg(const M64& dst, R64 src);
+        void lockcmpxchg16b(const M128& dst);
+        void lockxadd(const M8& dst, R8 src);
+        void lockxadd(const M16& dst, R16 src);
         void lockxadd(const M32& dst, R32 src);
+        void lockxadd(const M64& dst, R64 src);
 
         void cwde();
         void cdqe();
@@ -209,6 +294,19 @@ namespace x64 {
         void bsf(R64 dst, R64 src);
         void bsr(R32 dst, R32 src);
         void tzcnt(R32 dst, R32 src);
+        void tzcnt(R64 dst, R64 src);
+        void popcnt(R32 dst, R32 src);
+        void popcnt(R64 dst, R64 src);
+
+        // BMI instructions, only available when the host supports them
+        void shlx(R32 dst, R32 src, R32 count);
+        void shlx(R64 dst, R64 src, R64 count);
+        void shrx(R32 dst, R32 src, R32 count);
+        void shrx(R64 dst, R64 src, R64 count);
+        void sarx(R32 dst, R32 src, R32 count);
+        void sarx(R64 dst, R64 src, R64 count);
+        void andn(R32 dst, R32 src1, R32 src2);
+        void andn(R64 dst, R64 src1, R64 src2);
 
         void set(Cond, R8);
         void cmov(Cond, R32, R32);
@@ -323,6 +421,7 @@ namespace x64 {
         void movhlps(XMM, XMM);
         void movlhps(XMM, XMM);
         void pmovmskb(R32, XMM);
+        void movmskpd(R32, XMM);
         void movq2dq(XMM, MMX);
 
         void pand(XMM, XMM);
@@ -477,6 +576,10 @@ namespace x64 {
 
         void pmaxsd(XMM, XMM);
         void pminsd(XMM, XMM);
+        void pmaxuw(XMM, XMM);
+        void pmaxud(XMM, XMM);
+        void pminuw(XMM, XMM);
+        void pminud(XMM, XMM);
         void pmovzxbw(XMM, XMM);
         void roundps(XMM, XMM, u8);
         void roundpd(XMM, XMM, u8);
@@ -487,12 +590,47 @@ namespace x64 {
         void blendvps(XMM, XMM);
         void pblendvb(XMM, XMM);
 
+        void pcmpistri(XMM, XMM, u8);
+        void pcmpestri(XMM, XMM, u8);
+        void crc32(R32, R8);
+        void crc32(R32, R16);
+        void crc32(R32, R32);
+        void crc32(R64, R64);
+
+        // x87
+        void fld(const M32&);
+        void fld(const M64&);
+        void fld(const M80&);
+        void fild(const M16&);
+        void fild(const M32&);
+        void fild(const M64&);
+        void fstp(const M32&);
+        void fstp(const M64&);
+        void fstp(const M80&);
+        void fisttp(const M16&);
+        void fisttp(const M32&);
+        void fisttp(const M64&);
+        void fpop();
+        void fldz();
+        void fld1();
+        void fldlg2();
+        void faddp();
+        void fsubp();
+        void fmulp();
+        void fdivp();
+        void fcomip();
+        void fucomip();
+        void fabs();
+        void fchs();
+        void emms();
+
         // exits
         struct Label {
             explicit Label(Assembler&);
             size_t labelIndex { 0 };
             size_t positionInCode { (size_t)(-1) };
             std::vector<size_t> jumpsToMe;
+            std::vector<size_t> shortJumpsToMe;
         };
 
         Label& label();
@@ -502,6 +640,8 @@ namespace x64 {
         void jumpCondition(Cond, Label* label);
         void jump(Label* label);
         void jump(R64);
+        // jumps if rcx is zero, without reading or writing the flags
+        void jrcxz(Label* label);
 
         void call(R64 src);
         void ret();
@@ -527,8 +667,19 @@ namespace x64 {
         template<typename Reg, typename Mem>
         void opRegMem(std::initializer_list<u8> inss, Reg reg, const Mem& mem, REX);
 
+        enum class VexPrefix : u8 {
+            NONE = 0b00,
+            P66 = 0b01,
+            PF3 = 0b10,
+            PF2 = 0b11,
+        };
+
+        // 3-byte vex encoding of an instruction of the 0f38 map, with register operands only
+        void vex0F38(VexPrefix prefix, REX rex, u8 opcode, u8 reg, u8 vvvv, u8 rm);
+
         std::vector<u8> code_;
         std::deque<Label> labels_;
+        std::vector<size_t> imm64Offsets_;
 
     };
 
@@ -0,0 +1,110 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include "x64/instructions/basicblock.h"
+#include "utils.h"
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef MULTIPROCESSING
+#include <mutex>
+#endif
+
+namespace x64 {
+
+    class CodeCacheFile;
+
+    // Where the code of a segment comes from: a file mapped at a given address.
+    struct CodeCacheLocation {
+        CodeCacheFile* file { nullptr };
+        u64 regionBase { 0 };
+
+        bool operator==(const CodeCacheLocation& other) const {
+            return file == other.file && regionBase == other.regionBase;
+        }
+    };
+
+    // Bytes of native code kept in memory by a cache, across all of its files.
+    struct CodeCacheBudget {
+        u64 limit { 0 };
+        std::atomic<u64> usedBytes { 0 };
+    };
+
+    // Compiled code for the executable regions of one elf file.
+    // Entries are keyed by the offsets of the compiled blocks within the mapping,
+    // and by whether the code was allowed to drop the flags on exit.
+    class CodeCacheFile {
+    public:
+        CodeCacheFile(std::string cachePath, u64 identity, CodeCacheBudget* budget = nullptr);
+
+        std::optional<NativeBasicBlock> tryLoad(u64 regionBase, const std::vector<const BasicBlock*>& basicBlocks, int optimizationLevel, bool flagsLiveOut) const;
+        // Code that is not relocatable stays private to the process that compiled it.
+        void store(u64 regionBase, const std::vector<const BasicBlock*>& basicBlocks, int optimizationLevel, bool flagsLiveOut, const NativeBasicBlock& nativeBasicBlock);
+
+        bool tryRead();
+        bool tryWrite() const;
+        bool isDirty() const { return dirty_; }
+        // Whether the entries outlive the emulator, in which case they are worth optimizing right away.
+        bool isPersistent() const { return !cachePath_.empty(); }
+
+    private:
+        struct Entry {
+            u64 regionBase { 0 };
+            i32 optimizationLevel { 0 };
+            bool flagsLiveOut { true };
+            std::vector<u64> offsets;
+            u64 instructionsHash { 0 };
+            NativeBasicBlock code;
+        };
+
+        static u64 hashInstructions(const std::vector<const BasicBlock*>& basicBlocks);
+        static u64 key(u64 regionBase, const std::vector<u64>& offsets, int optimizationLevel, bool flagsLiveOut);
+        static std::vector<u64> offsetsOf(u64 regionBase, const std::vector<const BasicBlock*>& basicBlocks);
+
+        std::string cachePath_;
+        u64 identity_ { 0 };
+        CodeCacheBudget* budget_ { nullptr };
+        std::unordered_map<u64, Entry> entries_;
+        bool dirty_ { false };
+#ifdef MULTIPROCESSING
+        mutable std::mutex guard_;
+#endif
+    };
+
+    // Persistent storage of native code, shared by all emulated processes.
+    // Files are identified by their path, inode, size and modification time, and by the emulator binary itself.
+    // Cached code is written back to disk when the cache is destroyed.
+    // Entries are never patched: the code is copied and relocated each time it is loaded.
+    class CodeCache {
+    public:
+        static std::unique_ptr<CodeCache> tryCreate(const std::string& directory);
+        // Code is only shared with the processes forked or exec'd by this emulator.
+        // Entries that would take the cache over the given size are not stored.
+        static std::unique_ptr<CodeCache> createInMemory(u64 sizeLimit);
+        ~CodeCache();
+
+        CodeCacheFile* tryOpen(const std::string& path);
+
+        // Rewrites the host pointers of cached code for the blocks it is about to be used with.
+        static bool relocate(NativeBasicBlock* nativeBasicBlock, const std::vector<const BasicBlock*>& basicBlocks,
+                             const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr);
+
+    private:
+        CodeCache(std::string directory, u64 emulatorIdentity);
+
+        std::string directory_;
+        u64 emulatorIdentity_ { 0 };
+        std::unique_ptr<CodeCacheBudget> budget_;
+        std::unordered_map<std::string, std::unique_ptr<CodeCacheFile>> files_;
+#ifdef MULTIPROCESSING
+        std::mutex guard_;
+#endif
+    };
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "x64/compiler/ir.h"
 #include <memory>
 #include <optional>
+#include <utility>
 #include <vector>
 
 namespace x64 {
@@ -19,8 +20,15 @@ namespace x64 {
 
         std::optional<NativeBasicBlock> tryGenerate(const ir::IR& ir);
 
+        // Offsets of the 64-bit immediates in the last generated code
+        const std::vector<size_t>& imm64Offsets() const;
+
+        // Relocation indices of the host pointers in the last generated code, with the offsets of their immediates
+        const std::vector<std::pair<u32, size_t>>& relocationOffsets() const;
+
     private:
         std::unique_ptr<Assembler> assembler_;
+        std::vector<std::pair<u32, size_t>> relocationOffsets_;
     };
 
 }
@@ -0,0 +1,74 @@
+#ifndef CODEPATCHER_H
+#define CODEPATCHER_H
+
+#include "utils.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace x64 {
+
+    // Lets several workers run jitted code while another one changes it.
+    // Each worker running jitted code holds a slot with the epoch it entered it at.
+    // Memory that jitted code may still read is retired rather than freed, and is released
+    // once every worker that could have read it has left the jitted code.
+    // Code is rewritten in the same way: the region is first skipped by a short jump written at once,
+    // and the new code is only written once no worker can be inside of the region anymore.
+    // Changes must be serialized by the caller.
+    class CodePatcher {
+    public:
+        CodePatcher();
+        ~CodePatcher();
+
+        static constexpr size_t MAX_WORKERS = 64;
+
+        // The first 8 bytes of a region are written at once, so regions must start on 8 bytes.
+        static constexpr u64 REGION_ALIGNMENT = 8;
+
+        // Marks the calling worker as running jitted code, and returns its slot.
+        size_t enter();
+        void leave(size_t slot);
+
+        // Frees memory once no worker can be reading it anymore.
+        void retire(std::shared_ptr<const void> memory);
+
+        // Replaces the start of the size bytes at ptr by code. Until the code is written,
+        // workers reaching the region jump over it, so that it must be skippable.
+        void write(u8* ptr, size_t size, const std::vector<u8>& code);
+
+        // Completes the writes and frees the memory that no worker can observe anymore.
+        void synchronize();
+
+        bool hasPendingChanges() const { return !retired_.empty() || !pendingWrites_.empty(); }
+
+    private:
+        CodePatcher(const CodePatcher&) = delete;
+        CodePatcher& operator=(const CodePatcher&) = delete;
+
+        // the epoch of the oldest worker still running jitted code
+        u64 oldestRunningEpoch() const;
+
+        static void storeHead(u8* ptr, const u8* bytes, size_t count);
+        static void complete(u8* ptr, const std::vector<u8>& code);
+
+        std::atomic<u64> epoch_ { 1 };
+        std::array<std::atomic<u64>, MAX_WORKERS> workerEpochs_;
+
+        struct RetiredMemory {
+            u64 epoch;
+            std::shared_ptr<const void> memory;
+        };
+        std::vector<RetiredMemory> retired_;
+
+        struct PendingWrite {
+            u64 epoch;
+            u8* ptr;
+            std::vector<u8> code;
+        };
+        std::vector<PendingWrite> pendingWrites_;
+    };
+
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef COMPILATIONPOOL_H
+#define COMPILATIONPOOL_H
+
+#include "x64/compiler/codecache.h"
+#include "x64/compiler/jitstats.h"
+#include "x64/instructions/basicblock.h"
+#include "utils.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace x64 {
+
+    class Compiler;
+    class JitBasicBlock;
+
+    // A basic block (or trace) waiting to be compiled by the pool.
+    // The requester owns the basic blocks and must keep them alive until the pool
+    // has been cancelled or the request has left the COMPILING state.
+    struct CompilationRequest {
+        enum class State : u32 {
+            QUEUED,
+            COMPILING,
+            READY,
+            FAILED,
+        };
+
+        std::vector<const BasicBlock*> basicBlocks;
+        std::vector<const void*> basicBlockPtrs;
+        int optimizationLevel { 0 };
+        u64 generation { 0 };
+        CodeCacheLocation cacheLocation;
+        bool flagsLiveOut { true };
+
+        // destination of the native code, allocated upfront because the code refers to it
+        std::unique_ptr<JitBasicBlock> jitBasicBlock;
+
+        // written by the compiling thread, published by the transition to READY
+        std::optional<NativeBasicBlock> nativeBasicBlock;
+        u32 compiledBasicBlocks { 0 };
+        bool compiledWithFlagsLiveOut { true };
+        JitStats stats;
+        CompileTelemetry telemetry;
+
+        std::atomic<State> state { State::QUEUED };
+
+        bool isDone() const {
+            State s = state.load(std::memory_order_acquire);
+            return s == State::READY || s == State::FAILED;
+        }
+    };
+
+    // Compiles basic blocks on background host threads.
+    // Requests are handed over through a lock-free queue and results are published
+    // through the state of the request, so the guest never waits for the compiler.
+    class CompilationPool {
+    public:
+        explicit CompilationPool(u32 nbThreads);
+        ~CompilationPool();
+
+        u32 nbThreads() const { return (u32)workers_.size(); }
+
+        bool trySubmit(std::shared_ptr<CompilationRequest> request);
+
+        // Drops all requests that have not been compiled yet and waits for the ones being compiled.
+        // Must be called before destroying basic blocks that may be referenced by a request.
+        void cancelAll();
+
+        bool isStale(const CompilationRequest& request) const {
+            return request.generation != generation_.load();
+        }
+
+    private:
+        CompilationPool(const CompilationPool&) = delete;
+        CompilationPool& operator=(const CompilationPool&) = delete;
+
+        void run();
+        void compile(Compiler& compiler, CompilationRequest& request);
+
+        // Bounded multi-producer multi-consumer queue.
+        // Each cell carries a sequence number telling whether it is ready to be written or read.
+        template<typename T, size_t N>
+        class LockFreeQueue {
+            static_assert((N & (N-1)) == 0, "Queue size must be a power of 2");
+        public:
+            LockFreeQueue() {
+                for(size_t i = 0; i < N; ++i) cells_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            bool tryPush(T value) {
+                size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+                Cell* cell = nullptr;
+                while(true) {
+                    cell = &cells_[pos & (N-1)];
+                    size_t seq = cell->sequence.load(std::memory_order_acquire);
+                    std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+                    if(diff == 0) {
+                        if(enqueuePos_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+                    } else if(diff < 0) {
+                        return false;
+                    } else {
+                        pos = enqueuePos_.load(std::memory_order_relaxed);
+                    }
+                }
+                cell->value = std::move(value);
+                cell->sequence.store(pos+1, std::memory_order_release);
+                return true;
+            }
+
+            bool tryPop(T* value) {
+                size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+                Cell* cell = nullptr;
+                while(true) {
+                    cell = &cells_[pos & (N-1)];
+                    size_t seq = cell->sequence.load(std::memory_order_acquire);
+                    std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos+1);
+                    if(diff == 0) {
+                        if(dequeuePos_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+                    } else if(diff < 0) {
+                        return false;
+                    } else {
+                        pos = dequeuePos_.load(std::memory_order_relaxed);
+                    }
+                }
+                *value = std::move(cell->value);
+                cell->sequence.store(pos+N, std::memory_order_release);
+                return true;
+            }
+
+        private:
+            struct Cell {
+                std::atomic<size_t> sequence;
+                T value;
+            };
+            std::array<Cell, N> cells_;
+            alignas(64) std::atomic<size_t> enqueuePos_ { 0 };
+            alignas(64) std::atomic<size_t> dequeuePos_ { 0 };
+        };
+
+        static constexpr size_t QUEUE_SIZE = 0x400;
+        LockFreeQueue<std::shared_ptr<CompilationRequest>, QUEUE_SIZE> queue_;
+
+        std::atomic<u64> generation_ { 0 };
+        std::atomic<u32> busyWorkers_ { 0 };
+        std::atomic<u32> pendingRequests_ { 0 };
+
+        // only used to park idle workers
+        std::mutex mutex_;
+        std::condition_variable wakeUp_;
+        std::atomic<u32> sleepingWorkers_ { 0 };
+        bool stop_ { false };
+
+        std::vector<std::thread> workers_;
+    };
+
+}
+
+#endif
@@ -3,6 +3,9 @@
 
 #include "x64/instructions/basicblock.h"
 #include "x64/compiler/ir.h"
+#include "x64/compiler/jitstats.h"
+#include "x64/compiler/registerallocator.h"
+#include "host/hostinstructions.h"
 #include "x64/types.h"
 #include "utils.h"
 #include <memory>
@@ -18,6 +21,7 @@ namespace x64 {
         class Optimizer;
     }
     class CodeGenerator;
+    class CodePatcher;
     class Assembler;
 
     class Compiler {
@@ -30,9 +34,27 @@ namespace x64 {
         std::optional<NativeBasicBlock> tryCompileJitTrampoline();
 
         void writeJumpTo(const void* address, u8* ptr, size_t size);
-        void writePushCallstackTo(const void* address, u8* ptr, size_t size);
+        void writeLoopJumpTo(const void* address, u8* ptr, size_t size);
+        void writePushCallstackTo(const void* address, u64 returnAddress, u8* ptr, size_t size);
+        void writeUnpatchedJump(u8* ptr, size_t size);
+
+        // With a code patcher, the code written above may be running on other threads.
+        void setCodePatcher(CodePatcher* codePatcher) { codePatcher_ = codePatcher; }
 
         std::optional<ir::IR> tryCompileIR(const BasicBlock&, int optimizationLevel = 0, const void* basicBlockPtr = nullptr, const void* jitBasicBlockPtr = nullptr, bool diagnose = false);
+
+        // Compiles a chain of basic blocks into a single native region.
+        // Each block must end with a fixed destination jump towards the next one.
+        // Leaving the chain early goes through a side exit that reports the block it was taken from.
+        // When flagsLiveOut is false, the flags are known to be overwritten wherever the chain exits to.
+        std::optional<NativeBasicBlock> tryCompileTrace(const std::vector<const BasicBlock*>&, int optimizationLevel, const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr, bool flagsLiveOut = true, bool diagnose = false);
+
+        std::optional<ir::IR> tryCompileTraceIR(const std::vector<const BasicBlock*>&, int optimizationLevel, const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr, bool flagsLiveOut = true, bool diagnose = false);
+
+        void setStats(JitStats* stats) { stats_ = stats; }
+
+        // Describes the last call to tryCompileTrace, successful or not.
+        const CompileTelemetry& telemetry() const { return telemetry_; }
     private:
         bool tryCompile(const X64Instruction&);
 
@@ -40,11 +62,23 @@ namespace x64 {
 
         std::optional<ir::IR> jitEntry();
         std::optional<ir::IR> basicBlockEntrypoint();
-        std::optional<ir::IR> basicBlockBody(const BasicBlock&, bool diagnose);
-        std::optional<ir::IR> prepareExit(u32 nbInstructionsInBlock, u64 basicBlockPtr, u64 jitBasicBlockPtr);
+        std::optional<ir::IR> basicBlockBody(const BasicBlock&, const std::vector<bool>& flagsLiveAfter, bool diagnose);
+        bool tryCompileBody(const BasicBlock&, u32 blockInTrace, const std::vector<bool>& flagsLiveAfter, int optimizationLevel, bool diagnose, std::vector<ir::IR>* pieces);
+        std::optional<ir::IR> interpreterCallout(const X64Instruction&, CpuExecPtr, u32 blockInTrace, u32 instructionInBlock, bool flagsLiveAfter);
+        void reportUnsupported(const X64Instruction&);
+        std::optional<ir::IR> prepareExit(u32 nbInstructionsInBlock, u32 blockInTrace, const void* basicBlockPtr, const void* jitBasicBlockPtr);
         std::optional<ir::IR> basicBlockExit(const BasicBlock&, bool diagnose);
+        std::optional<ir::IR> traceLink(const BasicBlock& current, const BasicBlock& next, u32 nbInstructionsInTrace, u32 blockInTrace, const void* basicBlockPtr, const void* jitBasicBlockPtr);
         std::optional<ir::IR> jitExit();
 
+        // Computes whether the flags may be read after each instruction and returns whether they may be read on entry.
+        static bool computeFlagsLiveness(const BasicBlock&, bool flagsLiveOut, std::vector<bool>* flagsLiveAfter);
+        bool trySkipDeadFlagsInstruction(const X64Instruction&, bool flagsLiveAfter);
+
+        // Host pointers are recorded when they are emitted, so that the code can be used by another process.
+        void loadHostPointer(R64 dst, const void* ptr, NativeRelocation::Kind kind, u32 block, u32 instruction);
+        void addRelocations(const std::vector<const BasicBlock*>&, const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr, NativeBasicBlock*) const;
+
         bool tryAdvanceInstructionPointer(u64 nextAddress);
 
         bool tryCompileMovR8Imm(R8, Imm);
@@ -128,6 +162,12 @@ namespace x64 {
         bool tryCompileSarRM32Imm(const RM32&, Imm);
         bool tryCompileSarRM64R8(const RM64&, R8);
         bool tryCompileSarRM64Imm(const RM64&, Imm);
+        bool tryCompileShlxR32RM32R32(R32, const RM32&, R32);
+        bool tryCompileShlxR64RM64R64(R64, const RM64&, R64);
+        bool tryCompileShrxR32RM32R32(R32, const RM32&, R32);
+        bool tryCompileShrxR64RM64R64(R64, const RM64&, R64);
+        bool tryCompileSarxR32RM32R32(R32, const RM32&, R32);
+        bool tryCompileSarxR64RM64R64(R64, const RM64&, R64);
         bool tryCompileRolRM16R8(const RM16&, R8);
         bool tryCompileRolRM16Imm(const RM16&, Imm);
         bool tryCompileRolRM32R8(const RM32&, R8);
@@ -202,9 +242,53 @@ namespace x64 {
         bool tryCompileXchgRM64R64(const RM64&, R64);
         bool tryCompileCmpxchgRM32R32(const RM32&, R32);
         bool tryCompileCmpxchgRM64R64(const RM64&, R64);
+        bool tryCompileLockAddM8RM8(const M8&, const RM8&);
+        bool tryCompileLockAddM8Imm(const M8&, Imm);
+        bool tryCompileLockAddM16RM16(const M16&, const RM16&);
+        bool tryCompileLockAddM16Imm(const M16&, Imm);
+        bool tryCompileLockAddM32RM32(const M32&, const RM32&);
+        bool tryCompileLockAddM32Imm(const M32&, Imm);
+        bool tryCompileLockAddM64RM64(const M64&, const RM64&);
+        bool tryCompileLockAddM64Imm(const M64&, Imm);
+        bool tryCompileLockSubM8RM8(const M8&, const RM8&);
+        bool tryCompileLockSubM8Imm(const M8&, Imm);
+        bool tryCompileLockSubM16RM16(const M16&, const RM16&);
+        bool tryCompileLockSubM16Imm(const M16&, Imm);
+        bool tryCompileLockSubM32RM32(const M32&, const RM32&);
+        bool tryCompileLockSubM32Imm(const M32&, Imm);
+        bool tryCompileLockSubM64RM64(const M64&, const RM64&);
+        bool tryCompileLockSubM64Imm(const M64&, Imm);
+        bool tryCompileLockOrM8RM8(const M8&, const RM8&);
+        bool tryCompileLockOrM8Imm(const M8&, Imm);
+        bool tryCompileLockOrM16RM16(const M16&, const RM16&);
+        bool tryCompileLockOrM16Imm(const M16&, Imm);
+        bool tryCompileLockOrM32RM32(const M32&, const RM32&);
+        bool tryCompileLockOrM32Imm(const M32&, Imm);
+        bool tryCompileLockOrM64RM64(const M64&, const RM64&);
+        bool tryCompileLockOrM64Imm(const M64&, Imm);
+        bool tryCompileLockIncM8(const M8&);
+        bool tryCompileLockIncM16(const M16&);
+        bool tryCompileLockIncM32(const M32&);
+        bool tryCompileLockIncM64(const M64&);
+        bool tryCompileLockDecM8(const M8&);
+        bool tryCompileLockDecM16(const M16&);
+        bool tryCompileLockDecM32(const M32&);
+        bool tryCompileLockDecM64(const M64&);
+        bool tryCompileLockBtsM16R16(const M16&, R16);
+        bool tryCompileLockBtsM16Imm(const M16&, Imm);
+        bool tryCompileLockBtsM32R32(const M32&, R32);
+        bool tryCompileLockBtsM32Imm(const M32&, Imm);
+        bool tryCompileLockBtsM64R64(const M64&, R64);
+        bool tryCompileLockBtsM64Imm(const M64&, Imm);
+        bool tryCompileLockCmpxchgM8R8(const M8&, R8);
+        bool tryCompileLockCmpxchgM16R16(const M16&, R16);
         bool tryCompileLockCmpxchgM32R32(const M32&, R32);
         bool tryCompileLockCmpxchgM64R64(const M64&, R64);
+        bool tryCompileLockCmpxchg16BM128(const M128&);
+        bool tryCompileLockXaddM8R8(const M8&, R8);
+        bool tryCompileLockXaddM16R16(const M16&, R16);
         bool tryCompileLockXaddM32R32(const M32&, R32);
+        bool tryCompileLockXaddM64R64(const M64&, R64);
         bool tryCompileCwde();
         bool tryCompileCdqe();
         bool tryCompileCdq();
@@ -221,6 +305,9 @@ namespace x64 {
         bool tryCompileBsfR64R64(R64, R64);
         bool tryCompileBsrR32R32(R32, R32);
         bool tryCompileTzcntR32RM32(R32, const RM32&);
+        bool tryCompileTzcntR64RM64(R64, const RM64&);
+        bool tryCompilePopcntR32RM32(R32, const RM32&);
+        bool tryCompilePopcntR64RM64(R64, const RM64&);
         bool tryCompileSetRM8(Cond, const RM8&);
         bool tryCompileCmovR32RM32(Cond, R32, const RM32&);
         bool tryCompileCmovR64RM64(Cond, R64, const RM64&);
@@ -502,6 +589,10 @@ namespace x64 {
 
         bool tryCompilePmaxsdXmmXmmM128(XMM, const XMMM128&);
         bool tryCompilePminsdXmmXmmM128(XMM, const XMMM128&);
+        bool tryCompilePmaxuwXmmXmmM128(XMM, const XMMM128&);
+        bool tryCompilePmaxudXmmXmmM128(XMM, const XMMM128&);
+        bool tryCompilePminuwXmmXmmM128(XMM, const XMMM128&);
+        bool tryCompilePminudXmmXmmM128(XMM, const XMMM128&);
         bool tryCompilePmovzxbwXMMXMM(XMM, XMM);
         bool tryCompileRoundpsXmmXmmImm(XMM, XMM, Imm);
         bool tryCompileRoundpdXmmXmmImm(XMM, XMM, Imm);
@@ -512,8 +603,58 @@ namespace x64 {
         bool tryCompileBlendvpsXmmXmmM128(XMM, const XMMM128&);
         bool tryCompilePblendvbXmmXmmM128(XMM, const XMMM128&);
 
+        bool tryCompilePcmpistriXmmXmmM128Imm(XMM, const XMMM128&, Imm);
+        bool tryCompilePcmpestriXmmXmmM128Imm(XMM, const XMMM128&, Imm);
+        bool tryCompileCrc32R32RM8(R32, const RM8&);
+        bool tryCompileCrc32R32RM16(R32, const RM16&);
+        bool tryCompileCrc32R32RM32(R32, const RM32&);
+        bool tryCompileCrc32R64RM64(R64, const RM64&);
+
         bool tryCompileStmxcsrM32(const M32&);
 
+        // x87
+        bool tryCompileFldz();
+        bool tryCompileFld1();
+        bool tryCompileFldlg2();
+        bool tryCompileFldST(ST);
+        bool tryCompileFldM32(const M32&);
+        bool tryCompileFldM64(const M64&);
+        bool tryCompileFldM80(const M80&);
+        bool tryCompileFildM16(const M16&);
+        bool tryCompileFildM32(const M32&);
+        bool tryCompileFildM64(const M64&);
+        bool tryCompileFstpST(ST);
+        bool tryCompileFstpM32(const M32&);
+        bool tryCompileFstpM64(const M64&);
+        bool tryCompileFstpM80(const M80&);
+        bool tryCompileFistpM16(const M16&);
+        bool tryCompileFistpM32(const M32&);
+        bool tryCompileFistpM64(const M64&);
+        bool tryCompileFxchST(ST);
+        bool tryCompileFaddM32(const M32&);
+        bool tryCompileFaddM64(const M64&);
+        bool tryCompileFaddpST(ST);
+        bool tryCompileFsubSTM32(ST, const M32&);
+        bool tryCompileFsubSTM64(ST, const M64&);
+        bool tryCompileFsubSTST(ST, ST);
+        bool tryCompileFsubrpST(ST);
+        bool tryCompileFmul1M32(const M32&);
+        bool tryCompileFmul1M64(const M64&);
+        bool tryCompileFmulSTST(ST, ST);
+        bool tryCompileFmulpSTST(ST, ST);
+        bool tryCompileFdivSTST(ST, ST);
+        bool tryCompileFdivM32(const M32&);
+        bool tryCompileFdivpSTST(ST, ST);
+        bool tryCompileFdivrSTST(ST, ST);
+        bool tryCompileFdivrM32(const M32&);
+        bool tryCompileFdivrpSTST(ST, ST);
+        bool tryCompileFcomiSTST(ST, ST);
+        bool tryCompileFcomipSTST(ST, ST);
+        bool tryCompileFucomiSTST(ST, ST);
+        bool tryCompileFucomipSTST(ST, ST);
+        bool tryCompileFabs();
+        bool tryCompileFchs();
+
 
         // exits
         bool tryCompileCall(u64 dst, u64 retAddress);
@@ -590,9 +731,25 @@ namespace x64 {
 
         std::unique_ptr<ir::IrGenerator> generator_;
         std::unique_ptr<ir::Optimizer> optimizer_;
+        std::unique_ptr<ir::RegisterAllocator> registerAllocator_;
+        std::unique_ptr<ir::Optimizer> peepholeOptimizer_;
         std::unique_ptr<CodeGenerator> codeGenerator_;
         std::unique_ptr<Assembler> assembler_;
 
+        JitStats* stats_ { nullptr };
+        CodePatcher* codePatcher_ { nullptr };
+        CompileTelemetry telemetry_;
+        ir::RegisterAllocator::Stats registerAllocatorStats_;
+        u32 interpreterCallouts_ { 0 };
+        u32 eliminatedFlagUpdates_ { 0 };
+        bool hostX87StackIsEmpty_ { false };
+        // when the flags are dead after the instruction, flag-less host instructions may be used
+        bool flagsLiveAfterInstruction_ { true };
+        host::HostFeatures hostFeatures_;
+        std::vector<std::vector<bool>> flagsLiveAfter_;
+        // what the host pointers emitted in the trace refer to, indexed by the ir instructions that load them
+        std::vector<NativeRelocation> relocations_;
+
         void readReg8(Reg dst, R8 src);
         void writeReg8(R8 dst, Reg src);
         void readMem8(Reg dst, const Mem& address);
@@ -621,17 +778,44 @@ namespace x64 {
         void readMem128(Reg128 dst, const Mem& address);
         void writeMem128(const Mem& address, Reg128 src);
 
+        M80 x87Register(Reg dst, ST st);
+        M8 x87Tag(Reg slot);
+        void loadX87Register(ST src, TmpReg tmp);
+        void storeX87Register(ST dst, TmpReg tmp);
+        void pushX87Register(TmpReg tmp1, TmpReg tmp2);
+        void popX87Register(TmpReg tmp1, TmpReg tmp2);
+        void emptyHostX87Stack();
+
+        template<Size size>
+        bool tryCompileX87Load(const M<size>& src, void(ir::IrGenerator::*load)(const M<size>&));
+        template<Size size>
+        bool tryCompileX87Store(const M<size>& dst, void(ir::IrGenerator::*store)(const M<size>&));
+        template<Size size>
+        bool tryCompileX87Arithmetic(ST dst, const M<size>& src, bool memoryIsLhs, void(ir::IrGenerator::*op)());
+        bool tryCompileX87Arithmetic(ST dst, ST lhs, ST rhs, bool pop, void(ir::IrGenerator::*op)());
+        bool tryCompileX87Compare(ST dst, ST src, bool pop, void(ir::IrGenerator::*op)());
+
         void addTime(u32 amount);
         void incrementCalls();
         void readFsBase(Reg dst);
-        void writeBasicBlockPtr(u64 basicBlockPtr);
-        void writeJitBasicBlockPtr(u64 jitBasicBlockPtr);
+        void writeBasicBlockPtr(const void* basicBlockPtr, u32 blockInTrace);
+        void writeJitBasicBlockPtr(const void* jitBasicBlockPtr);
+
+        void clearIfTickLimitReached(R64 dst, R64 tmp1, R64 tmp2);
 
         const std::vector<u8>& jmpCode(const void* dst, TmpReg tmp);
         size_t jmpCodeSize(const void* dst, TmpReg tmp);
-
-        const std::vector<u8>& pushCallstackCode(const void* dst, TmpReg tmp1, TmpReg tmp2);
-        const std::vector<u8>& popCallstackCode(Reg dst, TmpReg tmp1, TmpReg tmp2);
+        const std::vector<u8>& loopJmpCode(const void* dst, TmpReg tmp);
+        // room left for the jump to the next block, whether it closes a loop or not
+        size_t replaceableJumpSize();
+        // writes code over the regionSize bytes of replaceable code at ptr, followed by size-regionSize other bytes
+        void writeCode(const std::vector<u8>& code, u8* ptr, size_t regionSize, size_t size);
+
+        // leaves the flags untouched
+        const std::vector<u8>& pushCallstackCode(const void* dst, u64 returnAddress, TmpReg tmp1, TmpReg tmp2);
+        // dst receives the native code to return to, or nullptr if the return address was mispredicted.
+        // The comparison with the return address clobbers the flags: callers must save them first.
+        const std::vector<u8>& popCallstackCode(Reg dst, TmpReg tmp1, TmpReg tmp2, TmpReg tmp3);
 
         template<Size size>
         Mem getAddress(Reg dst, TmpReg tmp, const M<size>& mem);
@@ -692,9 +876,16 @@ namespace x64 {
         void pop(Reg128);
 
         void tryCompileBlockLookup();
+        void tryCompileIndirectBranchCacheLookup();
+        // entryAddress holds the guest address of the table entry that RIP was read from
+        void tryCompileJumpTableLookup(Reg entryAddress);
 
         static XMM scratchXmmRegister(std::initializer_list<XMM> usedRegisters);
 
+        // Hands func the host memory operand of dst, for lock-prefixed instructions
+        template<Size size, typename Func>
+        bool forLockedM(const M<size>& dst, Func&& func);
+
         template<typename Func>
         bool forRM8Imm(const RM8& dst, Imm imm, Func&& func, bool writeResultBack = true);
 
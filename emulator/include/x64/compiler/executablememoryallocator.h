@@ -3,8 +3,10 @@
 
 #include "utils.h"
 #include <list>
+#include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 
 namespace x64 {
 
@@ -24,6 +26,16 @@ namespace x64 {
         std::optional<MemoryBlock> allocate(u32 requestedSize);
         void free(MemoryBlock block);
 
+        // bytes handed out and not freed yet
+        u64 usedBytes() const { return usedBytes_; }
+
+        // bytes of executable memory mapped by the allocator
+        u64 reservedBytes() const { return ranges_.size() * MemRange::SIZE; }
+
+        // Moves the given blocks next to each other into new ranges, and releases all the previous ones.
+        // Every block that is not in the list must have been freed. Returns false if nothing was moved.
+        bool compact(const std::vector<MemoryBlock*>& blocks);
+
     private:
 
         class MemRange {
@@ -36,8 +48,9 @@ namespace x64 {
             std::optional<MemoryBlock> tryAllocate(u32 requestedSize, ExecutableMemoryAllocator* allocator);
             u32 usedChunks() const { return firstAvailableChunk_; }
 
-        private:
             static constexpr u32 SIZE = 0x10000;
+
+        private:
             static constexpr u32 CHUNK_SIZE = 0x10;
             static constexpr u32 NB_CHUNKS = SIZE / CHUNK_SIZE;
 
@@ -50,7 +63,11 @@ namespace x64 {
         };
 
         std::list<MemRange> ranges_;
-        std::list<MemoryBlock> freeBlocks_;
+
+        // freed blocks, by size
+        std::map<u32, std::vector<u8*>> freeBlocks_;
+
+        u64 usedBytes_ { 0 };
     };
 
 }
@@ -37,6 +37,7 @@ namespace x64::ir {
         explicit Operand(M16 op) : value_(op) { }
         explicit Operand(M32 op) : value_(op) { }
         explicit Operand(M64 op) : value_(op) { }
+        explicit Operand(M80 op) : value_(op) { }
         explicit Operand(MMX op) : value_(op) { }
         explicit Operand(XMM op) : value_(op) { }
         explicit Operand(M128 op) : value_(op) { }
@@ -86,6 +87,7 @@ namespace x64::ir {
         bool mayAlias(const M16& other) const;
         bool mayAlias(const M32& other) const;
         bool mayAlias(const M64& other) const;
+        bool mayAlias(const M80& other) const;
         bool mayAlias(const M128& other) const;
 
         bool readsFrom(R64 reg) const;
@@ -114,6 +116,7 @@ namespace x64::ir {
                 || std::holds_alternative<M16>(value_)
                 || std::holds_alternative<M32>(value_)
                 || std::holds_alternative<M64>(value_)
+                || std::holds_alternative<M80>(value_)
                 || std::holds_alternative<M128>(value_);
         }
 
@@ -127,10 +130,14 @@ namespace x64::ir {
             if(auto m16 = as<M16>()) return Memory { m16->segment, m16->encoding };
             if(auto m32 = as<M32>()) return Memory { m32->segment, m32->encoding };
             if(auto m64 = as<M64>()) return Memory { m64->segment, m64->encoding };
+            if(auto m80 = as<M80>()) return Memory { m80->segment, m80->encoding };
             if(auto m128 = as<M128>()) return Memory { m128->segment, m128->encoding };
             return {};
         }
 
+        // The same memory operand, addressed with another encoding.
+        Operand withEncoding(const Encoding64& encoding) const;
+
     private:
         struct Void {
             bool operator==(const Void&) const { return true; }
@@ -138,7 +145,7 @@ namespace x64::ir {
         std::variant<Void,
                     u8, u16, u32, u64,
                     R8, R16, R32, R64,
-                    M8, M16, M32, M64,
+                    M8, M16, M32, M64, M80,
                     MMX, XMM, M128,
                     LabelIndex> value_;
 
@@ -162,6 +169,9 @@ namespace x64::ir {
         SHL,
         SHR,
         SAR,
+        SHLX,
+        SHRX,
+        SARX,
         ROL,
         ROR,
         MUL,
@@ -173,12 +183,20 @@ namespace x64::ir {
         OR,
         XOR,
         NOT,
+        ANDN,
         NEG,
         INC,
         DEC,
         XCHG,
         CMPXCHG,
+        LOCKADD,
+        LOCKSUB,
+        LOCKOR,
+        LOCKINC,
+        LOCKDEC,
+        LOCKBTS,
         LOCKCMPXCHG,
+        LOCKCMPXCHG16B,
         LOCKXADD,
         CWDE,
         CDQE,
@@ -192,6 +210,7 @@ namespace x64::ir {
         BSF,
         BSR,
         TZCNT,
+        POPCNT,
         SET,
         CMOV,
         BSWAP,
@@ -349,6 +368,10 @@ namespace x64::ir {
         PMULHRSW,
         PMAXSD,
         PMINSD,
+        PMAXUW,
+        PMAXUD,
+        PMINUW,
+        PMINUD,
         PMOVZXBW,
         ROUNDPS,
         ROUNDPD,
@@ -358,6 +381,28 @@ namespace x64::ir {
         PINSRD,
         BLENDVPS,
         PBLENDVB,
+        PCMPISTRI,
+        PCMPESTRI,
+        CRC32,
+
+        // x87 operations work on the host x87 stack, which must be empty between guest instructions
+        FLD,
+        FILD,
+        FSTP,
+        FISTTP,
+        FPOP,
+        FLDZ,
+        FLD1,
+        FLDLG2,
+        FADDP,
+        FSUBP,
+        FMULP,
+        FDIVP,
+        FCOMIP,
+        FUCOMIP,
+        FABS,
+        FCHS,
+        EMMS,
     };
 
     class Instruction {
@@ -386,6 +431,9 @@ namespace x64::ir {
 
         bool canModifyFlags() const;
 
+        // The host x87 stack is implicitly read and written
+        bool usesX87Stack() const;
+
         Instruction& addCond(Cond cond) {
             condition_ = cond;
             return *this;
@@ -396,6 +444,11 @@ namespace x64::ir {
             return *this;
         }
 
+        void setOut(Operand op) { out_ = op; }
+        void setIn1(Operand op) { in1_ = op; }
+        void setIn2(Operand op) { in2_ = op; }
+        void setIn3(Operand op) { in3_ = op; }
+
         void setLabelIndex(LabelIndex index) {
             assert(in1_.as<LabelIndex>().has_value());
             in1_ = Operand(index);
@@ -406,6 +459,14 @@ namespace x64::ir {
             return *this;
         }
 
+        // The 64-bit immediate is a host pointer, described by relocation `index` of the compiler
+        Instruction& addRelocation(u32 index) {
+            relocation_ = index;
+            return *this;
+        }
+
+        std::optional<u32> relocation() const { return relocation_; }
+
         std::string toString() const;
 
         bool readsFrom(R64 reg) const;
@@ -430,6 +491,7 @@ namespace x64::ir {
         std::optional<Cond> condition_;
         std::optional<FCond> fcondition_;
         BitMask<4> impactedRegisters64_;
+        std::optional<u32> relocation_;
     };
 
     struct IR {
@@ -24,6 +24,7 @@ namespace x64::ir {
         void mov(R32 dst, u32 imm);
         void mov(R64 dst, R64 src);
         void mov(R64 dst, u64 imm);
+        void movHostPointer(R64 dst, u64 ptr, u32 relocation);
         void mov(R8 dst, const M8& src);
         void mov(const M8& dst, R8 src);
         void mov(R16 dst, const M16& src);
@@ -94,6 +95,12 @@ namespace x64::ir {
         void sar(R32 lhs, u8 imm);
         void sar(R64 lhs, R8 rhs);
         void sar(R64 lhs, u8 imm);
+        void shlx(R32 dst, R32 src, R32 count);
+        void shlx(R64 dst, R64 src, R64 count);
+        void shrx(R32 dst, R32 src, R32 count);
+        void shrx(R64 dst, R64 src, R64 count);
+        void sarx(R32 dst, R32 src, R32 count);
+        void sarx(R64 dst, R64 src, R64 count);
         void rol(R16 lhs, R8 rhs);
         void rol(R16 lhs, u8 imm);
         void rol(R32 lhs, R8 rhs);
@@ -166,12 +173,60 @@ namespace x64::ir {
         void xchg(R16 dst, R16 src);
         void xchg(R32 dst, R32 src);
         void xchg(R64 dst, R64 src);
+        void xchg(const M8& dst, R8 src);
+        void xchg(const M16& dst, R16 src);
+        void xchg(const M32& dst, R32 src);
+        void xchg(const M64& dst, R64 src);
         void cmpxchg(R32 dst, R32 src);
         void cmpxchg(R64 dst, R64 src);
 
+        void lockadd(const M8& dst, R8 src);
+        void lockadd(const M8& dst, i8 imm);
+        void lockadd(const M16& dst, R16 src);
+        void lockadd(const M16& dst, i16 imm);
+        void lockadd(const M32& dst, R32 src);
+        void lockadd(const M32& dst, i32 imm);
+        void lockadd(const M64& dst, R64 src);
+        void lockadd(const M64& dst, i32 imm);
+        void locksub(const M8& dst, R8 src);
+        void locksub(const M8& dst, i8 imm);
+        void locksub(const M16& dst, R16 src);
+        void locksub(const M16& dst, i16 imm);
+        void locksub(const M32& dst, R32 src);
+        void locksub(const M32& dst, i32 imm);
+        void locksub(const M64& dst, R64 src);
+        void locksub(const M64& dst, i32 imm);
+        void lockor(const M8& dst, R8 src);
+        void lockor(const M8& dst, i8 imm);
+        void lockor(const M16& dst, R16 src);
+        void lockor(const M16& dst, i16 imm);
+        void lockor(const M32& dst, R32 src);
+        void lockor(const M32& dst, i32 imm);
+        void lockor(const M64& dst, R64 src);
+        void lockor(const M64& dst, i32 imm);
+        void lockinc(const M8& dst);
+        void lockinc(const M16& dst);
+        void lockinc(const M32& dst);
+        void lockinc(const M64& dst);
+        void lockdec(const M8& dst);
+        void lockdec(const M16& dst);
+        void lockdec(const M32& dst);
+        void lockdec(const M64& dst);
+        void lockbts(const M16& dst, R16 src);
+        void lockbts(const M16& dst, u8 imm);
+        void lockbts(const M32& dst, R32 src);
+        void lockbts(const M32& dst, u8 imm);
+        void lockbts(const M64& dst, R64 src);
+        void lockbts(const M64& dst, u8 imm);
+        void lockcmpxchg(const M8& dst, R8 src);
+        void lockcmpxchg(const M16& dst, R16 src);
         void lockcmpxchg(const M32& dst, R32 src);
         void lockcmpxchg(const M64& dst, R64 src);
+        void lockcmpxchg16b(const M128& dst);
+        void lockxadd(const M8& dst, R8 src);
+        void lockxadd(const M16& dst, R16 src);
         void lockxadd(const M32& dst, R32 src);
+        void lockxadd(const M64& dst, R64 src);
 
         void cwde();
         void cdqe();
@@ -195,6 +250,9 @@ namespace x64::ir {
         void bsf(R64 dst, R64 src);
         void bsr(R32 dst, R32 src);
         void tzcnt(R32 dst, R32 src);
+        void tzcnt(R64 dst, R64 src);
+        void popcnt(R32 dst, R32 src);
+        void popcnt(R64 dst, R64 src);
 
         void set(Cond, R8);
         void cmov(Cond, R32, R32);
@@ -463,6 +521,10 @@ namespace x64::ir {
 
         void pmaxsd(XMM, XMM);
         void pminsd(XMM, XMM);
+        void pmaxuw(XMM, XMM);
+        void pmaxud(XMM, XMM);
+        void pminuw(XMM, XMM);
+        void pminud(XMM, XMM);
         void pmovzxbw(XMM, XMM);
         void roundps(XMM, XMM, u8);
         void roundpd(XMM, XMM, u8);
@@ -473,6 +535,40 @@ namespace x64::ir {
         void blendvps(XMM, XMM);
         void pblendvb(XMM, XMM);
 
+        void pcmpistri(XMM, XMM, u8);
+        void pcmpestri(XMM, XMM, u8);
+        void crc32(R32, R8);
+        void crc32(R32, R16);
+        void crc32(R32, R32);
+        void crc32(R64, R64);
+
+        // x87
+        void fld(const M32&);
+        void fld(const M64&);
+        void fld(const M80&);
+        void fild(const M16&);
+        void fild(const M32&);
+        void fild(const M64&);
+        void fstp(const M32&);
+        void fstp(const M64&);
+        void fstp(const M80&);
+        void fisttp(const M16&);
+        void fisttp(const M32&);
+        void fisttp(const M64&);
+        void fpop();
+        void fldz();
+        void fld1();
+        void fldlg2();
+        void faddp();
+        void fsubp();
+        void fmulp();
+        void fdivp();
+        void fcomip();
+        void fucomip();
+        void fabs();
+        void fchs();
+        void emms();
+
         // exits
         struct Label {
             u32 labelIndex;
@@ -1,13 +1,26 @@
 #ifndef JIT_H
 #define JIT_H
 
+#include "x64/compiler/codecache.h"
+#include "x64/compiler/codepatcher.h"
+#include "x64/compiler/compilationpool.h"
 #include "x64/compiler/executablememoryallocator.h"
+#include "x64/compiler/jitstats.h"
 #include "x64/instructions/basicblock.h"
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <deque>
+#include <exception>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <unordered_set>
 #include <vector>
+#ifdef MULTIPROCESSING
+#include <mutex>
+#endif
 
 namespace x64 {
     class Cpu;
@@ -25,6 +38,46 @@ namespace x64 {
         u64* hitCounts { nullptr };
     };
 
+    // DO NOT MODIFY THIS STRUCT
+    // WITHOUT CHANGING THE JIT AS WELL !!
+    // Native copy of the guest table that a jmp [base + index*8] reads its destination from.
+    // Entry i is only taken while the guest table still holds targets[i] at that position.
+    struct JumpTable {
+        u64 base { 0 };
+        u64 size { 0 };
+        const u64* targets { nullptr };
+        const void** blocks { nullptr };
+    };
+
+    // DO NOT MODIFY THIS STRUCT
+    // WITHOUT CHANGING THE JIT AS WELL !!
+    // Direct-mapped cache from guest addresses to the native code of indirect branch targets.
+    // Shared by all the jitted code of a process, and probed before leaving the jit.
+    struct IndirectBranchCache {
+        static constexpr u64 SIZE = 0x1000;
+
+        // (address >> 4) ^ (address >> 16), computed by the jit as ((address >> 12) ^ address) >> 4
+        static constexpr u64 indexOf(u64 address) {
+            return ((address >> 4) ^ (address >> 16)) & (SIZE-1);
+        }
+
+        std::array<u64, SIZE> addresses;
+        std::array<const u8*, SIZE> entrypoints;
+    };
+
+    // DO NOT MODIFY THIS STRUCT
+    // WITHOUT CHANGING THE JIT AS WELL !!
+    // Return address prediction: a call pushes the guest address it returns to, with the native code
+    // of the block at that address once it is known. A ret only jumps there if it returns to that address.
+    struct CallstackEntry {
+        u64 returnAddress { 0 };
+        const void* landingPad { nullptr };
+    };
+
+    // The callstack is a ring indexed by the low byte of its size, so that the jitted code never
+    // overflows it. Deeper calls overwrite the oldest entries, whose returns are then mispredicted.
+    static constexpr size_t CALLSTACK_SIZE = 0x100;
+
     // DO NOT CHANGE THIS VALUE UNLESS THE LAYOUT
     // OF emulator::BasicBlock CHANGES AS WELL
     static constexpr size_t NATIVE_BLOCK_OFFSET = 0x18;
@@ -35,10 +88,18 @@ namespace x64 {
 
     // DO NOT CHANGE THIS VALUE UNLESS THE LAYOUT
     // OF emulator::BasicBlock CHANGES AS WELL
-    static constexpr size_t CALLS_OFFSET = 0x40;
+    static constexpr size_t CALLS_OFFSET = 0x28;
+
+    // DO NOT CHANGE THIS VALUE UNLESS THE LAYOUT
+    // OF emulator::BasicBlock CHANGES AS WELL
+    static constexpr size_t JUMP_TABLE_OFFSET = 0x30;
 
     static constexpr u64 TICK_LIMIT_MASK = (u64)(~(u64)0xFFFFF);
 
+    // Jitted code compares the ticks to the limit through the sign of their difference,
+    // so a limit that is never reached must still fit in 63 bits.
+    static constexpr u64 NO_TICK_LIMIT = (u64)std::numeric_limits<i64>::max();
+
     struct alignas(16) FlaglessCompareBuffer {
         u64 zeroes { 0 };
         u64 ones { (u64)(-1) };
@@ -50,6 +111,16 @@ namespace x64 {
         u64 padding { 0 };
     };
 
+    // While in jitted code, each x87 register lives in its own 32-byte slot.
+    // The top of stack is kept as the offset of the st(0) slot, so that the slot of st(i)
+    // is found by truncating an addition to a byte, which leaves the flags untouched.
+    struct alignas(16) X87Slot {
+        f80 value;
+        u8 tag;
+        u8 padding[21];
+    };
+    static_assert(sizeof(X87Slot) == 32);
+
     // DO NOT MODIFY THIS STRUCT
     // WITHOUT CHANGING THE JIT AS WELL !!
     struct NativeArguments {
@@ -58,23 +129,32 @@ namespace x64 {
         Xmm* xmms;
         u8* memory;
         u64* rflags;
-        const u32* mxcsr;
+        u32* mxcsr;
         u64 fsbase;
         u64* ticks;
-        void** callstack;
+        CallstackEntry* callstack;
         u64* callstackSize;
         void** currentlyExecutingSegmentPtr;
         const void* currentlyExecutingJitBasicBlock;
         const void* executableCode;
         FlaglessCompareBuffer flaglessCompareBuffer;
+        Cpu* cpu;
+        Jit* jit;
+        const IndirectBranchCache* indirectBranchCache;
+        u32 x87top;
+        std::array<X87Slot, 8> x87stack;
+        u64 tickLimit;
     };
 
     using NativeExecPtr = void(*)(NativeArguments*);
 
     class JitBasicBlock {
         friend class BasicBlockTest;
+        friend class Jit;
     public:
         static std::unique_ptr<JitBasicBlock> tryCreate(const x64::BasicBlock& bb, const void* currentBb, x64::Compiler* compiler, int optimizationLevel, ExecutableMemoryAllocator* allocator);
+        static std::unique_ptr<JitBasicBlock> tryCreate(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, x64::Compiler* compiler, int optimizationLevel, ExecutableMemoryAllocator* allocator);
+        static std::unique_ptr<JitBasicBlock> tryCreate(std::unique_ptr<JitBasicBlock> dst, const NativeBasicBlock& nativeBasicBlock, ExecutableMemoryAllocator* allocator);
 
         JitBasicBlock();
         ~JitBasicBlock();
@@ -100,11 +180,27 @@ namespace x64 {
             return jumpEntrypoint_;
         }
 
+        // The tables are copied and published at once, the previous copies are retired.
         void syncBlockLookupTable(u64 size, const u64* addresses, const JitBasicBlock** blocks, u64* hitCounts);
+        void syncJumpTable(u64 base, u64 size, const u64* targets, const JitBasicBlock** blocks);
 
-        void tryPatchJump(std::optional<size_t>* pendingPatch, const JitBasicBlock* next, x64::Compiler* compiler);
+        // Jumps that close a loop check the tick limit first, and leave the jitted code once it is reached.
+        void tryPatchJump(std::optional<size_t>* pendingPatch, const JitBasicBlock* next, bool closesLoop, x64::Compiler* compiler);
         void tryPatchPushCallstack(std::optional<std::pair<size_t, u64>>* pendingPatch, const JitBasicBlock* next, x64::Compiler* compiler);
 
+        // Makes the jumps and callstack pushes patched to go to `from` go to `to` instead.
+        void retarget(const JitBasicBlock* from, const JitBasicBlock* to, x64::Compiler* compiler);
+
+        // Makes the code that still enters this block continue in `next` instead.
+        void redirectTo(const JitBasicBlock* next, x64::Compiler* compiler);
+
+        // Restores the jumps and callstack pushes patched to go to deadBlocks,
+        // so that they can be patched again once their destination has been recompiled.
+        void unlinkDeadBlocks(const std::unordered_set<const JitBasicBlock*>& deadBlocks, x64::Compiler* compiler);
+
+        // Rewrites the patched jumps and callstack pushes, after their destinations have moved.
+        void relink(x64::Compiler* compiler);
+
         template<typename Functor>
         void forAllPendingJumpPatches(bool continuing, Functor&& functor) {
             if(continuing && !!pendingPatches_.offsetOfReplaceableJumpToContinuingBlock) {
@@ -124,6 +220,8 @@ namespace x64 {
 
         u64 calls() const { return calls_; }
 
+        u32 codeSize() const { return executableMemory_.size; }
+
     private:
         JitBasicBlock(const JitBasicBlock&) = delete;
         JitBasicBlock(JitBasicBlock&&) = delete;
@@ -157,26 +255,58 @@ namespace x64 {
             return executableMemory_.ptr;
         }
 
+        // Jitted code running on other workers may still read the tables that are replaced.
+        void publishBlockLookupTable(std::shared_ptr<const void> owner, const x64::BlockLookupTable* table);
+        void publishJumpTable(std::shared_ptr<const void> owner, const x64::JumpTable* table);
+        void retire(std::shared_ptr<const void> owner);
+
+        static constexpr x64::BlockLookupTable EMPTY_BLOCK_LOOKUP_TABLE {};
+        static constexpr x64::JumpTable EMPTY_JUMP_TABLE {};
+
         MemoryBlock executableMemory_;
 
         const u8* jumpEntrypoint_ { nullptr };
 
-        x64::BlockLookupTable variableDestinationTable_;
+        std::atomic<const x64::BlockLookupTable*> variableDestinationTable_ { &EMPTY_BLOCK_LOOKUP_TABLE };
 
         u64 calls_ { 0 };
 
+        std::atomic<const x64::JumpTable*> jumpTable_ { &EMPTY_JUMP_TABLE };
+
+        std::shared_ptr<const void> blockLookupTableOwner_;
+        std::shared_ptr<const void> jumpTableOwner_;
+        CodePatcher* codePatcher_ { nullptr };
+
         struct PendingPatches {
             std::optional<size_t> offsetOfReplaceableJumpToContinuingBlock;
             std::optional<size_t> offsetOfReplaceableJumpToConditionalBlock;
             std::optional<std::pair<size_t, u64>> offsetOfCallstackPush;
         } pendingPatches_;
         std::optional<size_t> jumpLandingOffset_;
+
+        // patches that have been applied, and the block they go to
+        struct PatchedJump {
+            size_t offset;
+            const JitBasicBlock* next;
+            bool closesLoop;
+            bool continuing;
+        };
+        struct PatchedCallstackPush {
+            size_t offset;
+            u64 returnAddress;
+            const JitBasicBlock* next;
+        };
+        std::vector<PatchedJump> patchedJumps_;
+        std::vector<PatchedCallstackPush> patchedCallstackPushes_;
     };
 
     class BasicBlockTest {
+        static_assert(sizeof(std::atomic<const BlockLookupTable*>) == sizeof(const BlockLookupTable*));
+        static_assert(sizeof(std::atomic<const JumpTable*>) == sizeof(const JumpTable*));
         static_assert(offsetof(JitBasicBlock, jumpEntrypoint_) == x64::NATIVE_BLOCK_OFFSET);
         static_assert(offsetof(JitBasicBlock, variableDestinationTable_) == x64::BLOCK_LOOKUP_TABLE_OFFSET);
         static_assert(offsetof(JitBasicBlock, calls_) == x64::CALLS_OFFSET);
+        static_assert(offsetof(JitBasicBlock, jumpTable_) == x64::JUMP_TABLE_OFFSET);
     };
 
     class Jit {
@@ -195,41 +325,129 @@ namespace x64 {
         void setOptimizationLevel(int level) { optimizationLevel_ = level; }
         int optimizationLevel() const { return optimizationLevel_; }
 
-        JitBasicBlock* tryCompile(const x64::BasicBlock& bb, void* currentBb);
-
+        // With tiered compilation, blocks are first compiled quickly on their own (BASELINE),
+        // and recompiled into optimized traces once they have proven to be hot (OPTIMIZED).
+        enum class Tier {
+            BASELINE,
+            OPTIMIZED,
+        };
+        void setTieredCompilation(bool enable) { tieredCompilationEnabled_ = enable; }
+        bool tieredCompilationEnabled() const { return tieredCompilationEnabled_; }
+        int optimizationLevel(Tier tier) const { return tier == Tier::BASELINE ? 0 : optimizationLevel_; }
+
+        void setStats(JitStats* stats);
+
+        // When a cache location is given, the compiled code is also stored in the code cache.
+        // When flagsLiveOut is false, the flags are not read after the code exits and need not be kept up to date.
+        JitBasicBlock* tryCompile(const x64::BasicBlock& bb, void* currentBb, const CodeCacheLocation& location = {}, bool flagsLiveOut = true, Tier tier = Tier::OPTIMIZED);
+        JitBasicBlock* tryCompileTrace(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location = {}, bool flagsLiveOut = true, Tier tier = Tier::OPTIMIZED);
+        // Describes the last compilation done by tryCompile or tryCompileTrace.
+        const CompileTelemetry& lastCompileTelemetry() const;
+        JitBasicBlock* tryLoadFromCache(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location, bool flagsLiveOut);
+
+        // With compilation threads, basic blocks are compiled in the background.
+        // The caller polls the request and installs the native code once it is done.
+        void setCompilationThreads(u32 nbThreads);
+        u32 compilationThreads() const { return !!compilationPool_ ? compilationPool_->nbThreads() : 0; }
+        std::shared_ptr<CompilationRequest> trySubmitCompilation(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location = {}, bool flagsLiveOut = true, Tier tier = Tier::OPTIMIZED);
+        bool isStale(const CompilationRequest& request) const { return !compilationPool_ || compilationPool_->isStale(request); }
+        JitBasicBlock* tryInstall(CompilationRequest* request);
+        void cancelPendingCompilations();
+
+        // Replaces a block by a recompiled version of it. The old code keeps working, by jumping to the new one.
+        void replace(JitBasicBlock* old, const JitBasicBlock* replacement);
+
+        // The native code is bounded by the code cache limit. Once the cache is full,
+        // the owner of the blocks evicts the cold ones and hands the others to collect.
+        static constexpr u64 DEFAULT_CODE_CACHE_LIMIT = 256*1024*1024;
+        void setCodeCacheLimit(u64 bytes) { codeCacheLimit_ = bytes; }
+        u64 codeCacheLimit() const { return codeCacheLimit_; }
+        u64 codeCacheSize() const { return allocator_.usedBytes(); }
+        bool isCodeCacheFull() const { return codeCacheSize() > codeCacheLimit_; }
+
+#ifdef MULTIPROCESSING
+        // Workers change the native code and the code segments under this guard, while jitted code runs without it.
+        // Taking it also completes the changes that no worker can observe anymore.
+        std::unique_lock<std::mutex> lock();
+#endif
+
+        // Frees the blocks that are not in liveBlocks, unlinks the code going to them and compacts the others.
+        // The callstack and the indirect branch cache are cleared, since they may point to any block.
+        // Must not be called while jitted code is running.
+        void collect(const std::unordered_set<const JitBasicBlock*>& liveBlocks);
+
+        // Stops the code of the other blocks from going to deadBlocks, whose guest code has changed.
+        // Their memory is released by the next collection. Must not be called while jitted code is running.
+        void discard(const std::unordered_set<const JitBasicBlock*>& deadBlocks);
+
+        // Chained blocks return once the ticks reach tickLimit on a loop back-edge or an indirect branch.
         void exec(Cpu* cpu, Mmu* mmu, NativeExecPtr nativeBasicBlock, u64* ticks,
-            void** currentlyExecutingBasicBlockPtr, const void* currentlyExecutingJitBasicBlock);
+            void** currentlyExecutingBasicBlockPtr, const void* currentlyExecutingJitBasicBlock, u64 tickLimit = NO_TICK_LIMIT);
+
+        // Called from jitted code to execute an instruction that the compiler does not support.
+        // Returns 0 on success. On failure, the error is rethrown once the jitted code has returned.
+        static u64 interpret(NativeArguments* arguments, const X64Instruction* instruction, CpuExecPtr execPtr);
             
         x64::Compiler* compiler() { return compiler_.get(); }
 
+        // Lets jitted code reach the block directly when an indirect branch goes to address.
+        // The cache must be cleared whenever a jit basic block is abandoned.
+        void addIndirectBranchTarget(u64 address, const JitBasicBlock* block);
+        void clearIndirectBranchCache();
+
+        // The callstack belongs to the thread running the jitted code.
         void notifyCall();
         void notifyRet();
 
-        x64::JitBasicBlock* const* callstack() const { return callstack_.data(); }
-        u64 callstackSize() const { return callstackSize_; }
+        const std::array<CallstackEntry, CALLSTACK_SIZE>& callstack() { return executionState().callstack; }
+        u64 callstackSize() { return executionState().callstackSize; }
         void nukeCallstack();
-        void setCallstack(void** blocks, u64 size);
+        void setCallstack(const std::array<CallstackEntry, CALLSTACK_SIZE>& entries, u64 size);
             
     private:
         Jit();
         void tryCreateJitTrampoline();
+        JitBasicBlock* tryCreate(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location, bool flagsLiveOut, Tier tier);
+        JitBasicBlock* add(std::unique_ptr<JitBasicBlock> block);
+
+        // What the jitted code changes besides the guest state.
+        // With several workers, each of them has its own, and saves it with the threads it runs.
+        struct ExecutionState {
+            std::array<CallstackEntry, CALLSTACK_SIZE> callstack;
+            u64 callstackSize { 0 };
+            std::exception_ptr pendingException;
+        };
+        ExecutionState& executionState();
 
         ExecutableMemoryAllocator allocator_;
         std::optional<MemoryBlock> jitTrampoline_;
 
         std::unique_ptr<x64::Compiler> compiler_;
+        JitStats* stats_ { nullptr };
 
         std::vector<std::unique_ptr<JitBasicBlock>> blocks_;
+        u64 codeCacheLimit_ { DEFAULT_CODE_CACHE_LIMIT };
         bool jitChainingEnabled_ { false };
         bool jitCallChainingEnabled_ { false };
+        bool tieredCompilationEnabled_ { true };
 
-        std::array<JitBasicBlock*, 0x1000> callstack_;
-        u64 callstackSize_ { 0 };
+#ifdef MULTIPROCESSING
+        std::mutex guard_;
+        CodePatcher codePatcher_;
+#else
+        ExecutionState executionState_;
+#endif
+
+        std::unique_ptr<IndirectBranchCache> indirectBranchCache_;
 
         size_t compilationAttempts_ { 0 };
         size_t failedCompilationAttempts_ { 0 };
+        size_t traceCompilationAttempts_ { 0 };
+        size_t failedTraceCompilationAttempts_ { 0 };
 
         int optimizationLevel_ { 0 };
+
+        std::unique_ptr<CompilationPool> compilationPool_;
     };
 
 }
@@ -1,12 +1,27 @@
 #ifndef JITSTATS_H
 #define JITSTATS_H
 
+#include "x64/instructions/x64instruction.h"
 #include "utils.h"
 #include <fmt/format.h>
+#include <optional>
 #include <unordered_set>
 
 namespace x64 {
 
+    // How the last compilation of a code segment went.
+    struct CompileTelemetry {
+        u32 guestInstructions { 0 };
+        u32 irInstructionsBeforeOptimization { 0 };
+        u32 irInstructionsAfterOptimization { 0 };
+        u32 interpretedInstructions { 0 };
+        u32 nativeCodeSize { 0 };
+        u64 compileTimeNs { 0 };
+        // the first instruction that the compiler could not translate, whether it was delegated to the interpreter or not
+        std::optional<X64Instruction> firstUnsupportedInstruction;
+        bool compiled { false };
+    };
+
     struct JitStats {
         u64 jitExits_ { 0 };
         u64 avoidableExits_ { 0 };
@@ -18,6 +33,19 @@ namespace x64 {
         u64 jitExitCallRM64_ { 0 };
         u64 jitExitJmpRM64_ { 0 };
 
+        u64 compiledGuestInstructions_ { 0 };
+        u64 compiledIrInstructions_ { 0 };
+        u64 allocatedGuestRegisters_ { 0 };
+        u64 removedRegisterFileAccesses_ { 0 };
+        u64 interpretedInstructions_ { 0 };
+        u64 eliminatedFlagUpdates_ { 0 };
+        u64 backgroundCompilations_ { 0 };
+        u64 tierUpCompilations_ { 0 };
+        u64 cachedCompilations_ { 0 };
+        u64 evictedBlocks_ { 0 };
+        u64 codeCacheCompactions_ { 0 };
+        u64 invalidatedBlocks_ { 0 };
+
 #ifdef VM_JIT_TELEMETRY
         std::unordered_set<u64> distinctJitExitJmp_;
         std::unordered_set<u64> distinctJitExitJcc_;
@@ -47,6 +75,56 @@ namespace x64 {
                 fmt::print("  jmp  exits: {}\n", jitExitJmpRM64_);
                 fmt::print("  call exits: {}\n", jitExitCallRM64_);
             }
+            if(level >= 1 && compiledGuestInstructions_ > 0) {
+                fmt::print("Compiled {} guest instructions into {} ir instructions ({:.2f} per guest instruction)\n",
+                        compiledGuestInstructions_, compiledIrInstructions_, (double)compiledIrInstructions_/(double)compiledGuestInstructions_);
+                fmt::print("  {} guest registers kept in host registers, {} register file accesses removed\n",
+                        allocatedGuestRegisters_, removedRegisterFileAccesses_);
+                fmt::print("    (allocated per block body and spilled around interpreter callouts; not kept across trace links)\n");
+                fmt::print("  {} instructions delegated to the interpreter\n", interpretedInstructions_);
+                fmt::print("  {} dead flag updates eliminated\n", eliminatedFlagUpdates_);
+                fmt::print("  {} blocks compiled in the background\n", backgroundCompilations_);
+                fmt::print("  {} blocks recompiled at a higher tier\n", tierUpCompilations_);
+            }
+            if(level >= 1 && cachedCompilations_ > 0) {
+                fmt::print("{} blocks loaded from the code cache\n", cachedCompilations_);
+            }
+            if(level >= 1 && evictedBlocks_ > 0) {
+                fmt::print("{} blocks evicted from the code cache, {} compactions\n", evictedBlocks_, codeCacheCompactions_);
+            }
+            if(level >= 1 && invalidatedBlocks_ > 0) {
+                fmt::print("{} blocks invalidated by writes to their code\n", invalidatedBlocks_);
+            }
+        }
+
+        void addExitStats(const JitStats& other) {
+            jitExits_ += other.jitExits_;
+            avoidableExits_ += other.avoidableExits_;
+            jitExitJmp_ += other.jitExitJmp_;
+            jitExitJcc_ += other.jitExitJcc_;
+            jitExitCall_ += other.jitExitCall_;
+            jitExitSyscall_ += other.jitExitSyscall_;
+            jitExitRet_ += other.jitExitRet_;
+            jitExitCallRM64_ += other.jitExitCallRM64_;
+            jitExitJmpRM64_ += other.jitExitJmpRM64_;
+#ifdef VM_JIT_TELEMETRY
+            distinctJitExitJmp_.insert(other.distinctJitExitJmp_.begin(), other.distinctJitExitJmp_.end());
+            distinctJitExitJcc_.insert(other.distinctJitExitJcc_.begin(), other.distinctJitExitJcc_.end());
+            distinctJitExitCall_.insert(other.distinctJitExitCall_.begin(), other.distinctJitExitCall_.end());
+            distinctJitExitSyscall_.insert(other.distinctJitExitSyscall_.begin(), other.distinctJitExitSyscall_.end());
+            distinctJitExitRet_.insert(other.distinctJitExitRet_.begin(), other.distinctJitExitRet_.end());
+            distinctJitExitCallRM64_.insert(other.distinctJitExitCallRM64_.begin(), other.distinctJitExitCallRM64_.end());
+            distinctJitExitJmpRM64_.insert(other.distinctJitExitJmpRM64_.begin(), other.distinctJitExitJmpRM64_.end());
+#endif
+        }
+
+        void addCompilationStats(const JitStats& other) {
+            compiledGuestInstructions_ += other.compiledGuestInstructions_;
+            compiledIrInstructions_ += other.compiledIrInstructions_;
+            allocatedGuestRegisters_ += other.allocatedGuestRegisters_;
+            removedRegisterFileAccesses_ += other.removedRegisterFileAccesses_;
+            interpretedInstructions_ += other.interpretedInstructions_;
+            eliminatedFlagUpdates_ += other.eliminatedFlagUpdates_;
         }
 
     };
@@ -10,6 +10,7 @@ namespace x64::ir {
 
     class OptimizationPass;
     struct LivenessAnalysis;
+    class ReachingDefinitions;
 
     class Optimizer {
     public:
@@ -25,6 +26,13 @@ namespace x64::ir {
             u32 immediateReadback { 0 };
             u32 delayedReadback { 0 };
             u32 duplicateInstruction { 0 };
+            u32 constantPropagation { 0 };
+            u32 constantFolding { 0 };
+            u32 copyPropagation { 0 };
+            u32 addressFolding { 0 };
+            u32 andnFusion { 0 };
+            u32 memoryOperandFolding { 0 };
+            u32 leaMerging { 0 };
         };
 
         void optimize(IR& ir, Stats* stats = nullptr);
@@ -57,14 +65,67 @@ namespace x64::ir {
     };
 
     class DelayedReadBackElimination : public OptimizationPass {
+    public:
+        DelayedReadBackElimination();
+        ~DelayedReadBackElimination();
         bool optimize(IR*, Optimizer::Stats*) override;
+
     private:
+        std::unique_ptr<ReachingDefinitions> definitions_;
         std::vector<size_t> removableInstructions_;
     };
 
     class DuplicateInstructionElimination : public OptimizationPass {
+    public:
+        DuplicateInstructionElimination();
+        ~DuplicateInstructionElimination();
         bool optimize(IR*, Optimizer::Stats*) override;
+
     private:
+        std::unique_ptr<ReachingDefinitions> definitions_;
+        std::vector<size_t> removableInstructions_;
+    };
+
+    // Replaces reads of registers holding a known constant by the constant,
+    // and computes the result of operations on constants when their flags are not used.
+    class ConstantPropagation : public OptimizationPass {
+        bool optimize(IR*, Optimizer::Stats*) override;
+    private:
+        std::vector<bool> flagsOverwritten_;
+    };
+
+    // Reads the source of register to register movs instead of their destination,
+    // and removes the movs whose destination already holds the source.
+    class CopyPropagation : public OptimizationPass {
+        bool optimize(IR*, Optimizer::Stats*) override;
+    private:
+        std::vector<size_t> removableInstructions_;
+    };
+
+    // Merges the address computed by a lea into the memory operands that use it.
+    class AddressFolding : public OptimizationPass {
+        bool optimize(IR*, Optimizer::Stats*) override;
+    };
+
+    // Merges a not into the and that consumes it, when the host has an andn instruction.
+    class AndnFusion : public OptimizationPass {
+        bool optimize(IR*, Optimizer::Stats*) override;
+    private:
+        std::vector<bool> flagsOverwritten_;
+        std::vector<size_t> removableInstructions_;
+    };
+
+    // Peephole pass for the allocated IR, just before code generation.
+    // Merges the load of a temporary and its store back around an arithmetic operation or a comparison
+    // into a memory operand of that operation, and merges a lea into the lea offsetting its result.
+    class MemoryOperandFolding : public OptimizationPass {
+    public:
+        MemoryOperandFolding();
+        ~MemoryOperandFolding();
+        bool optimize(IR*, Optimizer::Stats*) override;
+
+    private:
+        std::unique_ptr<LivenessAnalysis> analysis_;
         std::vector<size_t> removableInstructions_;
     };
 }
@@ -0,0 +1,78 @@
+#ifndef REGISTERALLOCATOR_H
+#define REGISTERALLOCATOR_H
+
+#include "x64/compiler/ir.h"
+#include <array>
+#include <vector>
+
+namespace x64::ir {
+
+    // Keeps the most used guest registers of a basic block body in host callee-saved registers.
+    // Guest registers are loaded from the register file on entry and written back on exit,
+    // instead of being accessed in memory by every instruction.
+    // A body may be made of several runs separated by calls into the interpreter, which may access the
+    // whole register file: the allocated registers are spilled before each call and reloaded after it.
+    // Trace links are not such calls: bodies on both sides of a link are allocated separately.
+    class RegisterAllocator {
+    public:
+        // Host registers that are never used by the generated code.
+        // The jit trampoline saves and restores them around the native code.
+        static constexpr std::array<R64, 4> HOST_REGISTERS {{
+            R64::RBX,
+            R64::R12,
+            R64::R14,
+            R64::R15,
+        }};
+
+        struct Stats {
+            u32 allocatedRegisters { 0 };
+            u32 removedRegisterFileAccesses { 0 };
+            u32 coalescedMoves { 0 };
+        };
+
+        explicit RegisterAllocator(R64 registerFileBase);
+
+        bool allocate(IR& ir, Stats* stats = nullptr);
+        bool allocate(const std::vector<IR*>& runs, Stats* stats = nullptr);
+
+    private:
+        static constexpr u32 NB_GUEST_REGISTERS = 16;
+
+        struct GuestRegister {
+            u32 accesses { 0 };
+            bool eligible { true };
+            std::optional<R64> host;
+        };
+
+        // Register file accesses needed at the boundaries of a run
+        struct RunBoundary {
+            std::array<bool, NB_GUEST_REGISTERS> loadNeeded {};
+            std::array<bool, NB_GUEST_REGISTERS> written {};
+        };
+
+        enum class AccessKind {
+            READ32,
+            READ64,
+            WRITE64,
+            WRITE64_IMM,
+        };
+
+        struct Access {
+            u32 guestRegister;
+            AccessKind kind;
+        };
+
+        bool analyze(const std::vector<IR*>& runs);
+        std::optional<u32> guestRegisterOf(const Operand& op) const;
+        std::optional<Access> accessOf(const Instruction& ins) const;
+        void rewrite(const IR& ir, const RunBoundary& boundary, IR* result) const;
+        u32 coalesce(IR* ir) const;
+
+        R64 registerFileBase_;
+        std::array<GuestRegister, NB_GUEST_REGISTERS> guestRegisters_;
+        std::vector<RunBoundary> runBoundaries_;
+        std::array<bool, HOST_REGISTERS.size()> availableHostRegisters_;
+    };
+}
+
+#endif
@@ -219,6 +219,26 @@ namespace x64 {
 
         static const std::array<CpuExecPtr, (size_t)Insn::UNKNOWN+1> execFunctions_;
 
+        static ThreadedInstruction threadedForm(const X64Instruction&);
+
+        template<Size size, U<size>(*op)(U<size>, U<size>, Flags*)>
+        static void execOpRegReg(Cpu&, const X64Instruction&);
+        template<Size size, U<size>(*op)(U<size>, U<size>, Flags*)>
+        static void execOpRegImm(Cpu&, const X64Instruction&);
+        template<Size size, U<size>(*op)(U<size>, U<size>, Flags*)>
+        static void execOpRegMem(Cpu&, const X64Instruction&);
+        template<Size size, U<size>(*op)(U<size>, Flags*)>
+        static void execOpReg(Cpu&, const X64Instruction&);
+
+        template<Size size, void(*op)(U<size>, U<size>, Flags*)>
+        static void execCompareRegReg(Cpu&, const X64Instruction&);
+        template<Size size, void(*op)(U<size>, U<size>, Flags*)>
+        static void execCompareRegImm(Cpu&, const X64Instruction&);
+        template<Size size, void(*op)(U<size>, U<size>, Flags*)>
+        static void execCompareRegMem(Cpu&, const X64Instruction&);
+        template<Size size>
+        static void execTestRegReg(Cpu&, const X64Instruction&);
+
     public:
         void execAddRM8RM8(const X64Instruction&);
         void execAddRM8Imm(const X64Instruction&);
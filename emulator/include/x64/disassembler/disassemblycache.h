@@ -53,6 +53,9 @@ namespace x64 {
 
         std::optional<std::string> tryFindContainingFile(u64 address);
 
+        // Drops the disassembly of the sections that intersect [begin, end).
+        void invalidate(u64 begin, u64 end);
+
         void addCallback(DisassemblyCacheCallback* callback) {
             callbacks_.push_back(callback);
         }
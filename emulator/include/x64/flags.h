@@ -4,19 +4,92 @@
 #include "x64/types.h"
 #include <optional>
 #include <string>
+#include <type_traits>
 
 namespace x64 {
 
     struct Flags {
-        bool carry { false };
-        bool zero { false };
-        bool sign { false };
-        bool overflow { false };
         bool direction { false };
         bool identification { true };
 
         bool matches(Cond condition) const;
 
+        // The arithmetic flags of the most frequent operations are not computed when the operation executes.
+        // The operation, its operands and its result are recorded instead, and each flag is only
+        // computed from them when it is read. Most of these flags are overwritten before being read.
+        enum class LazyOp : u8 {
+            NONE,
+            ADD,
+            SUB,
+            LOGIC,
+            INC,
+            DEC,
+        };
+
+        template<typename U>
+        void setLazy(LazyOp op, U dst, U src, U res) {
+            static_assert(std::is_unsigned_v<U>);
+            // inc and dec leave the carry untouched
+            if(op == LazyOp::INC || op == LazyOp::DEC) carry_ = carry();
+            lazyOp_ = op;
+            signMask_ = (u64)1 << (8*sizeof(U)-1);
+            dst_ = dst;
+            src_ = src;
+            res_ = res;
+            deferParity((u8)res);
+        }
+
+        bool carry() const {
+            switch(lazyOp_) {
+                case LazyOp::NONE: return carry_;
+                case LazyOp::ADD: return res_ < dst_;
+                case LazyOp::SUB: return dst_ < src_;
+                case LazyOp::LOGIC: return false;
+                case LazyOp::INC:
+                case LazyOp::DEC: return carry_;
+            }
+            UNREACHABLE();
+        }
+
+        bool zero() const {
+            if(lazyOp_ == LazyOp::NONE) return zero_;
+            return res_ == 0;
+        }
+
+        bool sign() const {
+            if(lazyOp_ == LazyOp::NONE) return sign_;
+            return res_ & signMask_;
+        }
+
+        bool overflow() const {
+            switch(lazyOp_) {
+                case LazyOp::NONE: return overflow_;
+                case LazyOp::ADD: return ~(dst_ ^ src_) & (dst_ ^ res_) & signMask_;
+                case LazyOp::SUB: return (dst_ ^ src_) & (dst_ ^ res_) & signMask_;
+                case LazyOp::LOGIC: return false;
+                case LazyOp::INC: return res_ == signMask_;
+                case LazyOp::DEC: return dst_ == signMask_;
+            }
+            UNREACHABLE();
+        }
+
+        void setCarry(bool value) {
+            materialize();
+            carry_ = value;
+        }
+        void setZero(bool value) {
+            materialize();
+            zero_ = value;
+        }
+        void setSign(bool value) {
+            materialize();
+            sign_ = value;
+        }
+        void setOverflow(bool value) {
+            materialize();
+            overflow_ = value;
+        }
+
         void setParity(bool value) {
             parity_ = value;
             awaitingParity_.reset();
@@ -41,22 +114,22 @@ namespace x64 {
 
         static Flags fromRflags(u64 rflags) {
             Flags flags;
-            flags.carry = rflags & CARRY_MASK;
+            flags.carry_ = rflags & CARRY_MASK;
             flags.setParity(rflags & PARITY_MASK);
-            flags.zero = rflags & ZERO_MASK;
-            flags.sign = rflags & SIGN_MASK;
-            flags.overflow = rflags & OVERFLOW_MASK;
+            flags.zero_ = rflags & ZERO_MASK;
+            flags.sign_ = rflags & SIGN_MASK;
+            flags.overflow_ = rflags & OVERFLOW_MASK;
             flags.identification = rflags & IDENTIFICATION_MASK;
             return flags;
         }
 
         u64 toRflags() const {
             u64 rflags = 0;
-            rflags |= (carry ? CARRY_MASK : 0);
+            rflags |= (carry() ? CARRY_MASK : 0);
             rflags |= (parity() ? PARITY_MASK : 0);
-            rflags |= (zero ? ZERO_MASK : 0);
-            rflags |= (sign ? SIGN_MASK : 0);
-            rflags |= (overflow ? OVERFLOW_MASK : 0);
+            rflags |= (zero() ? ZERO_MASK : 0);
+            rflags |= (sign() ? SIGN_MASK : 0);
+            rflags |= (overflow() ? OVERFLOW_MASK : 0);
             rflags |= (identification ? IDENTIFICATION_MASK : 0);
             return rflags;
         }
@@ -64,6 +137,27 @@ namespace x64 {
         std::string toString() const;
 
     private:
+        // computes the recorded flags, before one of them is overwritten
+        void materialize() {
+            if(lazyOp_ == LazyOp::NONE) return;
+            carry_ = carry();
+            zero_ = zero();
+            sign_ = sign();
+            overflow_ = overflow();
+            lazyOp_ = LazyOp::NONE;
+        }
+
+        bool carry_ { false };
+        bool zero_ { false };
+        bool sign_ { false };
+        bool overflow_ { false };
+
+        LazyOp lazyOp_ { LazyOp::NONE };
+        u64 signMask_ { 0 };
+        u64 dst_ { 0 };
+        u64 src_ { 0 };
+        u64 res_ { 0 };
+
         mutable std::optional<u8> awaitingParity_;
         mutable bool parity_ { false };
 
@@ -81,25 +175,25 @@ namespace x64 {
 
     inline bool Flags::matches(Cond condition) const {
         switch(condition) {
-            case Cond::A: return (carry == 0 && zero == 0);
-            case Cond::AE: return (carry == 0);
-            case Cond::B: return (carry == 1);
-            case Cond::BE: return (carry == 1 || zero == 1);
-            case Cond::E: return (zero == 1);
-            case Cond::G: return (zero == 0 && sign == overflow);
-            case Cond::GE: return (sign == overflow);
-            case Cond::L: return (sign != overflow);
-            case Cond::LE: return (zero == 1 || sign != overflow);
-            case Cond::NB: return (carry == 0);
-            case Cond::NBE: return (carry == 0 && zero == 0);
-            case Cond::NE: return (zero == 0);
-            case Cond::NO: return (overflow == 0);
+            case Cond::A: return (carry() == 0 && zero() == 0);
+            case Cond::AE: return (carry() == 0);
+            case Cond::B: return (carry() == 1);
+            case Cond::BE: return (carry() == 1 || zero() == 1);
+            case Cond::E: return (zero() == 1);
+            case Cond::G: return (zero() == 0 && sign() == overflow());
+            case Cond::GE: return (sign() == overflow());
+            case Cond::L: return (sign() != overflow());
+            case Cond::LE: return (zero() == 1 || sign() != overflow());
+            case Cond::NB: return (carry() == 0);
+            case Cond::NBE: return (carry() == 0 && zero() == 0);
+            case Cond::NE: return (zero() == 0);
+            case Cond::NO: return (overflow() == 0);
             case Cond::NP: return (parity() == 0);
-            case Cond::NS: return (sign == 0);
+            case Cond::NS: return (sign() == 0);
             case Cond::NU: return (parity() == 0);
-            case Cond::O: return (overflow == 1);
+            case Cond::O: return (overflow() == 1);
             case Cond::P: return (parity() == 1);
-            case Cond::S: return (sign == 1);
+            case Cond::S: return (sign() == 1);
             case Cond::U: return (parity() == 1);
         }
         UNREACHABLE();
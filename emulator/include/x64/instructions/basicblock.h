@@ -12,20 +12,38 @@ namespace x64 {
 
     using CpuExecPtr = void(*)(Cpu&, const X64Instruction&);
 
+    // The form of an instruction that the interpreter runs, decoded once when the block is created.
+    struct ThreadedInstruction {
+        CpuExecPtr exec;   // specialized for the operand form of the instruction when it is a frequent one
+        bool updatesRip;   // whether rip must hold the next address before exec runs
+    };
+
     class BasicBlock {
     public:
-        BasicBlock(std::vector<std::pair<X64Instruction, CpuExecPtr>> instructions)
+        BasicBlock(std::vector<std::pair<X64Instruction, ThreadedInstruction>> instructions)
                 : instructions_(std::move(instructions)) {
             assert(!instructions_.empty());
+            // rip must be right when the block is left
+            instructions_.back().second.updatesRip = true;
             endsWithFixedDestinationJump_ = instructions_.back().first.isFixedDestinationJump();
             endsWithDirectCall_ = instructions_.back().first.isDirectCall();
             endsWithIndirectCall_ = instructions_.back().first.isIndirectCall();
             hasAtomic_ = std::any_of(instructions_.begin(), instructions_.end(), [](const auto& p) {
                 return p.first.lock();
             });
+            for(const auto& p : instructions_) {
+                if(p.first.readsFlags()) {
+                    readsIncomingFlags_ = true;
+                    break;
+                }
+                if(p.first.writesFlags()) {
+                    overwritesFlags_ = true;
+                    break;
+                }
+            }
         }
 
-        const std::vector<std::pair<X64Instruction, CpuExecPtr>>& instructions() const {
+        const std::vector<std::pair<X64Instruction, ThreadedInstruction>>& instructions() const {
             return instructions_;
         }
 
@@ -45,12 +63,129 @@ namespace x64 {
             return hasAtomic_;
         }
 
+        // Whether the flags the block starts with may be read before being overwritten
+        bool readsIncomingFlags() const {
+            return readsIncomingFlags_;
+        }
+
+        // Whether all the flags are overwritten before any of them is read
+        bool overwritesFlags() const {
+            return overwritesFlags_;
+        }
+
+        // The address of the table that a final jmp [base + index*8] reads its destination from,
+        // when the base is a constant or is set from one earlier in the block and not written to since.
+        // This is only a guess of the table: the entries must be checked before being used.
+        std::optional<u64> jumpTableAddress() const {
+            const X64Instruction& jmp = instructions_.back().first;
+            if(jmp.insn() != Insn::JMP_RM64) return {};
+            const RM64& dst = jmp.op0<RM64>();
+            if(dst.isReg || dst.mem.segment == Segment::FS) return {};
+            const Encoding64& enc = dst.mem.encoding;
+            if(enc.index == R64::ZERO || enc.index == R64::RIP || enc.scale != 8) return {};
+            if(enc.base == R64::ZERO) return (u64)(i64)enc.displacement;
+            for(size_t i = instructions_.size()-1; i-- > 0;) {
+                const X64Instruction& ins = instructions_[i].first;
+                if(ins.insn() == Insn::MOV_R64_IMM && ins.op0<R64>() == enc.base) {
+                    return ins.op1<Imm>().as<u64>() + (u64)(i64)enc.displacement;
+                }
+                if(ins.insn() == Insn::LEA_R64_ENCODING64 && ins.op0<R64>() == enc.base) {
+                    const Encoding64& lea = ins.op1<Encoding64>();
+                    if(lea.index != R64::ZERO) return {};
+                    if(lea.base == R64::RIP) return ins.nextAddress() + (u64)(i64)lea.displacement + (u64)(i64)enc.displacement;
+                    if(lea.base == R64::ZERO) return (u64)(i64)lea.displacement + (u64)(i64)enc.displacement;
+                    return {};
+                }
+                if(mayWrite(ins, enc.base)) return {};
+            }
+            return {};
+        }
+
     private:
-        std::vector<std::pair<X64Instruction, CpuExecPtr>> instructions_;
+        // Conservative: only the forms that commonly sit between the base and the jump are known not to write reg.
+        static bool mayWrite(const X64Instruction& ins, R64 reg) {
+            auto isReg32 = [&](R32 r) { return (u8)r == (u8)reg; };
+            auto isRM32 = [&](const RM32& rm) { return rm.isReg && (u8)rm.reg == (u8)reg; };
+            auto isRM64 = [&](const RM64& rm) { return rm.isReg && rm.reg == reg; };
+            switch(ins.insn()) {
+                case Insn::CMP_RM32_RM32:
+                case Insn::CMP_RM32_IMM:
+                case Insn::CMP_RM64_RM64:
+                case Insn::CMP_RM64_IMM:
+                case Insn::TEST_RM32_R32:
+                case Insn::TEST_RM32_IMM:
+                case Insn::TEST_RM64_R64:
+                case Insn::TEST_RM64_IMM:
+                case Insn::NOP:
+                    return false;
+                case Insn::MOV_R32_R32:
+                case Insn::MOV_R32_M32:
+                case Insn::MOV_R32_IMM:
+                case Insn::MOVZX_R32_RM8:
+                case Insn::MOVZX_R32_RM16:
+                case Insn::LEA_R32_ENCODING32:
+                case Insn::LEA_R32_ENCODING64:
+                    return isReg32(ins.op0<R32>());
+                case Insn::MOV_R64_R64:
+                case Insn::MOV_R64_M64:
+                case Insn::MOV_R64_IMM:
+                case Insn::MOVZX_R64_RM8:
+                case Insn::MOVZX_R64_RM16:
+                case Insn::MOVZX_R64_RM32:
+                case Insn::MOVSX_R64_RM8:
+                case Insn::MOVSX_R64_RM16:
+                case Insn::MOVSX_R64_RM32:
+                case Insn::LEA_R64_ENCODING32:
+                case Insn::LEA_R64_ENCODING64:
+                    return ins.op0<R64>() == reg;
+                case Insn::ADD_RM32_RM32:
+                case Insn::ADD_RM32_IMM:
+                case Insn::SUB_RM32_RM32:
+                case Insn::SUB_RM32_IMM:
+                case Insn::AND_RM32_RM32:
+                case Insn::AND_RM32_IMM:
+                case Insn::XOR_RM32_RM32:
+                case Insn::XOR_RM32_IMM:
+                    return isRM32(ins.op0<RM32>());
+                case Insn::ADD_RM64_RM64:
+                case Insn::ADD_RM64_IMM:
+                case Insn::SUB_RM64_RM64:
+                case Insn::SUB_RM64_IMM:
+                case Insn::AND_RM64_RM64:
+                case Insn::AND_RM64_IMM:
+                case Insn::XOR_RM64_RM64:
+                case Insn::XOR_RM64_IMM:
+                    return isRM64(ins.op0<RM64>());
+                default:
+                    return true;
+            }
+        }
+
+
+    private:
+        std::vector<std::pair<X64Instruction, ThreadedInstruction>> instructions_;
         bool endsWithFixedDestinationJump_ { false };
         bool endsWithDirectCall_ { false };
         bool endsWithIndirectCall_ { false };
         bool hasAtomic_ { false };
+        bool readsIncomingFlags_ { false };
+        bool overwritesFlags_ { false };
+    };
+
+    // A 64-bit immediate of the native code that holds a host pointer.
+    // The pointer is identified by what it refers to, so that the code can be reused by another emulator process.
+    struct NativeRelocation {
+        enum class Kind : u8 {
+            BASIC_BLOCK,            // the basic block pointer given for block `block` of the trace
+            JIT_BASIC_BLOCK,        // the jit basic block pointer
+            INSTRUCTION,            // instruction `instruction` of block `block`
+            INSTRUCTION_HANDLER,    // the interpreter function of that instruction
+            INTERPRETER_ENTRYPOINT, // Jit::interpret
+        };
+        u32 offset;
+        Kind kind;
+        u32 block;
+        u32 instruction;
     };
 
     struct NativeBasicBlock {
@@ -60,6 +195,9 @@ namespace x64 {
         std::optional<size_t> offsetOfReplaceableJumpToConditionalBlock;
         std::optional<std::pair<size_t, u64>> offsetOfReplaceableCallstackPush;
         std::optional<size_t> offsetOfReplaceableCallstackPop;
+        std::vector<NativeRelocation> relocations;
+        // false when some host pointers of the code are not in `relocations`: the code cannot be used by another process
+        bool relocatable { true };
     };
 
 }
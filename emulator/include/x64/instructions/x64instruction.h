@@ -948,6 +948,11 @@ namespace x64 {
         bool isSSE() const;
         bool isX87() const;
 
+        // Whether the instruction may read the status flags (CF, PF, ZF, SF and OF).
+        bool readsFlags() const;
+        // Whether the instruction overwrites all the status flags, even if with undefined values.
+        bool writesFlags() const;
+
     private:
 
 #ifndef NDEBUG
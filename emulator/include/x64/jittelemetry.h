@@ -0,0 +1,55 @@
+#ifndef JITTELEMETRY_H
+#define JITTELEMETRY_H
+
+#include "x64/compiler/jitstats.h"
+#include "utils.h"
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace x64 {
+
+    class CodeSegment;
+
+    // Collects the compile telemetry of code segments before they go away, and exports it.
+    // Each entry tells how often a segment ran and how much of it had to be interpreted,
+    // so that the instructions missing from the jit can be ranked by the time they cost.
+    class JitTelemetryReport {
+    public:
+        enum class Format {
+            JSON,
+            CSV,
+        };
+
+        // The format is given by the extension of the path: .json or .csv
+        static std::optional<Format> formatOf(const std::string& path);
+
+        void add(const CodeSegment& segment, std::string source);
+        size_t size() const { return entries_.size(); }
+
+        void write(std::ostream& stream, Format format) const;
+        bool tryWrite(const std::string& path) const;
+
+    private:
+        struct Entry {
+            u64 address { 0 };
+            std::string source;
+            u64 calls { 0 };
+            u32 guestInstructions { 0 };
+            bool jitted { false };
+            std::optional<CompileTelemetry> telemetry;
+
+            // guest instructions run by the interpreter, with or without native code around them
+            u64 interpretedExecutions() const;
+        };
+
+        void writeJson(std::ostream& stream) const;
+        void writeCsv(std::ostream& stream) const;
+
+        std::vector<Entry> entries_;
+    };
+
+}
+
+#endif
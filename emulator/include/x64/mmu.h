@@ -1,8 +1,9 @@
 #ifndef MMU_H
 #define MMU_H
 
+#include "host/hostinstructions.h"
 #include "host/hostmemory.h"
-#include "x64/spinlock.h"
+#include "x64/codewritewatch.h"
 #include "bitflags.h"
 #include "types.h"
 #include "utils.h"
@@ -16,6 +17,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace x64 {
@@ -49,8 +51,6 @@ namespace x64 {
         BitFlags<PROT> prot() const { return prot_; }
         const std::string& name() const { return name_; }
 
-        Spinlock& lock() { return lock_; }
-
         bool contains(u64 address) const;
         bool intersectsRange(u64 base, u64 end) const;
 
@@ -74,7 +74,6 @@ namespace x64 {
     private:
         void verifyNotActivated() const;
 
-        Spinlock lock_;
         u64 base_;
         u64 size_;
         BitFlags<PROT> prot_;
@@ -100,6 +99,8 @@ namespace x64 {
         host::VirtualMemoryRange memoryRange_;
         u64 firstUnlookupdableAddress { 0 };
         u64 topOfReserved { 0 };
+        // created once code is translated from the address space
+        std::unique_ptr<CodeWriteWatch> codeWriteWatch;
         
     private:
         explicit AddressSpace(host::VirtualMemoryRange range);
@@ -169,29 +170,31 @@ namespace x64 {
 
         std::string readString(Ptr8 src) const;
 
+        // Atomically replaces the value at ptr by modify(value), and returns the value it replaced.
+        // Other threads may write concurrently, so modify may be called several times and must only
+        // have side effects that the last call overwrites.
         template<Size s, typename Modify>
-        void withExclusiveRegion(SPtr<s> ptr, Modify modify) {
-            u64 address = ptr.address();
-            MmuRegion* region = findAddress(address);
-            verify(!!region, "No region found");
-
-            SpinlockLocker locker(region->lock());
-            if constexpr(s == Size::BYTE) {
-                u8 oldValue = read8(ptr);
-                u8 newValue = modify(oldValue);
-                write(ptr, newValue, locker);
-            } else if constexpr(s == Size::WORD) {
-                u16 oldValue = read16(ptr);
-                u16 newValue = modify(oldValue);
-                write(ptr, newValue, locker);
-            } else if constexpr(s == Size::DWORD) {
-                u32 oldValue = read32(ptr);
-                u32 newValue = modify(oldValue);
-                write(ptr, newValue, locker);
-            } else if constexpr(s == Size::QWORD) {
-                u64 oldValue = read64(ptr);
-                u64 newValue = modify(oldValue);
-                write(ptr, newValue, locker);
+        auto atomicModify(SPtr<s> ptr, Modify modify) {
+#ifdef MULTIPROCESSING
+            verify(!syscallInProgress_, "Cannot write to mmu during syscall");
+#endif
+            u8* dataPtr = getWritePtr(ptr.address());
+            if constexpr(s == Size::XWORD) {
+                verify((u64)dataPtr % 16 == 0, "pointer is not properly aligned in cmpxchg16b");
+                u128* aptr = reinterpret_cast<u128*>(dataPtr);
+                u128 oldValue;
+                std::memcpy(&oldValue, dataPtr, sizeof(u128));
+                while(!host::cmpxchg16b(aptr, &oldValue, modify(oldValue))) { }
+                return oldValue;
+            } else {
+                using T = std::conditional_t<s == Size::BYTE, u8,
+                          std::conditional_t<s == Size::WORD, u16,
+                          std::conditional_t<s == Size::DWORD, u32, u64>>>;
+                static_assert(sizeof(std::atomic<T>) == sizeof(T), "size of atomic<T> does not match size of T");
+                std::atomic<T>* aptr = reinterpret_cast<std::atomic<T>*>(dataPtr);
+                T oldValue = aptr->load(std::memory_order_relaxed);
+                while(!aptr->compare_exchange_weak(oldValue, modify(oldValue))) { }
+                return oldValue;
             }
         }
 
@@ -261,6 +264,15 @@ namespace x64 {
 
         std::vector<u8> mincore(u64 address, u64 length) const;
 
+        // Watches the writes to the pages of [begin, end), from which code has been translated.
+        // The pages written since the last call to takeWrittenCodePages are then reported by it.
+        void protectCode(u64 begin, u64 end);
+        bool hasWrittenCode() const;
+        void takeWrittenCodePages(std::vector<u64>* pages);
+
+        // Makes jitted code return early once it writes to a watched page. Reset with nullptr.
+        void setJittedCodeTickLimit(u64* tickLimit);
+
         u64 memoryConsumptionInMB() const {
             u64 cons = 0;
             for(const auto& ptr : addressSpace_.regions) {
@@ -315,27 +327,6 @@ namespace x64 {
             static_assert(sizeof(T) == pointerSize(s));
             u64 address = ptr.address();
             u8* dataPtr = getWritePtr(address);
-#ifdef MULTIPROCESSING
-            MmuRegion* region = findAddress(address);
-            SpinlockLocker locker(region->lock());
-#endif
-            std::memcpy(dataPtr, &value, sizeof(T));
-        }
-
-        template<typename T, Size s>
-        void write(SPtr<s> ptr, T value, SpinlockLocker& locker) {
-#ifdef MULTIPROCESSING
-            verify(!syscallInProgress_, "Cannot write to mmu during syscall");
-#endif
-            static_assert(sizeof(T) == pointerSize(s));
-            u64 address = ptr.address();
-            u8* dataPtr = getWritePtr(address);
-#ifdef MULTIPROCESSING
-            MmuRegion* region = findAddress(address);
-            verify(locker.holdsLock(region->lock()));
-#else
-            (void)locker;
-#endif
             std::memcpy(dataPtr, &value, sizeof(T));
         }
 
@@ -347,10 +338,6 @@ namespace x64 {
             static_assert(sizeof(T) == pointerSize(s));
             u64 address = ptr.address();
             u8* dataPtr = getWritePtr(address);
-#ifdef MULTIPROCESSING
-            MmuRegion* region = findAddress(address);
-            SpinlockLocker locker(region->lock());
-#endif
             verify((u64)dataPtr % alignof(T) == 0, "pointer is not properly aligned in xchg");
             static_assert(sizeof(std::atomic<T>) == sizeof(T), "size of atomic<T> does not match size of T");
             std::atomic<T>* aptr = reinterpret_cast<std::atomic<T>*>(dataPtr);
@@ -43,8 +43,14 @@ namespace x64 {
     };
 
     struct X87Tag {
+        static constexpr u8 VALID = 0x0;
+        static constexpr u8 EMPTY = 0x3;
+
         u16 tags { 0xFFFF };
 
+        u8 get(u8 reg) const { return (u8)((tags >> (2*reg)) & 0x3); }
+        void set(u8 reg, u8 tag) { tags = (u16)((tags & ~(0x3 << (2*reg))) | ((tag & 0x3) << (2*reg))); }
+
         u16 asWord() const;
         static X87Tag fromWord(u16 tw);
     };
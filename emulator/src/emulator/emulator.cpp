@@ -47,6 +47,26 @@ namespace emulator {
         optimizationLevel_ = level;
     }
 
+    void Emulator::setEnableJitTiers(bool enableJitTiers) {
+        enableJitTiers_ = enableJitTiers;
+    }
+
+    void Emulator::setJitThreads(int nbThreads) {
+        jitThreads_ = nbThreads;
+    }
+
+    void Emulator::setJitCodeCacheSize(unsigned int codeCacheSizeInMB) {
+        jitCodeCacheSizeInMB_ = codeCacheSizeInMB;
+    }
+
+    void Emulator::setJitCacheDirectory(const std::string& directory) {
+        jitCacheDirectory_ = directory;
+    }
+
+    void Emulator::setJitTelemetryPath(const std::string& path) {
+        jitTelemetryPath_ = path;
+    }
+
     void Emulator::setEnableShm(bool enableShm) {
         enableShm_ = enableShm;
     }
@@ -69,6 +89,11 @@ namespace emulator {
         kernel.setEnableJitCallChaining(enableJitCallChaining_);
         kernel.setJitStatsLevel(jitStatsLevel_);
         kernel.setOptimizationLevel(optimizationLevel_);
+        kernel.setEnableJitTiers(enableJitTiers_);
+        kernel.setJitThreads(jitThreads_);
+        kernel.setJitCodeCacheSize(jitCodeCacheSizeInMB_);
+        kernel.setJitCacheDirectory(jitCacheDirectory_);
+        kernel.setJitTelemetryPath(jitTelemetryPath_);
         kernel.setEnableShm(enableShm_);
         kernel.setNbCores(nbCores_);
         kernel.setProcessVirtualMemory(virtualMemoryInMB_);
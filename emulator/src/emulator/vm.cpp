@@ -47,9 +47,7 @@ namespace emulator {
 
             if(auto* jit = currentThread_->process()->jit()) {
                 VMThread::SavedJitState& jitState = currentThread_->savedJitState();
-                jitState.callstack.resize(VMThread::SavedJitState::MAX_SIZE);
-                verify(jit->callstackSize() <= jitState.callstack.size());
-                std::copy(jit->callstack(), jit->callstack() + jit->callstackSize(), jitState.callstack.begin());
+                jitState.callstack = jit->callstack();
                 jitState.size = jit->callstackSize();
             }
         }
@@ -79,7 +77,7 @@ namespace emulator {
 
             if(auto* jit = currentThread_->process()->jit()) {
                 VMThread::SavedJitState& jitState = currentThread_->savedJitState();
-                jit->setCallstack(jitState.callstack.data(), jitState.size);
+                jit->setCallstack(jitState.callstack, jitState.size);
             }
         } else {
             currentThread_ = nullptr;
@@ -101,6 +99,17 @@ namespace emulator {
         x64::Jit* jit = process->jit();
         x64::CompilationQueue& compilationQueue = process->compilationQueue();
 
+        // exits are counted here, and only added to the stats of the process on the way out
+        x64::JitStats exitStats;
+        ScopeGuard mergeExitStats([&]() {
+            if(!stats_) return;
+#ifdef MULTIPROCESSING
+            std::unique_lock<std::mutex> jitLock;
+            if(!!jit) jitLock = jit->lock();
+#endif
+            stats_->addExitStats(exitStats);
+        });
+
         x64::CodeSegment* currentSegment = nullptr;
         x64::CodeSegment* nextSegment = process->fetchSegment(mmu_, cpu_.get(x64::R64::RIP));
 
@@ -132,39 +141,61 @@ namespace emulator {
             std::swap(currentSegment, nextSegment);
 #ifdef VM_BASICBLOCK_TELEMETRY
             ++basicBlockCount_[currentBasicBlock->start()];
+#endif
+#ifndef MULTIPROCESSING
+            // the code of the segment may have been written to since it was fetched
+            if(mmu_.hasWrittenCode()) {
+                process->invalidateWrittenCode(mmu_);
+                currentSegment = process->fetchSegment(mmu_, cpu_.get(x64::R64::RIP));
+            }
 #endif
             verify(currentSegment->start() == cpu_.get(x64::R64::RIP));
+#ifndef MULTIPROCESSING
+            // other workers could be running the code to evict
+            if(!!jit && jit->isCodeCacheFull()) process->collectJitCode();
+#endif
+#ifdef MULTIPROCESSING
+            // Compiling and linking blocks is done by one worker at a time,
+            // but the guest code runs without holding the jit.
+            std::unique_lock<std::mutex> jitLock;
+            if(!!jit) jitLock = jit->lock();
+#endif
             currentSegment->onCall(jit, compilationQueue);
             if(currentSegment->jitBasicBlock()) {
                 currentSegment->onJitCall();
+#ifdef MULTIPROCESSING
+                jitLock.unlock();
+#endif
                 jit->exec(&cpu_, &mmu_,
                           (x64::NativeExecPtr)currentSegment->jitBasicBlock()->callEntrypoint(),
                           time.ticks(),
                           (void**)&currentSegment,
-                          currentSegment->jitBasicBlock());
-                if(stats_) ++stats_->jitExits_;
-                updateJitStats(*currentSegment);
+                          currentSegment->jitBasicBlock(),
+                          time.instructionLimit());
+                ++exitStats.jitExits_;
+                updateJitStats(*currentSegment, cpu_.get(x64::R64::RIP), &exitStats);
             } else {
+                currentSegment->onCpuCall();
 #ifdef MULTIPROCESSING
-                if(currentSegment->basicBlock().hasAtomicInstruction()) {
-                    if(!thread->requestsAtomic()) {
-                        thread->enterAtomic();
-                        break;
-                    }
-                }
+                if(jitLock.owns_lock()) jitLock.unlock();
 #endif
-                currentSegment->onCpuCall();
                 cpu_.exec(currentSegment->basicBlock());
                 time.tick(currentSegment->basicBlock().instructions().size());
             }
+#ifdef MULTIPROCESSING
+            if(!!jit) jitLock = jit->lock();
+#endif
             nextSegment = findNextSegment();
 
             if(jit) {
+                if(endsWithIndirectBranch(*currentSegment) && !!nextSegment->jitBasicBlock()) {
+                    jit->addIndirectBranchTarget(nextSegment->start(), nextSegment->jitBasicBlock());
+                }
                 if(!!currentSegment->jitBasicBlock()
                 && currentSegment->basicBlock().endsWithFixedDestinationJump()
                 && !!nextSegment->jitBasicBlock()) {
                     if(jit->jitChainingEnabled()) currentSegment->tryPatch(*jit);
-                    if(stats_) ++stats_->avoidableExits_;
+                    ++exitStats.avoidableExits_;
                 }
                 if(currentSegment->basicBlock().endsWithDirectCall()
                     || currentSegment->basicBlock().endsWithIndirectCall()) {
@@ -231,49 +262,56 @@ namespace emulator {
         if(!!vm_) vm_->notifyStackChange(stackptr);
     }
 
-    void VM::updateJitStats(const x64::CodeSegment& seg) {
-        if(!stats_) return;
+    bool VM::endsWithIndirectBranch(const x64::CodeSegment& seg) {
+        auto lastInsn = seg.basicBlock().instructions().back().first.insn();
+        return lastInsn == x64::Insn::RET
+            || lastInsn == x64::Insn::CALLINDIRECT_RM64
+            || lastInsn == x64::Insn::JMP_RM64;
+    }
+
+    void VM::updateJitStats(const x64::CodeSegment& seg, [[maybe_unused]] u64 rip, x64::JitStats* stats) {
+        assert(!!stats);
         auto lastInsn = seg.basicBlock().instructions().back().first.insn();
         if(lastInsn == x64::Insn::JMP_U32) {
-            stats_->jitExitJmp_ += 1;
+            stats->jitExitJmp_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitJmp_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitJmp_.insert(rip);
 #endif
         }
         if(lastInsn == x64::Insn::JCC || lastInsn == x64::Insn::JE || lastInsn == x64::Insn::JNE) {
-            stats_->jitExitJcc_ += 1;
+            stats->jitExitJcc_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitJcc_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitJcc_.insert(rip);
 #endif
         }
         if(lastInsn == x64::Insn::CALLDIRECT) {
-            stats_->jitExitCall_ += 1;
+            stats->jitExitCall_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitCall_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitCall_.insert(rip);
 #endif
         }
         if(lastInsn == x64::Insn::SYSCALL) {
-            stats_->jitExitSyscall_ += 1;
+            stats->jitExitSyscall_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitSyscall_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitSyscall_.insert(rip);
 #endif
         }
         if(lastInsn == x64::Insn::RET) {
-            stats_->jitExitRet_ += 1;
+            stats->jitExitRet_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitRet_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitRet_.insert(rip);
 #endif
         }
         if(lastInsn == x64::Insn::CALLINDIRECT_RM64) {
-            stats_->jitExitCallRM64_ += 1;
+            stats->jitExitCallRM64_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitCallRM64_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitCallRM64_.insert(rip);
 #endif
         }
         if(lastInsn == x64::Insn::JMP_RM64) {
-            stats_->jitExitJmpRM64_ += 1;
+            stats->jitExitJmpRM64_ += 1;
 #ifdef VM_JIT_TELEMETRY
-            stats_->distinctJitExitJmpRM64_.insert(cpu_.get(x64::R64::RIP));
+            stats->distinctJitExitJmpRM64_.insert(rip);
 #endif
         }
     }
@@ -60,6 +60,6 @@ namespace emulator {
         callstack_ = other.callstack_;
         savedCpuState_ = other.savedCpuState_;
         savedJitState_ = other.savedJitState_;
-        std::fill(savedJitState_.callstack.begin(), savedJitState_.callstack.end(), nullptr);
+        std::fill(savedJitState_.callstack.begin(), savedJitState_.callstack.end(), x64::CallstackEntry{});
     }
 }
\ No newline at end of file
@@ -248,7 +248,7 @@ namespace host {
         return ImulResult<u64>{lower, upper, carry, overflow};
     }
 
-    CPUID cpuid(u32 a, u32 c) {
+    static CPUID hostCpuid(u32 a, u32 c) {
         CPUID s;
 #ifdef MSVC_COMPILER
         int cpuInfo[4] = { 0, 0, 0, 0 };
@@ -269,6 +269,11 @@ namespace host {
                     "xchgq %%rbx, %q1\n" : "=a" (s.a), "=r" (s.b), "=c" (s.c), "=d" (s.d)
                                         : "0" (a), "2" (c));
 #endif
+        return s;
+    }
+
+    CPUID cpuid(u32 a, u32 c) {
+        CPUID s = hostCpuid(a, c);
         if(a == 1) {
             // Pretend that we run on cpu 0
             s.b = s.b & 0x00FFFFFF;
@@ -315,6 +320,35 @@ namespace host {
         return familyId == 0b0110 || familyId == 0b1111;
     }
 
+    const HostFeatures& hostFeatures() {
+        static const HostFeatures features = []() {
+            HostFeatures f;
+            u32 maxLeaf = hostCpuid(0x0, 0x0).a;
+            CPUID leaf1 = hostCpuid(0x1, 0x0);
+            f.popcnt = leaf1.c & (1 << 23);
+            f.sse42 = leaf1.c & (1 << 20);
+            if(maxLeaf >= 7) {
+                CPUID leaf7 = hostCpuid(0x7, 0x0);
+                f.bmi1 = leaf7.b & (1 << 3);
+                f.bmi2 = leaf7.b & (1 << 8);
+            }
+            return f;
+        }();
+        return features;
+    }
+
+    bool cmpxchg16b(u128* ptr, u128* expected, u128 desired) {
+        bool exchanged = false;
+#ifdef MSVC_COMPILER
+        std::abort();
+#else
+        asm volatile("lock cmpxchg16b %1" : "=@ccz"(exchanged), "+m"(*ptr), "+a"(expected->lo), "+d"(expected->hi)
+                                          : "b"(desired.lo), "c"(desired.hi)
+                                          : "memory");
+#endif
+        return exchanged;
+    }
+
     XGETBV xgetbv(u32 c) {
         XGETBV s;
 #ifdef MSVC_COMPILER
@@ -10,6 +10,7 @@
 #include "kernel/linux/thread.h"
 #include "kernel/timers.h"
 #include "host/host.h"
+#include "x64/compiler/codecache.h"
 #include "x64/mmu.h"
 #include "scopeguard.h"
 #include "verify.h"
@@ -58,6 +59,26 @@ namespace kernel::gnulinux {
         optimizationLevel_ = level;
     }
 
+    void Kernel::setEnableJitTiers(bool enableJitTiers) {
+        enableJitTiers_ = enableJitTiers;
+    }
+
+    void Kernel::setJitThreads(int nbThreads) {
+        jitThreads_ = nbThreads;
+    }
+
+    void Kernel::setJitCodeCacheSize(unsigned int codeCacheSizeInMB) {
+        jitCodeCacheSizeInMB_ = codeCacheSizeInMB;
+    }
+
+    void Kernel::setJitCacheDirectory(const std::string& directory) {
+        jitCacheDirectory_ = directory;
+    }
+
+    void Kernel::setJitTelemetryPath(const std::string& path) {
+        jitTelemetryPath_ = path;
+    }
+
     void Kernel::setEnableShm(bool enableShm) {
         enableShm_ = enableShm;
     }
@@ -89,7 +110,22 @@ namespace kernel::gnulinux {
             mainProcess->setEnableJitChaining(isJitChainingEnabled());
             mainProcess->setEnableJitCallChaining(isJitCallChainingEnabled());
             mainProcess->setOptimizationLevel(optimizationLevel());
+            mainProcess->setEnableJitTiers(isJitTiersEnabled());
+            mainProcess->setJitThreads(jitThreads());
+            mainProcess->setJitCodeCacheLimit((u64)jitCodeCacheSize() * 1024 * 1024);
+            if(isJitEnabled() && !jitCacheDirectory().empty()) {
+                codeCache_ = x64::CodeCache::tryCreate(jitCacheDirectory());
+                if(!codeCache_) warn(fmt::format("Unable to use \"{}\" as jit cache directory", jitCacheDirectory()));
+                mainProcess->setCodeCache(codeCache_.get());
+            }
             mainProcess->setJitStatsLevel(jitStatsLevel());
+            if(!jitTelemetryPath().empty()) {
+                if(!x64::JitTelemetryReport::formatOf(jitTelemetryPath())) {
+                    warn(fmt::format("Unable to report jit telemetry to \"{}\": expected a .json or .csv file", jitTelemetryPath()));
+                } else {
+                    mainProcess->setJitTelemetryPath(jitTelemetryPath());
+                }
+            }
             scheduler().run();
             exitCode = mainThread->exitStatus();
             if(hasPanicked()) {
@@ -102,6 +138,13 @@ namespace kernel::gnulinux {
         return exitCode;
     }
 
+    x64::CodeCache* Kernel::sharedCodeCache() {
+        if(!isJitEnabled()) return nullptr;
+        // forked and exec'd processes reuse the code translated from the files they share with their parent
+        if(!codeCache_) codeCache_ = x64::CodeCache::createInMemory((u64)jitCodeCacheSize() * 1024 * 1024);
+        return codeCache_.get();
+    }
+
     void Kernel::panic() {
         hasPanicked_ = true;
         scheduler_->panic();
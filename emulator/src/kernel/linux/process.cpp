@@ -6,6 +6,8 @@
 #include "x64/compiler/compiler.h"
 #include "host/host.h"
 #include "fmt/format.h"
+#include <algorithm>
+#include <unordered_set>
 
 namespace kernel::gnulinux {
 
@@ -48,9 +50,12 @@ namespace kernel::gnulinux {
             fds_(fds),
             currentWorkDirectory_(cwd) {
         jit_ = x64::Jit::tryCreate();
+        if(!!jit_) jit_->setStats(&jitStats_);
     }
 
     Process::~Process() {
+        if(!!jit_) jit_->cancelPendingCompilations();
+        writeJitTelemetry();
         jitStats_.dump(jitStatsLevel());
         if(jitStatsLevel() > 0) {
             std::vector<const x64::CodeSegment*> segments;
@@ -101,7 +106,12 @@ namespace kernel::gnulinux {
         process->parent_ = this;
         if(jit_) {
             process->jit_ = jit_->clone();
+            if(!!process->jit_) process->jit_->setStats(&process->jitStats_);
         }
+        process->codeCache_ = codeCache_;
+        process->writableMappings_ = writableMappings_;
+        process->jitTelemetryPath_ = jitTelemetryPath_;
+        process->jitTelemetryNamedByPid_ = true;
         notifyChildCreated(process.get());
         return process;
     }
@@ -138,23 +148,21 @@ namespace kernel::gnulinux {
     }
 
     void Process::onRegionProtectionChange(u64 base, u64 length, BitFlags<x64::PROT> protBefore, BitFlags<x64::PROT> protAfter) {
+        bool wasExecutable = protBefore.test(x64::PROT::EXEC);
+        bool isExecutable = protAfter.test(x64::PROT::EXEC);
+        if(wasExecutable && isExecutable) {
+            // code that becomes writable is translated again, so that chained jumps into it check for writes
+            if(protBefore.test(x64::PROT::WRITE) || !protAfter.test(x64::PROT::WRITE)) return;
+            dropCodeSegments(base, length);
+            codeSegments_.reserve(base, base+length);
+            return;
+        }
         // if executable flag didn't change, we don't need to to anything
-        if(protBefore.test(x64::PROT::EXEC) == protAfter.test(x64::PROT::EXEC)) return;
+        if(wasExecutable == isExecutable) return;
 
-        if(!protAfter.test(x64::PROT::EXEC)) {
+        if(!isExecutable) {
             // if we become non-executable, purge the basic blocks
-            if(jitStatsLevel() >= 2) {
-                std::vector<const x64::CodeSegment*> segments;
-                codeSegments_.forEach(base, base+length, [&](const x64::CodeSegment& seg) {
-                    segments.push_back(&seg);
-                });
-                dumpJitTelemetry(segments);
-            }
-            codeSegments_.forEachMutable(base, base+length, [&](x64::CodeSegment& seg) {
-                codeSegmentsByAddress_.erase(seg.start());
-                seg.removeFromCaches();
-            });
-            codeSegments_.remove(base, base+length);
+            dropCodeSegments(base, length);
         } else {
             // if we become executable, reserve basic blocks
             codeSegments_.reserve(base, base+length);
@@ -163,7 +171,10 @@ namespace kernel::gnulinux {
 
     void Process::onRegionDestruction(u64 base, u64 length, BitFlags<x64::PROT> prot) {
         if(!prot.test(x64::PROT::EXEC)) return;
+        dropCodeSegments(base, length);
+    }
 
+    void Process::dropCodeSegments(u64 base, u64 length) {
         if(jitStatsLevel() >= 2) {
             std::vector<const x64::CodeSegment*> segments;
             codeSegments_.forEach(base, base+length, [&](const x64::CodeSegment& seg) {
@@ -171,11 +182,112 @@ namespace kernel::gnulinux {
             });
             dumpJitTelemetry(segments);
         }
+        if(!!jit_) jit_->cancelPendingCompilations();
+        recordJitTelemetry(base, base+length);
+        std::unordered_set<const x64::JitBasicBlock*> droppedBlocks;
         codeSegments_.forEachMutable(base, base+length, [&](x64::CodeSegment& seg) {
             codeSegmentsByAddress_.erase(seg.start());
-            seg.removeFromCaches();
+            seg.removeFromCaches(&droppedBlocks);
         });
         codeSegments_.remove(base, base+length);
+        forgetCodePages(base, base+length);
+        // the jitted code of the removed segments may still be referenced by other blocks
+        discardJitCode(droppedBlocks);
+    }
+
+    void Process::invalidateWrittenCode(x64::Mmu& mmu) {
+        writtenCodePages_.clear();
+        mmu.takeWrittenCodePages(&writtenCodePages_);
+        if(writtenCodePages_.empty()) return;
+
+        if(!!jit_) jit_->cancelPendingCompilations();
+        std::unordered_set<const x64::JitBasicBlock*> droppedBlocks;
+        std::vector<x64::CodeSegment*> removedSegments;
+        for(u64 page : writtenCodePages_) {
+            disassemblyCache_.invalidate(page, page + x64::Mmu::PAGE_SIZE);
+            auto it = segmentsByCodePage_.find(page);
+            if(it == segmentsByCodePage_.end()) continue;
+            for(u64 start : it->second) {
+                // segments spanning several pages may already be gone
+                auto segit = codeSegmentsByAddress_.find(start);
+                if(segit == codeSegmentsByAddress_.end()) continue;
+                x64::CodeSegment* seg = segit->second;
+                codeSegmentsByAddress_.erase(segit);
+                seg->removeFromCaches(&droppedBlocks);
+                removedSegments.push_back(seg);
+            }
+            segmentsByCodePage_.erase(it);
+        }
+        if(!jitTelemetryPath_.empty()) {
+            for(const x64::CodeSegment* seg : removedSegments) jitTelemetry_.add(*seg, functionName(seg->start()));
+        }
+        // only destroy the segments once no other segment refers to them
+        for(x64::CodeSegment* seg : removedSegments) {
+            [[maybe_unused]] auto segmentLeftToDie = codeSegments_.take(seg);
+        }
+        discardJitCode(droppedBlocks);
+    }
+
+    void Process::discardJitCode(const std::unordered_set<const x64::JitBasicBlock*>& droppedBlocks) {
+        if(!jit_ || droppedBlocks.empty()) return;
+        jit_->discard(droppedBlocks);
+        codeSegments_.forEachMutable([&](x64::CodeSegment& seg) {
+            seg.syncBlockLookupTable();
+        });
+        clearSavedJitCallstacks();
+    }
+
+    void Process::clearSavedJitCallstacks() {
+        // the callstacks of the other threads may go to any block
+        for(auto& thread : threads_) {
+            auto& jitState = thread->savedJitState();
+            std::fill(jitState.callstack.begin(), jitState.callstack.end(), x64::CallstackEntry{});
+        }
+    }
+
+    void Process::forgetCodePages(u64 base, u64 end) {
+        if(segmentsByCodePage_.empty()) return;
+        for(auto it = segmentsByCodePage_.begin(); it != segmentsByCodePage_.end();) {
+            if(base <= it->first && it->first < end) {
+                it = segmentsByCodePage_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void Process::collectJitCode() {
+        if(!jit_ || !jit_->isCodeCacheFull()) return;
+
+        // evict the coldest code until the cache is half full, so that collections stay rare
+        std::vector<x64::CodeSegment*> compiledSegments;
+        u64 liveSize = 0;
+        codeSegments_.forEachMutable([&](x64::CodeSegment& seg) {
+            if(!seg.jitBasicBlock()) return;
+            compiledSegments.push_back(&seg);
+            liveSize += seg.jitBasicBlock()->codeSize();
+        });
+        std::sort(compiledSegments.begin(), compiledSegments.end(), [](const x64::CodeSegment* a, const x64::CodeSegment* b) {
+            return a->calls() < b->calls();
+        });
+        u64 targetSize = jit_->codeCacheLimit() / 2;
+        for(x64::CodeSegment* seg : compiledSegments) {
+            if(liveSize <= targetSize) break;
+            liveSize -= seg->jitBasicBlock()->codeSize();
+            seg->evictJitBasicBlock();
+        }
+
+        // the blocks that no segment owns are gone: evicted, replaced by a higher tier, or from removed segments
+        std::unordered_set<const x64::JitBasicBlock*> liveBlocks;
+        codeSegments_.forEach([&](const x64::CodeSegment& seg) {
+            if(!!seg.jitBasicBlock()) liveBlocks.insert(seg.jitBasicBlock());
+        });
+        jit_->collect(liveBlocks);
+        codeSegments_.forEachMutable([&](x64::CodeSegment& seg) {
+            seg.syncBlockLookupTable();
+        });
+
+        clearSavedJitCallstacks();
     }
 
     x64::CodeSegment* Process::fetchSegment(x64::Mmu& mmu, u64 address) {
@@ -186,22 +298,90 @@ namespace kernel::gnulinux {
         if(it != codeSegmentsByAddress_.end()) {
             return it->second;
         } else {
-            x64::MmuBytecodeRetriever bytecodeRetriever(mmu, disassemblyCache_);
-            disassemblyCache_.getBasicBlock(address, &bytecodeRetriever, &blockInstructions_);
-            verify(!blockInstructions_.empty() && blockInstructions_.back().isBranch(), [&]() {
-                fmt::print("did not find bb exit branch for bb starting at {:#x}\n", address);
-            });
-            x64::BasicBlock cpuBb = x64::Cpu::createBasicBlock(blockInstructions_.data(), blockInstructions_.size());
-            verify(!cpuBb.instructions().empty(), "Cannot create empty basic block");
-            std::unique_ptr<x64::CodeSegment> seg = std::make_unique<x64::CodeSegment>(std::move(cpuBb));
-            x64::CodeSegment* segptr = seg.get();
-            u64 segstart = seg->start();
-            codeSegments_.add(segstart, std::move(seg));
-            codeSegmentsByAddress_[address] = segptr;
+            x64::CodeSegment* segptr = createSegment(mmu, address);
+            linkJumpTable(mmu, segptr);
             return segptr;
         }
     }
 
+    void Process::setCodeCache(x64::CodeCache* codeCache) {
+        if(codeCache == codeCache_) return;
+        codeCache_ = codeCache;
+        // the segments that are not compiled yet can still share their code
+        x64::Mmu mmu(addressSpace(), x64::Mmu::WITHOUT_SIDE_EFFECTS::YES);
+        codeSegments_.forEachMutable([&](x64::CodeSegment& seg) {
+            setCacheLocation(((const x64::Mmu&)mmu).findAddress(seg.start()), &seg);
+        });
+    }
+
+    void Process::rememberWritableMapping(u64 base, u64 length) {
+        writableMappings_.push_back(std::make_pair(base, base+length));
+    }
+
+    void Process::setCacheLocation(const x64::MmuRegion* region, x64::CodeSegment* seg) {
+        if(!codeCache_ || !region || region->name().empty()) return;
+        // code that may have been rewritten in place does not match the file anymore
+        if(region->prot().test(x64::PROT::WRITE)) return;
+        for(const auto& mapping : writableMappings_) {
+            if(seg->start() < mapping.second && mapping.first < seg->end()) return;
+        }
+        x64::CodeCacheFile* file = codeCache_->tryOpen(region->name());
+        if(!!file) seg->setCacheLocation(x64::CodeCacheLocation{file, region->base()});
+    }
+
+    x64::CodeSegment* Process::createSegment(x64::Mmu& mmu, u64 address) {
+        x64::MmuBytecodeRetriever bytecodeRetriever(mmu, disassemblyCache_);
+        disassemblyCache_.getBasicBlock(address, &bytecodeRetriever, &blockInstructions_);
+        verify(!blockInstructions_.empty() && blockInstructions_.back().isBranch(), [&]() {
+            fmt::print("did not find bb exit branch for bb starting at {:#x}\n", address);
+        });
+        x64::BasicBlock cpuBb = x64::Cpu::createBasicBlock(blockInstructions_.data(), blockInstructions_.size());
+        verify(!cpuBb.instructions().empty(), "Cannot create empty basic block");
+        std::unique_ptr<x64::CodeSegment> seg = std::make_unique<x64::CodeSegment>(std::move(cpuBb));
+        const x64::MmuRegion* region = ((const x64::Mmu&)mmu).findAddress(address);
+        setCacheLocation(region, seg.get());
+        if(!!region && region->prot().test(x64::PROT::WRITE)) seg->setWritable();
+        x64::CodeSegment* segptr = seg.get();
+        u64 segstart = seg->start();
+#ifndef MULTIPROCESSING
+        // the segment is dropped as soon as its code gets written to
+        mmu.protectCode(segstart, seg->end());
+        for(u64 page = x64::Mmu::pageRoundDown(segstart); page < seg->end(); page += x64::Mmu::PAGE_SIZE) {
+            segmentsByCodePage_[page].push_back(segstart);
+        }
+#endif
+        codeSegments_.add(segstart, std::move(seg));
+        codeSegmentsByAddress_[address] = segptr;
+        return segptr;
+    }
+
+    void Process::linkJumpTable(x64::Mmu& mmu, x64::CodeSegment* seg) {
+        std::optional<u64> table = seg->basicBlock().jumpTableAddress();
+        if(!table) return;
+        const x64::Mmu& constMmu = mmu;
+        const x64::MmuRegion* code = constMmu.findAddress(seg->start());
+        if(!code || !code->prot().test(x64::PROT::EXEC)) return;
+
+        // the table ends where its entries stop pointing into the code of the jump
+        std::vector<u64> targets;
+        for(u64 entry = table.value(); targets.size() < MAX_JUMP_TABLE_ENTRIES; entry += 8) {
+            const x64::MmuRegion* region = constMmu.findAddress(entry);
+            if(!region || !region->prot().test(x64::PROT::READ) || entry+8 > region->end()) break;
+            u64 target = mmu.read64(x64::Ptr64{entry});
+            if(!code->contains(target)) break;
+            targets.push_back(target);
+        }
+        if(targets.empty()) return;
+
+        // The entries may be data that only looks like a table: nothing is translated here.
+        // Targets that already have a segment are linked now, the others once the jump reaches them.
+        seg->setJumpTable(table.value(), targets);
+        for(u64 target : targets) {
+            auto it = codeSegmentsByAddress_.find(target);
+            if(it != codeSegmentsByAddress_.end()) seg->addSuccessor(it->second);
+        }
+    }
+
     void Process::dumpGraphviz(std::ostream& stream) const {
         stream << "digraph G {\n";
         std::unordered_map<void*, u32> counter;
@@ -274,6 +454,9 @@ namespace kernel::gnulinux {
     }
 
     void Process::prepareExec() {
+        // the code segments of the old program are about to go, their names with them
+        if(!!jit_) jit_->cancelPendingCompilations();
+        recordJitTelemetry();
         u64 size = [&]() -> u64 {
             x64::Mmu mmu(addressSpace());
             return mmu.memorySize();
@@ -293,14 +476,23 @@ namespace kernel::gnulinux {
         disassemblyCache_ = {};
         codeSegments_ = {};
         codeSegmentsByAddress_ = {};
+        segmentsByCodePage_ = {};
         symbolProvider_ = {};
         functionNameCache_ = {};
+        writableMappings_.clear();
         if(!!jit_) {
             bool jitChainingEnabled = jit_->jitChainingEnabled();
             bool jitCallChainingEnabled = jit_->jitCallChainingEnabled();
+            u32 compilationThreads = jit_->compilationThreads();
+            bool tieredCompilationEnabled = jit_->tieredCompilationEnabled();
+            u64 codeCacheLimit = jit_->codeCacheLimit();
             jit_ = x64::Jit::tryCreate();
+            jit_->setStats(&jitStats_);
             jit_->setEnableJitChaining(jitChainingEnabled);
             jit_->setEnableJitCallChaining(jitCallChainingEnabled);
+            jit_->setCompilationThreads(compilationThreads);
+            jit_->setTieredCompilation(tieredCompilationEnabled);
+            jit_->setCodeCacheLimit(codeCacheLimit);
         }
         children_ = {};
         exitedChildren_ = {};
@@ -308,6 +500,32 @@ namespace kernel::gnulinux {
 
 #define JIT_THRESHOLD 1024
 
+    void Process::recordJitTelemetry(u64 base, u64 end) {
+        if(jitTelemetryPath_.empty()) return;
+        codeSegments_.forEach(base, end, [&](const x64::CodeSegment& seg) {
+            jitTelemetry_.add(seg, functionName(seg.start()));
+        });
+    }
+
+    void Process::recordJitTelemetry() {
+        if(jitTelemetryPath_.empty()) return;
+        codeSegments_.forEach([&](const x64::CodeSegment& seg) {
+            jitTelemetry_.add(seg, functionName(seg.start()));
+        });
+    }
+
+    void Process::writeJitTelemetry() {
+        if(jitTelemetryPath_.empty()) return;
+        recordJitTelemetry();
+        std::string path = jitTelemetryPath_;
+        if(jitTelemetryNamedByPid_) {
+            // report.json becomes report.<pid>.json
+            size_t extension = path.rfind('.');
+            path.insert(extension, fmt::format(".{}", pid_));
+        }
+        if(!jitTelemetry_.tryWrite(path)) warn(fmt::format("Unable to write jit telemetry to {}", path));
+    }
+
     void Process::dumpJitTelemetry(const std::vector<const x64::CodeSegment*>& blocks) {
         if(blocks.empty()) return;
         std::vector<const x64::CodeSegment*> jittedBlocks;
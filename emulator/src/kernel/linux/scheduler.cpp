@@ -22,7 +22,6 @@ namespace kernel::gnulinux {
 
     struct TaggedVM {
         bool canRunSyscalls { false };
-        bool canRunAtomics { false };
     };
 
     Scheduler::Scheduler(Kernel& kernel) : kernel_(kernel) {
@@ -45,7 +44,6 @@ namespace kernel::gnulinux {
 
     std::unique_ptr<TaggedVM> Scheduler::createVM(const Worker& worker) {
         std::unique_ptr<TaggedVM> vm = std::make_unique<TaggedVM>();
-        vm->canRunAtomics = worker.canRunAtomic();
         vm->canRunSyscalls = worker.canRunSyscalls();
         return vm;
     }
@@ -69,14 +67,9 @@ namespace kernel::gnulinux {
                 Job job = jobOrCommand.job;
 
                 if(job.ring == RING::KERNEL) {
-                    assert(job.atomic == ATOMIC::NO);
                     runKernel(job.thread);
                 } else {
-                    if(job.atomic == ATOMIC::NO) {
-                        runUserspace(job.thread);
-                    } else {
-                        runUserspaceAtomic(job.thread);
-                    }
+                    runUserspace(job.thread);
                 }
 
             } catch(...) {
@@ -140,31 +133,6 @@ namespace kernel::gnulinux {
         // fmt::print(stderr, "{}: stop thread {}\n", worker.id, thread->description().tid);
     }
 
-    void Scheduler::runUserspaceAtomic(Thread* thread) {
-        std::unique_lock lock(schedulerMutex_);
-        ScopeGuard guard([&]() {
-            stopRunningThread(thread, lock);
-            syncThreadTimeSlice(thread, &lock);
-            --numRunningJobs_;
-            lock.unlock();
-            schedulerHasRunnableThread_.notify_all();
-        });
-        verify(numRunningJobs_ == 0, "jobs running while atomic");
-        ++numRunningJobs_;
-        // fmt::print(stderr, "{}: run thread {}\n", worker.id, thread->description().tid);
-        thread->time().setSlice(currentTime_.count(), ATOMIC_TIME_SLICE);
-
-        x64::Mmu mmu(thread->process()->addressSpace());
-        emulator::VM vm(mmu, thread->process()->jitStats());
-        Process::SymbolRetriever retriever(thread->process());
-        while(!thread->time().isStopAsked()) {
-            syncThreadTimeSlice(thread, &lock);
-            vm.execute(thread);
-        }
-        thread->resetAtomicRequest();
-        // fmt::print(stderr, "{}: stop thread {}\n", worker.id, thread->description().tid);
-    }
-
     void Scheduler::runKernel(Thread* thread) {
         std::unique_lock lock(schedulerMutex_);
         ScopeGuard guard([&]() {
@@ -231,21 +199,17 @@ namespace kernel::gnulinux {
             && runnableThreads_.empty();
     }
 
-    bool Scheduler::hasRunnableThread(bool canRunSyscalls, bool canRunAtomics) const {
-        auto isUserspaceJob = [](Job job) { return job.ring == RING::USERSPACE && job.atomic == ATOMIC::NO; };
-        auto isAtomicJob = [](Job job) { return job.ring == RING::USERSPACE && job.atomic == ATOMIC::YES; };
+    bool Scheduler::hasRunnableThread(bool canRunSyscalls) const {
+        auto isUserspaceJob = [](Job job) { return job.ring == RING::USERSPACE; };
         auto isKernelJob = [](Job job) { return job.ring == RING::KERNEL; };
 
         size_t nbUserspaceRunning = (size_t)std::count_if(runningJobs_.begin(), runningJobs_.end(), isUserspaceJob);
-        size_t nbAtomicRunning = (size_t)std::count_if(runningJobs_.begin(), runningJobs_.end(), isAtomicJob);
         size_t nbKernelRunning = (size_t)std::count_if(runningJobs_.begin(), runningJobs_.end(), isKernelJob);
 
-        auto isUserspaceThread = [](const Thread* thread) { return !thread->requestsSyscall() && !thread->requestsAtomic(); };
-        auto isAtomicThread = [](const Thread* thread) { return !thread->requestsSyscall() && thread->requestsAtomic(); };
+        auto isUserspaceThread = [](const Thread* thread) { return !thread->requestsSyscall(); };
         auto isKernelThread = [](const Thread* thread) { return thread->requestsSyscall(); };
 
         size_t nbUserspaceRunnable = (size_t)std::count_if(runnableThreads_.begin(), runnableThreads_.end(), isUserspaceThread);
-        size_t nbAtomicRunnable = (size_t)std::count_if(runnableThreads_.begin(), runnableThreads_.end(), isAtomicThread);
         size_t nbKernelRunnable = (size_t)std::count_if(runnableThreads_.begin(), runnableThreads_.end(), isKernelThread);
 
         if(canRunSyscalls) {
@@ -253,21 +217,10 @@ namespace kernel::gnulinux {
                 fmt::print(stderr, "HOW CAN WE HAVE 2 KERNEL THREADS RUNNING ???\n");
             }
             if(nbKernelRunnable > 0) {
-                return nbUserspaceRunning + nbAtomicRunning == 0;
-            }
-        }
-        if(canRunAtomics) {
-            if(nbAtomicRunning > 0) {
-                fmt::print(stderr, "HOW CAN WE HAVE 2 ATOMIC THREADS RUNNING ???\n");
-            }
-            // syscalls have priority
-            if(nbKernelRunning > 0 || nbKernelRunnable > 0) {
-                return false;
-            } else if(nbAtomicRunnable > 0) {
-                return nbUserspaceRunning + nbKernelRunning == 0;
+                return nbUserspaceRunning == 0;
             }
         }
-        if(nbKernelRunning + nbKernelRunnable + nbAtomicRunning + nbAtomicRunnable > 0) {
+        if(nbKernelRunning + nbKernelRunnable > 0) {
             return false;
         } else {
             return nbUserspaceRunnable > 0;
@@ -278,13 +231,13 @@ namespace kernel::gnulinux {
         std::unique_lock lock(schedulerMutex_);
         schedulerHasRunnableThread_.wait(lock, [&]{
             return kernel_.hasPanicked()     // something bad happened
-                || this->hasRunnableThread(vm->canRunSyscalls, vm->canRunAtomics)  // we want to run an available thread
+                || this->hasRunnableThread(vm->canRunSyscalls)  // we want to run an available thread
                 || this->allThreadsDead()     // we need to exit because all threads are dead
                 || this->allThreadsBlocked(); // we need to check unblocking conditions
         });
 
         assert(kernel_.hasPanicked()
-            || hasRunnableThread(vm->canRunSyscalls, vm->canRunAtomics)
+            || hasRunnableThread(vm->canRunSyscalls)
             || allThreadsDead()
             || allThreadsBlocked());
 
@@ -316,7 +269,7 @@ namespace kernel::gnulinux {
             fmt::print("DEADLOCK !\n");
             fmt::print("No thread is runnable in queue:\n");
             for(const auto& t : threads_) {
-                fmt::print("  {} syscall? : {}  atomic? : {} \n", t->toString(), t->requestsSyscall(), t->requestsAtomic());
+                fmt::print("  {} syscall? : {}\n", t->toString(), t->requestsSyscall());
             }
             for(const auto& blocker : futexBlockers_) {
                 fmt::print("  {}\n", blocker.toString());
@@ -339,19 +292,9 @@ namespace kernel::gnulinux {
             return nullptr;
         };
         
-        auto findAtomicUserspaceThread = [&]() -> Thread* {
-            for(Thread* thread : runnableThreads_) {
-                if(thread->requestsSyscall()) continue;
-                if(!thread->requestsAtomic()) continue;
-                return thread;
-            }
-            return nullptr;
-        };
-        
         auto findUserspaceThread = [&]() -> Thread* {
             for(Thread* thread : runnableThreads_) {
                 if(thread->requestsSyscall()) continue;
-                if(thread->requestsAtomic()) continue;
                 return thread;
             }
             return nullptr;
@@ -360,9 +303,6 @@ namespace kernel::gnulinux {
         // First we look for a thread trying to perform a syscall
         Thread* threadToRun = findKernelThread();
         
-        // If there are none, we look for a userspace thread that want to run alone (atomically)
-        if(!threadToRun) threadToRun = findAtomicUserspaceThread();
-
         // If there are none, we look for a thread that is runnable
         if(!threadToRun) threadToRun = findUserspaceThread();
 
@@ -385,12 +325,10 @@ namespace kernel::gnulinux {
         }
 
         RING ring = threadToRun->requestsSyscall() ? RING::KERNEL : RING::USERSPACE;
-        ATOMIC atomic = threadToRun->requestsAtomic() ? ATOMIC::YES : ATOMIC::NO;
 
         Job job {
             threadToRun,
             ring,
-            atomic,
         };
 
         auto it = std::find(runnableThreads_.begin(), runnableThreads_.end(), threadToRun);
@@ -440,6 +440,7 @@ namespace kernel::gnulinux {
                 verify(mmu_->mprotect(regionBase, length, saved) >= 0, "mprotect failed");
                 auto filename = kernel_.fs().filename(descriptor);
                 mmu_->setRegionName(regionBase, filename);
+                if(protFlags.test(x64::PROT::WRITE)) currentProcess_->rememberWritableMapping(regionBase, length);
                 return 0;
             });
         }
@@ -466,6 +467,15 @@ namespace kernel::gnulinux {
     int Sys::mprotect(x64::Ptr addr, size_t length, int prot) {
         BitFlags<x64::PROT> protFlags = BitFlags<x64::PROT>::fromIntegerType(prot);
         int ret = mmu_->mprotect(addr.address(), length, protFlags);
+        if(ret == 0 && protFlags.test(x64::PROT::WRITE)) {
+            // only file mappings may share their code, anonymous ones are not worth remembering
+            bool fileMapping = false;
+            mmu_->forAllRegions([&](const x64::MmuRegion& region) {
+                if(!region.intersectsRange(addr.address(), addr.address() + length)) return;
+                fileMapping |= !region.name().empty();
+            });
+            if(fileMapping) currentProcess_->rememberWritableMapping(addr.address(), length);
+        }
         if(kernel_.logSyscalls()) {
             bool protRead = protFlags.test(x64::PROT::READ);
             bool protWrite = protFlags.test(x64::PROT::WRITE);
@@ -955,6 +965,12 @@ namespace kernel::gnulinux {
         return ret;
     }
 
+    // The code cache is only worth having once a process has a child or another program to share code with
+    static void shareTranslatedCode(Kernel& kernel, Process* process) {
+        if(!process->jitEnabled()) return;
+        process->setCodeCache(kernel.sharedCodeCache());
+    }
+
     [[nodiscard]] static bool checkCloneFlags(const Host::CloneFlags& flags) {
         bool expected =
                 true
@@ -1038,6 +1054,7 @@ namespace kernel::gnulinux {
             verify(!cloneFlags.cloneFiles, "cloneFiles without cloneThread not supported");
             BitFlags<Process::CloneFlags> cflags;
             if(cloneFlags.cloneVm) cflags.add(Process::CloneFlags::VM);
+            shareTranslatedCode(kernel_, currentProcess_);
             Process* newProcess = [&]() -> Process* {
                 auto process = currentProcess_->clone(kernel_.processTable(), cflags);
                 verify(!!process, "Unable to create new process");
@@ -1130,6 +1147,7 @@ namespace kernel::gnulinux {
         int ret = 0;
 
         {
+            shareTranslatedCode(kernel_, currentProcess_);
             ExecVE execve(kernel_.processTable(), *currentProcess_, kernel_.scheduler(), kernel_.fs());
             ErrnoOr<Thread*> errnoOrThread = execve.exec(path, args, envs);
             ret = errnoOrThread.errorOr(0);
@@ -2518,6 +2536,7 @@ namespace kernel::gnulinux {
             verify(!cloneFlags.cloneFiles, "cloneFiles without cloneThread not supported");
             BitFlags<Process::CloneFlags> cflags;
             if(cloneFlags.cloneVm) cflags.add(Process::CloneFlags::VM);
+            shareTranslatedCode(kernel_, currentProcess_);
             Process* newProcess = [&]() -> Process* {
                 auto process = currentProcess_->clone(kernel_.processTable(), cflags);
                 verify(!!process, "Unable to create new process");
@@ -66,6 +66,30 @@ int main(int argc, char* argv[], char* envp[]) {
             .implicit_value(true)
             .nargs(0);
 
+    parser.add_argument("--nojittiers")
+            .help("compile blocks once at the requested optimization level, instead of starting with cheap code")
+            .default_value(false)
+            .implicit_value(true)
+            .nargs(0);
+
+    parser.add_argument("--jitthreads")
+            .help("Number of host threads compiling in the background (0 compiles on the executing thread)")
+            .default_value<int>(1)
+            .scan<'i', int>();
+
+    parser.add_argument("--jitmem")
+            .help("Amount of native code kept by the jit before cold code is evicted, and by the code shared between processes (in MB)")
+            .default_value<unsigned int>(256)
+            .scan<'u', unsigned int>();
+
+    parser.add_argument("--jitcache")
+            .help("Directory where compiled code is kept between runs (disabled when empty)")
+            .default_value(std::string(""));
+
+    parser.add_argument("--jittelemetry")
+            .help("File where the compilation of each block is reported, as .json or .csv (disabled when empty)")
+            .default_value(std::string(""));
+
     parser.add_argument("-j")
             .help("Number of cores")
 #ifndef MULTIPROCESSING
@@ -138,6 +162,11 @@ int main(int argc, char* argv[], char* envp[]) {
         if(parser["-O1"] == true) {
             emulator.setOptimizationLevel(1);
         }
+        emulator.setEnableJitTiers(parser["--nojittiers"] == false);
+        emulator.setJitThreads(parser.get<int>("--jitthreads"));
+        emulator.setJitCodeCacheSize(parser.get<unsigned int>("--jitmem"));
+        emulator.setJitCacheDirectory(parser.get<std::string>("--jitcache"));
+        emulator.setJitTelemetryPath(parser.get<std::string>("--jittelemetry"));
         if(parser["--shm"] == true) {
             emulator.setEnableShm(true);
         }
@@ -11,34 +11,34 @@
 namespace x64 {
 
     static void sameFlags([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b) {
-        assert(a.carry      == b.carry);
-        assert(a.overflow   == b.overflow);
+        assert(a.carry()      == b.carry());
+        assert(a.overflow()   == b.overflow());
         assert(a.parity()   == b.parity());
-        assert(a.sign       == b.sign);
-        assert(a.zero       == b.zero);
+        assert(a.sign()       == b.sign());
+        assert(a.zero()       == b.zero());
     }
 
     static void sameCarryOverflow([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b) {
-        assert(a.carry    == b.carry);
-        assert(a.overflow == b.overflow);
+        assert(a.carry()    == b.carry());
+        assert(a.overflow() == b.overflow());
     }
 
     static void sameCarryZero([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b) {
-        assert(a.carry == b.carry);
-        assert(a.zero  == b.zero);
+        assert(a.carry() == b.carry());
+        assert(a.zero()  == b.zero());
     }
 
     static void sameCarry([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b) {
-        assert(a.carry == b.carry);
+        assert(a.carry() == b.carry());
     }
 
     static void sameZero([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b) {
-        assert(a.zero == b.zero);
+        assert(a.zero() == b.zero());
     }
 
     static void sameCarryZeroParity([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b) {
-        assert(a.carry    == b.carry);
-        assert(a.zero     == b.zero);
+        assert(a.carry()    == b.carry());
+        assert(a.zero()     == b.zero());
         assert(a.parity() == b.parity());
     }
 
@@ -355,11 +355,11 @@ namespace x64 {
     template<typename U>
     auto sameFlagsShift([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b, U src) {
         if((src & 0x3f) == 0) return;
-        assert(a.carry    == b.carry);
+        assert(a.carry()    == b.carry());
         assert(a.parity() == b.parity());
-        assert(a.sign     == b.sign);
-        assert(a.zero     == b.zero);
-        if(src == 1) assert(a.overflow == b.overflow);
+        assert(a.sign()     == b.sign());
+        assert(a.zero()     == b.zero());
+        if(src == 1) assert(a.overflow() == b.overflow());
     }
 
     u8 CheckedCpuImpl::shl8(u8 dst, u8 src, Flags* flags) {
@@ -391,11 +391,11 @@ namespace x64 {
     template<typename U>
     auto sameFlagsShiftd([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b, U count) {
         if((count & 0x3f) == 0) return;
-        assert(a.carry    == b.carry);
+        assert(a.carry()    == b.carry());
         assert(a.parity() == b.parity());
-        assert(a.sign     == b.sign);
-        assert(a.zero     == b.zero);
-        if(count == 1) assert(a.overflow == b.overflow);
+        assert(a.sign()     == b.sign());
+        assert(a.zero()     == b.zero());
+        if(count == 1) assert(a.overflow() == b.overflow());
     }
 
     u32 CheckedCpuImpl::shld32(u32 dst, u32 src, u8 count, Flags* flags) {
@@ -432,8 +432,8 @@ namespace x64 {
     template<typename U>
     auto sameFlagsRotate([[maybe_unused]] const Flags& a, [[maybe_unused]] const Flags& b, U count) {
         if(count == 0) return;
-        assert(a.carry  == b.carry);
-        if(count == 1) assert(a.overflow == b.overflow);
+        assert(a.carry()  == b.carry());
+        if(count == 1) assert(a.overflow() == b.overflow());
     }
  
     u8 CheckedCpuImpl::rcl8(u8 val, u8 count, Flags* flags) {
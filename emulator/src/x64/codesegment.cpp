@@ -1,8 +1,13 @@
 #include "x64/codesegment.h"
 #include "verify.h"
+#include <algorithm>
 #include <ostream>
 
 #define JIT_THRESHOLD 1024
+#define TIER_UP_THRESHOLD 0x4000
+#define TRACE_MAX_BLOCKS 8
+#define TRACE_EDGE_BIAS 8
+#define LOOP_SEARCH_MAX_SEGMENTS 64
 
 namespace x64 {
 
@@ -83,6 +88,24 @@ namespace x64 {
                 variableDestinationInfo_.nextStart.data(),
                 (const JitBasicBlock**)variableDestinationInfo_.nextJit.data(),
                 variableDestinationInfo_.nextCount.data());
+        for(size_t i = 0; i < jumpTableInfo_.next.size(); ++i) {
+            jumpTableInfo_.nextJit[i] = !!jumpTableInfo_.next[i] ? jumpTableInfo_.next[i]->jitBasicBlock() : nullptr;
+        }
+        jitBasicBlock_->syncJumpTable(
+                jumpTableInfo_.base,
+                jumpTableInfo_.nextJit.size(),
+                jumpTableInfo_.nextStart.data(),
+                (const JitBasicBlock**)jumpTableInfo_.nextJit.data());
+    }
+
+    void CodeSegment::setJumpTable(u64 base, const std::vector<u64>& targets) {
+        verify(!endsWithFixedDestinationJump_, "Fixed destination jumps do not use jump tables");
+        jumpTableInfo_.base = base;
+        jumpTableInfo_.nextStart = targets;
+        jumpTableInfo_.next.assign(targets.size(), nullptr);
+        jumpTableInfo_.nextJit.assign(targets.size(), nullptr);
+        for(const auto& successor : successors_) jumpTableInfo_.addSuccessor(successor.second);
+        syncBlockLookupTable();
     }
 
     void CodeSegment::addSuccessor(CodeSegment* other) {
@@ -92,6 +115,7 @@ namespace x64 {
         auto res = successors_.insert(std::make_pair(other->start(), other));
         if(res.second && !endsWithFixedDestinationJump_) {
             variableDestinationInfo_.addSuccessor(other);
+            jumpTableInfo_.addSuccessor(other);
             syncBlockLookupTable();
         }
         other->predecessors_.insert(std::make_pair(start(), this));
@@ -108,6 +132,14 @@ namespace x64 {
         ret = other;
     }
 
+    void CodeSegment::ReturnDestinationInfo::removeReturn(CodeSegment* other) {
+        if(ret == other) ret = nullptr;
+    }
+
+    void CodeSegment::removeReturn(CodeSegment* other) {
+        returnDestinationInfo_.removeReturn(other);
+    }
+
     void CodeSegment::removePredecessor(CodeSegment* other) {
         predecessors_.erase(other->start());
     }
@@ -133,24 +165,114 @@ namespace x64 {
         nextCount.clear();
     }
 
-    void CodeSegment::removeSucessor(CodeSegment* other) {
+    void CodeSegment::JumpTableInfo::addSuccessor(CodeSegment* other) {
+        // a segment may come back at the address of a dropped one
+        for(size_t i = 0; i < next.size(); ++i) {
+            if(!next[i] && nextStart[i] == other->start()) next[i] = other;
+        }
+    }
+
+    void CodeSegment::JumpTableInfo::removeSuccessor(CodeSegment* other) {
+        // the entries stay in place, they now miss
+        std::replace(next.begin(), next.end(), other, (CodeSegment*)nullptr);
+    }
+
+    void CodeSegment::removeSucessor(CodeSegment* other, std::unordered_set<const JitBasicBlock*>* droppedBlocks) {
         if(endsWithFixedDestinationJump_) {
             fixedDestinationInfo_.removeSuccessor(other);
         } else {
             variableDestinationInfo_.removeSuccessor(other);
+            jumpTableInfo_.removeSuccessor(other);
             syncBlockLookupTable();
         }
         successors_.erase(other->start());
+        // a new segment may appear at the same address, and read the flags
+        dropCodeRelyingOnDeadFlags(droppedBlocks);
+        auto traceHeads = traceHeads_;
+        for(CodeSegment* head : traceHeads) head->dropCodeRelyingOnDeadFlags(droppedBlocks);
+    }
+
+    void CodeSegment::dropCodeRelyingOnDeadFlags(std::unordered_set<const JitBasicBlock*>* droppedBlocks) {
+        assert(!!droppedBlocks);
+        if(!reliesOnDeadFlags_) return;
+        // chained code, the callstack and the lookup tables may still lead to the native code
+        if(!!jitBasicBlock_) droppedBlocks->insert(jitBasicBlock_);
+        removeTrace();
+        jitBasicBlock_ = nullptr;
+        reliesOnDeadFlags_ = false;
+        compilationAttempted_ = false;
+        tierUpAttempted_ = false;
     }
 
-    void CodeSegment::removeFromCaches() {
-        for(auto prev : predecessors_) prev.second->removeSucessor(this);
+    void CodeSegment::removeFromCaches(std::unordered_set<const JitBasicBlock*>* droppedBlocks) {
+        assert(!!droppedBlocks);
+        if(!!jitBasicBlock_) droppedBlocks->insert(jitBasicBlock_);
+        removeTrace();
+        auto traceHeads = std::move(traceHeads_);
+        traceHeads_.clear();
+        for(CodeSegment* head : traceHeads) {
+            if(!!head->jitBasicBlock_) droppedBlocks->insert(head->jitBasicBlock_);
+            head->removeTrace();
+        }
+        for(auto prev : predecessors_) prev.second->removeSucessor(this, droppedBlocks);
         predecessors_.clear();
         for(auto succ : successors_) succ.second->removePredecessor(this);
         successors_.clear();
-        for(auto prev : callPredecessors_) prev.second->removeCallPredecessor(this);
+        for(auto prev : callPredecessors_) prev.second->removeReturn(this);
         callPredecessors_.clear();
+        if(!!returnDestinationInfo_.ret) returnDestinationInfo_.ret->removeCallPredecessor(this);
+        returnDestinationInfo_.ret = nullptr;
+        pendingCompilation_ = {};
+        jitBasicBlock_ = nullptr;
+        reliesOnDeadFlags_ = false;
+    }
+
+    void CodeSegment::evictJitBasicBlock() {
+        if(!jitBasicBlock_) return;
+        // keep counting the calls made through the native code
+        calls_ += jitBasicBlock_->calls();
+        removeTrace();
         jitBasicBlock_ = nullptr;
+        reliesOnDeadFlags_ = false;
+        compilationAttempted_ = false;
+        tierUpAttempted_ = false;
+        tier_ = Jit::Tier::OPTIMIZED;
+        callsForCompilation_ = JIT_THRESHOLD;
+        pendingCompilation_ = {};
+    }
+
+    void CodeSegment::removeTrace() {
+        if(trace_.empty()) return;
+        for(CodeSegment* seg : trace_) {
+            seg->traceHeads_.erase(std::remove(seg->traceHeads_.begin(), seg->traceHeads_.end(), this), seg->traceHeads_.end());
+        }
+        trace_.clear();
+        // the native code contains the other segments, it cannot be used anymore
+        jitBasicBlock_ = nullptr;
+        reliesOnDeadFlags_ = false;
+    }
+
+    std::vector<CodeSegment*> CodeSegment::findTrace() const {
+        std::vector<CodeSegment*> trace;
+        const CodeSegment* current = this;
+        while(trace.size()+1 < TRACE_MAX_BLOCKS) {
+            if(!current->cpuBasicBlock_.endsWithFixedDestinationJump()) break;
+            const FixedDestinationInfo& info = current->fixedDestinationInfo_;
+            CodeSegment* next = info.next[0];
+            if(!next) break;
+            // only follow edges that are (almost) always taken
+            if(info.nextCount[0] < TRACE_EDGE_BIAS * info.nextCount[1]) break;
+            // loops are closed by chaining the exit back to the entry
+            if(next == this) break;
+            if(std::find(trace.begin(), trace.end(), next) != trace.end()) break;
+            // code that may be rewritten is only entered through jumps that check the tick limit
+            if(next->writable_) break;
+            // the trace exits through the last segment, its exits must be patchable
+            if(!next->endsWithFixedDestinationJump_) break;
+            trace.push_back(next);
+            current = next;
+        }
+        return trace;
     }
 
     size_t CodeSegment::size() const {
@@ -159,6 +281,8 @@ namespace x64 {
 
     void CodeSegment::onCall(Jit* jit, CompilationQueue& compilationQueue) {
         if(!jit) return;
+        if(!!pendingCompilation_.request) tryInstallCompilation(*jit);
+        tryTierUp(*jit);
         compilationQueue.process(*jit, this);
     }
 
@@ -171,23 +295,31 @@ namespace x64 {
     }
 
     void CodeSegment::tryCompile(Jit& jit, CompilationQueue& queue) {
+        if(!compilationAttempted_ && !cacheLookupAttempted_ && !!cacheLocation_.file) {
+            // code that another process already translated from the same file is not worth interpreting first
+            cacheLookupAttempted_ = true;
+            if(tryLoadFromCache(jit, findTrace())) {
+                compilationAttempted_ = true;
+                return;
+            }
+        }
         if(calls_ < callsForCompilation_) {
             callsForCompilation_ /= 2;
             return;
         }
         if(!compilationAttempted_) {
-            jitBasicBlock_ = jit.tryCompile(cpuBasicBlock_, this);
-
-            if(!!jitBasicBlock_) {
-                if(jit.jitChainingEnabled()) {
-                    tryPatch(jit);
-                    for(auto prev : predecessors_) {
-                        prev.second->tryPatch(jit);
-                    }
-                    for(auto prev : callPredecessors_) {
-                        prev.second->tryPatch(jit);
-                    }
-                }
+            if(tryLoadFromCache(jit, findTrace())) {
+                // nothing to compile
+            } else {
+                // baseline code is compiled one segment at a time, traces come with the optimized tier.
+                // Code that goes to the on-disk cache is optimized right away, its cost is paid once across runs.
+                bool persistent = !!cacheLocation_.file && cacheLocation_.file->isPersistent();
+                bool baseline = jit.tieredCompilationEnabled() && !persistent;
+                Jit::Tier tier = baseline ? Jit::Tier::BASELINE : Jit::Tier::OPTIMIZED;
+                std::vector<CodeSegment*> trace;
+                if(tier == Jit::Tier::OPTIMIZED) trace = findTrace();
+                // the queue is full, try again on the next call
+                if(!tryCompileAtTier(jit, std::move(trace), tier)) return;
             }
             compilationAttempted_ = true;
             if(!!fixedDestinationInfo_.next[0]) queue.push(fixedDestinationInfo_.next[0]);
@@ -199,10 +331,256 @@ namespace x64 {
         }
     }
 
+    void CodeSegment::traceBasicBlocks(const std::vector<CodeSegment*>& trace, std::vector<const BasicBlock*>* basicBlocks, std::vector<const void*>* segments) const {
+        basicBlocks->clear();
+        segments->clear();
+        basicBlocks->push_back(&cpuBasicBlock_);
+        segments->push_back(this);
+        for(const CodeSegment* seg : trace) {
+            basicBlocks->push_back(&seg->cpuBasicBlock_);
+            segments->push_back(seg);
+        }
+    }
+
+    CodeCacheLocation CodeSegment::traceCacheLocation(const std::vector<CodeSegment*>& trace) const {
+        // cached code is only valid as long as all of its blocks come from the same mapping
+        for(const CodeSegment* seg : trace) {
+            if(!(seg->cacheLocation_ == cacheLocation_)) return {};
+        }
+        return cacheLocation_;
+    }
+
+    bool CodeSegment::flagsLiveIn() const {
+        return cpuBasicBlock_.readsIncomingFlags() || !cpuBasicBlock_.overwritesFlags();
+    }
+
+    bool CodeSegment::areFlagsLiveOut(const std::vector<CodeSegment*>& trace) const {
+        // The flags are dead when every place the code may exit to overwrites them before reading them.
+        // Only exits to fixed destinations that have already been discovered can be checked.
+        auto isLiveAt = [](const CodeSegment* seg, u64 address) {
+            for(const CodeSegment* next : seg->fixedDestinationInfo_.next) {
+                if(!!next && next->start() == address) return next->flagsLiveIn();
+            }
+            return true;
+        };
+        for(size_t i = 0; i <= trace.size(); ++i) {
+            const CodeSegment* seg = (i == 0) ? this : trace[i-1];
+            const CodeSegment* nextInTrace = (i < trace.size()) ? trace[i] : nullptr;
+            const X64Instruction& last = seg->cpuBasicBlock_.instructions().back().first;
+            std::array<u64, 2> exits;
+            size_t nbExits = 0;
+            switch(last.insn()) {
+                case Insn::JMP_U32: exits[nbExits++] = last.op0<u32>(); break;
+                case Insn::JE:
+                case Insn::JNE: {
+                    exits[nbExits++] = last.op0<u64>();
+                    exits[nbExits++] = last.nextAddress();
+                    break;
+                }
+                case Insn::JCC: {
+                    exits[nbExits++] = last.op1<u64>();
+                    exits[nbExits++] = last.nextAddress();
+                    break;
+                }
+                case Insn::CALLDIRECT: exits[nbExits++] = last.op0<u64>(); break;
+                default: return true;
+            }
+            for(size_t e = 0; e < nbExits; ++e) {
+                // staying in the trace is covered by the liveness of the trace itself
+                if(!!nextInTrace && nextInTrace->start() == exits[e]) continue;
+                if(isLiveAt(seg, exits[e])) return true;
+            }
+        }
+        return false;
+    }
+
+    bool CodeSegment::tryLoadFromCache(Jit& jit, std::vector<CodeSegment*> trace) {
+        if(!cacheLocation_.file) return false;
+        std::vector<const BasicBlock*> basicBlocks;
+        std::vector<const void*> segments;
+        JitBasicBlock* loaded = nullptr;
+        bool flagsLiveOut = true;
+        if(!trace.empty() && !!traceCacheLocation(trace).file) {
+            traceBasicBlocks(trace, &basicBlocks, &segments);
+            flagsLiveOut = areFlagsLiveOut(trace);
+            loaded = jit.tryLoadFromCache(basicBlocks, segments, cacheLocation_, flagsLiveOut);
+        }
+        if(!loaded) {
+            trace.clear();
+            traceBasicBlocks({}, &basicBlocks, &segments);
+            flagsLiveOut = areFlagsLiveOut({});
+            loaded = jit.tryLoadFromCache(basicBlocks, segments, cacheLocation_, flagsLiveOut);
+        }
+        if(!loaded) return false;
+        // only optimized code is stored in the cache
+        install(jit, loaded, std::move(trace), !flagsLiveOut, Jit::Tier::OPTIMIZED);
+        return true;
+    }
+
+    bool CodeSegment::tryCompileAtTier(Jit& jit, std::vector<CodeSegment*> trace, Jit::Tier tier) {
+        if(jit.compilationThreads() > 0) return trySubmitCompilation(jit, std::move(trace), tier);
+        // baseline code is cheap to produce again, it is not worth caching
+        bool cacheable = (tier != Jit::Tier::BASELINE);
+        JitBasicBlock* compiled = nullptr;
+        bool flagsLiveOut = true;
+        if(!trace.empty()) {
+            std::vector<const BasicBlock*> basicBlocks;
+            std::vector<const void*> segments;
+            traceBasicBlocks(trace, &basicBlocks, &segments);
+            flagsLiveOut = areFlagsLiveOut(trace);
+            compiled = jit.tryCompileTrace(basicBlocks, segments, cacheable ? traceCacheLocation(trace) : CodeCacheLocation{}, flagsLiveOut, tier);
+        }
+        if(!compiled) {
+            trace.clear();
+            flagsLiveOut = areFlagsLiveOut({});
+            compiled = jit.tryCompile(cpuBasicBlock_, this, cacheable ? cacheLocation_ : CodeCacheLocation{}, flagsLiveOut, tier);
+        }
+        telemetry_ = jit.lastCompileTelemetry();
+        if(!!compiled) install(jit, compiled, std::move(trace), !flagsLiveOut, tier);
+        return true;
+    }
+
+    void CodeSegment::tryTierUp(Jit& jit) {
+        if(!jitBasicBlock_ || tier_ != Jit::Tier::BASELINE) return;
+        if(tierUpAttempted_ || !!pendingCompilation_.request) return;
+        if(jitBasicBlock_->calls() < TIER_UP_THRESHOLD) return;
+        // the baseline code keeps running until the optimized one is ready
+        if(!tryCompileAtTier(jit, findTrace(), Jit::Tier::OPTIMIZED)) return;
+        tierUpAttempted_ = true;
+    }
+
+    void CodeSegment::install(Jit& jit, JitBasicBlock* compiled, std::vector<CodeSegment*> trace, bool reliesOnDeadFlags, Jit::Tier tier) {
+        verify(!!compiled);
+        if(JitBasicBlock* old = jitBasicBlock_) {
+            removeTrace();
+            calls_ += old->calls();
+            retargetPredecessors(jit, old, compiled);
+            jit.replace(old, compiled);
+        }
+        jitBasicBlock_ = compiled;
+        reliesOnDeadFlags_ = reliesOnDeadFlags;
+        tier_ = tier;
+        if(!trace.empty()) setTrace(std::move(trace));
+        onCompiled(jit);
+    }
+
+    void CodeSegment::retargetPredecessors(Jit& jit, const JitBasicBlock* from, const JitBasicBlock* to) {
+        auto retarget = [&](CodeSegment* seg) {
+            if(!!seg->jitBasicBlock_) seg->jitBasicBlock_->retarget(from, to, jit.compiler());
+            // traces going through the predecessor may exit through it
+            for(CodeSegment* head : seg->traceHeads_) {
+                if(!!head->jitBasicBlock_) head->jitBasicBlock_->retarget(from, to, jit.compiler());
+            }
+        };
+        for(auto prev : predecessors_) retarget(prev.second);
+        for(auto prev : callPredecessors_) retarget(prev.second);
+    }
+
+    void CodeSegment::setTrace(std::vector<CodeSegment*> trace) {
+        trace_ = std::move(trace);
+        for(CodeSegment* seg : trace_) seg->traceHeads_.push_back(this);
+    }
+
+    void CodeSegment::onCompiled(Jit& jit) {
+        if(!jitBasicBlock_) return;
+        if(!jit.jitChainingEnabled()) return;
+        tryPatch(jit);
+        for(auto prev : predecessors_) {
+            prev.second->tryPatch(jit);
+        }
+        for(auto prev : callPredecessors_) {
+            prev.second->tryPatch(jit);
+        }
+    }
+
+    bool CodeSegment::trySubmitCompilation(Jit& jit, std::vector<CodeSegment*> trace, Jit::Tier tier) {
+        std::vector<const BasicBlock*> basicBlocks;
+        std::vector<const void*> segments;
+        traceBasicBlocks(trace, &basicBlocks, &segments);
+        CodeCacheLocation location = (tier != Jit::Tier::BASELINE) ? traceCacheLocation(trace) : CodeCacheLocation{};
+        auto request = jit.trySubmitCompilation(basicBlocks, segments, location, areFlagsLiveOut(trace), tier);
+        if(!request) return false;
+        pendingCompilation_.request = std::move(request);
+        pendingCompilation_.trace = std::move(trace);
+        pendingCompilation_.tier = tier;
+        return true;
+    }
+
+    void CodeSegment::tryInstallCompilation(Jit& jit) {
+        bool isStale = jit.isStale(*pendingCompilation_.request);
+        if(!isStale && !pendingCompilation_.request->isDone()) return;
+        PendingCompilation pending;
+        std::swap(pending.request, pendingCompilation_.request);
+        std::swap(pending.trace, pendingCompilation_.trace);
+        pending.tier = pendingCompilation_.tier;
+        auto retryLater = [&]() {
+            if(!!jitBasicBlock_) {
+                tierUpAttempted_ = false;
+            } else {
+                compilationAttempted_ = false;
+            }
+        };
+        if(isStale) {
+            // segments were removed since the request was submitted, the trace may not exist anymore
+            retryLater();
+            return;
+        }
+        u32 compiledBasicBlocks = pending.request->compiledBasicBlocks;
+        if(compiledBasicBlocks > 1) {
+            pending.trace.resize(compiledBasicBlocks-1);
+        } else {
+            pending.trace.clear();
+        }
+        bool reliesOnDeadFlags = !pending.request->compiledWithFlagsLiveOut;
+        if(reliesOnDeadFlags && areFlagsLiveOut(pending.trace)) {
+            // a successor was replaced while compiling, compile again
+            retryLater();
+            return;
+        }
+        telemetry_ = pending.request->telemetry;
+        JitBasicBlock* compiled = jit.tryInstall(pending.request.get());
+        if(!compiled) return;
+        install(jit, compiled, std::move(pending.trace), reliesOnDeadFlags, pending.tier);
+    }
+
     void CodeSegment::tryPatch(Jit& jit) {
+        tryPatchJitBasicBlock(jit);
+        // traces going through this segment may exit through it
+        for(CodeSegment* head : traceHeads_) head->tryPatchJitBasicBlock(jit);
+    }
+
+    bool CodeSegment::closesLoop(const CodeSegment* next) const {
+        // Chained code only returns to the vm through unpatched exits.
+        // Every cycle of chained blocks must check the tick limit on at least one of its edges:
+        // the edge that completes a cycle is the last one patched, and sees the others.
+        std::vector<const CodeSegment*> visited;
+        std::vector<const CodeSegment*> toVisit { next };
+        while(!toVisit.empty()) {
+            const CodeSegment* seg = toVisit.back();
+            toVisit.pop_back();
+            if(seg == this) return true;
+            if(!seg->jitBasicBlock_) continue;
+            if(std::find(visited.begin(), visited.end(), seg) != visited.end()) continue;
+            // too far to tell, assume the worst
+            if(visited.size() >= LOOP_SEARCH_MAX_SEGMENTS) return true;
+            visited.push_back(seg);
+            // chained code leaves a block through the exits of its last segment
+            const CodeSegment* exit = seg->exitSegment();
+            for(const CodeSegment* succ : exit->fixedDestinationInfo_.next) {
+                if(!!succ) toVisit.push_back(succ);
+            }
+            // calls come back through the callstack
+            if(!!exit->returnDestinationInfo_.ret) toVisit.push_back(exit->returnDestinationInfo_.ret);
+        }
+        return false;
+    }
+
+    void CodeSegment::tryPatchJitBasicBlock(Jit& jit) {
         if(!jitBasicBlock_) return;
         if(jitBasicBlock_->needsPatching()) {
-            u64 continuingBlockAddress = end();
+            // a trace leaves through the exit of its last segment
+            const CodeSegment* exit = exitSegment();
+            u64 continuingBlockAddress = exit->end();
 
             auto tryPatchCallstack = [&](CodeSegment* next) {
                 if(!next) return;
@@ -211,7 +589,7 @@ namespace x64 {
                     jitBasicBlock_->tryPatchPushCallstack(pendingPatch, next->jitBasicBlock(), jit.compiler());
                 });
             };
-            tryPatchCallstack(returnDestinationInfo_.ret);
+            tryPatchCallstack(exit->returnDestinationInfo_.ret);
 
             auto tryPatchJump = [&](CodeSegment* next) {
                 if(!next) return;
@@ -219,11 +597,12 @@ namespace x64 {
                 // We patch calls before patching jumps because otherwise we will never patch the calls !
                 if(jitBasicBlock_->needsCallPatching()) return;
                 jitBasicBlock_->forAllPendingJumpPatches(next->start() == continuingBlockAddress, [&](std::optional<size_t>* pendingPatch) {
-                    jitBasicBlock_->tryPatchJump(pendingPatch, next->jitBasicBlock(), jit.compiler());
+                    bool checksTickLimit = next->writable_ || closesLoop(next);
+                    jitBasicBlock_->tryPatchJump(pendingPatch, next->jitBasicBlock(), checksTickLimit, jit.compiler());
                 });
             };
-            tryPatchJump(fixedDestinationInfo_.next[0]);
-            tryPatchJump(fixedDestinationInfo_.next[1]);
+            tryPatchJump(exit->fixedDestinationInfo_.next[0]);
+            tryPatchJump(exit->fixedDestinationInfo_.next[1]);
         }
         syncBlockLookupTable();
     }
@@ -0,0 +1,169 @@
+#include "x64/codewritewatch.h"
+#include "x64/mmu.h"
+#include "host/hostmemory.h"
+#include "verify.h"
+#include <mutex>
+
+namespace x64 {
+
+    // The watches of all the address spaces, looked up by the signal handler.
+    // Chunks are only ever appended, so that the handler can walk them without locking.
+    struct WatchChunk {
+        static constexpr size_t SIZE = 64;
+        std::array<std::atomic<CodeWriteWatch*>, SIZE> slots {};
+        std::atomic<WatchChunk*> next { nullptr };
+    };
+    static WatchChunk watches_;
+    static std::mutex watchesGuard_;
+    static bool handlerInstalled_ { false };
+    static struct sigaction previousAction_;
+
+    CodeWriteWatch::CodeWriteWatch(const AddressSpace& addressSpace) :
+            addressSpace_(addressSpace),
+            states_(addressSpace.memoryRange_.size() / PAGE_SIZE) {
+        registerWatch(this);
+    }
+
+    CodeWriteWatch::~CodeWriteWatch() {
+        unregisterWatch(this);
+    }
+
+    void CodeWriteWatch::registerWatch(CodeWriteWatch* watch) {
+        std::unique_lock lock(watchesGuard_);
+        if(!handlerInstalled_) {
+            struct sigaction action;
+            action.sa_sigaction = &CodeWriteWatch::onSegmentationFault;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = SA_SIGINFO;
+            int ret = sigaction(SIGSEGV, &action, &previousAction_);
+            verify(ret == 0, "Unable to install the code write handler");
+            handlerInstalled_ = true;
+        }
+        WatchChunk* chunk = &watches_;
+        while(true) {
+            for(auto& slot : chunk->slots) {
+                CodeWriteWatch* expected = nullptr;
+                if(slot.compare_exchange_strong(expected, watch)) return;
+            }
+            WatchChunk* next = chunk->next.load(std::memory_order_relaxed);
+            if(!next) {
+                // every process translating code has a watch, there is no bound on their number
+                next = new WatchChunk;
+                chunk->next.store(next, std::memory_order_release);
+            }
+            chunk = next;
+        }
+    }
+
+    void CodeWriteWatch::unregisterWatch(CodeWriteWatch* watch) {
+        std::unique_lock lock(watchesGuard_);
+        for(WatchChunk* chunk = &watches_; !!chunk; chunk = chunk->next.load(std::memory_order_relaxed)) {
+            for(auto& slot : chunk->slots) {
+                CodeWriteWatch* expected = watch;
+                if(slot.compare_exchange_strong(expected, nullptr)) return;
+            }
+        }
+    }
+
+    void CodeWriteWatch::onSegmentationFault(int sig, siginfo_t* info, void* context) {
+        const u8* hostAddress = (const u8*)info->si_addr;
+        for(WatchChunk* chunk = &watches_; !!chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+            for(auto& slot : chunk->slots) {
+                CodeWriteWatch* watch = slot.load(std::memory_order_acquire);
+                if(!watch) continue;
+                if(watch->tryHandleWrite(hostAddress)) return;
+            }
+        }
+        // Not a write to translated code: this fault is for the previous handler, which stays behind this one.
+        if(previousAction_.sa_flags & SA_SIGINFO) {
+            previousAction_.sa_sigaction(sig, info, context);
+        } else if(previousAction_.sa_handler != SIG_DFL && previousAction_.sa_handler != SIG_IGN) {
+            previousAction_.sa_handler(sig);
+        } else {
+            // the default action ends the process: the faulting access runs again without any handler
+            signal(SIGSEGV, SIG_DFL);
+        }
+    }
+
+    bool CodeWriteWatch::tryHandleWrite(const u8* hostAddress) {
+        const u8* base = addressSpace_.memoryRange_.base();
+        if(hostAddress < base || hostAddress >= base + addressSpace_.memoryRange_.size()) return false;
+        u64 address = (u64)(hostAddress - base);
+        u64 pageIndex = address / PAGE_SIZE;
+        if(pageIndex >= states_.size()) return false;
+        if(states_[pageIndex].load(std::memory_order_relaxed) != WATCHED) return false;
+
+        // the guest may not be allowed to write there at all
+        if(address >= addressSpace_.firstUnlookupdableAddress) return false;
+        const MmuRegion* region = addressSpace_.regionLookup[pageIndex];
+        if(!region || !region->prot().test(PROT::WRITE)) return false;
+
+        u64 page = pageIndex * PAGE_SIZE;
+        if(!protect(page, false)) return false;
+        states_[pageIndex].store(WRITTEN, std::memory_order_relaxed);
+        size_t index = nbWrittenPages_.fetch_add(1, std::memory_order_relaxed);
+        if(index < WRITTEN_PAGES_CAPACITY) {
+            writtenPages_[index] = page;
+        } else {
+            writtenPagesOverflow_.store(true, std::memory_order_relaxed);
+        }
+        hasWrittenPages_.store(true, std::memory_order_relaxed);
+        if(u64* tickLimit = tickLimit_.load(std::memory_order_relaxed)) *tickLimit = 0;
+        return true;
+    }
+
+    bool CodeWriteWatch::protect(u64 address, bool watched) const {
+        BitFlags<host::HostMemory::Protection> prot;
+        prot.add(host::HostMemory::Protection::READ);
+        if(!watched) prot.add(host::HostMemory::Protection::WRITE);
+        u8* ptr = (u8*)addressSpace_.memoryRange_.base() + address;
+        return host::HostMemory::tryProtectVirtualMemoryRange(ptr, PAGE_SIZE, prot);
+    }
+
+    void CodeWriteWatch::watch(u64 address, bool writable) {
+        u64 pageIndex = address / PAGE_SIZE;
+        verify(pageIndex < states_.size(), "Cannot watch page outside of the address space");
+        if(writable) {
+            bool didProtect = protect(pageIndex * PAGE_SIZE, true);
+            verify(didProtect, "Unable to protect code page");
+        }
+        if(states_[pageIndex].exchange(WATCHED, std::memory_order_relaxed) == UNWATCHED) ++watchedPages_;
+    }
+
+    void CodeWriteWatch::unwatch(u64 begin, u64 end) {
+        if(watchedPages_ == 0) return;
+        for(u64 pageIndex = begin / PAGE_SIZE; pageIndex < end / PAGE_SIZE && pageIndex < states_.size(); ++pageIndex) {
+            if(states_[pageIndex].exchange(UNWATCHED, std::memory_order_relaxed) == UNWATCHED) continue;
+            --watchedPages_;
+        }
+    }
+
+    void CodeWriteWatch::rewatch(u64 begin, u64 end) {
+        if(watchedPages_ == 0) return;
+        for(u64 pageIndex = begin / PAGE_SIZE; pageIndex < end / PAGE_SIZE && pageIndex < states_.size(); ++pageIndex) {
+            if(states_[pageIndex].load(std::memory_order_relaxed) != WATCHED) continue;
+            bool didProtect = protect(pageIndex * PAGE_SIZE, true);
+            verify(didProtect, "Unable to protect code page");
+        }
+    }
+
+    void CodeWriteWatch::takeWrittenPages(std::vector<u64>* pages) {
+        assert(!!pages);
+        if(!hasWrittenPages_.exchange(false, std::memory_order_relaxed)) return;
+        size_t nbWrittenPages = nbWrittenPages_.exchange(0, std::memory_order_relaxed);
+        bool overflow = writtenPagesOverflow_.exchange(false, std::memory_order_relaxed);
+        auto take = [&](u64 pageIndex) {
+            // the page may have been unwatched since
+            if(states_[pageIndex].load(std::memory_order_relaxed) != WRITTEN) return;
+            states_[pageIndex].store(UNWATCHED, std::memory_order_relaxed);
+            --watchedPages_;
+            pages->push_back(pageIndex * PAGE_SIZE);
+        };
+        if(!overflow) {
+            for(size_t i = 0; i < nbWrittenPages; ++i) take(writtenPages_[i] / PAGE_SIZE);
+        } else {
+            for(u64 pageIndex = 0; pageIndex < states_.size(); ++pageIndex) take(pageIndex);
+        }
+    }
+
+}
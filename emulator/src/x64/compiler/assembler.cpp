@@ -40,6 +40,7 @@ namespace x64 {
     void Assembler::clear() {
         code_.clear();
         labels_.clear();
+        imm64Offsets_.clear();
     }
 
     void Assembler::write8(u8 value) {
@@ -145,6 +146,7 @@ namespace x64 {
     void Assembler::mov(R64 dst, u64 imm) {
         write8((u8)(0x48 | (((u8)dst >= 8) ? 1 : 0)));
         write8((u8)(0xb8 + encodeRegister(dst)));
+        imm64Offsets_.push_back(code_.size());
         write64(imm);
     }
 
@@ -382,6 +384,42 @@ namespace x64 {
         }
     }
 
+    void Assembler::add(R32 dst, const M32& src) {
+        return opRegMem({ 0x03 }, dst, src, REX::NONE);
+    }
+
+    void Assembler::add(R64 dst, const M64& src) {
+        return opRegMem({ 0x03 }, dst, src, REX::W);
+    }
+
+    void Assembler::add(const M32& dst, R32 src) {
+        return opRegMem({ 0x01 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::add(const M64& dst, R64 src) {
+        return opRegMem({ 0x01 }, src, dst, REX::W);
+    }
+
+    void Assembler::add(const M32& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)0, dst, REX::NONE);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)0, dst, REX::NONE);
+            write32((u32)imm);
+        }
+    }
+
+    void Assembler::add(const M64& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)0, dst, REX::W);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)0, dst, REX::W);
+            write32((u32)imm);
+        }
+    }
+
     void Assembler::adc(R32 dst, R32 src) {
         if(((u8)src >= 8) || ((u8)dst >= 8)) {
             write8((u8)(0x40 | (((u8)src >= 8) ? 4 : 0) | (((u8)dst >= 8) ? 1 : 0)));
@@ -494,6 +532,42 @@ namespace x64 {
         }
     }
 
+    void Assembler::sub(R32 dst, const M32& src) {
+        return opRegMem({ 0x2b }, dst, src, REX::NONE);
+    }
+
+    void Assembler::sub(R64 dst, const M64& src) {
+        return opRegMem({ 0x2b }, dst, src, REX::W);
+    }
+
+    void Assembler::sub(const M32& dst, R32 src) {
+        return opRegMem({ 0x29 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::sub(const M64& dst, R64 src) {
+        return opRegMem({ 0x29 }, src, dst, REX::W);
+    }
+
+    void Assembler::sub(const M32& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)5, dst, REX::NONE);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)5, dst, REX::NONE);
+            write32((u32)imm);
+        }
+    }
+
+    void Assembler::sub(const M64& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)5, dst, REX::W);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)5, dst, REX::W);
+            write32((u32)imm);
+        }
+    }
+
     void Assembler::sbb(R8 dst, R8 src) {
         write8((u8)(0x40 | (((u8)src >= 8) ? 4 : 0) | (((u8)dst >= 8) ? 1 : 0)));
         write8((u8)(0x18));
@@ -622,6 +696,42 @@ namespace x64 {
         }
     }
 
+    void Assembler::cmp(R32 lhs, const M32& rhs) {
+        return opRegMem({ 0x3b }, lhs, rhs, REX::NONE);
+    }
+
+    void Assembler::cmp(R64 lhs, const M64& rhs) {
+        return opRegMem({ 0x3b }, lhs, rhs, REX::W);
+    }
+
+    void Assembler::cmp(const M32& lhs, R32 rhs) {
+        return opRegMem({ 0x39 }, rhs, lhs, REX::NONE);
+    }
+
+    void Assembler::cmp(const M64& lhs, R64 rhs) {
+        return opRegMem({ 0x39 }, rhs, lhs, REX::W);
+    }
+
+    void Assembler::cmp(const M32& lhs, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)7, lhs, REX::NONE);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)7, lhs, REX::NONE);
+            write32((u32)imm);
+        }
+    }
+
+    void Assembler::cmp(const M64& lhs, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)7, lhs, REX::W);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)7, lhs, REX::W);
+            write32((u32)imm);
+        }
+    }
+
     void Assembler::shl_cl(R32 lhs) {
         if((u8)lhs >= 8) {
             write8((u8)(0x40 | (((u8)lhs >= 8) ? 1 : 0)));
@@ -1257,6 +1367,42 @@ namespace x64 {
         write32((u32)imm);
     }
 
+    void Assembler::and_(R32 dst, const M32& src) {
+        return opRegMem({ 0x23 }, dst, src, REX::NONE);
+    }
+
+    void Assembler::and_(R64 dst, const M64& src) {
+        return opRegMem({ 0x23 }, dst, src, REX::W);
+    }
+
+    void Assembler::and_(const M32& dst, R32 src) {
+        return opRegMem({ 0x21 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::and_(const M64& dst, R64 src) {
+        return opRegMem({ 0x21 }, src, dst, REX::W);
+    }
+
+    void Assembler::and_(const M32& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)4, dst, REX::NONE);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)4, dst, REX::NONE);
+            write32((u32)imm);
+        }
+    }
+
+    void Assembler::and_(const M64& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)4, dst, REX::W);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)4, dst, REX::W);
+            write32((u32)imm);
+        }
+    }
+
     void Assembler::or_(R8 dst, R8 src) {
         write8(0x66);
         if((u8)dst >= 8 || (u8)src >= 8) {
@@ -1325,6 +1471,42 @@ namespace x64 {
         write32((u32)imm);
     }
 
+    void Assembler::or_(R32 dst, const M32& src) {
+        return opRegMem({ 0x0b }, dst, src, REX::NONE);
+    }
+
+    void Assembler::or_(R64 dst, const M64& src) {
+        return opRegMem({ 0x0b }, dst, src, REX::W);
+    }
+
+    void Assembler::or_(const M32& dst, R32 src) {
+        return opRegMem({ 0x09 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::or_(const M64& dst, R64 src) {
+        return opRegMem({ 0x09 }, src, dst, REX::W);
+    }
+
+    void Assembler::or_(const M32& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)1, dst, REX::NONE);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)1, dst, REX::NONE);
+            write32((u32)imm);
+        }
+    }
+
+    void Assembler::or_(const M64& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)1, dst, REX::W);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)1, dst, REX::W);
+            write32((u32)imm);
+        }
+    }
+
     void Assembler::xor_(R8 dst, R8 src) {
         verify(dst == R8::R8B || dst == R8::R9B);
         verify(src == R8::R8B || src == R8::R9B);
@@ -1394,6 +1576,42 @@ namespace x64 {
         write32((u32)imm);
     }
 
+    void Assembler::xor_(R32 dst, const M32& src) {
+        return opRegMem({ 0x33 }, dst, src, REX::NONE);
+    }
+
+    void Assembler::xor_(R64 dst, const M64& src) {
+        return opRegMem({ 0x33 }, dst, src, REX::W);
+    }
+
+    void Assembler::xor_(const M32& dst, R32 src) {
+        return opRegMem({ 0x31 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::xor_(const M64& dst, R64 src) {
+        return opRegMem({ 0x31 }, src, dst, REX::W);
+    }
+
+    void Assembler::xor_(const M32& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)6, dst, REX::NONE);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)6, dst, REX::NONE);
+            write32((u32)imm);
+        }
+    }
+
+    void Assembler::xor_(const M64& dst, i32 imm) {
+        if((i8)imm == imm) {
+            opRegMem({ 0x83 }, (R64)6, dst, REX::W);
+            write8((u8)imm);
+        } else {
+            opRegMem({ 0x81 }, (R64)6, dst, REX::W);
+            write32((u32)imm);
+        }
+    }
+
     void Assembler::not_(R32 dst) {
         if((u8)dst >= 8) {
             write8((u8)(0x40 | (((u8)dst >= 8) ? 1 : 0) ));
@@ -1515,6 +1733,23 @@ namespace x64 {
         write8((u8)(0b11000000 | (encodeRegister(src) << 3) | encodeRegister(dst)));
     }
 
+    void Assembler::xchg(const M8& dst, R8 src) {
+        return opRegMem({ 0x86 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::xchg(const M16& dst, R16 src) {
+        write8(0x66);
+        return opRegMem({ 0x87 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::xchg(const M32& dst, R32 src) {
+        return opRegMem({ 0x87 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::xchg(const M64& dst, R64 src) {
+        return opRegMem({ 0x87 }, src, dst, REX::W);
+    }
+
     void Assembler::cmpxchg(R32 dst, R32 src) {
         if((u8)dst >= 8 || (u8)src >= 8) {
             write8((u8)(0x40 | (((u8)src >= 8) ? 4 : 0) | (((u8)dst >= 8) ? 1 : 0) ));
@@ -1531,6 +1766,232 @@ namespace x64 {
         write8((u8)(0b11000000 | (encodeRegister(src) << 3) | encodeRegister(dst)));
     }
 
+    void Assembler::lockadd(const M8& dst, R8 src) {
+        write8(0xf0);
+        return opRegMem({ 0x00 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockadd(const M8& dst, i8 imm) {
+        write8(0xf0);
+        opRegMem({ 0x80 }, (R64)0, dst, REX::NONE);
+        write8((u8)imm);
+    }
+
+    void Assembler::lockadd(const M16& dst, R16 src) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0x01 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockadd(const M16& dst, i16 imm) {
+        write8(0xf0);
+        write8(0x66);
+        opRegMem({ 0x81 }, (R64)0, dst, REX::NONE);
+        write16((u16)imm);
+    }
+
+    void Assembler::lockadd(const M32& dst, R32 src) {
+        write8(0xf0);
+        return opRegMem({ 0x01 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockadd(const M32& dst, i32 imm) {
+        write8(0xf0);
+        opRegMem({ 0x81 }, (R64)0, dst, REX::NONE);
+        write32((u32)imm);
+    }
+
+    void Assembler::lockadd(const M64& dst, R64 src) {
+        write8(0xf0);
+        return opRegMem({ 0x01 }, src, dst, REX::W);
+    }
+
+    void Assembler::lockadd(const M64& dst, i32 imm) {
+        write8(0xf0);
+        opRegMem({ 0x81 }, (R64)0, dst, REX::W);
+        write32((u32)imm);
+    }
+
+    void Assembler::locksub(const M8& dst, R8 src) {
+        write8(0xf0);
+        return opRegMem({ 0x28 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::locksub(const M8& dst, i8 imm) {
+        write8(0xf0);
+        opRegMem({ 0x80 }, (R64)5, dst, REX::NONE);
+        write8((u8)imm);
+    }
+
+    void Assembler::locksub(const M16& dst, R16 src) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0x29 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::locksub(const M16& dst, i16 imm) {
+        write8(0xf0);
+        write8(0x66);
+        opRegMem({ 0x81 }, (R64)5, dst, REX::NONE);
+        write16((u16)imm);
+    }
+
+    void Assembler::locksub(const M32& dst, R32 src) {
+        write8(0xf0);
+        return opRegMem({ 0x29 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::locksub(const M32& dst, i32 imm) {
+        write8(0xf0);
+        opRegMem({ 0x81 }, (R64)5, dst, REX::NONE);
+        write32((u32)imm);
+    }
+
+    void Assembler::locksub(const M64& dst, R64 src) {
+        write8(0xf0);
+        return opRegMem({ 0x29 }, src, dst, REX::W);
+    }
+
+    void Assembler::locksub(const M64& dst, i32 imm) {
+        write8(0xf0);
+        opRegMem({ 0x81 }, (R64)5, dst, REX::W);
+        write32((u32)imm);
+    }
+
+    void Assembler::lockor(const M8& dst, R8 src) {
+        write8(0xf0);
+        return opRegMem({ 0x08 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockor(const M8& dst, i8 imm) {
+        write8(0xf0);
+        opRegMem({ 0x80 }, (R64)1, dst, REX::NONE);
+        write8((u8)imm);
+    }
+
+    void Assembler::lockor(const M16& dst, R16 src) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0x09 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockor(const M16& dst, i16 imm) {
+        write8(0xf0);
+        write8(0x66);
+        opRegMem({ 0x81 }, (R64)1, dst, REX::NONE);
+        write16((u16)imm);
+    }
+
+    void Assembler::lockor(const M32& dst, R32 src) {
+        write8(0xf0);
+        return opRegMem({ 0x09 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockor(const M32& dst, i32 imm) {
+        write8(0xf0);
+        opRegMem({ 0x81 }, (R64)1, dst, REX::NONE);
+        write32((u32)imm);
+    }
+
+    void Assembler::lockor(const M64& dst, R64 src) {
+        write8(0xf0);
+        return opRegMem({ 0x09 }, src, dst, REX::W);
+    }
+
+    void Assembler::lockor(const M64& dst, i32 imm) {
+        write8(0xf0);
+        opRegMem({ 0x81 }, (R64)1, dst, REX::W);
+        write32((u32)imm);
+    }
+
+    void Assembler::lockinc(const M8& dst) {
+        write8(0xf0);
+        return opRegMem({ 0xfe }, (R64)0, dst, REX::NONE);
+    }
+
+    void Assembler::lockinc(const M16& dst) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0xff }, (R64)0, dst, REX::NONE);
+    }
+
+    void Assembler::lockinc(const M32& dst) {
+        write8(0xf0);
+        return opRegMem({ 0xff }, (R64)0, dst, REX::NONE);
+    }
+
+    void Assembler::lockinc(const M64& dst) {
+        write8(0xf0);
+        return opRegMem({ 0xff }, (R64)0, dst, REX::W);
+    }
+
+    void Assembler::lockdec(const M8& dst) {
+        write8(0xf0);
+        return opRegMem({ 0xfe }, (R64)1, dst, REX::NONE);
+    }
+
+    void Assembler::lockdec(const M16& dst) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0xff }, (R64)1, dst, REX::NONE);
+    }
+
+    void Assembler::lockdec(const M32& dst) {
+        write8(0xf0);
+        return opRegMem({ 0xff }, (R64)1, dst, REX::NONE);
+    }
+
+    void Assembler::lockdec(const M64& dst) {
+        write8(0xf0);
+        return opRegMem({ 0xff }, (R64)1, dst, REX::W);
+    }
+
+    void Assembler::lockbts(const M16& dst, R16 src) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0x0f, 0xab }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockbts(const M32& dst, R32 src) {
+        write8(0xf0);
+        return opRegMem({ 0x0f, 0xab }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockbts(const M64& dst, R64 src) {
+        write8(0xf0);
+        return opRegMem({ 0x0f, 0xab }, src, dst, REX::W);
+    }
+
+    void Assembler::lockbts(const M16& dst, u8 imm) {
+        write8(0xf0);
+        write8(0x66);
+        opRegMem({ 0x0f, 0xba }, (R64)5, dst, REX::NONE);
+        write8(imm);
+    }
+
+    void Assembler::lockbts(const M32& dst, u8 imm) {
+        write8(0xf0);
+        opRegMem({ 0x0f, 0xba }, (R64)5, dst, REX::NONE);
+        write8(imm);
+    }
+
+    void Assembler::lockbts(const M64& dst, u8 imm) {
+        write8(0xf0);
+        opRegMem({ 0x0f, 0xba }, (R64)5, dst, REX::W);
+        write8(imm);
+    }
+
+    void Assembler::lockcmpxchg(const M8& dst, R8 src) {
+        write8(0xf0);
+        return opRegMem({ 0x0f, 0xb0 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockcmpxchg(const M16& dst, R16 src) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0x0f, 0xb1 }, src, dst, REX::NONE);
+    }
+
     void Assembler::lockcmpxchg(const M32& dst, R32 src) {
         write8(0xf0);
         return opRegMem({ 0x0f, 0xb1 }, src, dst, REX::NONE);
@@ -1541,11 +2002,32 @@ namespace x64 {
         return opRegMem({ 0x0f, 0xb1 }, src, dst, REX::W);
     }
 
+    void Assembler::lockcmpxchg16b(const M128& dst) {
+        write8(0xf0);
+        return opRegMem({ 0x0f, 0xc7 }, (R64)1, dst, REX::W);
+    }
+
+    void Assembler::lockxadd(const M8& dst, R8 src) {
+        write8(0xf0);
+        return opRegMem({ 0x0f, 0xc0 }, src, dst, REX::NONE);
+    }
+
+    void Assembler::lockxadd(const M16& dst, R16 src) {
+        write8(0xf0);
+        write8(0x66);
+        return opRegMem({ 0x0f, 0xc1 }, src, dst, REX::NONE);
+    }
+
     void Assembler::lockxadd(const M32& dst, R32 src) {
         write8(0xf0);
         return opRegMem({ 0x0f, 0xc1 }, src, dst, REX::NONE);
     }
 
+    void Assembler::lockxadd(const M64& dst, R64 src) {
+        write8(0xf0);
+        return opRegMem({ 0x0f, 0xc1 }, src, dst, REX::W);
+    }
+
     void Assembler::cwde() {
         write8(0x98);
     }
@@ -1633,6 +2115,11 @@ namespace x64 {
             code_[jumpPosition+2] = (u8)((offset >> 16) & 0xFF);
             code_[jumpPosition+3] = (u8)((offset >> 24) & 0xFF);
         }
+        for(size_t jumpPosition : label.shortJumpsToMe) {
+            i64 offset = (i64)label.positionInCode - (i64)jumpPosition - 1;
+            verify(offset >= -128 && offset < 128, "short jump out of range");
+            code_[jumpPosition] = (u8)(offset & 0xFF);
+        }
     }
 
     void Assembler::bsf(R32 dst, R32 src) {
@@ -1672,6 +2159,73 @@ namespace x64 {
         write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
     }
 
+    void Assembler::tzcnt(R64 dst, R64 src) {
+        write8(0xf3);
+        write8((u8)(0x48 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        write8((u8)0x0f);
+        write8((u8)0xbc);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::popcnt(R32 dst, R32 src) {
+        write8(0xf3);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0xb8);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::popcnt(R64 dst, R64 src) {
+        write8(0xf3);
+        write8((u8)(0x48 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        write8((u8)0x0f);
+        write8((u8)0xb8);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::vex0F38(VexPrefix prefix, REX rex, u8 opcode, u8 reg, u8 vvvv, u8 rm) {
+        // R, X and B are stored inverted, as is vvvv
+        write8(0xc4);
+        write8((u8)(((reg >= 8) ? 0 : 0x80) | 0x40 | ((rm >= 8) ? 0 : 0x20) | 0b00010));
+        write8((u8)(((rex == REX::W) ? 0x80 : 0) | ((~vvvv & 0xf) << 3) | (u8)prefix));
+        write8(opcode);
+        write8((u8)(0b11000000 | ((reg & 0x7) << 3) | (rm & 0x7)));
+    }
+
+    void Assembler::shlx(R32 dst, R32 src, R32 count) {
+        vex0F38(VexPrefix::P66, REX::NONE, 0xf7, (u8)dst, (u8)count, (u8)src);
+    }
+
+    void Assembler::shlx(R64 dst, R64 src, R64 count) {
+        vex0F38(VexPrefix::P66, REX::W, 0xf7, (u8)dst, (u8)count, (u8)src);
+    }
+
+    void Assembler::shrx(R32 dst, R32 src, R32 count) {
+        vex0F38(VexPrefix::PF2, REX::NONE, 0xf7, (u8)dst, (u8)count, (u8)src);
+    }
+
+    void Assembler::shrx(R64 dst, R64 src, R64 count) {
+        vex0F38(VexPrefix::PF2, REX::W, 0xf7, (u8)dst, (u8)count, (u8)src);
+    }
+
+    void Assembler::sarx(R32 dst, R32 src, R32 count) {
+        vex0F38(VexPrefix::PF3, REX::NONE, 0xf7, (u8)dst, (u8)count, (u8)src);
+    }
+
+    void Assembler::sarx(R64 dst, R64 src, R64 count) {
+        vex0F38(VexPrefix::PF3, REX::W, 0xf7, (u8)dst, (u8)count, (u8)src);
+    }
+
+    void Assembler::andn(R32 dst, R32 src1, R32 src2) {
+        vex0F38(VexPrefix::NONE, REX::NONE, 0xf2, (u8)dst, (u8)src1, (u8)src2);
+    }
+
+    void Assembler::andn(R64 dst, R64 src1, R64 src2) {
+        vex0F38(VexPrefix::NONE, REX::W, 0xf2, (u8)dst, (u8)src1, (u8)src2);
+    }
+
     void Assembler::set(Cond cond, R8 dst) {
         if((u8)dst >= 8) {
             write8((u8)(0x40 | (((u8)dst >= 8) ? 1 : 0) ));
@@ -2372,6 +2926,16 @@ namespace x64 {
         write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
     }
 
+    void Assembler::movmskpd(R32 dst, XMM src) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x50);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
     void Assembler::movq2dq(XMM dst, MMX src) {
         write8(0xf3);
         if((u8)dst >= 8 || (u8)src >= 8) {
@@ -3722,6 +4286,50 @@ namespace x64 {
         write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
     }
 
+    void Assembler::pmaxuw(XMM dst, XMM src) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0x3E);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::pmaxud(XMM dst, XMM src) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0x3F);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::pminuw(XMM dst, XMM src) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0x3A);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::pminud(XMM dst, XMM src) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0x3B);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
     void Assembler::pmovzxbw(XMM dst, XMM src) {
         write8(0x66);
         if((u8)dst >= 8 || (u8)src >= 8) {
@@ -3826,6 +4434,193 @@ namespace x64 {
         write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
     }
 
+    void Assembler::pcmpistri(XMM dst, XMM src, u8 imm) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x3a);
+        write8((u8)0x63);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+        write8(imm);
+    }
+
+    void Assembler::pcmpestri(XMM dst, XMM src, u8 imm) {
+        write8(0x66);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x3a);
+        write8((u8)0x61);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+        write8(imm);
+    }
+
+    void Assembler::crc32(R32 dst, R8 src) {
+        verify(src == R8::R8B || src == R8::R9B);
+        write8(0xf2);
+        write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0xf0);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::crc32(R32 dst, R16 src) {
+        write8(0x66);
+        write8(0xf2);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0xf1);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::crc32(R32 dst, R32 src) {
+        write8(0xf2);
+        if((u8)dst >= 8 || (u8)src >= 8) {
+            write8((u8)(0x40 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        }
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0xf1);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    void Assembler::crc32(R64 dst, R64 src) {
+        write8(0xf2);
+        write8((u8)(0x48 | (((u8)dst >= 8) ? 4 : 0) | (((u8)src >= 8) ? 1 : 0) ));
+        write8((u8)0x0f);
+        write8((u8)0x38);
+        write8((u8)0xf1);
+        write8((u8)(0b11000000 | (encodeRegister(dst) << 3) | encodeRegister(src)));
+    }
+
+    // x87 memory operands encode the opcode extension in the reg field of the modrm byte
+    void Assembler::fld(const M32& src) {
+        return opRegMem({ 0xd9 }, (R64)0, src, REX::NONE);
+    }
+
+    void Assembler::fld(const M64& src) {
+        return opRegMem({ 0xdd }, (R64)0, src, REX::NONE);
+    }
+
+    void Assembler::fld(const M80& src) {
+        return opRegMem({ 0xdb }, (R64)5, src, REX::NONE);
+    }
+
+    void Assembler::fild(const M16& src) {
+        return opRegMem({ 0xdf }, (R64)0, src, REX::NONE);
+    }
+
+    void Assembler::fild(const M32& src) {
+        return opRegMem({ 0xdb }, (R64)0, src, REX::NONE);
+    }
+
+    void Assembler::fild(const M64& src) {
+        return opRegMem({ 0xdf }, (R64)5, src, REX::NONE);
+    }
+
+    void Assembler::fstp(const M32& dst) {
+        return opRegMem({ 0xd9 }, (R64)3, dst, REX::NONE);
+    }
+
+    void Assembler::fstp(const M64& dst) {
+        return opRegMem({ 0xdd }, (R64)3, dst, REX::NONE);
+    }
+
+    void Assembler::fstp(const M80& dst) {
+        return opRegMem({ 0xdb }, (R64)7, dst, REX::NONE);
+    }
+
+    void Assembler::fisttp(const M16& dst) {
+        return opRegMem({ 0xdf }, (R64)1, dst, REX::NONE);
+    }
+
+    void Assembler::fisttp(const M32& dst) {
+        return opRegMem({ 0xdb }, (R64)1, dst, REX::NONE);
+    }
+
+    void Assembler::fisttp(const M64& dst) {
+        return opRegMem({ 0xdd }, (R64)1, dst, REX::NONE);
+    }
+
+    void Assembler::fpop() {
+        // fstp st(0)
+        write8(0xdd);
+        write8(0xd8);
+    }
+
+    void Assembler::fldz() {
+        write8(0xd9);
+        write8(0xee);
+    }
+
+    void Assembler::fld1() {
+        write8(0xd9);
+        write8(0xe8);
+    }
+
+    void Assembler::fldlg2() {
+        write8(0xd9);
+        write8(0xec);
+    }
+
+    void Assembler::faddp() {
+        // st(1) = st(1) + st(0), then pop
+        write8(0xde);
+        write8(0xc1);
+    }
+
+    void Assembler::fsubp() {
+        // st(1) = st(1) - st(0), then pop
+        write8(0xde);
+        write8(0xe9);
+    }
+
+    void Assembler::fmulp() {
+        // st(1) = st(1) * st(0), then pop
+        write8(0xde);
+        write8(0xc9);
+    }
+
+    void Assembler::fdivp() {
+        // st(1) = st(1) / st(0), then pop
+        write8(0xde);
+        write8(0xf9);
+    }
+
+    void Assembler::fcomip() {
+        // compare st(0) with st(1), then pop
+        write8(0xdf);
+        write8(0xf1);
+    }
+
+    void Assembler::fucomip() {
+        // compare st(0) with st(1), then pop
+        write8(0xdf);
+        write8(0xe9);
+    }
+
+    void Assembler::fabs() {
+        write8(0xd9);
+        write8(0xe1);
+    }
+
+    void Assembler::fchs() {
+        write8(0xd9);
+        write8(0xe0);
+    }
+
+    void Assembler::emms() {
+        write8(0x0f);
+        write8(0x77);
+    }
+
     void Assembler::patchJumps() {
         for(const Label& label : labels_) {
             closeLabel(label);
@@ -3874,6 +4669,12 @@ namespace x64 {
         write8((u8)(0b11000000 | (0b100 << 3) | encodeRegister(dst)));
     }
 
+    void Assembler::jrcxz(Label* label) {
+        write8(0xe3);
+        label->shortJumpsToMe.push_back(code_.size());
+        write8(0x00);
+    }
+
     void Assembler::call(R64 src) {
         if((u8)src >= 8) {
             write8((u8)(0x40 | (((u8)src >= 8) ? 1 : 0) ));
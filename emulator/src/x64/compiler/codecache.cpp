@@ -0,0 +1,386 @@
+#include "x64/compiler/codecache.h"
+#include "x64/compiler/jit.h"
+#include "host/hostinstructions.h"
+#include "verify.h"
+#include <fmt/format.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace x64 {
+
+    namespace {
+        // Bump when the layout of the cache files or the generated code changes in an incompatible way.
+        constexpr u32 CODE_CACHE_VERSION = 8;
+        constexpr u64 CODE_CACHE_MAGIC = 0x0043544a49343658; // "X64JITC"
+
+        u64 combine(u64 hash, u64 value) {
+            // FNV-1a, one byte at a time
+            for(u32 i = 0; i < 8; ++i) {
+                hash ^= (value >> (8*i)) & 0xFF;
+                hash *= 0x100000001b3;
+            }
+            return hash;
+        }
+
+        constexpr u64 HASH_SEED = 0xcbf29ce484222325;
+
+        std::optional<u64> tryIdentify(const std::string& path) {
+            struct stat st;
+            if(::stat(path.c_str(), &st) != 0) return {};
+            if(!S_ISREG(st.st_mode)) return {};
+            u64 hash = HASH_SEED;
+            for(char c : path) hash = combine(hash, (u64)(u8)c);
+            hash = combine(hash, (u64)st.st_dev);
+            hash = combine(hash, (u64)st.st_ino);
+            hash = combine(hash, (u64)st.st_size);
+            hash = combine(hash, (u64)st.st_mtim.tv_sec);
+            hash = combine(hash, (u64)st.st_mtim.tv_nsec);
+            return hash;
+        }
+
+        class Writer {
+        public:
+            template<typename T>
+            void write(const T& value) {
+                static_assert(std::is_trivially_copyable_v<T>);
+                const u8* ptr = (const u8*)&value;
+                data_.insert(data_.end(), ptr, ptr+sizeof(T));
+            }
+
+            void writeOptional(const std::optional<size_t>& value) {
+                write<u8>(!!value);
+                write<u64>(value.value_or(0));
+            }
+
+            const std::vector<u8>& data() const { return data_; }
+
+        private:
+            std::vector<u8> data_;
+        };
+
+        class Reader {
+        public:
+            explicit Reader(const std::vector<u8>& data) : data_(data) { }
+
+            template<typename T>
+            bool read(T* value) {
+                static_assert(std::is_trivially_copyable_v<T>);
+                if(position_ + sizeof(T) > data_.size()) return false;
+                std::memcpy(value, data_.data() + position_, sizeof(T));
+                position_ += sizeof(T);
+                return true;
+            }
+
+            bool readOptional(std::optional<size_t>* value) {
+                u8 hasValue = 0;
+                u64 v = 0;
+                if(!read(&hasValue) || !read(&v)) return false;
+                *value = hasValue ? std::optional<size_t>((size_t)v) : std::nullopt;
+                return true;
+            }
+
+            bool readBytes(std::vector<u8>* bytes, size_t size) {
+                if(position_ + size > data_.size()) return false;
+                bytes->assign(data_.begin() + (std::ptrdiff_t)position_, data_.begin() + (std::ptrdiff_t)(position_ + size));
+                position_ += size;
+                return true;
+            }
+
+        private:
+            const std::vector<u8>& data_;
+            size_t position_ { 0 };
+        };
+    }
+
+    CodeCacheFile::CodeCacheFile(std::string cachePath, u64 identity, CodeCacheBudget* budget) :
+            cachePath_(std::move(cachePath)),
+            identity_(identity),
+            budget_(budget) { }
+
+    u64 CodeCacheFile::hashInstructions(const std::vector<const BasicBlock*>& basicBlocks) {
+        u64 hash = HASH_SEED;
+        for(const BasicBlock* basicBlock : basicBlocks) {
+            for(const auto& ins : basicBlock->instructions()) {
+                hash = combine(hash, ins.first.address());
+                hash = combine(hash, ins.first.nextAddress());
+                hash = combine(hash, (u64)ins.first.insn());
+                hash = combine(hash, (u64)ins.first.lock());
+                // code rewritten in place may only differ by its registers, immediates or displacements.
+                // The operand buffers hold padding, their text is used instead.
+                for(char c : ins.first.toString()) hash = combine(hash, (u64)(u8)c);
+            }
+        }
+        return hash;
+    }
+
+    u64 CodeCacheFile::key(u64 regionBase, const std::vector<u64>& offsets, int optimizationLevel, bool flagsLiveOut) {
+        u64 hash = combine(HASH_SEED, regionBase);
+        hash = combine(hash, (u64)optimizationLevel);
+        hash = combine(hash, (u64)flagsLiveOut);
+        for(u64 offset : offsets) hash = combine(hash, offset);
+        return hash;
+    }
+
+    std::vector<u64> CodeCacheFile::offsetsOf(u64 regionBase, const std::vector<const BasicBlock*>& basicBlocks) {
+        std::vector<u64> offsets;
+        offsets.reserve(basicBlocks.size());
+        for(const BasicBlock* basicBlock : basicBlocks) {
+            offsets.push_back(basicBlock->instructions()[0].first.address() - regionBase);
+        }
+        return offsets;
+    }
+
+    std::optional<NativeBasicBlock> CodeCacheFile::tryLoad(u64 regionBase, const std::vector<const BasicBlock*>& basicBlocks, int optimizationLevel, bool flagsLiveOut) const {
+#ifdef MULTIPROCESSING
+        std::unique_lock lock(guard_);
+#endif
+        std::vector<u64> offsets = offsetsOf(regionBase, basicBlocks);
+        auto it = entries_.find(key(regionBase, offsets, optimizationLevel, flagsLiveOut));
+        if(it == entries_.end()) return {};
+        const Entry& entry = it->second;
+        if(entry.regionBase != regionBase) return {};
+        if(entry.optimizationLevel != optimizationLevel) return {};
+        if(entry.flagsLiveOut != flagsLiveOut) return {};
+        if(entry.offsets != offsets) return {};
+        if(entry.instructionsHash != hashInstructions(basicBlocks)) return {};
+        return entry.code;
+    }
+
+    void CodeCacheFile::store(u64 regionBase, const std::vector<const BasicBlock*>& basicBlocks, int optimizationLevel, bool flagsLiveOut, const NativeBasicBlock& nativeBasicBlock) {
+        // host pointers that are not relocated would be stale in another process
+        if(!nativeBasicBlock.relocatable) return;
+        Entry entry;
+        entry.regionBase = regionBase;
+        entry.optimizationLevel = optimizationLevel;
+        entry.flagsLiveOut = flagsLiveOut;
+        entry.offsets = offsetsOf(regionBase, basicBlocks);
+        entry.instructionsHash = hashInstructions(basicBlocks);
+        entry.code = nativeBasicBlock;
+        u64 k = key(regionBase, entry.offsets, optimizationLevel, flagsLiveOut);
+#ifdef MULTIPROCESSING
+        std::unique_lock lock(guard_);
+#endif
+        if(!!budget_) {
+            // Once the cache is full, new code stays private to the process that compiled it
+            auto it = entries_.find(k);
+            u64 replaced = (it != entries_.end()) ? it->second.code.nativecode.size() : 0;
+            u64 size = entry.code.nativecode.size();
+            u64 used = budget_->usedBytes.fetch_add(size, std::memory_order_relaxed) + size;
+            if(used - replaced > budget_->limit) {
+                budget_->usedBytes.fetch_sub(size, std::memory_order_relaxed);
+                return;
+            }
+            budget_->usedBytes.fetch_sub(replaced, std::memory_order_relaxed);
+        }
+        entries_[k] = std::move(entry);
+        dirty_ = true;
+    }
+
+    bool CodeCacheFile::tryRead() {
+        std::ifstream file(cachePath_, std::ios::in | std::ios::binary);
+        if(!file) return false;
+        std::vector<u8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Reader reader(data);
+
+        u64 magic = 0;
+        u32 version = 0;
+        u64 identity = 0;
+        u64 nbEntries = 0;
+        if(!reader.read(&magic) || magic != CODE_CACHE_MAGIC) return false;
+        if(!reader.read(&version) || version != CODE_CACHE_VERSION) return false;
+        if(!reader.read(&identity) || identity != identity_) return false;
+        if(!reader.read(&nbEntries)) return false;
+
+        std::unordered_map<u64, Entry> entries;
+        for(u64 e = 0; e < nbEntries; ++e) {
+            Entry entry;
+            u64 nbOffsets = 0;
+            if(!reader.read(&entry.regionBase)) return false;
+            if(!reader.read(&entry.optimizationLevel)) return false;
+            u8 flagsLiveOut = 0;
+            if(!reader.read(&flagsLiveOut)) return false;
+            entry.flagsLiveOut = !!flagsLiveOut;
+            if(!reader.read(&nbOffsets) || nbOffsets > data.size()) return false;
+            entry.offsets.resize(nbOffsets);
+            for(u64& offset : entry.offsets) {
+                if(!reader.read(&offset)) return false;
+            }
+            if(!reader.read(&entry.instructionsHash)) return false;
+
+            NativeBasicBlock& code = entry.code;
+            u64 codeSize = 0;
+            if(!reader.read(&codeSize)) return false;
+            if(!reader.readBytes(&code.nativecode, codeSize)) return false;
+            if(!reader.readOptional(&code.offsetOfJumpLandingPad)) return false;
+            if(!reader.readOptional(&code.offsetOfReplaceableJumpToContinuingBlock)) return false;
+            if(!reader.readOptional(&code.offsetOfReplaceableJumpToConditionalBlock)) return false;
+            std::optional<size_t> callstackPushOffset;
+            u64 callstackPushAddress = 0;
+            if(!reader.readOptional(&callstackPushOffset)) return false;
+            if(!reader.read(&callstackPushAddress)) return false;
+            if(!!callstackPushOffset) code.offsetOfReplaceableCallstackPush = std::make_pair(callstackPushOffset.value(), callstackPushAddress);
+            if(!reader.readOptional(&code.offsetOfReplaceableCallstackPop)) return false;
+            u64 nbRelocations = 0;
+            if(!reader.read(&nbRelocations) || nbRelocations > data.size()) return false;
+            code.relocations.resize(nbRelocations);
+            for(NativeRelocation& relocation : code.relocations) {
+                if(!reader.read(&relocation.offset)) return false;
+                if(!reader.read(&relocation.kind)) return false;
+                if(!reader.read(&relocation.block)) return false;
+                if(!reader.read(&relocation.instruction)) return false;
+                if(relocation.offset + sizeof(u64) > code.nativecode.size()) return false;
+            }
+            u64 k = key(entry.regionBase, entry.offsets, entry.optimizationLevel, entry.flagsLiveOut);
+            entries.emplace(k, std::move(entry));
+        }
+        entries_ = std::move(entries);
+        return true;
+    }
+
+    bool CodeCacheFile::tryWrite() const {
+        Writer writer;
+        writer.write<u64>(CODE_CACHE_MAGIC);
+        writer.write<u32>(CODE_CACHE_VERSION);
+        writer.write<u64>(identity_);
+        writer.write<u64>(entries_.size());
+        for(const auto& p : entries_) {
+            const Entry& entry = p.second;
+            writer.write<u64>(entry.regionBase);
+            writer.write<i32>(entry.optimizationLevel);
+            writer.write<u8>(entry.flagsLiveOut);
+            writer.write<u64>(entry.offsets.size());
+            for(u64 offset : entry.offsets) writer.write<u64>(offset);
+            writer.write<u64>(entry.instructionsHash);
+
+            const NativeBasicBlock& code = entry.code;
+            writer.write<u64>(code.nativecode.size());
+            for(u8 byte : code.nativecode) writer.write<u8>(byte);
+            writer.writeOptional(code.offsetOfJumpLandingPad);
+            writer.writeOptional(code.offsetOfReplaceableJumpToContinuingBlock);
+            writer.writeOptional(code.offsetOfReplaceableJumpToConditionalBlock);
+            std::optional<size_t> callstackPushOffset;
+            if(!!code.offsetOfReplaceableCallstackPush) callstackPushOffset = code.offsetOfReplaceableCallstackPush->first;
+            writer.writeOptional(callstackPushOffset);
+            writer.write<u64>(!!code.offsetOfReplaceableCallstackPush ? code.offsetOfReplaceableCallstackPush->second : 0);
+            writer.writeOptional(code.offsetOfReplaceableCallstackPop);
+            writer.write<u64>(code.relocations.size());
+            for(const NativeRelocation& relocation : code.relocations) {
+                writer.write<u32>(relocation.offset);
+                writer.write<NativeRelocation::Kind>(relocation.kind);
+                writer.write<u32>(relocation.block);
+                writer.write<u32>(relocation.instruction);
+            }
+        }
+
+        // write to a temporary file first, so that concurrent emulators never read a partial cache
+        std::string temporaryPath = fmt::format("{}.{}.tmp", cachePath_, ::getpid());
+        {
+            std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+            if(!file) return false;
+            file.write((const char*)writer.data().data(), (std::streamsize)writer.data().size());
+            if(!file) return false;
+        }
+        return std::rename(temporaryPath.c_str(), cachePath_.c_str()) == 0;
+    }
+
+    std::unique_ptr<CodeCache> CodeCache::tryCreate(const std::string& directory) {
+        if(directory.empty()) return {};
+        if(::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) return {};
+        // code generated by another build of the emulator, or for another host, cannot be trusted
+        auto emulatorIdentity = tryIdentify("/proc/self/exe");
+        if(!emulatorIdentity) return {};
+        u64 identity = combine(emulatorIdentity.value(), host::hostFeatures().mask());
+        return std::unique_ptr<CodeCache>(new CodeCache(directory, identity));
+    }
+
+    std::unique_ptr<CodeCache> CodeCache::createInMemory(u64 sizeLimit) {
+        auto cache = std::unique_ptr<CodeCache>(new CodeCache("", 0));
+        cache->budget_ = std::make_unique<CodeCacheBudget>();
+        cache->budget_->limit = sizeLimit;
+        return cache;
+    }
+
+    CodeCache::CodeCache(std::string directory, u64 emulatorIdentity) :
+            directory_(std::move(directory)),
+            emulatorIdentity_(emulatorIdentity) { }
+
+    CodeCache::~CodeCache() {
+        for(const auto& p : files_) {
+            if(!p.second || !p.second->isDirty() || !p.second->isPersistent()) continue;
+            if(!p.second->tryWrite()) warn(fmt::format("Unable to write jit cache for {}", p.first));
+        }
+    }
+
+    CodeCacheFile* CodeCache::tryOpen(const std::string& path) {
+#ifdef MULTIPROCESSING
+        std::unique_lock lock(guard_);
+#endif
+        auto it = files_.find(path);
+        if(it != files_.end()) return it->second.get();
+        std::unique_ptr<CodeCacheFile> file;
+        if(auto fileIdentity = tryIdentify(path)) {
+            u64 identity = combine(fileIdentity.value(), emulatorIdentity_);
+            if(directory_.empty()) {
+                file = std::make_unique<CodeCacheFile>("", identity, budget_.get());
+            } else {
+                file = std::make_unique<CodeCacheFile>(fmt::format("{}/{:016x}.jit", directory_, identity), identity);
+                file->tryRead();
+            }
+        }
+        CodeCacheFile* ptr = file.get();
+        files_.emplace(path, std::move(file));
+        return ptr;
+    }
+
+    bool CodeCache::relocate(NativeBasicBlock* nativeBasicBlock, const std::vector<const BasicBlock*>& basicBlocks,
+                             const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr) {
+        verify(!!nativeBasicBlock);
+        verify(basicBlocks.size() == basicBlockPtrs.size());
+        for(const NativeRelocation& relocation : nativeBasicBlock->relocations) {
+            if(relocation.offset + sizeof(u64) > nativeBasicBlock->nativecode.size()) return false;
+            auto instruction = [&]() -> const std::pair<X64Instruction, ThreadedInstruction>* {
+                if(relocation.block >= basicBlocks.size()) return nullptr;
+                const auto& instructions = basicBlocks[relocation.block]->instructions();
+                if(relocation.instruction >= instructions.size()) return nullptr;
+                return &instructions[relocation.instruction];
+            };
+            u64 value = 0;
+            switch(relocation.kind) {
+                case NativeRelocation::Kind::BASIC_BLOCK: {
+                    if(relocation.block >= basicBlockPtrs.size()) return false;
+                    value = (u64)basicBlockPtrs[relocation.block];
+                    break;
+                }
+                case NativeRelocation::Kind::JIT_BASIC_BLOCK: {
+                    value = (u64)jitBasicBlockPtr;
+                    break;
+                }
+                case NativeRelocation::Kind::INSTRUCTION: {
+                    const auto* ins = instruction();
+                    if(!ins) return false;
+                    value = (u64)&ins->first;
+                    break;
+                }
+                case NativeRelocation::Kind::INSTRUCTION_HANDLER: {
+                    const auto* ins = instruction();
+                    if(!ins) return false;
+                    value = (u64)ins->second.exec;
+                    break;
+                }
+                case NativeRelocation::Kind::INTERPRETER_ENTRYPOINT: {
+                    value = (u64)&Jit::interpret;
+                    break;
+                }
+                default: return false;
+            }
+            std::memcpy(nativeBasicBlock->nativecode.data() + relocation.offset, &value, sizeof(value));
+        }
+        return true;
+    }
+
+}
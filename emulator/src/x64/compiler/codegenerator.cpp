@@ -1,5 +1,6 @@
 #include "x64/compiler/codegenerator.h"
 #include "x64/compiler/assembler.h"
+#include "x64/compiler/codepatcher.h"
 #include "verify.h"
 #include <fmt/format.h>
 #include <cassert>
@@ -17,8 +18,17 @@ namespace x64 {
     static constexpr M64 STACK_PTR = M64{Segment::UNK, Encoding64{R64::RSP, R64::ZERO, 0, 0}};
 #endif
 
+    const std::vector<size_t>& CodeGenerator::imm64Offsets() const {
+        return assembler_->imm64Offsets();
+    }
+
+    const std::vector<std::pair<u32, size_t>>& CodeGenerator::relocationOffsets() const {
+        return relocationOffsets_;
+    }
+
     std::optional<NativeBasicBlock> CodeGenerator::tryGenerate(const ir::IR& ir) {
         assembler_->clear();
+        relocationOffsets_.clear();
         std::optional<size_t> offsetOfJumpLandingPad;
         std::optional<size_t> offsetOfReplaceableJumpToContinuingBlock;
         std::optional<size_t> offsetOfReplaceableJumpToConditionalBlock;
@@ -39,6 +49,13 @@ namespace x64 {
             if(ir.jumpLanding == i) {
                 offsetOfJumpLandingPad = assembler_->code().size();
             }
+#ifdef MULTIPROCESSING
+            // replaceable code is patched while other workers run it, starting with its first 8 bytes at once
+            if(ir.jumpToNext == i || ir.jumpToOther == i || (ir.pushCallstack && ir.pushCallstack->first == i)) {
+                size_t misalignment = assembler_->code().size() % CodePatcher::REGION_ALIGNMENT;
+                if(misalignment != 0) assembler_->nops(CodePatcher::REGION_ALIGNMENT - misalignment);
+            }
+#endif
             if(ir.jumpToNext == i) {
                 offsetOfReplaceableJumpToContinuingBlock = assembler_->code().size();
             }
@@ -117,6 +134,7 @@ namespace x64 {
                         assembler_->mov(r64dst.value(), imm32src.value());
                     } else if(r64dst && imm64src) {
                         assembler_->mov(r64dst.value(), imm64src.value());
+                        if(auto relocation = ins.relocation()) relocationOffsets_.emplace_back(relocation.value(), assembler_->imm64Offsets().back());
                     } else if(r32dst && mmxsrc) {
                         assembler_->movd(r32dst.value(), mmxsrc.value());
                     } else if(mmxdst && r32src) {
@@ -188,6 +206,8 @@ namespace x64 {
                     auto r16dst = ins.out().as<R16>();
                     auto r32dst = ins.out().as<R32>();
                     auto r64dst = ins.out().as<R64>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
 
                     assert(r8dst == ins.in1().as<R8>());
                     assert(r16dst == ins.in1().as<R16>());
@@ -198,6 +218,8 @@ namespace x64 {
                     auto r16src2 = ins.in2().as<R16>();
                     auto r32src2 = ins.in2().as<R32>();
                     auto r64src2 = ins.in2().as<R64>();
+                    auto m32src2 = ins.in2().as<M32>();
+                    auto m64src2 = ins.in2().as<M64>();
 
                     auto imm8src2 = ins.in2().as<i8>();
                     auto imm16src2 = ins.in2().as<i16>();
@@ -219,6 +241,18 @@ namespace x64 {
                         assembler_->add(r64dst.value(), r64src2.value());
                     } else if(r64dst && imm32src2) {
                         assembler_->add(r64dst.value(), imm32src2.value());
+                    } else if(r32dst && m32src2) {
+                        assembler_->add(r32dst.value(), m32src2.value());
+                    } else if(r64dst && m64src2) {
+                        assembler_->add(r64dst.value(), m64src2.value());
+                    } else if(m32dst && r32src2) {
+                        assembler_->add(m32dst.value(), r32src2.value());
+                    } else if(m32dst && imm32src2) {
+                        assembler_->add(m32dst.value(), imm32src2.value());
+                    } else if(m64dst && r64src2) {
+                        assembler_->add(m64dst.value(), r64src2.value());
+                    } else if(m64dst && imm32src2) {
+                        assembler_->add(m64dst.value(), imm32src2.value());
                     } else {
                         return fail();
                     }
@@ -244,6 +278,8 @@ namespace x64 {
                     auto r16dst = ins.out().as<R16>();
                     auto r32dst = ins.out().as<R32>();
                     auto r64dst = ins.out().as<R64>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
 
                     assert(r8dst == ins.in1().as<R8>());
                     assert(r16dst == ins.in1().as<R16>());
@@ -254,6 +290,8 @@ namespace x64 {
                     auto r16src2 = ins.in2().as<R16>();
                     auto r32src2 = ins.in2().as<R32>();
                     auto r64src2 = ins.in2().as<R64>();
+                    auto m32src2 = ins.in2().as<M32>();
+                    auto m64src2 = ins.in2().as<M64>();
 
                     auto imm8src2 = ins.in2().as<i8>();
                     auto imm16src2 = ins.in2().as<i16>();
@@ -275,6 +313,18 @@ namespace x64 {
                         assembler_->sub(r64dst.value(), r64src2.value());
                     } else if(r64dst && imm32src2) {
                         assembler_->sub(r64dst.value(), imm32src2.value());
+                    } else if(r32dst && m32src2) {
+                        assembler_->sub(r32dst.value(), m32src2.value());
+                    } else if(r64dst && m64src2) {
+                        assembler_->sub(r64dst.value(), m64src2.value());
+                    } else if(m32dst && r32src2) {
+                        assembler_->sub(m32dst.value(), r32src2.value());
+                    } else if(m32dst && imm32src2) {
+                        assembler_->sub(m32dst.value(), imm32src2.value());
+                    } else if(m64dst && r64src2) {
+                        assembler_->sub(m64dst.value(), r64src2.value());
+                    } else if(m64dst && imm32src2) {
+                        assembler_->sub(m64dst.value(), imm32src2.value());
                     } else {
                         return fail();
                     }
@@ -318,11 +368,15 @@ namespace x64 {
                     auto r16lhs = ins.in1().as<R16>();
                     auto r32lhs = ins.in1().as<R32>();
                     auto r64lhs = ins.in1().as<R64>();
+                    auto m32lhs = ins.in1().as<M32>();
+                    auto m64lhs = ins.in1().as<M64>();
 
                     auto r8rhs = ins.in2().as<R8>();
                     auto r16rhs = ins.in2().as<R16>();
                     auto r32rhs = ins.in2().as<R32>();
                     auto r64rhs = ins.in2().as<R64>();
+                    auto m32rhs = ins.in2().as<M32>();
+                    auto m64rhs = ins.in2().as<M64>();
 
                     auto imm8rhs = ins.in2().as<i8>();
                     auto imm16rhs = ins.in2().as<i16>();
@@ -344,6 +398,18 @@ namespace x64 {
                         assembler_->cmp(r64lhs.value(), r64rhs.value());
                     } else if(r64lhs && imm32rhs) {
                         assembler_->cmp(r64lhs.value(), imm32rhs.value());
+                    } else if(r32lhs && m32rhs) {
+                        assembler_->cmp(r32lhs.value(), m32rhs.value());
+                    } else if(r64lhs && m64rhs) {
+                        assembler_->cmp(r64lhs.value(), m64rhs.value());
+                    } else if(m32lhs && r32rhs) {
+                        assembler_->cmp(m32lhs.value(), r32rhs.value());
+                    } else if(m32lhs && imm32rhs) {
+                        assembler_->cmp(m32lhs.value(), imm32rhs.value());
+                    } else if(m64lhs && r64rhs) {
+                        assembler_->cmp(m64lhs.value(), r64rhs.value());
+                    } else if(m64lhs && imm32rhs) {
+                        assembler_->cmp(m64lhs.value(), imm32rhs.value());
                     } else {
                         return fail();
                     }
@@ -436,6 +502,57 @@ namespace x64 {
                     }
                     break;
                 }
+                case ir::Op::SHLX: {
+                    auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+                    auto r32src = ins.in1().as<R32>();
+                    auto r64src = ins.in1().as<R64>();
+                    auto r32count = ins.in2().as<R32>();
+                    auto r64count = ins.in2().as<R64>();
+
+                    if(r32dst && r32src && r32count) {
+                        assembler_->shlx(r32dst.value(), r32src.value(), r32count.value());
+                    } else if(r64dst && r64src && r64count) {
+                        assembler_->shlx(r64dst.value(), r64src.value(), r64count.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::SHRX: {
+                    auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+                    auto r32src = ins.in1().as<R32>();
+                    auto r64src = ins.in1().as<R64>();
+                    auto r32count = ins.in2().as<R32>();
+                    auto r64count = ins.in2().as<R64>();
+
+                    if(r32dst && r32src && r32count) {
+                        assembler_->shrx(r32dst.value(), r32src.value(), r32count.value());
+                    } else if(r64dst && r64src && r64count) {
+                        assembler_->shrx(r64dst.value(), r64src.value(), r64count.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::SARX: {
+                    auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+                    auto r32src = ins.in1().as<R32>();
+                    auto r64src = ins.in1().as<R64>();
+                    auto r32count = ins.in2().as<R32>();
+                    auto r64count = ins.in2().as<R64>();
+
+                    if(r32dst && r32src && r32count) {
+                        assembler_->sarx(r32dst.value(), r32src.value(), r32count.value());
+                    } else if(r64dst && r64src && r64count) {
+                        assembler_->sarx(r64dst.value(), r64src.value(), r64count.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
                 case ir::Op::ROL: {
                     auto r16dst = ins.out().as<R16>();
                     auto r32dst = ins.out().as<R32>();
@@ -622,6 +739,8 @@ namespace x64 {
                     auto r16dst = ins.out().as<R16>();
                     auto r32dst = ins.out().as<R32>();
                     auto r64dst = ins.out().as<R64>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
 
                     assert(r8dst == ins.in1().as<R8>());
                     assert(r16dst == ins.in1().as<R16>());
@@ -632,6 +751,8 @@ namespace x64 {
                     auto r16src2 = ins.in2().as<R16>();
                     auto r32src2 = ins.in2().as<R32>();
                     auto r64src2 = ins.in2().as<R64>();
+                    auto m32src2 = ins.in2().as<M32>();
+                    auto m64src2 = ins.in2().as<M64>();
 
                     auto imm8src2 = ins.in2().as<i8>();
                     auto imm16src2 = ins.in2().as<i16>();
@@ -653,6 +774,18 @@ namespace x64 {
                         assembler_->and_(r64dst.value(), r64src2.value());
                     } else if(r64dst && imm32src2) {
                         assembler_->and_(r64dst.value(), imm32src2.value());
+                    } else if(r32dst && m32src2) {
+                        assembler_->and_(r32dst.value(), m32src2.value());
+                    } else if(r64dst && m64src2) {
+                        assembler_->and_(r64dst.value(), m64src2.value());
+                    } else if(m32dst && r32src2) {
+                        assembler_->and_(m32dst.value(), r32src2.value());
+                    } else if(m32dst && imm32src2) {
+                        assembler_->and_(m32dst.value(), imm32src2.value());
+                    } else if(m64dst && r64src2) {
+                        assembler_->and_(m64dst.value(), r64src2.value());
+                    } else if(m64dst && imm32src2) {
+                        assembler_->and_(m64dst.value(), imm32src2.value());
                     } else {
                         return fail();
                     }
@@ -663,6 +796,8 @@ namespace x64 {
                     auto r16dst = ins.out().as<R16>();
                     auto r32dst = ins.out().as<R32>();
                     auto r64dst = ins.out().as<R64>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
 
                     assert(r8dst == ins.in1().as<R8>());
                     assert(r16dst == ins.in1().as<R16>());
@@ -673,6 +808,8 @@ namespace x64 {
                     auto r16src2 = ins.in2().as<R16>();
                     auto r32src2 = ins.in2().as<R32>();
                     auto r64src2 = ins.in2().as<R64>();
+                    auto m32src2 = ins.in2().as<M32>();
+                    auto m64src2 = ins.in2().as<M64>();
 
                     auto imm8src2 = ins.in2().as<i8>();
                     auto imm16src2 = ins.in2().as<i16>();
@@ -694,6 +831,18 @@ namespace x64 {
                         assembler_->or_(r64dst.value(), r64src2.value());
                     } else if(r64dst && imm32src2) {
                         assembler_->or_(r64dst.value(), imm32src2.value());
+                    } else if(r32dst && m32src2) {
+                        assembler_->or_(r32dst.value(), m32src2.value());
+                    } else if(r64dst && m64src2) {
+                        assembler_->or_(r64dst.value(), m64src2.value());
+                    } else if(m32dst && r32src2) {
+                        assembler_->or_(m32dst.value(), r32src2.value());
+                    } else if(m32dst && imm32src2) {
+                        assembler_->or_(m32dst.value(), imm32src2.value());
+                    } else if(m64dst && r64src2) {
+                        assembler_->or_(m64dst.value(), r64src2.value());
+                    } else if(m64dst && imm32src2) {
+                        assembler_->or_(m64dst.value(), imm32src2.value());
                     } else {
                         return fail();
                     }
@@ -704,6 +853,8 @@ namespace x64 {
                     auto r16dst = ins.out().as<R16>();
                     auto r32dst = ins.out().as<R32>();
                     auto r64dst = ins.out().as<R64>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
 
                     assert(r8dst == ins.in1().as<R8>());
                     assert(r16dst == ins.in1().as<R16>());
@@ -714,6 +865,8 @@ namespace x64 {
                     auto r16src2 = ins.in2().as<R16>();
                     auto r32src2 = ins.in2().as<R32>();
                     auto r64src2 = ins.in2().as<R64>();
+                    auto m32src2 = ins.in2().as<M32>();
+                    auto m64src2 = ins.in2().as<M64>();
 
                     auto imm8src2 = ins.in2().as<i8>();
                     auto imm16src2 = ins.in2().as<i16>();
@@ -735,6 +888,18 @@ namespace x64 {
                         assembler_->xor_(r64dst.value(), r64src2.value());
                     } else if(r64dst && imm32src2) {
                         assembler_->xor_(r64dst.value(), imm32src2.value());
+                    } else if(r32dst && m32src2) {
+                        assembler_->xor_(r32dst.value(), m32src2.value());
+                    } else if(r64dst && m64src2) {
+                        assembler_->xor_(r64dst.value(), m64src2.value());
+                    } else if(m32dst && r32src2) {
+                        assembler_->xor_(m32dst.value(), r32src2.value());
+                    } else if(m32dst && imm32src2) {
+                        assembler_->xor_(m32dst.value(), imm32src2.value());
+                    } else if(m64dst && r64src2) {
+                        assembler_->xor_(m64dst.value(), r64src2.value());
+                    } else if(m64dst && imm32src2) {
+                        assembler_->xor_(m64dst.value(), imm32src2.value());
                     } else {
                         return fail();
                     }
@@ -756,6 +921,23 @@ namespace x64 {
                     }
                     break;
                 }
+                case ir::Op::ANDN: {
+                    auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+                    auto r32src1 = ins.in1().as<R32>();
+                    auto r64src1 = ins.in1().as<R64>();
+                    auto r32src2 = ins.in2().as<R32>();
+                    auto r64src2 = ins.in2().as<R64>();
+
+                    if(r32dst && r32src1 && r32src2) {
+                        assembler_->andn(r32dst.value(), r32src1.value(), r32src2.value());
+                    } else if(r64dst && r64src1 && r64src2) {
+                        assembler_->andn(r64dst.value(), r64src1.value(), r64src2.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
                 case ir::Op::NEG: {
                     auto r8dst = ins.out().as<R8>();
                     auto r16dst = ins.out().as<R16>();
@@ -835,6 +1017,15 @@ namespace x64 {
                     auto r32src = ins.in2().as<R32>();
                     auto r64src = ins.in2().as<R64>();
 
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
                     if(r8dst && r8src) {
                         assembler_->xchg(r8dst.value(), r8src.value());
                     } else if(r16dst && r16src) {
@@ -843,6 +1034,14 @@ namespace x64 {
                         assembler_->xchg(r32dst.value(), r32src.value());
                     } else if(r64dst && r64src) {
                         assembler_->xchg(r64dst.value(), r64src.value());
+                    } else if(m8dst && r8src) {
+                        assembler_->xchg(m8dst.value(), r8src.value());
+                    } else if(m16dst && r16src) {
+                        assembler_->xchg(m16dst.value(), r16src.value());
+                    } else if(m32dst && r32src) {
+                        assembler_->xchg(m32dst.value(), r32src.value());
+                    } else if(m64dst && r64src) {
+                        assembler_->xchg(m64dst.value(), r64src.value());
                     } else {
                         return fail();
                     }
@@ -865,15 +1064,221 @@ namespace x64 {
                     }
                     break;
                 }
+                case ir::Op::LOCKADD: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
+                    auto r8src = ins.in2().as<R8>();
+                    auto r16src = ins.in2().as<R16>();
+                    auto r32src = ins.in2().as<R32>();
+                    auto r64src = ins.in2().as<R64>();
+
+                    auto imm8src = ins.in2().as<i8>();
+                    auto imm16src = ins.in2().as<i16>();
+                    auto imm32src = ins.in2().as<i32>();
+
+                    if(m8dst && r8src) {
+                        assembler_->lockadd(m8dst.value(), r8src.value());
+                    } else if(m8dst && imm8src) {
+                        assembler_->lockadd(m8dst.value(), imm8src.value());
+                    } else if(m16dst && r16src) {
+                        assembler_->lockadd(m16dst.value(), r16src.value());
+                    } else if(m16dst && imm16src) {
+                        assembler_->lockadd(m16dst.value(), imm16src.value());
+                    } else if(m32dst && r32src) {
+                        assembler_->lockadd(m32dst.value(), r32src.value());
+                    } else if(m32dst && imm32src) {
+                        assembler_->lockadd(m32dst.value(), imm32src.value());
+                    } else if(m64dst && r64src) {
+                        assembler_->lockadd(m64dst.value(), r64src.value());
+                    } else if(m64dst && imm32src) {
+                        assembler_->lockadd(m64dst.value(), imm32src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::LOCKSUB: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
+                    auto r8src = ins.in2().as<R8>();
+                    auto r16src = ins.in2().as<R16>();
+                    auto r32src = ins.in2().as<R32>();
+                    auto r64src = ins.in2().as<R64>();
+
+                    auto imm8src = ins.in2().as<i8>();
+                    auto imm16src = ins.in2().as<i16>();
+                    auto imm32src = ins.in2().as<i32>();
+
+                    if(m8dst && r8src) {
+                        assembler_->locksub(m8dst.value(), r8src.value());
+                    } else if(m8dst && imm8src) {
+                        assembler_->locksub(m8dst.value(), imm8src.value());
+                    } else if(m16dst && r16src) {
+                        assembler_->locksub(m16dst.value(), r16src.value());
+                    } else if(m16dst && imm16src) {
+                        assembler_->locksub(m16dst.value(), imm16src.value());
+                    } else if(m32dst && r32src) {
+                        assembler_->locksub(m32dst.value(), r32src.value());
+                    } else if(m32dst && imm32src) {
+                        assembler_->locksub(m32dst.value(), imm32src.value());
+                    } else if(m64dst && r64src) {
+                        assembler_->locksub(m64dst.value(), r64src.value());
+                    } else if(m64dst && imm32src) {
+                        assembler_->locksub(m64dst.value(), imm32src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::LOCKOR: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
+                    auto r8src = ins.in2().as<R8>();
+                    auto r16src = ins.in2().as<R16>();
+                    auto r32src = ins.in2().as<R32>();
+                    auto r64src = ins.in2().as<R64>();
+
+                    auto imm8src = ins.in2().as<i8>();
+                    auto imm16src = ins.in2().as<i16>();
+                    auto imm32src = ins.in2().as<i32>();
+
+                    if(m8dst && r8src) {
+                        assembler_->lockor(m8dst.value(), r8src.value());
+                    } else if(m8dst && imm8src) {
+                        assembler_->lockor(m8dst.value(), imm8src.value());
+                    } else if(m16dst && r16src) {
+                        assembler_->lockor(m16dst.value(), r16src.value());
+                    } else if(m16dst && imm16src) {
+                        assembler_->lockor(m16dst.value(), imm16src.value());
+                    } else if(m32dst && r32src) {
+                        assembler_->lockor(m32dst.value(), r32src.value());
+                    } else if(m32dst && imm32src) {
+                        assembler_->lockor(m32dst.value(), imm32src.value());
+                    } else if(m64dst && r64src) {
+                        assembler_->lockor(m64dst.value(), r64src.value());
+                    } else if(m64dst && imm32src) {
+                        assembler_->lockor(m64dst.value(), imm32src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::LOCKINC: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
+                    if(m8dst) {
+                        assembler_->lockinc(m8dst.value());
+                    } else if(m16dst) {
+                        assembler_->lockinc(m16dst.value());
+                    } else if(m32dst) {
+                        assembler_->lockinc(m32dst.value());
+                    } else if(m64dst) {
+                        assembler_->lockinc(m64dst.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::LOCKDEC: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
+                    if(m8dst) {
+                        assembler_->lockdec(m8dst.value());
+                    } else if(m16dst) {
+                        assembler_->lockdec(m16dst.value());
+                    } else if(m32dst) {
+                        assembler_->lockdec(m32dst.value());
+                    } else if(m64dst) {
+                        assembler_->lockdec(m64dst.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::LOCKBTS: {
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m16dst == ins.in1().as<M16>());
+                    assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+
+                    auto r16src = ins.in2().as<R16>();
+                    auto r32src = ins.in2().as<R32>();
+                    auto r64src = ins.in2().as<R64>();
+                    auto imm8src = ins.in2().as<u8>();
+
+                    if(m16dst && r16src) {
+                        assembler_->lockbts(m16dst.value(), r16src.value());
+                    } else if(m16dst && imm8src) {
+                        assembler_->lockbts(m16dst.value(), imm8src.value());
+                    } else if(m32dst && r32src) {
+                        assembler_->lockbts(m32dst.value(), r32src.value());
+                    } else if(m32dst && imm8src) {
+                        assembler_->lockbts(m32dst.value(), imm8src.value());
+                    } else if(m64dst && r64src) {
+                        assembler_->lockbts(m64dst.value(), r64src.value());
+                    } else if(m64dst && imm8src) {
+                        assembler_->lockbts(m64dst.value(), imm8src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
                 case ir::Op::LOCKCMPXCHG: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
                     auto m32dst = ins.out().as<M32>();
                     auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
                     assert(m32dst == ins.in1().as<M32>());
                     assert(m64dst == ins.in1().as<M64>());
+                    auto r8src = ins.in2().as<R8>();
+                    auto r16src = ins.in2().as<R16>();
                     auto r32src = ins.in2().as<R32>();
                     auto r64src = ins.in2().as<R64>();
 
-                    if(m32dst && r32src) {
+                    if(m8dst && r8src) {
+                        assembler_->lockcmpxchg(m8dst.value(), r8src.value());
+                    } else if(m16dst && r16src) {
+                        assembler_->lockcmpxchg(m16dst.value(), r16src.value());
+                    } else if(m32dst && r32src) {
                         assembler_->lockcmpxchg(m32dst.value(), r32src.value());
                     } else if(m64dst && r64src) {
                         assembler_->lockcmpxchg(m64dst.value(), r64src.value());
@@ -882,13 +1287,38 @@ namespace x64 {
                     }
                     break;
                 }
+                case ir::Op::LOCKCMPXCHG16B: {
+                    auto m128dst = ins.out().as<M128>();
+                    assert(m128dst == ins.in1().as<M128>());
+                    if(m128dst) {
+                        assembler_->lockcmpxchg16b(m128dst.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
                 case ir::Op::LOCKXADD: {
+                    auto m8dst = ins.out().as<M8>();
+                    auto m16dst = ins.out().as<M16>();
                     auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    assert(m8dst == ins.in1().as<M8>());
+                    assert(m16dst == ins.in1().as<M16>());
                     assert(m32dst == ins.in1().as<M32>());
+                    assert(m64dst == ins.in1().as<M64>());
+                    auto r8src = ins.in2().as<R8>();
+                    auto r16src = ins.in2().as<R16>();
                     auto r32src = ins.in2().as<R32>();
+                    auto r64src = ins.in2().as<R64>();
 
-                    if(m32dst && r32src) {
+                    if(m8dst && r8src) {
+                        assembler_->lockxadd(m8dst.value(), r8src.value());
+                    } else if(m16dst && r16src) {
+                        assembler_->lockxadd(m16dst.value(), r16src.value());
+                    } else if(m32dst && r32src) {
                         assembler_->lockxadd(m32dst.value(), r32src.value());
+                    } else if(m64dst && r64src) {
+                        assembler_->lockxadd(m64dst.value(), r64src.value());
                     } else {
                         return fail();
                     }
@@ -1009,11 +1439,37 @@ namespace x64 {
                 }
                 case ir::Op::TZCNT: {
                     auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+
                     assert(r32dst == ins.in1().as<R32>());
+                    assert(r64dst == ins.in1().as<R64>());
+
                     auto r32src2 = ins.in2().as<R32>();
+                    auto r64src2 = ins.in2().as<R64>();
 
                     if(r32dst && r32src2) {
                         assembler_->tzcnt(r32dst.value(), r32src2.value());
+                    } else if(r64dst && r64src2) {
+                        assembler_->tzcnt(r64dst.value(), r64src2.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::POPCNT: {
+                    auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+
+                    assert(r32dst == ins.in1().as<R32>());
+                    assert(r64dst == ins.in1().as<R64>());
+
+                    auto r32src2 = ins.in2().as<R32>();
+                    auto r64src2 = ins.in2().as<R64>();
+
+                    if(r32dst && r32src2) {
+                        assembler_->popcnt(r32dst.value(), r32src2.value());
+                    } else if(r64dst && r64src2) {
+                        assembler_->popcnt(r64dst.value(), r64src2.value());
                     } else {
                         return fail();
                     }
@@ -3082,6 +3538,54 @@ namespace x64 {
                     }
                     break;
                 }
+                case ir::Op::PMAXUW: {
+                    auto r128dst = ins.out().as<XMM>();
+                    assert(r128dst == ins.in1().as<XMM>());
+                    auto r128src = ins.in2().as<XMM>();
+
+                    if(r128dst && r128src) {
+                        assembler_->pmaxuw(r128dst.value(), r128src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::PMAXUD: {
+                    auto r128dst = ins.out().as<XMM>();
+                    assert(r128dst == ins.in1().as<XMM>());
+                    auto r128src = ins.in2().as<XMM>();
+
+                    if(r128dst && r128src) {
+                        assembler_->pmaxud(r128dst.value(), r128src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::PMINUW: {
+                    auto r128dst = ins.out().as<XMM>();
+                    assert(r128dst == ins.in1().as<XMM>());
+                    auto r128src = ins.in2().as<XMM>();
+
+                    if(r128dst && r128src) {
+                        assembler_->pminuw(r128dst.value(), r128src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::PMINUD: {
+                    auto r128dst = ins.out().as<XMM>();
+                    assert(r128dst == ins.in1().as<XMM>());
+                    auto r128src = ins.in2().as<XMM>();
+
+                    if(r128dst && r128src) {
+                        assembler_->pminud(r128dst.value(), r128src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
                 case ir::Op::PMOVZXBW: {
                     auto r128dst = ins.out().as<XMM>();
                     auto r128src = ins.in1().as<XMM>();
@@ -3194,6 +3698,173 @@ namespace x64 {
                     }
                     break;
                 }
+                case ir::Op::PCMPISTRI: {
+                    assert(ins.out().as<R32>() == R32::ECX);
+                    auto r128src1 = ins.in1().as<XMM>();
+                    auto r128src2 = ins.in2().as<XMM>();
+                    auto imm = ins.in3().as<u8>();
+
+                    if(r128src1 && r128src2 && imm) {
+                        assembler_->pcmpistri(r128src1.value(), r128src2.value(), imm.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::PCMPESTRI: {
+                    assert(ins.out().as<R32>() == R32::ECX);
+                    auto r128src1 = ins.in1().as<XMM>();
+                    auto r128src2 = ins.in2().as<XMM>();
+                    auto imm = ins.in3().as<u8>();
+
+                    if(r128src1 && r128src2 && imm) {
+                        assembler_->pcmpestri(r128src1.value(), r128src2.value(), imm.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::CRC32: {
+                    auto r32dst = ins.out().as<R32>();
+                    auto r64dst = ins.out().as<R64>();
+
+                    assert(r32dst == ins.in1().as<R32>());
+                    assert(r64dst == ins.in1().as<R64>());
+
+                    auto r8src2 = ins.in2().as<R8>();
+                    auto r16src2 = ins.in2().as<R16>();
+                    auto r32src2 = ins.in2().as<R32>();
+                    auto r64src2 = ins.in2().as<R64>();
+
+                    if(r32dst && r8src2) {
+                        assembler_->crc32(r32dst.value(), r8src2.value());
+                    } else if(r32dst && r16src2) {
+                        assembler_->crc32(r32dst.value(), r16src2.value());
+                    } else if(r32dst && r32src2) {
+                        assembler_->crc32(r32dst.value(), r32src2.value());
+                    } else if(r64dst && r64src2) {
+                        assembler_->crc32(r64dst.value(), r64src2.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::FLD: {
+                    auto m32src = ins.in1().as<M32>();
+                    auto m64src = ins.in1().as<M64>();
+                    auto m80src = ins.in1().as<M80>();
+
+                    if(m32src) {
+                        assembler_->fld(m32src.value());
+                    } else if(m64src) {
+                        assembler_->fld(m64src.value());
+                    } else if(m80src) {
+                        assembler_->fld(m80src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::FILD: {
+                    auto m16src = ins.in1().as<M16>();
+                    auto m32src = ins.in1().as<M32>();
+                    auto m64src = ins.in1().as<M64>();
+
+                    if(m16src) {
+                        assembler_->fild(m16src.value());
+                    } else if(m32src) {
+                        assembler_->fild(m32src.value());
+                    } else if(m64src) {
+                        assembler_->fild(m64src.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::FSTP: {
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+                    auto m80dst = ins.out().as<M80>();
+
+                    if(m32dst) {
+                        assembler_->fstp(m32dst.value());
+                    } else if(m64dst) {
+                        assembler_->fstp(m64dst.value());
+                    } else if(m80dst) {
+                        assembler_->fstp(m80dst.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::FISTTP: {
+                    auto m16dst = ins.out().as<M16>();
+                    auto m32dst = ins.out().as<M32>();
+                    auto m64dst = ins.out().as<M64>();
+
+                    if(m16dst) {
+                        assembler_->fisttp(m16dst.value());
+                    } else if(m32dst) {
+                        assembler_->fisttp(m32dst.value());
+                    } else if(m64dst) {
+                        assembler_->fisttp(m64dst.value());
+                    } else {
+                        return fail();
+                    }
+                    break;
+                }
+                case ir::Op::FPOP: {
+                    assembler_->fpop();
+                    break;
+                }
+                case ir::Op::FLDZ: {
+                    assembler_->fldz();
+                    break;
+                }
+                case ir::Op::FLD1: {
+                    assembler_->fld1();
+                    break;
+                }
+                case ir::Op::FLDLG2: {
+                    assembler_->fldlg2();
+                    break;
+                }
+                case ir::Op::FADDP: {
+                    assembler_->faddp();
+                    break;
+                }
+                case ir::Op::FSUBP: {
+                    assembler_->fsubp();
+                    break;
+                }
+                case ir::Op::FMULP: {
+                    assembler_->fmulp();
+                    break;
+                }
+                case ir::Op::FDIVP: {
+                    assembler_->fdivp();
+                    break;
+                }
+                case ir::Op::FCOMIP: {
+                    assembler_->fcomip();
+                    break;
+                }
+                case ir::Op::FUCOMIP: {
+                    assembler_->fucomip();
+                    break;
+                }
+                case ir::Op::FABS: {
+                    assembler_->fabs();
+                    break;
+                }
+                case ir::Op::FCHS: {
+                    assembler_->fchs();
+                    break;
+                }
+                case ir::Op::EMMS: {
+                    assembler_->emms();
+                    break;
+                }
             }
         }
 
@@ -3206,6 +3877,8 @@ namespace x64 {
             offsetOfReplaceableJumpToConditionalBlock,
             offsetOfReplaceableCallstackPush,
             offsetOfReplaceableCallstackPop,
+            {},
+            true,
         };
     }
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "x64/compiler/codepatcher.h"
+#include "verify.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+namespace x64 {
+
+    CodePatcher::CodePatcher() {
+        for(auto& epoch : workerEpochs_) epoch.store(0, std::memory_order_relaxed);
+    }
+
+    CodePatcher::~CodePatcher() = default;
+
+    size_t CodePatcher::enter() {
+        u64 epoch = epoch_.load();
+        for(size_t slot = 0; slot < workerEpochs_.size(); ++slot) {
+            u64 expected = 0;
+            if(workerEpochs_[slot].compare_exchange_strong(expected, epoch)) return slot;
+        }
+        verify(false, "Too many workers running jitted code");
+        return 0;
+    }
+
+    void CodePatcher::leave(size_t slot) {
+        assert(slot < workerEpochs_.size());
+        workerEpochs_[slot].store(0, std::memory_order_release);
+    }
+
+    u64 CodePatcher::oldestRunningEpoch() const {
+        u64 oldest = std::numeric_limits<u64>::max();
+        for(const auto& slot : workerEpochs_) {
+            u64 epoch = slot.load();
+            if(epoch != 0) oldest = std::min(oldest, epoch);
+        }
+        return oldest;
+    }
+
+    void CodePatcher::retire(std::shared_ptr<const void> memory) {
+        // the workers entering from now on only see what replaced the memory
+        u64 epoch = epoch_.fetch_add(1) + 1;
+        if(oldestRunningEpoch() >= epoch) return;
+        retired_.push_back(RetiredMemory{epoch, std::move(memory)});
+    }
+
+    void CodePatcher::write(u8* ptr, size_t size, const std::vector<u8>& code) {
+        verify((u64)ptr % REGION_ALIGNMENT == 0, "Replaceable code is not aligned");
+        verify(code.size() >= 2 && code.size() <= size, "Replacement code does not fit");
+        verify(size - 2 <= (size_t)std::numeric_limits<i8>::max(), "Replaceable code is too large to be skipped");
+        auto pending = std::find_if(pendingWrites_.begin(), pendingWrites_.end(), [&](const PendingWrite& write) {
+            return write.ptr == ptr;
+        });
+        if(pending != pendingWrites_.end()) {
+            // the region is already skipped, only the code to write changes
+            pending->code = code;
+            return;
+        }
+        const u8 skip[2] { 0xeb, (u8)(size - 2) };
+        storeHead(ptr, skip, sizeof(skip));
+        u64 epoch = epoch_.fetch_add(1) + 1;
+        if(oldestRunningEpoch() >= epoch) {
+            complete(ptr, code);
+        } else {
+            pendingWrites_.push_back(PendingWrite{epoch, ptr, code});
+        }
+    }
+
+    void CodePatcher::synchronize() {
+        if(!hasPendingChanges()) return;
+        u64 oldest = oldestRunningEpoch();
+        retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [&](const RetiredMemory& retired) {
+            return retired.epoch <= oldest;
+        }), retired_.end());
+        pendingWrites_.erase(std::remove_if(pendingWrites_.begin(), pendingWrites_.end(), [&](const PendingWrite& write) {
+            if(write.epoch > oldest) return false;
+            complete(write.ptr, write.code);
+            return true;
+        }), pendingWrites_.end());
+    }
+
+    void CodePatcher::storeHead(u8* ptr, const u8* bytes, size_t count) {
+        assert((u64)ptr % REGION_ALIGNMENT == 0);
+        assert(count <= sizeof(u64));
+        static_assert(sizeof(std::atomic<u64>) == sizeof(u64), "size of atomic<u64> does not match size of u64");
+        std::atomic<u64>* head = reinterpret_cast<std::atomic<u64>*>(ptr);
+        u64 value = head->load(std::memory_order_relaxed);
+        std::memcpy(&value, bytes, count);
+        head->store(value, std::memory_order_release);
+    }
+
+    void CodePatcher::complete(u8* ptr, const std::vector<u8>& code) {
+        // nothing runs past the head of the region, which is written last
+        if(code.size() > sizeof(u64)) std::memcpy(ptr + sizeof(u64), code.data() + sizeof(u64), code.size() - sizeof(u64));
+        storeHead(ptr, code.data(), std::min(code.size(), sizeof(u64)));
+    }
+
+}
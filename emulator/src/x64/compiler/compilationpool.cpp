@@ -0,0 +1,104 @@
+#include "x64/compiler/compilationpool.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include "verify.h"
+
+namespace x64 {
+
+    CompilationPool::CompilationPool(u32 nbThreads) {
+        workers_.reserve(nbThreads);
+        for(u32 i = 0; i < nbThreads; ++i) {
+            workers_.emplace_back([this]() { run(); });
+        }
+    }
+
+    CompilationPool::~CompilationPool() {
+        cancelAll();
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wakeUp_.notify_all();
+        for(auto& worker : workers_) worker.join();
+    }
+
+    bool CompilationPool::trySubmit(std::shared_ptr<CompilationRequest> request) {
+        verify(!!request);
+        verify(!!request->jitBasicBlock);
+        verify(!request->basicBlocks.empty());
+        verify(request->basicBlocks.size() == request->basicBlockPtrs.size());
+        request->generation = generation_.load();
+        request->state.store(CompilationRequest::State::QUEUED, std::memory_order_relaxed);
+        pendingRequests_.fetch_add(1);
+        if(!queue_.tryPush(std::move(request))) {
+            pendingRequests_.fetch_sub(1);
+            return false;
+        }
+        if(sleepingWorkers_.load() > 0) {
+            // taking the lock guarantees that the sleeping worker is waiting, and won't miss the notification
+            { std::lock_guard lock(mutex_); }
+            wakeUp_.notify_one();
+        }
+        return true;
+    }
+
+    void CompilationPool::cancelAll() {
+        // Requests submitted before this point are stale: workers will not start them anymore.
+        // The ones that are already being compiled still reference their basic blocks, wait for them.
+        generation_.fetch_add(1);
+        while(busyWorkers_.load() > 0) std::this_thread::yield();
+    }
+
+    void CompilationPool::run() {
+        Compiler compiler;
+        while(true) {
+            busyWorkers_.fetch_add(1);
+            std::shared_ptr<CompilationRequest> request;
+            if(queue_.tryPop(&request)) {
+                pendingRequests_.fetch_sub(1);
+                if(!isStale(*request)) {
+                    compile(compiler, *request);
+                } else {
+                    request->state.store(CompilationRequest::State::FAILED, std::memory_order_release);
+                }
+                busyWorkers_.fetch_sub(1);
+                continue;
+            }
+            busyWorkers_.fetch_sub(1);
+
+            std::unique_lock lock(mutex_);
+            sleepingWorkers_.fetch_add(1);
+            wakeUp_.wait(lock, [&]() { return stop_ || pendingRequests_.load() > 0; });
+            sleepingWorkers_.fetch_sub(1);
+            if(stop_) return;
+        }
+    }
+
+    void CompilationPool::compile(Compiler& compiler, CompilationRequest& request) {
+        request.state.store(CompilationRequest::State::COMPILING, std::memory_order_relaxed);
+        compiler.setStats(&request.stats);
+        std::optional<NativeBasicBlock> nativeBasicBlock = compiler.tryCompileTrace(request.basicBlocks,
+                request.optimizationLevel, request.basicBlockPtrs, request.jitBasicBlock.get(), request.flagsLiveOut);
+        u32 compiledBasicBlocks = (u32)request.basicBlocks.size();
+        bool flagsLiveOut = request.flagsLiveOut;
+        if(!nativeBasicBlock && request.basicBlocks.size() > 1) {
+            // a trace that does not compile may still have a compilable head, which exits to more places
+            std::vector<const BasicBlock*> head { request.basicBlocks[0] };
+            std::vector<const void*> headPtr { request.basicBlockPtrs[0] };
+            nativeBasicBlock = compiler.tryCompileTrace(head, request.optimizationLevel, headPtr, request.jitBasicBlock.get());
+            compiledBasicBlocks = 1;
+            flagsLiveOut = true;
+        }
+        compiler.setStats(nullptr);
+        request.telemetry = compiler.telemetry();
+        if(!nativeBasicBlock) {
+            request.state.store(CompilationRequest::State::FAILED, std::memory_order_release);
+            return;
+        }
+        request.nativeBasicBlock = std::move(nativeBasicBlock);
+        request.compiledBasicBlocks = compiledBasicBlocks;
+        request.compiledWithFlagsLiveOut = flagsLiveOut;
+        request.state.store(CompilationRequest::State::READY, std::memory_order_release);
+    }
+
+}
@@ -1,14 +1,20 @@
 #include "x64/compiler/compiler.h"
 #include "x64/compiler/assembler.h"
 #include "x64/compiler/codegenerator.h"
+#include "x64/compiler/codepatcher.h"
 #include "x64/compiler/irgenerator.h"
 #include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
 #include "x64/compiler/optimizer.h"
 #include "x64/disassembler/zydiswrapper.h"
+#include "x64/x87.h"
 #include "verify.h"
 #include <fmt/format.h>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <unordered_set>
 
 namespace x64 {
 
@@ -18,13 +24,26 @@ namespace x64 {
     M64 make64(R64 base, i32 disp);
     M64 make64(R64 base, R64 index, u8 scale, i32 disp);
 
-    Compiler::Compiler() {
+    M80 make80(R64 base, R64 index, u8 scale, i32 disp);
+
+    M128 make128(R64 base, R64 index, u8 scale, i32 disp);
+
+    static Cond getReverseCondition(Cond condition);
+
+    Compiler::Compiler() : hostFeatures_(host::hostFeatures()) {
         generator_ = std::make_unique<ir::IrGenerator>();
         optimizer_ = std::make_unique<ir::Optimizer>();
         optimizer_->addPass<ir::DeadCodeElimination>();
         optimizer_->addPass<ir::ImmediateReadBackElimination>();
         optimizer_->addPass<ir::DelayedReadBackElimination>();
         optimizer_->addPass<ir::DuplicateInstructionElimination>();
+        optimizer_->addPass<ir::ConstantPropagation>();
+        optimizer_->addPass<ir::CopyPropagation>();
+        optimizer_->addPass<ir::AddressFolding>();
+        if(hostFeatures_.bmi1) optimizer_->addPass<ir::AndnFusion>();
+        registerAllocator_ = std::make_unique<ir::RegisterAllocator>(get(Reg::REG_BASE));
+        peepholeOptimizer_ = std::make_unique<ir::Optimizer>();
+        peepholeOptimizer_->addPass<ir::MemoryOperandFolding>();
         codeGenerator_ = std::make_unique<CodeGenerator>();
         assembler_ = std::make_unique<Assembler>();
     }
@@ -32,56 +51,93 @@ namespace x64 {
     Compiler::~Compiler() = default;
 
     std::optional<ir::IR> Compiler::tryCompileIR(const BasicBlock& basicBlock, int optimizationLevel, const void* basicBlockPtr, const void* jitBasicBlockPtr, bool diagnose) {
+        return tryCompileTraceIR({&basicBlock}, optimizationLevel, {basicBlockPtr}, jitBasicBlockPtr, true, diagnose);
+    }
+
+    std::optional<ir::IR> Compiler::tryCompileTraceIR(const std::vector<const BasicBlock*>& basicBlocks, int optimizationLevel, const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr, bool flagsLiveOut, bool diagnose) {
+        verify(!basicBlocks.empty(), "Cannot compile empty trace");
+        verify(basicBlocks.size() == basicBlockPtrs.size(), "Trace blocks and pointers mismatch");
 #ifdef COMPILER_DEBUG
     std::vector<Insn> must {{
         Insn::REP_MOVS_M8_M8
     }};
 
     for(Insn insn : must) {
-        if(std::none_of(basicBlock.instructions().begin(), basicBlock.instructions().end(), [=](const auto& ins) {
-            return ins.first.insn() == insn;
+        if(std::none_of(basicBlocks.begin(), basicBlocks.end(), [=](const BasicBlock* basicBlock) {
+            return std::any_of(basicBlock->instructions().begin(), basicBlock->instructions().end(), [=](const auto& ins) {
+                return ins.first.insn() == insn;
+            });
         })) return {};
     }
 #endif
         try {
+            registerAllocatorStats_ = ir::RegisterAllocator::Stats{};
+            interpreterCallouts_ = 0;
+            eliminatedFlagUpdates_ = 0;
+            relocations_.clear();
+            telemetry_ = CompileTelemetry{};
+            for(const BasicBlock* basicBlock : basicBlocks) {
+                telemetry_.guestInstructions += (u32)basicBlock->instructions().size();
+            }
+
+            // A block exits either to the next one in the trace, or out of the trace
+            flagsLiveAfter_.resize(basicBlocks.size());
+            bool flagsLiveIn = flagsLiveOut;
+            for(size_t i = basicBlocks.size(); i --> 0;) {
+                bool flagsLiveAtExit = (i+1 < basicBlocks.size()) ? (flagsLiveOut || flagsLiveIn) : flagsLiveOut;
+                flagsLiveIn = computeFlagsLiveness(*basicBlocks[i], flagsLiveAtExit, &flagsLiveAfter_[i]);
+            }
+
+            std::vector<ir::IR> pieces;
+            pieces.reserve(3*basicBlocks.size()+1);
+
             // Generate the block's entrypoint
             auto entry = basicBlockEntrypoint();
             if(!entry) return {};
-
-            // Try compiling all non-terminating instructions.
-            auto body = basicBlockBody(basicBlock, diagnose);
-            if(!body) return {};
-
-            if(optimizationLevel >= 1) {
-                ir::Optimizer::Stats stats;
-                optimizer_->optimize(body.value(), &stats);
+            pieces.push_back(std::move(entry.value()));
+
+            u32 nbInstructionsInTrace = 0;
+            for(size_t i = 0; i < basicBlocks.size(); ++i) {
+                const BasicBlock& basicBlock = *basicBlocks[i];
+                nbInstructionsInTrace += (u32)basicBlock.instructions().size();
+
+                // Try compiling all non-terminating instructions.
+                if(!tryCompileBody(basicBlock, (u32)i, flagsLiveAfter_[i], optimizationLevel, diagnose, &pieces)) return {};
+
+                if(i+1 < basicBlocks.size()) {
+                    // Stay inside the trace on the expected path, leave it otherwise
+                    auto link = traceLink(basicBlock, *basicBlocks[i+1], nbInstructionsInTrace, (u32)i, basicBlockPtrs[i], jitBasicBlockPtr);
+                    if(!link) {
+                        if(diagnose) fmt::print("Compilation of trace failed: cannot link block {}/{}\n", i, basicBlocks.size());
+                        return {};
+                    }
+                    pieces.push_back(std::move(link.value()));
+                }
             }
 
             // Then, just before the last instruction is where we are sure to still be on the execution path
             // Update everything here (e.g. number of ticks)
-            auto exitPreparation = prepareExit((u32)basicBlock.instructions().size(), (u64)basicBlockPtr, (u64)jitBasicBlockPtr);
+            auto exitPreparation = prepareExit(nbInstructionsInTrace, (u32)(basicBlocks.size()-1), basicBlockPtrs.back(), jitBasicBlockPtr);
             if(!exitPreparation) return {};
+            pieces.push_back(std::move(exitPreparation.value()));
 
             // Then, try compiling the last instruction
-            auto basicBlockExit = Compiler::basicBlockExit(basicBlock, diagnose);
+            auto basicBlockExit = Compiler::basicBlockExit(*basicBlocks.back(), diagnose);
             if(!basicBlockExit) return {};
-            
+            pieces.push_back(std::move(basicBlockExit.value()));
+
+            size_t nbInstructions = 0;
+            size_t nbLabels = 0;
+            for(const auto& piece : pieces) {
+                nbInstructions += piece.nbInstructions();
+                nbLabels += piece.nbLabels();
+            }
             ir::IR wholeIr;
-            wholeIr.reserveInstructions(
-                    entry->nbInstructions()
-                    + body->nbInstructions()
-                    + exitPreparation->nbInstructions()
-                    + basicBlockExit->nbInstructions());
-            wholeIr.reserveLabels(
-                    entry->nbLabels()
-                    + body->nbLabels()
-                    + exitPreparation->nbLabels()
-                    + basicBlockExit->nbLabels());
-            wholeIr
-                .add(entry.value())
-                .add(body.value())
-                .add(exitPreparation.value())
-                .add(basicBlockExit.value());
+            wholeIr.reserveInstructions(nbInstructions);
+            wholeIr.reserveLabels(nbLabels);
+            for(const auto& piece : pieces) {
+                wholeIr.add(piece);
+            }
             return wholeIr;
         } catch(std::exception& e) {
             warn(fmt::format("Error while compiling: {}", e.what()));
@@ -90,9 +146,30 @@ namespace x64 {
     }
 
     std::optional<NativeBasicBlock> Compiler::tryCompile(const BasicBlock& basicBlock, int optimizationLevel, const void* basicBlockPtr, const void* jitBasicBlockPtr, bool diagnose) {
-        auto wholeIr = tryCompileIR(basicBlock, optimizationLevel, basicBlockPtr, jitBasicBlockPtr, diagnose);
-        if(!wholeIr) return {};
+        return tryCompileTrace({&basicBlock}, optimizationLevel, {basicBlockPtr}, jitBasicBlockPtr, true, diagnose);
+    }
+
+    std::optional<NativeBasicBlock> Compiler::tryCompileTrace(const std::vector<const BasicBlock*>& basicBlocks, int optimizationLevel, const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr, bool flagsLiveOut, bool diagnose) {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&]() {
+            return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        };
+        auto wholeIr = tryCompileTraceIR(basicBlocks, optimizationLevel, basicBlockPtrs, jitBasicBlockPtr, flagsLiveOut, diagnose);
+        if(!wholeIr) {
+            telemetry_.compileTimeNs = elapsed();
+            return {};
+        }
         auto bb = codeGenerator_->tryGenerate(wholeIr.value());
+        if(!!bb && !!stats_) {
+            for(const BasicBlock* basicBlock : basicBlocks) {
+                stats_->compiledGuestInstructions_ += basicBlock->instructions().size();
+            }
+            stats_->compiledIrInstructions_ += wholeIr->instructions.size();
+            stats_->allocatedGuestRegisters_ += registerAllocatorStats_.allocatedRegisters;
+            stats_->removedRegisterFileAccesses_ += registerAllocatorStats_.removedRegisterFileAccesses;
+            stats_->interpretedInstructions_ += interpreterCallouts_;
+            stats_->eliminatedFlagUpdates_ += eliminatedFlagUpdates_;
+        }
         
         if(false && !bb) {
             for(size_t i = 0; i < wholeIr->instructions.size(); ++i) {
@@ -105,27 +182,35 @@ namespace x64 {
             fmt::print("\n");
             std::abort();
         }
+        telemetry_.compileTimeNs = elapsed();
         if(!bb) return {};
+        telemetry_.nativeCodeSize = (u32)bb->nativecode.size();
+        telemetry_.compiled = true;
         
         if(!!bb->offsetOfReplaceableCallstackPush) {
             size_t offset = bb->offsetOfReplaceableCallstackPush->first;
             auto* replacementLocation = bb->nativecode.data() + offset;
-            const auto& replacementCode = pushCallstackCode(0x0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+            u64 returnAddress = bb->offsetOfReplaceableCallstackPush->second;
+            const auto& replacementCode = pushCallstackCode(0x0, returnAddress, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
             assert(offset + replacementCode.size() <= bb->nativecode.size());
             memcpy(replacementLocation, replacementCode.data(), replacementCode.size());
         }
         
         if(!!bb->offsetOfReplaceableCallstackPop) {
             auto* replacementLocation = bb->nativecode.data() + bb->offsetOfReplaceableCallstackPop.value();
-            const auto& replacementCode = popCallstackCode(Reg::GPR0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+            const auto& replacementCode = popCallstackCode(Reg::GPR0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1}, TmpReg{Reg::MEM_ADDR});
             assert(bb->offsetOfReplaceableCallstackPop.value() + replacementCode.size() <= bb->nativecode.size());
             memcpy(replacementLocation, replacementCode.data(), replacementCode.size());
         }
+
+        addRelocations(basicBlocks, basicBlockPtrs, jitBasicBlockPtr, &bb.value());
         
 #ifdef COMPILER_DEBUG
         fmt::print("Compile block:\n");
-        for(const auto& blockIns : basicBlock.instructions()) {
-            fmt::print("  {:#8x} {}\n", blockIns.first.address(), blockIns.first.toString());
+        for(const BasicBlock* basicBlock : basicBlocks) {
+            for(const auto& blockIns : basicBlock->instructions()) {
+                fmt::print("  {:#8x} {}\n", blockIns.first.address(), blockIns.first.toString());
+            }
         }
         fmt::print("Compilation success !\n");
         fmt::print("IR:\n");
@@ -142,6 +227,48 @@ namespace x64 {
         return bb;
     }
 
+    void Compiler::loadHostPointer(R64 dst, const void* ptr, NativeRelocation::Kind kind, u32 block, u32 instruction) {
+        u32 index = (u32)relocations_.size();
+        relocations_.push_back(NativeRelocation{0, kind, block, instruction});
+        generator_->movHostPointer(dst, (u64)ptr, index);
+    }
+
+    void Compiler::addRelocations(const std::vector<const BasicBlock*>& basicBlocks, const std::vector<const void*>& basicBlockPtrs, const void* jitBasicBlockPtr, NativeBasicBlock* bb) const {
+        bb->relocations.clear();
+        std::unordered_set<size_t> relocatedOffsets;
+        for(const auto& [index, offset] : codeGenerator_->relocationOffsets()) {
+            assert(index < relocations_.size());
+            assert(offset + sizeof(u64) <= bb->nativecode.size());
+            NativeRelocation relocation = relocations_[index];
+            relocation.offset = (u32)offset;
+            bb->relocations.push_back(relocation);
+            relocatedOffsets.insert(offset);
+        }
+
+        // Any other immediate holding one of the trace's host pointers was not recorded when it was emitted,
+        // or is a guest value that happens to look like one: the code is then kept to this process.
+        std::unordered_set<u64> hostPointers;
+        auto addHostPointer = [&](const void* ptr) {
+            if(!!ptr) hostPointers.insert((u64)ptr);
+        };
+        addHostPointer(jitBasicBlockPtr);
+        addHostPointer((const void*)&Jit::interpret);
+        for(size_t b = 0; b < basicBlocks.size(); ++b) {
+            addHostPointer(basicBlockPtrs[b]);
+            for(const auto& ins : basicBlocks[b]->instructions()) {
+                addHostPointer(&ins.first);
+                addHostPointer((const void*)ins.second.exec);
+            }
+        }
+        for(size_t offset : codeGenerator_->imm64Offsets()) {
+            if(relocatedOffsets.count(offset) > 0) continue;
+            assert(offset + sizeof(u64) <= bb->nativecode.size());
+            u64 value = 0;
+            std::memcpy(&value, bb->nativecode.data() + offset, sizeof(value));
+            if(hostPointers.count(value) > 0) bb->relocatable = false;
+        }
+    }
+
     std::optional<NativeBasicBlock> Compiler::tryCompileJitTrampoline() {
         // Add the entrypoint code for when we are entering jitted code from the emulator
         auto entryCode = jitEntry();
@@ -159,7 +286,155 @@ namespace x64 {
         return code;
     }
 
+    void Compiler::tryCompileIndirectBranchCacheLookup() {
+        // save R13 and R14
+        generator_->push64(R64::R13);
+        generator_->push64(R64::R14);
+
+        // load the cache ptr into R13
+        constexpr size_t CACHE_OFFSET = offsetof(NativeArguments, indirectBranchCache);
+        static_assert(CACHE_OFFSET == 0xc0);
+        const R64 CACHE_BASE = R64::R13;
+        generator_->mov(CACHE_BASE, make64(R64::RDI, CACHE_OFFSET));
+
+        // load the lookup address into R14
+        readReg64(Reg::GPR0, R64::RIP);
+        const R64 SEARCHED_ADDRESS = R64::R14;
+        generator_->mov(SEARCHED_ADDRESS, get(Reg::GPR0));
+
+        // compute the index of the entry in GPR1
+        static_assert(IndirectBranchCache::indexOf(0x123456789abcdef0) == ((((0x123456789abcdef0 >> 12) ^ 0x123456789abcdef0) >> 4) & (IndirectBranchCache::SIZE-1)));
+        R64 INDEX = get(Reg::GPR1);
+        generator_->mov(INDEX, SEARCHED_ADDRESS);
+        generator_->shr(INDEX, 12);
+        generator_->xor_(INDEX, SEARCHED_ADDRESS);
+        generator_->shr(INDEX, 4);
+        generator_->and_(INDEX, (i32)(IndirectBranchCache::SIZE-1));
+
+        ir::IrGenerator::Label& fail = generator_->label();
+        ir::IrGenerator::Label& exit = generator_->label();
+
+        // if the entry holds another address, fail the lookup
+        constexpr size_t ADDRESSES_OFFSET = offsetof(IndirectBranchCache, addresses);
+        static_assert(ADDRESSES_OFFSET == 0x0);
+        generator_->mov(get(Reg::GPR0), make64(CACHE_BASE, INDEX, 8, ADDRESSES_OFFSET));
+        generator_->cmp(get(Reg::GPR0), SEARCHED_ADDRESS);
+        generator_->jumpCondition(x64::Cond::NE, &fail);
+
+        // otherwise, GPR0 holds the pointer to the native basic block (or nullptr)
+        constexpr size_t ENTRYPOINTS_OFFSET = offsetof(IndirectBranchCache, entrypoints);
+        static_assert(ENTRYPOINTS_OFFSET == 8*IndirectBranchCache::SIZE);
+        generator_->mov(get(Reg::GPR0), make64(CACHE_BASE, INDEX, 8, (i32)ENTRYPOINTS_OFFSET));
+
+#ifdef MULTIPROCESSING
+        // another worker may have replaced the entry meanwhile: it clears the address first
+        generator_->mov(CACHE_BASE, make64(CACHE_BASE, INDEX, 8, ADDRESSES_OFFSET));
+        generator_->cmp(CACHE_BASE, SEARCHED_ADDRESS);
+        generator_->jumpCondition(x64::Cond::NE, &fail);
+#endif
+
+        // indirect branches may form loops, give the scheduler a chance to run
+        clearIfTickLimitReached(get(Reg::GPR0), CACHE_BASE, SEARCHED_ADDRESS);
+        generator_->jump(&exit);
+
+        // FAIL
+        generator_->putLabel(fail);
+
+        // store nullptr
+        generator_->xor_(get(Reg::GPR0), get(Reg::GPR0));
+        // fallthrough to exit
+
+        // EXIT
+        generator_->putLabel(exit);
+
+        // restore R14 and R13
+        generator_->pop64(R64::R14);
+        generator_->pop64(R64::R13);
+    }
+
+    void Compiler::tryCompileJumpTableLookup(Reg entryAddress) {
+        // save R13 and R14
+        generator_->push64(R64::R13);
+        generator_->push64(R64::R14);
+
+        // load the jump table ptr into R13
+        constexpr size_t BBPTR_OFFSET = offsetof(NativeArguments, currentlyExecutingJitBasicBlock);
+        static_assert(BBPTR_OFFSET == 0x58);
+        M64 bbPtr = make64(R64::RDI, BBPTR_OFFSET);
+        generator_->mov(R64::R13, bbPtr);
+        // the table is published at once, so that all of its fields are read from the same version
+        M64 tablePtr = make64(R64::R13, JUMP_TABLE_OFFSET);
+        generator_->mov(R64::R13, tablePtr);
+        const R64 TABLE_BASE = R64::R13;
+
+        ir::IrGenerator::Label& fail = generator_->label();
+        ir::IrGenerator::Label& exit = generator_->label();
+
+        // compute the index of the entry in R14
+        constexpr size_t BASE_OFFSET = offsetof(JumpTable, base);
+        static_assert(BASE_OFFSET == 0x00);
+        const R64 INDEX = R64::R14;
+        generator_->mov(INDEX, get(entryAddress));
+        generator_->mov(get(Reg::GPR1), make64(TABLE_BASE, BASE_OFFSET));
+        generator_->sub(INDEX, get(Reg::GPR1));
+        generator_->shr(INDEX, 3);
+
+        // if the entry is outside of the table, fail the lookup
+        constexpr size_t SIZE_OFFSET = offsetof(JumpTable, size);
+        static_assert(SIZE_OFFSET == 0x08);
+        generator_->mov(get(Reg::GPR1), make64(TABLE_BASE, SIZE_OFFSET));
+        generator_->cmp(INDEX, get(Reg::GPR1));
+        generator_->jumpCondition(x64::Cond::AE, &fail);
+
+        // if the guest table does not hold the target the entry was made for anymore, fail the lookup
+        constexpr size_t TARGETS_OFFSET = offsetof(JumpTable, targets);
+        static_assert(TARGETS_OFFSET == 0x10);
+        generator_->mov(get(Reg::GPR1), make64(TABLE_BASE, TARGETS_OFFSET));
+        generator_->mov(get(Reg::GPR1), make64(get(Reg::GPR1), INDEX, 8, 0));
+        readReg64(Reg::GPR0, R64::RIP);
+        generator_->cmp(get(Reg::GPR0), get(Reg::GPR1));
+        generator_->jumpCondition(x64::Cond::NE, &fail);
+
+        // otherwise, load the basic block address
+        constexpr size_t BLOCKS_OFFSET = offsetof(JumpTable, blocks);
+        static_assert(BLOCKS_OFFSET == 0x18);
+        generator_->mov(get(Reg::GPR0), make64(TABLE_BASE, BLOCKS_OFFSET));
+        generator_->mov(get(Reg::GPR1), make64(get(Reg::GPR0), INDEX, 8, 0));
+
+        // GPR1 now holds the pointer to the emulator::JitBasicBlock
+        generator_->test(get(Reg::GPR1), get(Reg::GPR1));
+        generator_->jumpCondition(x64::Cond::E, &fail);
+
+        generator_->mov(get(Reg::GPR0), make64(get(Reg::GPR1), NATIVE_BLOCK_OFFSET));
+
+        // GPR0 now holds the pointer to the native basic block
+
+        // indirect branches may form loops, give the scheduler a chance to run
+        clearIfTickLimitReached(get(Reg::GPR0), TABLE_BASE, INDEX);
+        generator_->jump(&exit);
+
+        // FAIL
+        generator_->putLabel(fail);
+
+        // store nullptr
+        generator_->xor_(get(Reg::GPR0), get(Reg::GPR0));
+        // fallthrough to exit
+
+        // EXIT
+        generator_->putLabel(exit);
+
+        // restore R14 and R13
+        generator_->pop64(R64::R14);
+        generator_->pop64(R64::R13);
+    }
+
     void Compiler::tryCompileBlockLookup() {
+        // try the cache shared by all blocks first
+        tryCompileIndirectBranchCacheLookup();
+        ir::IrGenerator::Label& found = generator_->label();
+        generator_->test(get(Reg::GPR0), get(Reg::GPR0));
+        generator_->jumpCondition(x64::Cond::NE, &found);
+
         // save R13, R14 and R15
         generator_->push64(R64::R13);
         generator_->push64(R64::R14);
@@ -173,7 +448,7 @@ namespace x64 {
         generator_->mov(R64::R13, bbPtr);
         // 2- load the ptr to the lookup table
         M64 tablePtr = make64(R64::R13, BLOCK_LOOKUP_TABLE_OFFSET);
-        generator_->lea(R64::R13, tablePtr);
+        generator_->mov(R64::R13, tablePtr);
         const R64 TABLE_BASE = R64::R13;
 
         // load the lookup address into R14
@@ -227,6 +502,9 @@ namespace x64 {
 
         generator_->test(get(Reg::GPR0), get(Reg::GPR0));
         generator_->jumpCondition(x64::Cond::E, &fail);
+
+        // indirect branches may form loops, give the scheduler a chance to run
+        clearIfTickLimitReached(get(Reg::GPR0), TABLE_BASE, SEARCHED_ADDRESS);
         generator_->jump(&exit);
 
 
@@ -253,6 +531,8 @@ namespace x64 {
         generator_->pop64(R64::R15);
         generator_->pop64(R64::R14);
         generator_->pop64(R64::R13);
+
+        generator_->putLabel(found);
     }
 
     bool Compiler::tryCompile(const X64Instruction& ins) {
@@ -339,6 +619,12 @@ namespace x64 {
             case Insn::SAR_RM32_IMM: return tryCompileSarRM32Imm(ins.op0<RM32>(), ins.op1<Imm>());
             case Insn::SAR_RM64_R8: return tryCompileSarRM64R8(ins.op0<RM64>(), ins.op1<R8>());
             case Insn::SAR_RM64_IMM: return tryCompileSarRM64Imm(ins.op0<RM64>(), ins.op1<Imm>());
+            case Insn::SHLX_R32_RM32_R32: return tryCompileShlxR32RM32R32(ins.op0<R32>(), ins.op1<RM32>(), ins.op2<R32>());
+            case Insn::SHLX_R64_RM64_R64: return tryCompileShlxR64RM64R64(ins.op0<R64>(), ins.op1<RM64>(), ins.op2<R64>());
+            case Insn::SHRX_R32_RM32_R32: return tryCompileShrxR32RM32R32(ins.op0<R32>(), ins.op1<RM32>(), ins.op2<R32>());
+            case Insn::SHRX_R64_RM64_R64: return tryCompileShrxR64RM64R64(ins.op0<R64>(), ins.op1<RM64>(), ins.op2<R64>());
+            case Insn::SARX_R32_RM32_R32: return tryCompileSarxR32RM32R32(ins.op0<R32>(), ins.op1<RM32>(), ins.op2<R32>());
+            case Insn::SARX_R64_RM64_R64: return tryCompileSarxR64RM64R64(ins.op0<R64>(), ins.op1<RM64>(), ins.op2<R64>());
             case Insn::ROL_RM16_R8: return tryCompileRolRM16R8(ins.op0<RM16>(), ins.op1<R8>());
             case Insn::ROL_RM16_IMM: return tryCompileRolRM16Imm(ins.op0<RM16>(), ins.op1<Imm>());
             case Insn::ROL_RM32_R8: return tryCompileRolRM32R8(ins.op0<RM32>(), ins.op1<R8>());
@@ -407,17 +693,59 @@ namespace x64 {
             case Insn::DEC_RM16: return tryCompileDecRM16(ins.op0<RM16>());
             case Insn::DEC_RM32: return tryCompileDecRM32(ins.op0<RM32>());
             case Insn::DEC_RM64: return tryCompileDecRM64(ins.op0<RM64>());
-#ifndef MULTIPROCESSING
             case Insn::XCHG_RM8_R8: return tryCompileXchgRM8R8(ins.op0<RM8>(), ins.op1<R8>());
             case Insn::XCHG_RM16_R16: return tryCompileXchgRM16R16(ins.op0<RM16>(), ins.op1<R16>());
             case Insn::XCHG_RM32_R32: return tryCompileXchgRM32R32(ins.op0<RM32>(), ins.op1<R32>());
             case Insn::XCHG_RM64_R64: return tryCompileXchgRM64R64(ins.op0<RM64>(), ins.op1<R64>());
             case Insn::CMPXCHG_RM32_R32: return tryCompileCmpxchgRM32R32(ins.op0<RM32>(), ins.op1<R32>());
             case Insn::CMPXCHG_RM64_R64: return tryCompileCmpxchgRM64R64(ins.op0<RM64>(), ins.op1<R64>());
+            case Insn::LOCK_ADD_M8_RM8: return tryCompileLockAddM8RM8(ins.op0<M8>(), ins.op1<RM8>());
+            case Insn::LOCK_ADD_M8_IMM: return tryCompileLockAddM8Imm(ins.op0<M8>(), ins.op1<Imm>());
+            case Insn::LOCK_ADD_M16_RM16: return tryCompileLockAddM16RM16(ins.op0<M16>(), ins.op1<RM16>());
+            case Insn::LOCK_ADD_M16_IMM: return tryCompileLockAddM16Imm(ins.op0<M16>(), ins.op1<Imm>());
+            case Insn::LOCK_ADD_M32_RM32: return tryCompileLockAddM32RM32(ins.op0<M32>(), ins.op1<RM32>());
+            case Insn::LOCK_ADD_M32_IMM: return tryCompileLockAddM32Imm(ins.op0<M32>(), ins.op1<Imm>());
+            case Insn::LOCK_ADD_M64_RM64: return tryCompileLockAddM64RM64(ins.op0<M64>(), ins.op1<RM64>());
+            case Insn::LOCK_ADD_M64_IMM: return tryCompileLockAddM64Imm(ins.op0<M64>(), ins.op1<Imm>());
+            case Insn::LOCK_SUB_M8_RM8: return tryCompileLockSubM8RM8(ins.op0<M8>(), ins.op1<RM8>());
+            case Insn::LOCK_SUB_M8_IMM: return tryCompileLockSubM8Imm(ins.op0<M8>(), ins.op1<Imm>());
+            case Insn::LOCK_SUB_M16_RM16: return tryCompileLockSubM16RM16(ins.op0<M16>(), ins.op1<RM16>());
+            case Insn::LOCK_SUB_M16_IMM: return tryCompileLockSubM16Imm(ins.op0<M16>(), ins.op1<Imm>());
+            case Insn::LOCK_SUB_M32_RM32: return tryCompileLockSubM32RM32(ins.op0<M32>(), ins.op1<RM32>());
+            case Insn::LOCK_SUB_M32_IMM: return tryCompileLockSubM32Imm(ins.op0<M32>(), ins.op1<Imm>());
+            case Insn::LOCK_SUB_M64_RM64: return tryCompileLockSubM64RM64(ins.op0<M64>(), ins.op1<RM64>());
+            case Insn::LOCK_SUB_M64_IMM: return tryCompileLockSubM64Imm(ins.op0<M64>(), ins.op1<Imm>());
+            case Insn::LOCK_OR_M8_RM8: return tryCompileLockOrM8RM8(ins.op0<M8>(), ins.op1<RM8>());
+            case Insn::LOCK_OR_M8_IMM: return tryCompileLockOrM8Imm(ins.op0<M8>(), ins.op1<Imm>());
+            case Insn::LOCK_OR_M16_RM16: return tryCompileLockOrM16RM16(ins.op0<M16>(), ins.op1<RM16>());
+            case Insn::LOCK_OR_M16_IMM: return tryCompileLockOrM16Imm(ins.op0<M16>(), ins.op1<Imm>());
+            case Insn::LOCK_OR_M32_RM32: return tryCompileLockOrM32RM32(ins.op0<M32>(), ins.op1<RM32>());
+            case Insn::LOCK_OR_M32_IMM: return tryCompileLockOrM32Imm(ins.op0<M32>(), ins.op1<Imm>());
+            case Insn::LOCK_OR_M64_RM64: return tryCompileLockOrM64RM64(ins.op0<M64>(), ins.op1<RM64>());
+            case Insn::LOCK_OR_M64_IMM: return tryCompileLockOrM64Imm(ins.op0<M64>(), ins.op1<Imm>());
+            case Insn::LOCK_INC_M8: return tryCompileLockIncM8(ins.op0<M8>());
+            case Insn::LOCK_INC_M16: return tryCompileLockIncM16(ins.op0<M16>());
+            case Insn::LOCK_INC_M32: return tryCompileLockIncM32(ins.op0<M32>());
+            case Insn::LOCK_INC_M64: return tryCompileLockIncM64(ins.op0<M64>());
+            case Insn::LOCK_DEC_M8: return tryCompileLockDecM8(ins.op0<M8>());
+            case Insn::LOCK_DEC_M16: return tryCompileLockDecM16(ins.op0<M16>());
+            case Insn::LOCK_DEC_M32: return tryCompileLockDecM32(ins.op0<M32>());
+            case Insn::LOCK_DEC_M64: return tryCompileLockDecM64(ins.op0<M64>());
+            case Insn::LOCK_BTS_M16_R16: return tryCompileLockBtsM16R16(ins.op0<M16>(), ins.op1<R16>());
+            case Insn::LOCK_BTS_M16_IMM: return tryCompileLockBtsM16Imm(ins.op0<M16>(), ins.op1<Imm>());
+            case Insn::LOCK_BTS_M32_R32: return tryCompileLockBtsM32R32(ins.op0<M32>(), ins.op1<R32>());
+            case Insn::LOCK_BTS_M32_IMM: return tryCompileLockBtsM32Imm(ins.op0<M32>(), ins.op1<Imm>());
+            case Insn::LOCK_BTS_M64_R64: return tryCompileLockBtsM64R64(ins.op0<M64>(), ins.op1<R64>());
+            case Insn::LOCK_BTS_M64_IMM: return tryCompileLockBtsM64Imm(ins.op0<M64>(), ins.op1<Imm>());
+            case Insn::LOCK_CMPXCHG_M8_R8: return tryCompileLockCmpxchgM8R8(ins.op0<M8>(), ins.op1<R8>());
+            case Insn::LOCK_CMPXCHG_M16_R16: return tryCompileLockCmpxchgM16R16(ins.op0<M16>(), ins.op1<R16>());
             case Insn::LOCK_CMPXCHG_M32_R32: return tryCompileLockCmpxchgM32R32(ins.op0<M32>(), ins.op1<R32>());
             case Insn::LOCK_CMPXCHG_M64_R64: return tryCompileLockCmpxchgM64R64(ins.op0<M64>(), ins.op1<R64>());
+            case Insn::LOCK_CMPXCHG16B_M128: return tryCompileLockCmpxchg16BM128(ins.op0<M128>());
+            case Insn::LOCK_XADD_M8_R8: return tryCompileLockXaddM8R8(ins.op0<M8>(), ins.op1<R8>());
+            case Insn::LOCK_XADD_M16_R16: return tryCompileLockXaddM16R16(ins.op0<M16>(), ins.op1<R16>());
             case Insn::LOCK_XADD_M32_R32: return tryCompileLockXaddM32R32(ins.op0<M32>(), ins.op1<R32>());
-#endif
+            case Insn::LOCK_XADD_M64_R64: return tryCompileLockXaddM64R64(ins.op0<M64>(), ins.op1<R64>());
             case Insn::CWDE: return tryCompileCwde();
             case Insn::CDQE: return tryCompileCdqe();
             case Insn::CDQ: return tryCompileCdq();
@@ -435,6 +763,9 @@ namespace x64 {
             case Insn::BSF_R64_R64: return tryCompileBsfR64R64(ins.op0<R64>(), ins.op1<R64>());
             case Insn::BSR_R32_R32: return tryCompileBsrR32R32(ins.op0<R32>(), ins.op1<R32>());
             case Insn::TZCNT_R32_RM32: return tryCompileTzcntR32RM32(ins.op0<R32>(), ins.op1<RM32>());
+            case Insn::TZCNT_R64_RM64: return tryCompileTzcntR64RM64(ins.op0<R64>(), ins.op1<RM64>());
+            case Insn::POPCNT_R32_RM32: return tryCompilePopcntR32RM32(ins.op0<R32>(), ins.op1<RM32>());
+            case Insn::POPCNT_R64_RM64: return tryCompilePopcntR64RM64(ins.op0<R64>(), ins.op1<RM64>());
             case Insn::SET_RM8: return tryCompileSetRM8(ins.op0<Cond>(), ins.op1<RM8>());
             case Insn::CMOV_R32_RM32: return tryCompileCmovR32RM32(ins.op0<Cond>(), ins.op1<R32>(), ins.op2<RM32>());
             case Insn::CMOV_R64_RM64: return tryCompileCmovR64RM64(ins.op0<Cond>(), ins.op1<R64>(), ins.op2<RM64>());
@@ -709,6 +1040,10 @@ namespace x64 {
 
             case Insn::PMAXSD_XMM_XMMM128: return tryCompilePmaxsdXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
             case Insn::PMINSD_XMM_XMMM128: return tryCompilePminsdXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
+            case Insn::PMAXUW_XMM_XMMM128: return tryCompilePmaxuwXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
+            case Insn::PMAXUD_XMM_XMMM128: return tryCompilePmaxudXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
+            case Insn::PMINUW_XMM_XMMM128: return tryCompilePminuwXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
+            case Insn::PMINUD_XMM_XMMM128: return tryCompilePminudXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
             case Insn::PMOVZXBW_XMM_XMM: return tryCompilePmovzxbwXMMXMM(ins.op0<XMM>(), ins.op1<XMM>());
             case Insn::ROUNDPS_XMM_XMM_IMM: return tryCompileRoundpsXmmXmmImm(ins.op0<XMM>(), ins.op1<XMM>(), ins.op2<Imm>());
             case Insn::ROUNDPD_XMM_XMM_IMM: return tryCompileRoundpdXmmXmmImm(ins.op0<XMM>(), ins.op1<XMM>(), ins.op2<Imm>());
@@ -719,7 +1054,57 @@ namespace x64 {
             case Insn::BLENDVPS_XMM_XMMM128: return tryCompileBlendvpsXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
             case Insn::PBLENDVB_XMM_XMMM128: return tryCompilePblendvbXmmXmmM128(ins.op0<XMM>(), ins.op1<XMMM128>());
 
+            case Insn::PCMPISTRI_XMM_XMMM128_IMM: return tryCompilePcmpistriXmmXmmM128Imm(ins.op0<XMM>(), ins.op1<XMMM128>(), ins.op2<Imm>());
+            case Insn::PCMPESTRI_XMM_XMMM128_IMM: return tryCompilePcmpestriXmmXmmM128Imm(ins.op0<XMM>(), ins.op1<XMMM128>(), ins.op2<Imm>());
+            case Insn::CRC32_R32_RM8: return tryCompileCrc32R32RM8(ins.op0<R32>(), ins.op1<RM8>());
+            case Insn::CRC32_R32_RM16: return tryCompileCrc32R32RM16(ins.op0<R32>(), ins.op1<RM16>());
+            case Insn::CRC32_R32_RM32: return tryCompileCrc32R32RM32(ins.op0<R32>(), ins.op1<RM32>());
+            case Insn::CRC32_R64_RM64: return tryCompileCrc32R64RM64(ins.op0<R64>(), ins.op1<RM64>());
+
             case Insn::STMXCSR_M32: return tryCompileStmxcsrM32(ins.op0<M32>());
+
+            // x87
+            case Insn::FLDZ: return tryCompileFldz();
+            case Insn::FLD1: return tryCompileFld1();
+            case Insn::FLDLG2: return tryCompileFldlg2();
+            case Insn::FLD_ST: return tryCompileFldST(ins.op0<ST>());
+            case Insn::FLD_M32: return tryCompileFldM32(ins.op0<M32>());
+            case Insn::FLD_M64: return tryCompileFldM64(ins.op0<M64>());
+            case Insn::FLD_M80: return tryCompileFldM80(ins.op0<M80>());
+            case Insn::FILD_M16: return tryCompileFildM16(ins.op0<M16>());
+            case Insn::FILD_M32: return tryCompileFildM32(ins.op0<M32>());
+            case Insn::FILD_M64: return tryCompileFildM64(ins.op0<M64>());
+            case Insn::FSTP_ST: return tryCompileFstpST(ins.op0<ST>());
+            case Insn::FSTP_M32: return tryCompileFstpM32(ins.op0<M32>());
+            case Insn::FSTP_M64: return tryCompileFstpM64(ins.op0<M64>());
+            case Insn::FSTP_M80: return tryCompileFstpM80(ins.op0<M80>());
+            case Insn::FISTP_M16: return tryCompileFistpM16(ins.op0<M16>());
+            case Insn::FISTP_M32: return tryCompileFistpM32(ins.op0<M32>());
+            case Insn::FISTP_M64: return tryCompileFistpM64(ins.op0<M64>());
+            case Insn::FXCH_ST: return tryCompileFxchST(ins.op0<ST>());
+            case Insn::FADD_M32: return tryCompileFaddM32(ins.op0<M32>());
+            case Insn::FADD_M64: return tryCompileFaddM64(ins.op0<M64>());
+            case Insn::FADDP_ST: return tryCompileFaddpST(ins.op0<ST>());
+            case Insn::FSUB_ST_M32: return tryCompileFsubSTM32(ins.op0<ST>(), ins.op1<M32>());
+            case Insn::FSUB_ST_M64: return tryCompileFsubSTM64(ins.op0<ST>(), ins.op1<M64>());
+            case Insn::FSUB_ST_ST: return tryCompileFsubSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FSUBRP_ST: return tryCompileFsubrpST(ins.op0<ST>());
+            case Insn::FMUL1_M32: return tryCompileFmul1M32(ins.op0<M32>());
+            case Insn::FMUL1_M64: return tryCompileFmul1M64(ins.op0<M64>());
+            case Insn::FMUL_ST_ST: return tryCompileFmulSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FMULP_ST_ST: return tryCompileFmulpSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FDIV_ST_ST: return tryCompileFdivSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FDIV_M32: return tryCompileFdivM32(ins.op0<M32>());
+            case Insn::FDIVP_ST_ST: return tryCompileFdivpSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FDIVR_ST_ST: return tryCompileFdivrSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FDIVR_M32: return tryCompileFdivrM32(ins.op0<M32>());
+            case Insn::FDIVRP_ST_ST: return tryCompileFdivrpSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FCOMI_ST_ST: return tryCompileFcomiSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FCOMIP_ST_ST: return tryCompileFcomipSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FUCOMI_ST_ST: return tryCompileFucomiSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FUCOMIP_ST_ST: return tryCompileFucomipSTST(ins.op0<ST>(), ins.op1<ST>());
+            case Insn::FABS: return tryCompileFabs();
+            case Insn::FCHS: return tryCompileFchs();
             default: break;
         }
         return false;
@@ -744,6 +1129,11 @@ namespace x64 {
     std::optional<ir::IR> Compiler::jitEntry() {
         generator_->clear();
         saveStack();
+        // guest registers may live in callee-saved registers while in jitted code
+        static_assert(ir::RegisterAllocator::HOST_REGISTERS.size() % 2 == 0, "Stack must remain 16-byte aligned");
+        for(R64 reg : ir::RegisterAllocator::HOST_REGISTERS) {
+            generator_->push64(reg);
+        }
         loadArguments(TmpReg{Reg::GPR1});
         loadFlagsFromEmulator(TmpReg{Reg::GPR1});
         callNativeBasicBlock(TmpReg{Reg::GPR1});
@@ -757,12 +1147,18 @@ namespace x64 {
         return generator_->generateIR();
     }
 
-    std::optional<ir::IR> Compiler::basicBlockBody(const BasicBlock& basicBlock, bool diagnose) {
+    std::optional<ir::IR> Compiler::basicBlockBody(const BasicBlock& basicBlock, const std::vector<bool>& flagsLiveAfter, bool diagnose) {
         generator_->clear();
+        hostX87StackIsEmpty_ = false;
         const auto& instructions = basicBlock.instructions();
         for(size_t i = 0; i+1 < instructions.size(); ++i) {
             const X64Instruction& ins = instructions[i].first;
-            if(!tryCompile(ins)) {
+            if(trySkipDeadFlagsInstruction(ins, flagsLiveAfter[i])) continue;
+            flagsLiveAfterInstruction_ = flagsLiveAfter[i];
+            bool compiled = tryCompile(ins);
+            flagsLiveAfterInstruction_ = true;
+            if(!compiled) {
+                reportUnsupported(ins);
                 if(diagnose) fmt::print("Compilation of block failed: {} ({}/{})\n", ins.toString(), i, instructions.size());
                 return {};
             }
@@ -770,11 +1166,196 @@ namespace x64 {
         return generator_->generateIR();
     }
 
-    std::optional<ir::IR> Compiler::prepareExit(u32 nbInstructionsInBlock, u64 basicBlockPtr, u64 jitBasicBlockPtr) {
+    bool Compiler::tryCompileBody(const BasicBlock& basicBlock, u32 blockInTrace, const std::vector<bool>& flagsLiveAfter, int optimizationLevel, bool diagnose, std::vector<ir::IR>* pieces) {
+        assert(!!pieces);
+        auto optimize = [&](const std::vector<ir::IR*>& runs) {
+            for(const ir::IR* ir : runs) telemetry_.irInstructionsBeforeOptimization += (u32)ir->instructions.size();
+            if(optimizationLevel >= 1) {
+                ir::Optimizer::Stats stats;
+                for(ir::IR* ir : runs) optimizer_->optimize(*ir, &stats);
+                // If one run cannot keep guest registers in host registers, the others still can on their own
+                if(!registerAllocator_->allocate(runs, &registerAllocatorStats_) && runs.size() > 1) {
+                    for(ir::IR* ir : runs) registerAllocator_->allocate(*ir, &registerAllocatorStats_);
+                }
+                for(ir::IR* ir : runs) peepholeOptimizer_->optimize(*ir, &stats);
+            }
+            for(const ir::IR* ir : runs) telemetry_.irInstructionsAfterOptimization += (u32)ir->instructions.size();
+        };
+
+        // Most of the time, all instructions can be compiled at once
+        u32 eliminatedFlagUpdates = eliminatedFlagUpdates_;
+        auto body = basicBlockBody(basicBlock, flagsLiveAfter, false);
+        if(!!body) {
+            optimize({&body.value()});
+            pieces->push_back(std::move(body.value()));
+            return true;
+        }
+
+        // Otherwise, compile the instructions one at a time and let the interpreter execute the others.
+        // Compiled instructions are grouped so they can still be optimized together,
+        // and all groups share their register allocation around the interpreter callouts.
+        eliminatedFlagUpdates_ = eliminatedFlagUpdates;
+        hostX87StackIsEmpty_ = false;
+        std::vector<ir::IR> bodyPieces;
+        std::vector<size_t> compiledRuns;
+        ir::IR compiledRun;
+        auto flushCompiledRun = [&]() {
+            if(compiledRun.instructions.empty()) return;
+            compiledRuns.push_back(bodyPieces.size());
+            bodyPieces.push_back(std::move(compiledRun));
+            compiledRun = ir::IR{};
+        };
+        const auto& instructions = basicBlock.instructions();
+        for(size_t i = 0; i+1 < instructions.size(); ++i) {
+            const X64Instruction& ins = instructions[i].first;
+            if(trySkipDeadFlagsInstruction(ins, flagsLiveAfter[i])) continue;
+            generator_->clear();
+            flagsLiveAfterInstruction_ = flagsLiveAfter[i];
+            bool compiled = tryCompile(ins);
+            flagsLiveAfterInstruction_ = true;
+            if(compiled) {
+                compiledRun.add(generator_->generateIR());
+                continue;
+            }
+            reportUnsupported(ins);
+            auto callout = interpreterCallout(ins, instructions[i].second.exec, blockInTrace, (u32)i, flagsLiveAfter[i]);
+            if(!callout) {
+                if(diagnose) fmt::print("Compilation of block failed: {} ({}/{})\n", ins.toString(), i, instructions.size());
+                return false;
+            }
+            flushCompiledRun();
+            bodyPieces.push_back(std::move(callout.value()));
+            ++interpreterCallouts_;
+            ++telemetry_.interpretedInstructions;
+        }
+        flushCompiledRun();
+
+        std::vector<ir::IR*> runs;
+        for(size_t run : compiledRuns) runs.push_back(&bodyPieces[run]);
+        if(!runs.empty()) optimize(runs);
+        for(ir::IR& piece : bodyPieces) pieces->push_back(std::move(piece));
+        return true;
+    }
+
+    void Compiler::reportUnsupported(const X64Instruction& ins) {
+        if(!!telemetry_.firstUnsupportedInstruction) return;
+        telemetry_.firstUnsupportedInstruction = ins;
+    }
+
+    static bool canDelegateToInterpreter(const X64Instruction& ins) {
+        // Control flow must be handled by the jit itself
+        if(ins.isBranch()) return false;
+        switch(ins.insn()) {
+            case Insn::SYSCALL:
+            case Insn::HALT:
+            case Insn::UD2:
+            case Insn::UNKNOWN:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    std::optional<ir::IR> Compiler::interpreterCallout(const X64Instruction& ins, CpuExecPtr execPtr, u32 blockInTrace, u32 instructionInBlock, bool flagsLiveAfter) {
+        if(!canDelegateToInterpreter(ins)) return {};
+        generator_->clear();
+
+        // The interpreter only needs the flags if it reads them or lets some of them through.
+        // Its flags only need to come back if something reads them.
+        bool storeFlags = ins.readsFlags() || (flagsLiveAfter && !ins.writesFlags());
+        bool loadFlags = flagsLiveAfter;
+        eliminatedFlagUpdates_ += (u32)!storeFlags + (u32)!loadFlags;
+
+        // The interpreter expects the instruction pointer to already point to the next instruction
+        writeReg64(R64::RIP, ins.nextAddress(), TmpReg{Reg::GPR0});
+        if(storeFlags) storeFlagsToEmulator(TmpReg{Reg::GPR1});
+
+        // Save the pointers to the emulator state, which are not preserved across calls.
+        // An even number of registers keeps the stack aligned.
+        std::array<R64, 6> savedRegisters {{
+            R64::RAX,
+            get(Reg::MEM_BASE),
+            get(Reg::XMM_BASE),
+            get(Reg::REG_BASE),
+            get(Reg::MMX_BASE),
+            R64::RDI,
+        }};
+        for(R64 reg : savedRegisters) generator_->push64(reg);
+
+        // Call Jit::interpret(arguments, &ins, execPtr). RDI already holds the arguments.
+        loadHostPointer(R64::RSI, &ins, NativeRelocation::Kind::INSTRUCTION, blockInTrace, instructionInBlock);
+        loadHostPointer(R64::RDX, (const void*)execPtr, NativeRelocation::Kind::INSTRUCTION_HANDLER, blockInTrace, instructionInBlock);
+        loadHostPointer(get(Reg::GPR0), (const void*)&Jit::interpret, NativeRelocation::Kind::INTERPRETER_ENTRYPOINT, 0, 0);
+        generator_->call(get(Reg::GPR0));
+        generator_->mov(get(Reg::GPR0), R64::RAX);
+        hostX87StackIsEmpty_ = false;
+
+        for(auto it = savedRegisters.rbegin(); it != savedRegisters.rend(); ++it) generator_->pop64(*it);
+
+        // If the interpreter failed, leave the jitted code right away.
+        // Jit::exec will then rethrow the error.
+        ir::IrGenerator::Label& success = generator_->label();
+        generator_->test(get(Reg::GPR0), get(Reg::GPR0));
+        generator_->jumpCondition(Cond::E, &success);
+        writeReg64(R64::RIP, ins.address(), TmpReg{Reg::GPR0});
+        restoreStack();
+        generator_->ret();
+        generator_->putLabel(success);
+
+        if(loadFlags) loadFlagsFromEmulator(TmpReg{Reg::GPR1});
+        return generator_->generateIR();
+    }
+
+    bool Compiler::computeFlagsLiveness(const BasicBlock& basicBlock, bool flagsLiveOut, std::vector<bool>* flagsLiveAfter) {
+        assert(!!flagsLiveAfter);
+        const auto& instructions = basicBlock.instructions();
+        flagsLiveAfter->resize(instructions.size());
+        bool live = flagsLiveOut;
+        for(size_t i = instructions.size(); i --> 0;) {
+            const X64Instruction& ins = instructions[i].first;
+            (*flagsLiveAfter)[i] = live;
+            if(ins.writesFlags()) live = false;
+            if(ins.readsFlags()) live = true;
+        }
+        return live;
+    }
+
+    bool Compiler::trySkipDeadFlagsInstruction(const X64Instruction& ins, bool flagsLiveAfter) {
+        if(flagsLiveAfter) return false;
+        // These only compute flags. Memory operands are still accessed, since they may fault.
+        auto skip = [&](bool operandsAreRegisters) {
+            if(!operandsAreRegisters) return false;
+            ++eliminatedFlagUpdates_;
+            return true;
+        };
+        switch(ins.insn()) {
+            case Insn::TEST_RM8_R8:
+            case Insn::TEST_RM8_IMM: return skip(ins.op0<RM8>().isReg);
+            case Insn::TEST_RM16_R16:
+            case Insn::TEST_RM16_IMM: return skip(ins.op0<RM16>().isReg);
+            case Insn::TEST_RM32_R32:
+            case Insn::TEST_RM32_IMM: return skip(ins.op0<RM32>().isReg);
+            case Insn::TEST_RM64_R64:
+            case Insn::TEST_RM64_IMM: return skip(ins.op0<RM64>().isReg);
+            case Insn::CMP_RM8_RM8: return skip(ins.op0<RM8>().isReg && ins.op1<RM8>().isReg);
+            case Insn::CMP_RM8_IMM: return skip(ins.op0<RM8>().isReg);
+            case Insn::CMP_RM16_RM16: return skip(ins.op0<RM16>().isReg && ins.op1<RM16>().isReg);
+            case Insn::CMP_RM16_IMM: return skip(ins.op0<RM16>().isReg);
+            case Insn::CMP_RM32_RM32: return skip(ins.op0<RM32>().isReg && ins.op1<RM32>().isReg);
+            case Insn::CMP_RM32_IMM: return skip(ins.op0<RM32>().isReg);
+            case Insn::CMP_RM64_RM64: return skip(ins.op0<RM64>().isReg && ins.op1<RM64>().isReg);
+            case Insn::CMP_RM64_IMM: return skip(ins.op0<RM64>().isReg);
+            case Insn::FCOMI_ST_ST:
+            case Insn::FUCOMI_ST_ST: return skip(true);
+            default: return false;
+        }
+    }
+
+    std::optional<ir::IR> Compiler::prepareExit(u32 nbInstructionsInBlock, u32 blockInTrace, const void* basicBlockPtr, const void* jitBasicBlockPtr) {
         generator_->clear();
         addTime(nbInstructionsInBlock);
         incrementCalls();
-        writeBasicBlockPtr(basicBlockPtr);
+        writeBasicBlockPtr(basicBlockPtr, blockInTrace);
         writeJitBasicBlockPtr(jitBasicBlockPtr);
         return generator_->generateIR();
     }
@@ -785,6 +1366,7 @@ namespace x64 {
         const X64Instruction& lastInstruction = instructions.back().first;
         auto jumps = tryCompileLastInstruction(lastInstruction);
         if(!jumps) {
+            reportUnsupported(lastInstruction);
             if(diagnose) fmt::print("Compilation of block failed: {} ({}/{})\n", lastInstruction.toString(), instructions.size(), instructions.size());
             return {};
         }
@@ -793,9 +1375,60 @@ namespace x64 {
         return generator_->generateIR();
     }
 
+    std::optional<ir::IR> Compiler::traceLink(const BasicBlock& current, const BasicBlock& next, u32 nbInstructionsInTrace, u32 blockInTrace, const void* basicBlockPtr, const void* jitBasicBlockPtr) {
+        generator_->clear();
+        const X64Instruction& lastInstruction = current.instructions().back().first;
+        u64 nextStart = next.instructions()[0].first.address();
+        if(!tryAdvanceInstructionPointer(lastInstruction.nextAddress())) return {};
+
+        auto linkJcc = [&](Cond condition, u64 dst) -> bool {
+            // figure out which side of the branch stays in the trace
+            Cond stayCondition = condition;
+            u64 exitAddress = lastInstruction.nextAddress();
+            if(dst != nextStart) {
+                if(lastInstruction.nextAddress() != nextStart) return false;
+                stayCondition = getReverseCondition(condition);
+                exitAddress = dst;
+            }
+            auto& stayInTrace = generator_->label();
+            generator_->jumpCondition(stayCondition, &stayInTrace);
+
+            // side exit: change the instruction pointer
+            loadImm64(Reg::GPR0, exitAddress);
+            writeReg64(R64::RIP, Reg::GPR0);
+
+            // report the block we are leaving from and exit
+            addTime(nbInstructionsInTrace);
+            incrementCalls();
+            writeBasicBlockPtr(basicBlockPtr, blockInTrace);
+            writeJitBasicBlockPtr(jitBasicBlockPtr);
+            restoreStack();
+            generator_->ret();
+
+            generator_->putLabel(stayInTrace);
+            return true;
+        };
+
+        bool linked = [&]() -> bool {
+            switch(lastInstruction.insn()) {
+                case Insn::JMP_U32: return lastInstruction.op0<u32>() == nextStart;
+                case Insn::JE: return linkJcc(Cond::E, lastInstruction.op0<u64>());
+                case Insn::JNE: return linkJcc(Cond::NE, lastInstruction.op0<u64>());
+                case Insn::JCC: return linkJcc(lastInstruction.op0<Cond>(), lastInstruction.op1<u64>());
+                default: return false;
+            }
+        }();
+        if(!linked) return {};
+        return generator_->generateIR();
+    }
+
     std::optional<ir::IR> Compiler::jitExit() {
         generator_->clear();
         storeFlagsToEmulator(TmpReg{Reg::GPR1});
+        const auto& hostRegisters = ir::RegisterAllocator::HOST_REGISTERS;
+        for(auto it = hostRegisters.rbegin(); it != hostRegisters.rend(); ++it) {
+            generator_->pop64(*it);
+        }
         restoreStack();
         generator_->ret();
         return generator_->generateIR();
@@ -1552,7 +2185,11 @@ namespace x64 {
 
     bool Compiler::tryCompileShlRM32R8(const RM32& lhs, R8 rhs) {
         return forRM32R8(lhs, rhs, [&](Reg dst, Reg src) {
-            generator_->shl(get32(dst), get8(src));
+            if(hostFeatures_.bmi2 && !flagsLiveAfterInstruction_) {
+                generator_->shlx(get32(dst), get32(dst), get32(src));
+            } else {
+                generator_->shl(get32(dst), get8(src));
+            }
         });
     }
 
@@ -1564,7 +2201,11 @@ namespace x64 {
 
     bool Compiler::tryCompileShlRM64R8(const RM64& lhs, R8 rhs) {
         return forRM64R8(lhs, rhs, [&](Reg dst, Reg src) {
-            generator_->shl(get(dst), get8(src));
+            if(hostFeatures_.bmi2 && !flagsLiveAfterInstruction_) {
+                generator_->shlx(get(dst), get(dst), get(src));
+            } else {
+                generator_->shl(get(dst), get8(src));
+            }
         });
     }
 
@@ -1600,7 +2241,11 @@ namespace x64 {
 
     bool Compiler::tryCompileShrRM32R8(const RM32& lhs, R8 rhs) {
         return forRM32R8(lhs, rhs, [&](Reg dst, Reg src) {
-            generator_->shr(get32(dst), get8(src));
+            if(hostFeatures_.bmi2 && !flagsLiveAfterInstruction_) {
+                generator_->shrx(get32(dst), get32(dst), get32(src));
+            } else {
+                generator_->shr(get32(dst), get8(src));
+            }
         });
     }
 
@@ -1612,7 +2257,11 @@ namespace x64 {
 
     bool Compiler::tryCompileShrRM64R8(const RM64& lhs, R8 rhs) {
         return forRM64R8(lhs, rhs, [&](Reg dst, Reg src) {
-            generator_->shr(get(dst), get8(src));
+            if(hostFeatures_.bmi2 && !flagsLiveAfterInstruction_) {
+                generator_->shrx(get(dst), get(dst), get(src));
+            } else {
+                generator_->shr(get(dst), get8(src));
+            }
         });
     }
 
@@ -1636,7 +2285,11 @@ namespace x64 {
 
     bool Compiler::tryCompileSarRM32R8(const RM32& lhs, R8 rhs) {
         return forRM32R8(lhs, rhs, [&](Reg dst, Reg src) {
-            generator_->sar(get32(dst), get8(src));
+            if(hostFeatures_.bmi2 && !flagsLiveAfterInstruction_) {
+                generator_->sarx(get32(dst), get32(dst), get32(src));
+            } else {
+                generator_->sar(get32(dst), get8(src));
+            }
         });
     }
 
@@ -1648,7 +2301,11 @@ namespace x64 {
 
     bool Compiler::tryCompileSarRM64R8(const RM64& lhs, R8 rhs) {
         return forRM64R8(lhs, rhs, [&](Reg dst, Reg src) {
-            generator_->sar(get(dst), get8(src));
+            if(hostFeatures_.bmi2 && !flagsLiveAfterInstruction_) {
+                generator_->sarx(get(dst), get(dst), get(src));
+            } else {
+                generator_->sar(get(dst), get8(src));
+            }
         });
     }
 
@@ -1658,6 +2315,54 @@ namespace x64 {
         });
     }
 
+    bool Compiler::tryCompileShlxR32RM32R32(R32 dst, const RM32& src, R32 count) {
+        if(!hostFeatures_.bmi2) return false;
+        return forRM32RM32(RM32{true, count, {}}, src, [&](Reg count, Reg src) {
+            generator_->shlx(get32(src), get32(src), get32(count));
+            writeReg32(dst, src);
+        }, false);
+    }
+
+    bool Compiler::tryCompileShlxR64RM64R64(R64 dst, const RM64& src, R64 count) {
+        if(!hostFeatures_.bmi2) return false;
+        return forRM64RM64(RM64{true, count, {}}, src, [&](Reg count, Reg src) {
+            generator_->shlx(get(src), get(src), get(count));
+            writeReg64(dst, src);
+        }, false);
+    }
+
+    bool Compiler::tryCompileShrxR32RM32R32(R32 dst, const RM32& src, R32 count) {
+        if(!hostFeatures_.bmi2) return false;
+        return forRM32RM32(RM32{true, count, {}}, src, [&](Reg count, Reg src) {
+            generator_->shrx(get32(src), get32(src), get32(count));
+            writeReg32(dst, src);
+        }, false);
+    }
+
+    bool Compiler::tryCompileShrxR64RM64R64(R64 dst, const RM64& src, R64 count) {
+        if(!hostFeatures_.bmi2) return false;
+        return forRM64RM64(RM64{true, count, {}}, src, [&](Reg count, Reg src) {
+            generator_->shrx(get(src), get(src), get(count));
+            writeReg64(dst, src);
+        }, false);
+    }
+
+    bool Compiler::tryCompileSarxR32RM32R32(R32 dst, const RM32& src, R32 count) {
+        if(!hostFeatures_.bmi2) return false;
+        return forRM32RM32(RM32{true, count, {}}, src, [&](Reg count, Reg src) {
+            generator_->sarx(get32(src), get32(src), get32(count));
+            writeReg32(dst, src);
+        }, false);
+    }
+
+    bool Compiler::tryCompileSarxR64RM64R64(R64 dst, const RM64& src, R64 count) {
+        if(!hostFeatures_.bmi2) return false;
+        return forRM64RM64(RM64{true, count, {}}, src, [&](Reg count, Reg src) {
+            generator_->sarx(get(src), get(src), get(count));
+            writeReg64(dst, src);
+        }, false);
+    }
+
     bool Compiler::tryCompileRolRM16R8(const RM16& lhs, R8 rhs) {
         return forRM16R8(lhs, rhs, [&](Reg dst, Reg src) {
             generator_->rol(get16(dst), get8(src));
@@ -2028,12 +2733,12 @@ namespace x64 {
 
         // INSERT NOPs HERE TO BE REPLACED WITH THE PUSH TO THE CALLSTACK
         generator_->reportPushCallstack(retAddress);
-        const auto& dummyPushCallstackCode = pushCallstackCode(0x0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        const auto& dummyPushCallstackCode = pushCallstackCode(0x0, retAddress, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
         generator_->uds(dummyPushCallstackCode.size());
 
         // INSERT NOPs HERE TO BE REPLACED WITH THE JMP
         generator_->reportJump(ir::IrGenerator::JumpKind::OTHER_BLOCk);
-        size_t jumpCodeSize = jmpCodeSize(0x0, TmpReg{Reg::GPR0});
+        size_t jumpCodeSize = replaceableJumpSize();
         generator_->nops(jumpCodeSize);
 
         return true;
@@ -2044,13 +2749,24 @@ namespace x64 {
         pop64(Reg::GPR0, TmpReg{Reg::GPR1});
         writeReg64(R64::RIP, Reg::GPR0);
 
+        // popping the callstack compares return addresses and clobbers the flags: they must be saved before it
+        storeFlagsToEmulator(TmpReg{Reg::GPR1});
+
         // INSERT NOPs HERE TO BE REPLACED WITH THE RET FROM THE CALLSTACK
         generator_->reportPopCallstack();
-        const auto& dummyPopCallstackCode = popCallstackCode(Reg::GPR0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        const auto& dummyPopCallstackCode = popCallstackCode(Reg::GPR0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1}, TmpReg{Reg::MEM_ADDR});
         generator_->uds(dummyPopCallstackCode.size());
         // GPR0 contains the pointer to the return segment or nullptr
 
-        storeFlagsToEmulator(TmpReg{Reg::GPR1});
+        // the code returned to may have been written to, leave once the tick limit is cleared
+        clearIfTickLimitReached(get(Reg::GPR0), get(Reg::GPR1), get(Reg::MEM_ADDR));
+
+        // the callstack does not know where to return, try the indirect branch cache
+        ir::IrGenerator::Label& found = generator_->label();
+        generator_->test(get(Reg::GPR0), get(Reg::GPR0));
+        generator_->jumpCondition(x64::Cond::NE, &found);
+        tryCompileIndirectBranchCacheLookup();
+        generator_->putLabel(found);
 
         generator_->test(get(Reg::GPR0), get(Reg::GPR0));
         ir::IrGenerator::Label& lookupFail = generator_->label();
@@ -2118,7 +2834,7 @@ namespace x64 {
 
         // INSERT NOPs HERE TO BE REPLACED WITH THE JMP
         generator_->reportJump(ir::IrGenerator::JumpKind::OTHER_BLOCk);
-        size_t jumpCodeSize = jmpCodeSize(0x0, TmpReg{Reg::GPR0});
+        size_t jumpCodeSize = replaceableJumpSize();
         generator_->nops(jumpCodeSize);
 
         auto& skipToExit = generator_->label();
@@ -2144,7 +2860,7 @@ namespace x64 {
 
         // INSERT NOPs HERE TO BE REPLACED WITH THE JMP
         generator_->reportJump(ir::IrGenerator::JumpKind::OTHER_BLOCk);
-        size_t jumpCodeSize = jmpCodeSize(0x0, TmpReg{Reg::GPR0});
+        size_t jumpCodeSize = replaceableJumpSize();
         generator_->nops(jumpCodeSize);
 
         return true;
@@ -2181,7 +2897,7 @@ namespace x64 {
 
         // INSERT NOPs HERE TO BE REPLACED WITH THE PUSH TO THE CALLSTACK
         generator_->reportPushCallstack(retAddress);
-        const auto& dummyPushCallstackCode = pushCallstackCode(0x0, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        const auto& dummyPushCallstackCode = pushCallstackCode(0x0, retAddress, TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
         generator_->uds(dummyPushCallstackCode.size());
 
         generator_->pop64(get(Reg::GPR0));
@@ -2228,8 +2944,19 @@ namespace x64 {
             writeReg64(R64::RIP, Reg::GPR0);
         }
 
+        // switch statements jump through [base + index*8], the jump table of the block is tried first
+        bool throughJumpTable = !dst.isReg && dst.mem.encoding.index != R64::ZERO && dst.mem.encoding.scale == 8;
+
         storeFlagsToEmulator(TmpReg{Reg::GPR1});
+        ir::IrGenerator::Label& lookupDone = generator_->label();
+        if(throughJumpTable) {
+            // MEM_ADDR still holds the address of the table entry
+            tryCompileJumpTableLookup(Reg::MEM_ADDR);
+            generator_->test(get(Reg::GPR0), get(Reg::GPR0));
+            generator_->jumpCondition(x64::Cond::NE, &lookupDone);
+        }
         tryCompileBlockLookup();
+        generator_->putLabel(lookupDone);
 
         generator_->test(get(Reg::GPR0), get(Reg::GPR0));
         ir::IrGenerator::Label& lookupFail = generator_->label();
@@ -2759,22 +3486,15 @@ namespace x64 {
             writeReg8(src, Reg::GPR1);
             return true;
         } else {
-            // fetch dst address
-            const M8& mem = dst.mem;
-            if(mem.segment == Segment::FS) return false;
-            if(mem.encoding.index == R64::RIP) return false;
-            // get the address
-            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, mem);
-            // read the dst value at the address
-            readMem8(Reg::GPR0, addr);
-            // read the src register
-            readReg8(Reg::GPR1, src);
-            // perform the op
-            generator_->xchg(get8(Reg::GPR0), get8(Reg::GPR1));
-            // write back to the register
-            writeMem8(addr, Reg::GPR0);
-            writeReg8(src, Reg::GPR1);
-            return true;
+            if(dst.mem.segment == Segment::FS) return false;
+            return forLockedM(dst.mem, [&](const M8& d) {
+                // read the src register
+                readReg8(Reg::GPR1, src);
+                // exchanging with memory is atomic
+                generator_->xchg(d, get8(Reg::GPR1));
+                // write back to the register
+                writeReg8(src, Reg::GPR1);
+            });
         }
     }
 
@@ -2791,23 +3511,16 @@ namespace x64 {
             writeReg16(src, Reg::GPR1);
             return true;
         } else {
-            // fetch dst address
-            const M16& mem = dst.mem;
-            if(mem.segment == Segment::FS) return false;
-            if(mem.encoding.index == R64::RIP) return false;
-            // get the address
-            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, mem);
-            // read the dst value at the address
-            readMem16(Reg::GPR0, addr);
-            // read the src register
-            readReg16(Reg::GPR1, src);
-            // perform the op
-            generator_->xchg(get16(Reg::GPR0), get16(Reg::GPR1));
-            // write back to the register
-            writeMem16(addr, Reg::GPR0);
-            writeReg16(src, Reg::GPR1);
-            return true;
-        }
+            if(dst.mem.segment == Segment::FS) return false;
+            return forLockedM(dst.mem, [&](const M16& d) {
+                // read the src register
+                readReg16(Reg::GPR1, src);
+                // exchanging with memory is atomic
+                generator_->xchg(d, get16(Reg::GPR1));
+                // write back to the register
+                writeReg16(src, Reg::GPR1);
+            });
+        }
     }
 
     bool Compiler::tryCompileXchgRM32R32(const RM32& dst, R32 src) {
@@ -2823,22 +3536,15 @@ namespace x64 {
             writeReg32(src, Reg::GPR1);
             return true;
         } else {
-            // fetch dst address
-            const M32& mem = dst.mem;
-            if(mem.segment == Segment::FS) return false;
-            if(mem.encoding.index == R64::RIP) return false;
-            // get the address
-            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, mem);
-            // read the dst value at the address
-            readMem32(Reg::GPR0, addr);
-            // read the src register
-            readReg32(Reg::GPR1, src);
-            // perform the op
-            generator_->xchg(get32(Reg::GPR0), get32(Reg::GPR1));
-            // write back to the register
-            writeMem32(addr, Reg::GPR0);
-            writeReg32(src, Reg::GPR1);
-            return true;
+            if(dst.mem.segment == Segment::FS) return false;
+            return forLockedM(dst.mem, [&](const M32& d) {
+                // read the src register
+                readReg32(Reg::GPR1, src);
+                // exchanging with memory is atomic
+                generator_->xchg(d, get32(Reg::GPR1));
+                // write back to the register
+                writeReg32(src, Reg::GPR1);
+            });
         }
     }
 
@@ -2855,22 +3561,15 @@ namespace x64 {
             writeReg64(src, Reg::GPR1);
             return true;
         } else {
-            // fetch dst address
-            const M64& mem = dst.mem;
-            if(mem.segment == Segment::FS) return false;
-            if(mem.encoding.index == R64::RIP) return false;
-            // get the address
-            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, mem);
-            // read the dst value at the address
-            readMem64(Reg::GPR0, addr);
-            // read the src register
-            readReg64(Reg::GPR1, src);
-            // perform the op
-            generator_->xchg(get(Reg::GPR0), get(Reg::GPR1));
-            // write back to the register
-            writeMem64(addr, Reg::GPR0);
-            writeReg64(src, Reg::GPR1);
-            return true;
+            if(dst.mem.segment == Segment::FS) return false;
+            return forLockedM(dst.mem, [&](const M64& d) {
+                // read the src register
+                readReg64(Reg::GPR1, src);
+                // exchanging with memory is atomic
+                generator_->xchg(d, get(Reg::GPR1));
+                // write back to the register
+                writeReg64(src, Reg::GPR1);
+            });
         }
     }
 
@@ -2970,116 +3669,456 @@ namespace x64 {
         }
     }
 
-    bool Compiler::tryCompileLockCmpxchgM32R32(const M32& dst, R32 src) {
-        // fetch dst address
+    bool Compiler::tryCompileLockAddM8RM8(const M8& dst, const RM8& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M8& d) {
+            readReg8(Reg::GPR1, src.reg);
+            generator_->lockadd(d, get8(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM8Imm(const M8& dst, Imm imm) {
+        return forLockedM(dst, [&](const M8& d) {
+            generator_->lockadd(d, imm.as<i8>());
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM16RM16(const M16& dst, const RM16& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M16& d) {
+            readReg16(Reg::GPR1, src.reg);
+            generator_->lockadd(d, get16(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM16Imm(const M16& dst, Imm imm) {
+        return forLockedM(dst, [&](const M16& d) {
+            generator_->lockadd(d, imm.as<i16>());
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM32RM32(const M32& dst, const RM32& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M32& d) {
+            readReg32(Reg::GPR1, src.reg);
+            generator_->lockadd(d, get32(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM32Imm(const M32& dst, Imm imm) {
+        return forLockedM(dst, [&](const M32& d) {
+            generator_->lockadd(d, imm.as<i32>());
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM64RM64(const M64& dst, const RM64& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M64& d) {
+            readReg64(Reg::GPR1, src.reg);
+            generator_->lockadd(d, get(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockAddM64Imm(const M64& dst, Imm imm) {
+        return forLockedM(dst, [&](const M64& d) {
+            generator_->lockadd(d, imm.as<i32>());
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM8RM8(const M8& dst, const RM8& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M8& d) {
+            readReg8(Reg::GPR1, src.reg);
+            generator_->locksub(d, get8(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM8Imm(const M8& dst, Imm imm) {
+        return forLockedM(dst, [&](const M8& d) {
+            generator_->locksub(d, imm.as<i8>());
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM16RM16(const M16& dst, const RM16& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M16& d) {
+            readReg16(Reg::GPR1, src.reg);
+            generator_->locksub(d, get16(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM16Imm(const M16& dst, Imm imm) {
+        return forLockedM(dst, [&](const M16& d) {
+            generator_->locksub(d, imm.as<i16>());
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM32RM32(const M32& dst, const RM32& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M32& d) {
+            readReg32(Reg::GPR1, src.reg);
+            generator_->locksub(d, get32(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM32Imm(const M32& dst, Imm imm) {
+        return forLockedM(dst, [&](const M32& d) {
+            generator_->locksub(d, imm.as<i32>());
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM64RM64(const M64& dst, const RM64& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M64& d) {
+            readReg64(Reg::GPR1, src.reg);
+            generator_->locksub(d, get(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockSubM64Imm(const M64& dst, Imm imm) {
+        return forLockedM(dst, [&](const M64& d) {
+            generator_->locksub(d, imm.as<i32>());
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM8RM8(const M8& dst, const RM8& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M8& d) {
+            readReg8(Reg::GPR1, src.reg);
+            generator_->lockor(d, get8(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM8Imm(const M8& dst, Imm imm) {
+        return forLockedM(dst, [&](const M8& d) {
+            generator_->lockor(d, imm.as<i8>());
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM16RM16(const M16& dst, const RM16& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M16& d) {
+            readReg16(Reg::GPR1, src.reg);
+            generator_->lockor(d, get16(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM16Imm(const M16& dst, Imm imm) {
+        return forLockedM(dst, [&](const M16& d) {
+            generator_->lockor(d, imm.as<i16>());
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM32RM32(const M32& dst, const RM32& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M32& d) {
+            readReg32(Reg::GPR1, src.reg);
+            generator_->lockor(d, get32(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM32Imm(const M32& dst, Imm imm) {
+        return forLockedM(dst, [&](const M32& d) {
+            generator_->lockor(d, imm.as<i32>());
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM64RM64(const M64& dst, const RM64& src) {
+        if(!src.isReg) return false;
+        return forLockedM(dst, [&](const M64& d) {
+            readReg64(Reg::GPR1, src.reg);
+            generator_->lockor(d, get(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockOrM64Imm(const M64& dst, Imm imm) {
+        return forLockedM(dst, [&](const M64& d) {
+            generator_->lockor(d, imm.as<i32>());
+        });
+    }
+
+    bool Compiler::tryCompileLockIncM8(const M8& dst) {
+        return forLockedM(dst, [&](const M8& d) {
+            generator_->lockinc(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockIncM16(const M16& dst) {
+        return forLockedM(dst, [&](const M16& d) {
+            generator_->lockinc(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockIncM32(const M32& dst) {
+        return forLockedM(dst, [&](const M32& d) {
+            generator_->lockinc(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockIncM64(const M64& dst) {
+        return forLockedM(dst, [&](const M64& d) {
+            generator_->lockinc(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockDecM8(const M8& dst) {
+        return forLockedM(dst, [&](const M8& d) {
+            generator_->lockdec(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockDecM16(const M16& dst) {
+        return forLockedM(dst, [&](const M16& d) {
+            generator_->lockdec(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockDecM32(const M32& dst) {
+        return forLockedM(dst, [&](const M32& d) {
+            generator_->lockdec(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockDecM64(const M64& dst) {
+        return forLockedM(dst, [&](const M64& d) {
+            generator_->lockdec(d);
+        });
+    }
+
+    bool Compiler::tryCompileLockBtsM16R16(const M16& dst, R16 src) {
+        return forLockedM(dst, [&](const M16& d) {
+            readReg16(Reg::GPR1, src);
+            generator_->lockbts(d, get16(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockBtsM16Imm(const M16& dst, Imm imm) {
+        return forLockedM(dst, [&](const M16& d) {
+            generator_->lockbts(d, imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompileLockBtsM32R32(const M32& dst, R32 src) {
+        return forLockedM(dst, [&](const M32& d) {
+            readReg32(Reg::GPR1, src);
+            generator_->lockbts(d, get32(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockBtsM32Imm(const M32& dst, Imm imm) {
+        return forLockedM(dst, [&](const M32& d) {
+            generator_->lockbts(d, imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompileLockBtsM64R64(const M64& dst, R64 src) {
+        return forLockedM(dst, [&](const M64& d) {
+            readReg64(Reg::GPR1, src);
+            generator_->lockbts(d, get(Reg::GPR1));
+        });
+    }
+
+    bool Compiler::tryCompileLockBtsM64Imm(const M64& dst, Imm imm) {
+        return forLockedM(dst, [&](const M64& d) {
+            generator_->lockbts(d, imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompileLockCmpxchgM8R8(const M8& dst, R8 src) {
         if(dst.encoding.index == R64::RIP) return false;
         // save rax and set it
         generator_->push64(R64::RAX);
         readReg64(Reg::GPR0, R64::RAX);
         generator_->mov(R64::RAX, get(Reg::GPR0));
-        // get the address
-        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
-        M32 d = make32(get(Reg::MEM_BASE), get(addr.base), 1, addr.offset);
-        // read the src register
-        readReg32(Reg::GPR1, src);
-        // perform the op
-        generator_->lockcmpxchg(d, get32(Reg::GPR1));
-        // write back to the register
-        writeReg32(src, Reg::GPR1);
+        bool compiled = forLockedM(dst, [&](const M8& d) {
+            readReg8(Reg::GPR1, src);
+            generator_->lockcmpxchg(d, get8(Reg::GPR1));
+        });
         // set rax and restore rax
         generator_->mov(get(Reg::GPR0), R64::RAX);
         writeReg64(R64::RAX, Reg::GPR0);
         generator_->pop64(R64::RAX);
-        return true;
+        return compiled;
     }
 
-    bool Compiler::tryCompileLockCmpxchgM64R64(const M64& dst, R64 src) {
-        // fetch dst address
+    bool Compiler::tryCompileLockCmpxchgM16R16(const M16& dst, R16 src) {
         if(dst.encoding.index == R64::RIP) return false;
         // save rax and set it
         generator_->push64(R64::RAX);
         readReg64(Reg::GPR0, R64::RAX);
         generator_->mov(R64::RAX, get(Reg::GPR0));
-        // get the address
-        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
-        M64 d = make64(get(Reg::MEM_BASE), get(addr.base), 1, addr.offset);
-        // read the src register
-        readReg64(Reg::GPR1, src);
-        // perform the lock cmpxchg
-        generator_->lockcmpxchg(d, get(Reg::GPR1));
-        // write back to the register
-        writeReg64(src, Reg::GPR1);
+        bool compiled = forLockedM(dst, [&](const M16& d) {
+            readReg16(Reg::GPR1, src);
+            generator_->lockcmpxchg(d, get16(Reg::GPR1));
+        });
         // set rax and restore rax
         generator_->mov(get(Reg::GPR0), R64::RAX);
         writeReg64(R64::RAX, Reg::GPR0);
         generator_->pop64(R64::RAX);
-        return true;
+        return compiled;
     }
 
-    bool Compiler::tryCompileLockXaddM32R32(const M32& dst, R32 src) {
-        // fetch dst address
+    bool Compiler::tryCompileLockCmpxchgM32R32(const M32& dst, R32 src) {
         if(dst.encoding.index == R64::RIP) return false;
-        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
-        M32 d = make32(get(Reg::MEM_BASE), get(addr.base), 1, addr.offset);
-        // read the src register
-        readReg32(Reg::GPR1, src);
-        // perform the lock xadd
-        generator_->lockxadd(d, get32(Reg::GPR1));
-        // write back to the register
-        writeReg32(src, Reg::GPR1);
-        return true;
-    }
-
-    bool Compiler::tryCompileCwde() {
+        // save rax and set it
         generator_->push64(R64::RAX);
         readReg64(Reg::GPR0, R64::RAX);
         generator_->mov(R64::RAX, get(Reg::GPR0));
-        generator_->cwde();
+        bool compiled = forLockedM(dst, [&](const M32& d) {
+            readReg32(Reg::GPR1, src);
+            generator_->lockcmpxchg(d, get32(Reg::GPR1));
+        });
+        // set rax and restore rax
         generator_->mov(get(Reg::GPR0), R64::RAX);
         writeReg64(R64::RAX, Reg::GPR0);
         generator_->pop64(R64::RAX);
-        return true;
+        return compiled;
     }
 
-    bool Compiler::tryCompileCdqe() {
+    bool Compiler::tryCompileLockCmpxchgM64R64(const M64& dst, R64 src) {
+        if(dst.encoding.index == R64::RIP) return false;
+        // save rax and set it
         generator_->push64(R64::RAX);
         readReg64(Reg::GPR0, R64::RAX);
         generator_->mov(R64::RAX, get(Reg::GPR0));
-        generator_->cdqe();
+        bool compiled = forLockedM(dst, [&](const M64& d) {
+            readReg64(Reg::GPR1, src);
+            generator_->lockcmpxchg(d, get(Reg::GPR1));
+        });
+        // set rax and restore rax
         generator_->mov(get(Reg::GPR0), R64::RAX);
         writeReg64(R64::RAX, Reg::GPR0);
         generator_->pop64(R64::RAX);
-        return true;
+        return compiled;
     }
 
-    bool Compiler::tryCompileCdq() {
+    bool Compiler::tryCompileLockCmpxchg16BM128(const M128& dst) {
+        if(dst.encoding.index == R64::RIP) return false;
+        // compute the host address before rcx is taken from the guest
+        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
+        generator_->lea(get(Reg::MEM_ADDR), make64(get(Reg::MEM_BASE), get(addr.base), 1, addr.offset));
+        // save rax, rbx, rcx and rdx, and set them
         generator_->push64(R64::RAX);
+        generator_->push64(R64::RBX);
+        generator_->push64(R64::RCX);
         generator_->push64(R64::RDX);
         readReg64(Reg::GPR0, R64::RAX);
         generator_->mov(R64::RAX, get(Reg::GPR0));
-        generator_->cdq();
+        readReg64(Reg::GPR0, R64::RBX);
+        generator_->mov(R64::RBX, get(Reg::GPR0));
+        readReg64(Reg::GPR0, R64::RCX);
+        generator_->mov(R64::RCX, get(Reg::GPR0));
+        readReg64(Reg::GPR0, R64::RDX);
+        generator_->mov(R64::RDX, get(Reg::GPR0));
+        // perform the lock cmpxchg16b
+        generator_->lockcmpxchg16b(make128(get(Reg::MEM_ADDR), R64::ZERO, 1, 0));
+        // set rax and rdx
         generator_->mov(get(Reg::GPR0), R64::RAX);
         writeReg64(R64::RAX, Reg::GPR0);
-        generator_->mov(get(Reg::GPR1), R64::RDX);
-        writeReg64(R64::RDX, Reg::GPR1);
+        generator_->mov(get(Reg::GPR0), R64::RDX);
+        writeReg64(R64::RDX, Reg::GPR0);
+        // restore rax, rbx, rcx and rdx
         generator_->pop64(R64::RDX);
+        generator_->pop64(R64::RCX);
+        generator_->pop64(R64::RBX);
         generator_->pop64(R64::RAX);
         return true;
     }
 
-    bool Compiler::tryCompileCqo() {
-        generator_->push64(R64::RAX);
-        generator_->push64(R64::RDX);
-        readReg64(Reg::GPR0, R64::RAX);
-        generator_->mov(R64::RAX, get(Reg::GPR0));
-        generator_->cqo();
-        generator_->mov(get(Reg::GPR0), R64::RAX);
-        writeReg64(R64::RAX, Reg::GPR0);
-        generator_->mov(get(Reg::GPR1), R64::RDX);
-        writeReg64(R64::RDX, Reg::GPR1);
-        generator_->pop64(R64::RDX);
-        generator_->pop64(R64::RAX);
-        return true;
+    bool Compiler::tryCompileLockXaddM8R8(const M8& dst, R8 src) {
+        return forLockedM(dst, [&](const M8& d) {
+            // read the src register
+            readReg8(Reg::GPR1, src);
+            // perform the lock xadd
+            generator_->lockxadd(d, get8(Reg::GPR1));
+            // write back to the register
+            writeReg8(src, Reg::GPR1);
+        });
+    }
+
+    bool Compiler::tryCompileLockXaddM16R16(const M16& dst, R16 src) {
+        return forLockedM(dst, [&](const M16& d) {
+            // read the src register
+            readReg16(Reg::GPR1, src);
+            // perform the lock xadd
+            generator_->lockxadd(d, get16(Reg::GPR1));
+            // write back to the register
+            writeReg16(src, Reg::GPR1);
+        });
+    }
+
+    bool Compiler::tryCompileLockXaddM32R32(const M32& dst, R32 src) {
+        return forLockedM(dst, [&](const M32& d) {
+            // read the src register
+            readReg32(Reg::GPR1, src);
+            // perform the lock xadd
+            generator_->lockxadd(d, get32(Reg::GPR1));
+            // write back to the register
+            writeReg32(src, Reg::GPR1);
+        });
+    }
+
+    bool Compiler::tryCompileLockXaddM64R64(const M64& dst, R64 src) {
+        return forLockedM(dst, [&](const M64& d) {
+            // read the src register
+            readReg64(Reg::GPR1, src);
+            // perform the lock xadd
+            generator_->lockxadd(d, get(Reg::GPR1));
+            // write back to the register
+            writeReg64(src, Reg::GPR1);
+        });
+    }
+
+    bool Compiler::tryCompileCwde() {
+        generator_->push64(R64::RAX);
+        readReg64(Reg::GPR0, R64::RAX);
+        generator_->mov(R64::RAX, get(Reg::GPR0));
+        generator_->cwde();
+        generator_->mov(get(Reg::GPR0), R64::RAX);
+        writeReg64(R64::RAX, Reg::GPR0);
+        generator_->pop64(R64::RAX);
+        return true;
+    }
+
+    bool Compiler::tryCompileCdqe() {
+        generator_->push64(R64::RAX);
+        readReg64(Reg::GPR0, R64::RAX);
+        generator_->mov(R64::RAX, get(Reg::GPR0));
+        generator_->cdqe();
+        generator_->mov(get(Reg::GPR0), R64::RAX);
+        writeReg64(R64::RAX, Reg::GPR0);
+        generator_->pop64(R64::RAX);
+        return true;
+    }
+
+    bool Compiler::tryCompileCdq() {
+        generator_->push64(R64::RAX);
+        generator_->push64(R64::RDX);
+        readReg64(Reg::GPR0, R64::RAX);
+        generator_->mov(R64::RAX, get(Reg::GPR0));
+        generator_->cdq();
+        generator_->mov(get(Reg::GPR0), R64::RAX);
+        writeReg64(R64::RAX, Reg::GPR0);
+        generator_->mov(get(Reg::GPR1), R64::RDX);
+        writeReg64(R64::RDX, Reg::GPR1);
+        generator_->pop64(R64::RDX);
+        generator_->pop64(R64::RAX);
+        return true;
+    }
+
+    bool Compiler::tryCompileCqo() {
+        generator_->push64(R64::RAX);
+        generator_->push64(R64::RDX);
+        readReg64(Reg::GPR0, R64::RAX);
+        generator_->mov(R64::RAX, get(Reg::GPR0));
+        generator_->cqo();
+        generator_->mov(get(Reg::GPR0), R64::RAX);
+        writeReg64(R64::RAX, Reg::GPR0);
+        generator_->mov(get(Reg::GPR1), R64::RDX);
+        writeReg64(R64::RDX, Reg::GPR1);
+        generator_->pop64(R64::RDX);
+        generator_->pop64(R64::RAX);
+        return true;
     }
 
     bool Compiler::tryCompileLeaR32Enc32(R32 dst, const Encoding32& address) {
@@ -3153,11 +4192,34 @@ namespace x64 {
     }
 
     bool Compiler::tryCompileTzcntR32RM32(R32 dst, const RM32& src) {
+        // without bmi1, the host would execute tzcnt as bsf
+        if(!hostFeatures_.bmi1) return false;
         return forRM32RM32(RM32{true, dst, {}}, src, [&](Reg dst, Reg src) {
             generator_->tzcnt(get32(dst), get32(src));
         });
     }
 
+    bool Compiler::tryCompileTzcntR64RM64(R64 dst, const RM64& src) {
+        if(!hostFeatures_.bmi1) return false;
+        return forRM64RM64(RM64{true, dst, {}}, src, [&](Reg dst, Reg src) {
+            generator_->tzcnt(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePopcntR32RM32(R32 dst, const RM32& src) {
+        if(!hostFeatures_.popcnt) return false;
+        return forRM32RM32(RM32{true, dst, {}}, src, [&](Reg dst, Reg src) {
+            generator_->popcnt(get32(dst), get32(src));
+        });
+    }
+
+    bool Compiler::tryCompilePopcntR64RM64(R64 dst, const RM64& src) {
+        if(!hostFeatures_.popcnt) return false;
+        return forRM64RM64(RM64{true, dst, {}}, src, [&](Reg dst, Reg src) {
+            generator_->popcnt(get(dst), get(src));
+        });
+    }
+
     bool Compiler::tryCompileSetRM8(Cond cond, const RM8& dst) {
         return forRM8Imm(dst, Imm{}, [&](Reg dst, Imm) {
             generator_->set(cond, get8(dst));
@@ -5146,236 +6208,642 @@ namespace x64 {
         });
     }
 
-    bool Compiler::tryCompileAndnpdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->andnpd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileAndnpdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->andnpd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileOrpdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->orpd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileXorpdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->xorpd(get(dst), get(src));
+        });
+    }
+
+
+    bool Compiler::tryCompileShufpsXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->shufps(get(dst), get(src), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompileShufpdXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->shufpd(get(dst), get(src), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompileUnpckhpsXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->unpckhps(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileUnpckhpdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->unpckhpd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileUnpcklpsXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->unpcklps(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileUnpcklpdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->unpcklpd(get(dst), get(src));
+        });
+    }
+
+
+    bool Compiler::tryCompileLddquXmmM128(XMM dst, const M128& src) {
+        return tryCompileMovuXmmM128(dst, src);
+    }
+
+    bool Compiler::tryCompileMovddupXmmXmm(XMM dst, XMM src) {
+        readReg128(toGpr(dst), dst);
+        readReg128(toGpr(src), src);
+        generator_->movddup(get(toGpr(dst)), get(toGpr(src)));
+        writeReg128(dst, toGpr(dst));
+        return true;
+    }
+
+    bool Compiler::tryCompileMovddupXmmM64(XMM dst, const M64& src) {
+        RM64 src2 { false, {}, src };
+        if(!tryCompileMovqXmmRM64(dst, src2)) return false;
+        return tryCompileMovddupXmmXmm(dst, dst);
+    }
+
+    bool Compiler::tryCompilePalignrMmxMmxM64(MMX dst, const MMXM64& src, Imm imm) {
+        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
+            generator_->palignr(get(dst), get(src), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompilePhaddwMmxMmxM64(MMX dst, const MMXM64& src) {
+        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
+            generator_->phaddw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePhadddMmxMmxM64(MMX dst, const MMXM64& src) {
+        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
+            generator_->phaddd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmaddubswMmxMmxM64(MMX dst, const MMXM64& src) {
+        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
+            generator_->pmaddubsw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmulhrswMmxMmxM64(MMX dst, const MMXM64& src) {
+        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
+            generator_->pmulhrsw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePalignrXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->palignr(get(dst), get(src), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompilePhaddwXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->phaddw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePhadddXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->phaddd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmaddubswXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pmaddubsw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmulhrswXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pmulhrsw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmaxsdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pmaxsd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePminsdXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pminsd(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmaxuwXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pmaxuw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmaxudXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pmaxud(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePminuwXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pminuw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePminudXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pminud(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePmovzxbwXMMXMM(XMM dst, XMM src) {
+        return forXmmXmmM128(dst, XMMM128{true, src, {}}, [&](Reg128 dst, Reg128 src) {
+            generator_->pmovzxbw(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileRoundpsXmmXmmImm(XMM dst, XMM src, Imm imm) {
+        return forXmmXmmM128(dst, XMMM128{true, src, {}}, [&](Reg128 dst, Reg128 src) {
+            generator_->roundps(get(dst), get(src), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompileRoundpdXmmXmmImm(XMM dst, XMM src, Imm imm) {
+        return forXmmXmmM128(dst, XMMM128{true, src, {}}, [&](Reg128 dst, Reg128 src) {
+            generator_->roundpd(get(dst), get(src), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompilePmulldXmmXmmM128(XMM dst, const XMMM128& src) {
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            generator_->pmulld(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompilePextrdRM32XMMImm(const RM32& dst, XMM src, Imm imm) {
+        return forRM32Imm(dst, imm, [&](Reg dst, Imm imm) {
+            readReg128(toGpr(src), src);
+            generator_->pextrd(get32(dst), get(toGpr(src)), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompilePextrqRM64XMMImm(const RM64& dst, XMM src, Imm imm) {
+        return forRM64Imm(dst, imm, [&](Reg dst, Imm imm) {
+            readReg128(toGpr(src), src);
+            generator_->pextrq(get(dst), get(toGpr(src)), imm.as<u8>());
+        });
+    }
+
+    bool Compiler::tryCompilePinsrdRM32XMMImm(XMM dst, const RM32& src, Imm imm) {
+        return forRM32Imm(src, imm, [&](Reg src, Imm imm) {
+            readReg128(toGpr(dst), dst);
+            generator_->pinsrd(get(toGpr(dst)), get32(src), imm.as<u8>());
+            writeReg128(dst, toGpr(dst));
+        }, false);
+    }
+
+    bool Compiler::tryCompileBlendvpsXmmXmmM128(XMM dst, const XMMM128& src) {
+        if(!src.isReg) return false;
+        if(dst == XMM::XMM0) return false;
+        if(src.reg == XMM::XMM0) return false;
+        // read the dst register
+        readReg128(toGpr(dst), dst);
+        // read the src register
+        readReg128(toGpr(src.reg), src.reg);
+        // read the xmm0 register
+        readReg128(toGpr(XMM::XMM0), XMM::XMM0);
+        generator_->blendvps(get(toGpr(dst)), get(toGpr(src.reg)));
+        writeReg128(dst, toGpr(dst));
+        return true;
+    }
+
+    bool Compiler::tryCompilePblendvbXmmXmmM128(XMM dst, const XMMM128& src) {
+        if(dst == XMM::XMM0) return false;
+        if(src.isReg) {
+            if(src.reg == XMM::XMM0) return false;
+            // read the dst register
+            readReg128(toGpr(dst), dst);
+            // read the src register
+            readReg128(toGpr(src.reg), src.reg);
+            // read the xmm0 register
+            readReg128(toGpr(XMM::XMM0), XMM::XMM0);
+            generator_->pblendvb(get(toGpr(dst)), get(toGpr(src.reg)));
+            writeReg128(dst, toGpr(dst));
+            return true;
+        } else {
+            // fetch address
+            const M128& mem = src.mem;
+            if(mem.segment == Segment::FS) return false;
+            if(mem.encoding.index == R64::RIP) return false;
+            // save the scratch register, which cannot be the mask
+            Reg128 gpr = toGpr(scratchXmmRegister({ dst, XMM::XMM0 }));
+            push(gpr);
+            // read the dst register
+            readReg128(toGpr(dst), dst);
+            // read the xmm0 register
+            readReg128(toGpr(XMM::XMM0), XMM::XMM0);
+            // get the address
+            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR1}, mem);
+            // read the value at the address
+            readMem128(gpr, addr);
+            generator_->pblendvb(get(toGpr(dst)), get(gpr));
+            writeReg128(dst, toGpr(dst));
+            // restore gpr
+            pop(gpr);
+            return true;
+        }
+    }
+
+    bool Compiler::tryCompilePcmpistriXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
+        if(!hostFeatures_.sse42) return false;
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            // the host writes the index to ecx, which holds the memory base
+            generator_->push64(R64::RCX);
+            generator_->pcmpistri(get(dst), get(src), imm.as<u8>());
+            generator_->mov(get32(Reg::GPR0), R32::ECX);
+            generator_->pop64(R64::RCX);
+            writeReg32(R32::ECX, Reg::GPR0);
+        }, false);
+    }
+
+    bool Compiler::tryCompilePcmpestriXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
+        if(!hostFeatures_.sse42) return false;
+        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
+            // the string lengths are read from eax and edx
+            generator_->push64(R64::RAX);
+            generator_->push64(R64::RDX);
+            readReg32(Reg::GPR0, R32::EAX);
+            generator_->mov(R32::EAX, get32(Reg::GPR0));
+            readReg32(Reg::GPR0, R32::EDX);
+            generator_->mov(R32::EDX, get32(Reg::GPR0));
+            // and the index is written to ecx, which holds the memory base
+            generator_->push64(R64::RCX);
+            generator_->pcmpestri(get(dst), get(src), imm.as<u8>());
+            generator_->mov(get32(Reg::GPR0), R32::ECX);
+            generator_->pop64(R64::RCX);
+            generator_->pop64(R64::RDX);
+            generator_->pop64(R64::RAX);
+            writeReg32(R32::ECX, Reg::GPR0);
+        }, false);
+    }
+
+    bool Compiler::tryCompileCrc32R32RM8(R32 dst, const RM8& src) {
+        if(!hostFeatures_.sse42) return false;
+        if(src.isReg) {
+            // read the src register
+            readReg8(Reg::GPR1, src.reg);
+        } else {
+            // fetch src address
+            const M8& mem = src.mem;
+            if(mem.segment == Segment::FS) return false;
+            if(mem.encoding.index == R64::RIP) return false;
+            // get the address
+            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR1}, mem);
+            // read the src value at the address
+            readMem8(Reg::GPR1, addr);
+        }
+        // read the dst register
+        readReg32(Reg::GPR0, dst);
+        generator_->crc32(get32(Reg::GPR0), get8(Reg::GPR1));
+        // write to the destination register
+        writeReg32(dst, Reg::GPR0);
+        return true;
+    }
+
+    bool Compiler::tryCompileCrc32R32RM16(R32 dst, const RM16& src) {
+        if(!hostFeatures_.sse42) return false;
+        if(src.isReg) {
+            // read the src register
+            readReg16(Reg::GPR1, src.reg);
+        } else {
+            // fetch src address
+            const M16& mem = src.mem;
+            if(mem.segment == Segment::FS) return false;
+            if(mem.encoding.index == R64::RIP) return false;
+            // get the address
+            Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR1}, mem);
+            // read the src value at the address
+            readMem16(Reg::GPR1, addr);
+        }
+        // read the dst register
+        readReg32(Reg::GPR0, dst);
+        generator_->crc32(get32(Reg::GPR0), get16(Reg::GPR1));
+        // write to the destination register
+        writeReg32(dst, Reg::GPR0);
+        return true;
+    }
+
+    bool Compiler::tryCompileCrc32R32RM32(R32 dst, const RM32& src) {
+        if(!hostFeatures_.sse42) return false;
+        return forRM32RM32(RM32{true, dst, {}}, src, [&](Reg dst, Reg src) {
+            generator_->crc32(get32(dst), get32(src));
+        });
+    }
+
+    bool Compiler::tryCompileCrc32R64RM64(R64 dst, const RM64& src) {
+        if(!hostFeatures_.sse42) return false;
+        return forRM64RM64(RM64{true, dst, {}}, src, [&](Reg dst, Reg src) {
+            generator_->crc32(get(dst), get(src));
+        });
+    }
+
+    bool Compiler::tryCompileStmxcsrM32(const M32& dst) {
+        // fetch dst address
+        if(dst.segment == Segment::FS) return false;
+        if(dst.encoding.index == R64::RIP) return false;
+        // get the address
+        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
+        loadMxcsrFromEmulator(Reg::GPR1);
+        writeMem32(addr, Reg::GPR1);
+        return true;
+    }
+
+    bool Compiler::tryCompileFldz() {
+        emptyHostX87Stack();
+        generator_->fldz();
+        pushX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
+    }
+
+    bool Compiler::tryCompileFld1() {
+        emptyHostX87Stack();
+        generator_->fld1();
+        pushX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
+    }
+
+    bool Compiler::tryCompileFldlg2() {
+        emptyHostX87Stack();
+        generator_->fldlg2();
+        pushX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
+    }
+
+    bool Compiler::tryCompileFldST(ST src) {
+        emptyHostX87Stack();
+        loadX87Register(src, TmpReg{Reg::GPR0});
+        pushX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
+    }
+
+    template<Size size>
+    bool Compiler::tryCompileX87Load(const M<size>& src, void(ir::IrGenerator::*load)(const M<size>&)) {
+        // fetch src address
+        if(src.segment == Segment::FS) return false;
+        if(src.encoding.index == R64::RIP) return false;
+        emptyHostX87Stack();
+        // get the address
+        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, src);
+        // load the value on the host stack
+        M<size> s { Segment::CS, Encoding64 { get(Reg::MEM_BASE), get(addr.base), 1, addr.offset } };
+        (generator_.get()->*load)(s);
+        // and move it to the new top of the stack
+        pushX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
+    }
+
+    bool Compiler::tryCompileFldM32(const M32& src) {
+        return tryCompileX87Load(src, &ir::IrGenerator::fld);
+    }
+
+    bool Compiler::tryCompileFldM64(const M64& src) {
+        return tryCompileX87Load(src, &ir::IrGenerator::fld);
+    }
+
+    bool Compiler::tryCompileFldM80(const M80& src) {
+        return tryCompileX87Load(src, &ir::IrGenerator::fld);
+    }
+
+    bool Compiler::tryCompileFildM16(const M16& src) {
+        return tryCompileX87Load(src, &ir::IrGenerator::fild);
+    }
+
+    bool Compiler::tryCompileFildM32(const M32& src) {
+        return tryCompileX87Load(src, &ir::IrGenerator::fild);
     }
 
-    bool Compiler::tryCompileOrpdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->orpd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFildM64(const M64& src) {
+        return tryCompileX87Load(src, &ir::IrGenerator::fild);
     }
 
-    bool Compiler::tryCompileXorpdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->xorpd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFstpST(ST dst) {
+        emptyHostX87Stack();
+        loadX87Register(ST::ST0, TmpReg{Reg::GPR0});
+        storeX87Register(dst, TmpReg{Reg::GPR0});
+        popX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
     }
 
+    template<Size size>
+    bool Compiler::tryCompileX87Store(const M<size>& dst, void(ir::IrGenerator::*store)(const M<size>&)) {
+        // fetch dst address
+        if(dst.segment == Segment::FS) return false;
+        if(dst.encoding.index == R64::RIP) return false;
+        emptyHostX87Stack();
+        // get the address
+        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
+        // load the top of the stack on the host stack
+        loadX87Register(ST::ST0, TmpReg{Reg::GPR0});
+        // do the write
+        M<size> d { Segment::CS, Encoding64 { get(Reg::MEM_BASE), get(addr.base), 1, addr.offset } };
+        (generator_.get()->*store)(d);
+        popX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
+    }
 
-    bool Compiler::tryCompileShufpsXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->shufps(get(dst), get(src), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFstpM32(const M32& dst) {
+        return tryCompileX87Store(dst, &ir::IrGenerator::fstp);
     }
 
-    bool Compiler::tryCompileShufpdXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->shufpd(get(dst), get(src), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFstpM64(const M64& dst) {
+        return tryCompileX87Store(dst, &ir::IrGenerator::fstp);
     }
 
-    bool Compiler::tryCompileUnpckhpsXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->unpckhps(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFstpM80(const M80& dst) {
+        return tryCompileX87Store(dst, &ir::IrGenerator::fstp);
     }
 
-    bool Compiler::tryCompileUnpckhpdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->unpckhpd(get(dst), get(src));
-        });
+    // The interpreter truncates when converting to an integer, regardless of the rounding mode
+    bool Compiler::tryCompileFistpM16(const M16& dst) {
+        return tryCompileX87Store(dst, &ir::IrGenerator::fisttp);
     }
 
-    bool Compiler::tryCompileUnpcklpsXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->unpcklps(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFistpM32(const M32& dst) {
+        return tryCompileX87Store(dst, &ir::IrGenerator::fisttp);
     }
 
-    bool Compiler::tryCompileUnpcklpdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->unpcklpd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFistpM64(const M64& dst) {
+        return tryCompileX87Store(dst, &ir::IrGenerator::fisttp);
     }
 
+    bool Compiler::tryCompileFxchST(ST src) {
+        emptyHostX87Stack();
+        loadX87Register(ST::ST0, TmpReg{Reg::GPR0});
+        loadX87Register(src, TmpReg{Reg::GPR0});
+        storeX87Register(ST::ST0, TmpReg{Reg::GPR0});
+        storeX87Register(src, TmpReg{Reg::GPR0});
+        return true;
+    }
 
-    bool Compiler::tryCompileLddquXmmM128(XMM dst, const M128& src) {
-        return tryCompileMovuXmmM128(dst, src);
+    template<Size size>
+    bool Compiler::tryCompileX87Arithmetic(ST dst, const M<size>& src, bool memoryIsLhs, void(ir::IrGenerator::*op)()) {
+        // fetch src address
+        if(src.segment == Segment::FS) return false;
+        if(src.encoding.index == R64::RIP) return false;
+        emptyHostX87Stack();
+        // get the address
+        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, src);
+        M<size> s { Segment::CS, Encoding64 { get(Reg::MEM_BASE), get(addr.base), 1, addr.offset } };
+        // the popping operation computes st(1) op st(0)
+        if(memoryIsLhs) generator_->fld(s);
+        loadX87Register(dst, TmpReg{Reg::GPR0});
+        if(!memoryIsLhs) generator_->fld(s);
+        (generator_.get()->*op)();
+        storeX87Register(dst, TmpReg{Reg::GPR0});
+        return true;
     }
 
-    bool Compiler::tryCompileMovddupXmmXmm(XMM dst, XMM src) {
-        readReg128(toGpr(dst), dst);
-        readReg128(toGpr(src), src);
-        generator_->movddup(get(toGpr(dst)), get(toGpr(src)));
-        writeReg128(dst, toGpr(dst));
+    bool Compiler::tryCompileX87Arithmetic(ST dst, ST lhs, ST rhs, bool pop, void(ir::IrGenerator::*op)()) {
+        emptyHostX87Stack();
+        // the popping operation computes st(1) op st(0)
+        loadX87Register(lhs, TmpReg{Reg::GPR0});
+        loadX87Register(rhs, TmpReg{Reg::GPR0});
+        (generator_.get()->*op)();
+        storeX87Register(dst, TmpReg{Reg::GPR0});
+        if(pop) popX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
         return true;
     }
 
-    bool Compiler::tryCompileMovddupXmmM64(XMM dst, const M64& src) {
-        RM64 src2 { false, {}, src };
-        if(!tryCompileMovqXmmRM64(dst, src2)) return false;
-        return tryCompileMovddupXmmXmm(dst, dst);
+    bool Compiler::tryCompileFaddM32(const M32& src) {
+        return tryCompileX87Arithmetic(ST::ST0, src, false, &ir::IrGenerator::faddp);
     }
 
-    bool Compiler::tryCompilePalignrMmxMmxM64(MMX dst, const MMXM64& src, Imm imm) {
-        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
-            generator_->palignr(get(dst), get(src), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFaddM64(const M64& src) {
+        return tryCompileX87Arithmetic(ST::ST0, src, false, &ir::IrGenerator::faddp);
     }
 
-    bool Compiler::tryCompilePhaddwMmxMmxM64(MMX dst, const MMXM64& src) {
-        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
-            generator_->phaddw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFaddpST(ST dst) {
+        return tryCompileX87Arithmetic(dst, ST::ST0, dst, true, &ir::IrGenerator::faddp);
     }
 
-    bool Compiler::tryCompilePhadddMmxMmxM64(MMX dst, const MMXM64& src) {
-        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
-            generator_->phaddd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFsubSTM32(ST dst, const M32& src) {
+        return tryCompileX87Arithmetic(dst, src, false, &ir::IrGenerator::fsubp);
     }
 
-    bool Compiler::tryCompilePmaddubswMmxMmxM64(MMX dst, const MMXM64& src) {
-        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
-            generator_->pmaddubsw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFsubSTM64(ST dst, const M64& src) {
+        return tryCompileX87Arithmetic(dst, src, false, &ir::IrGenerator::fsubp);
     }
 
-    bool Compiler::tryCompilePmulhrswMmxMmxM64(MMX dst, const MMXM64& src) {
-        return forMmxMmxM64(dst, src, [&](RegMM dst, RegMM src) {
-            generator_->pmulhrsw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFsubSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, dst, src, false, &ir::IrGenerator::fsubp);
     }
 
-    bool Compiler::tryCompilePalignrXmmXmmM128Imm(XMM dst, const XMMM128& src, Imm imm) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->palignr(get(dst), get(src), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFsubrpST(ST dst) {
+        return tryCompileX87Arithmetic(dst, ST::ST0, dst, true, &ir::IrGenerator::fsubp);
     }
 
-    bool Compiler::tryCompilePhaddwXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->phaddw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFmul1M32(const M32& src) {
+        return tryCompileX87Arithmetic(ST::ST0, src, false, &ir::IrGenerator::fmulp);
     }
 
-    bool Compiler::tryCompilePhadddXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->phaddd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFmul1M64(const M64& src) {
+        return tryCompileX87Arithmetic(ST::ST0, src, false, &ir::IrGenerator::fmulp);
     }
 
-    bool Compiler::tryCompilePmaddubswXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->pmaddubsw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFmulSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, dst, src, false, &ir::IrGenerator::fmulp);
     }
 
-    bool Compiler::tryCompilePmulhrswXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->pmulhrsw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFmulpSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, dst, src, true, &ir::IrGenerator::fmulp);
     }
 
-    bool Compiler::tryCompilePmaxsdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->pmaxsd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFdivSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, dst, src, false, &ir::IrGenerator::fdivp);
     }
 
-    bool Compiler::tryCompilePminsdXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->pminsd(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFdivM32(const M32& src) {
+        return tryCompileX87Arithmetic(ST::ST0, src, false, &ir::IrGenerator::fdivp);
     }
 
-    bool Compiler::tryCompilePmovzxbwXMMXMM(XMM dst, XMM src) {
-        return forXmmXmmM128(dst, XMMM128{true, src, {}}, [&](Reg128 dst, Reg128 src) {
-            generator_->pmovzxbw(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFdivpSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, dst, src, true, &ir::IrGenerator::fdivp);
     }
 
-    bool Compiler::tryCompileRoundpsXmmXmmImm(XMM dst, XMM src, Imm imm) {
-        return forXmmXmmM128(dst, XMMM128{true, src, {}}, [&](Reg128 dst, Reg128 src) {
-            generator_->roundps(get(dst), get(src), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFdivrSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, src, dst, false, &ir::IrGenerator::fdivp);
     }
 
-    bool Compiler::tryCompileRoundpdXmmXmmImm(XMM dst, XMM src, Imm imm) {
-        return forXmmXmmM128(dst, XMMM128{true, src, {}}, [&](Reg128 dst, Reg128 src) {
-            generator_->roundpd(get(dst), get(src), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFdivrM32(const M32& src) {
+        return tryCompileX87Arithmetic(ST::ST0, src, true, &ir::IrGenerator::fdivp);
     }
 
-    bool Compiler::tryCompilePmulldXmmXmmM128(XMM dst, const XMMM128& src) {
-        return forXmmXmmM128(dst, src, [&](Reg128 dst, Reg128 src) {
-            generator_->pmulld(get(dst), get(src));
-        });
+    bool Compiler::tryCompileFdivrpSTST(ST dst, ST src) {
+        return tryCompileX87Arithmetic(dst, src, dst, true, &ir::IrGenerator::fdivp);
     }
 
-    bool Compiler::tryCompilePextrdRM32XMMImm(const RM32& dst, XMM src, Imm imm) {
-        return forRM32Imm(dst, imm, [&](Reg dst, Imm imm) {
-            readReg128(toGpr(src), src);
-            generator_->pextrd(get32(dst), get(toGpr(src)), imm.as<u8>());
-        });
+    bool Compiler::tryCompileX87Compare(ST dst, ST src, bool pop, void(ir::IrGenerator::*op)()) {
+        emptyHostX87Stack();
+        // compare dst with src, then drop both from the host stack
+        loadX87Register(src, TmpReg{Reg::GPR0});
+        loadX87Register(dst, TmpReg{Reg::GPR0});
+        (generator_.get()->*op)();
+        generator_->fpop();
+        if(pop) popX87Register(TmpReg{Reg::GPR0}, TmpReg{Reg::GPR1});
+        return true;
     }
 
-    bool Compiler::tryCompilePextrqRM64XMMImm(const RM64& dst, XMM src, Imm imm) {
-        return forRM64Imm(dst, imm, [&](Reg dst, Imm imm) {
-            readReg128(toGpr(src), src);
-            generator_->pextrq(get(dst), get(toGpr(src)), imm.as<u8>());
-        });
+    bool Compiler::tryCompileFcomiSTST(ST dst, ST src) {
+        return tryCompileX87Compare(dst, src, false, &ir::IrGenerator::fcomip);
     }
 
-    bool Compiler::tryCompilePinsrdRM32XMMImm(XMM dst, const RM32& src, Imm imm) {
-        return forRM32Imm(src, imm, [&](Reg src, Imm imm) {
-            readReg128(toGpr(dst), dst);
-            generator_->pinsrd(get(toGpr(dst)), get32(src), imm.as<u8>());
-            writeReg128(dst, toGpr(dst));
-        }, false);
+    bool Compiler::tryCompileFcomipSTST(ST dst, ST src) {
+        return tryCompileX87Compare(dst, src, true, &ir::IrGenerator::fcomip);
     }
 
-    bool Compiler::tryCompileBlendvpsXmmXmmM128(XMM dst, const XMMM128& src) {
-        if(!src.isReg) return false;
-        if(dst == XMM::XMM0) return false;
-        if(src.reg == XMM::XMM0) return false;
-        // read the dst register
-        readReg128(toGpr(dst), dst);
-        // read the src register
-        readReg128(toGpr(src.reg), src.reg);
-        // read the xmm0 register
-        readReg128(toGpr(XMM::XMM0), XMM::XMM0);
-        generator_->blendvps(get(toGpr(dst)), get(toGpr(src.reg)));
-        writeReg128(dst, toGpr(dst));
-        return true;
+    bool Compiler::tryCompileFucomiSTST(ST dst, ST src) {
+        return tryCompileX87Compare(dst, src, false, &ir::IrGenerator::fucomip);
     }
 
-    bool Compiler::tryCompilePblendvbXmmXmmM128(XMM dst, const XMMM128& src) {
-        if(!src.isReg) return false;
-        if(dst == XMM::XMM0) return false;
-        if(src.reg == XMM::XMM0) return false;
-        // read the dst register
-        readReg128(toGpr(dst), dst);
-        // read the src register
-        readReg128(toGpr(src.reg), src.reg);
-        // read the xmm0 register
-        readReg128(toGpr(XMM::XMM0), XMM::XMM0);
-        generator_->pblendvb(get(toGpr(dst)), get(toGpr(src.reg)));
-        writeReg128(dst, toGpr(dst));
+    bool Compiler::tryCompileFucomipSTST(ST dst, ST src) {
+        return tryCompileX87Compare(dst, src, true, &ir::IrGenerator::fucomip);
+    }
+
+    bool Compiler::tryCompileFabs() {
+        emptyHostX87Stack();
+        loadX87Register(ST::ST0, TmpReg{Reg::GPR0});
+        generator_->fabs();
+        storeX87Register(ST::ST0, TmpReg{Reg::GPR0});
         return true;
     }
 
-    bool Compiler::tryCompileStmxcsrM32(const M32& dst) {
-        // fetch dst address
-        if(dst.segment == Segment::FS) return false;
-        if(dst.encoding.index == R64::RIP) return false;
-        // get the address
-        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
-        loadMxcsrFromEmulator(Reg::GPR1);
-        writeMem32(addr, Reg::GPR1);
+    bool Compiler::tryCompileFchs() {
+        emptyHostX87Stack();
+        loadX87Register(ST::ST0, TmpReg{Reg::GPR0});
+        generator_->fchs();
+        storeX87Register(ST::ST0, TmpReg{Reg::GPR0});
         return true;
     }
 
@@ -5737,6 +7205,18 @@ namespace x64 {
         return 16*(i32)reg;
     }
 
+    M80 make80(R64 base, R64 index, u8 scale, i32 disp) {
+        return M80 {
+            Segment::CS,
+            Encoding64 {
+                base,
+                index,
+                scale,
+                disp,
+            },
+        };
+    }
+
     M128 make128(R64 base, R64 index, u8 scale, i32 disp) {
         return M128 {
             Segment::CS,
@@ -5762,24 +7242,28 @@ namespace x64 {
     }
 
     void Compiler::readRegMM(RegMM dst, MMX src) {
+        hostX87StackIsEmpty_ = false;
         MMX d = get(dst);
         M64 s = make64(get(Reg::MMX_BASE), registerOffset(src));
         generator_->movq(d, s);
     }
 
     void Compiler::writeRegMM(MMX dst, RegMM src) {
+        hostX87StackIsEmpty_ = false;
         M64 d = make64(get(Reg::MMX_BASE), registerOffset(dst));
         MMX s = get(src);
         generator_->movq(d, s);
     }
 
     void Compiler::readMemMM(RegMM dst, const Mem& address) {
+        hostX87StackIsEmpty_ = false;
         MMX d = get(dst);
         M64 s = make64(get(Reg::MEM_BASE), get(address.base), 1, address.offset);
         generator_->movq(d, s);
     }
 
     void Compiler::writeMemMM(const Mem& address, RegMM src) {
+        hostX87StackIsEmpty_ = false;
         M64 d = make64(get(Reg::MEM_BASE), get(address.base), 1, address.offset);
         MMX s = get(src);
         generator_->movq(d, s);
@@ -5809,6 +7293,63 @@ namespace x64 {
         generator_->movu(d, s);
     }
 
+    // Computes the offset of the slot of st in dst, and returns the location of its value
+    M80 Compiler::x87Register(Reg dst, ST st) {
+        constexpr size_t X87TOP_OFFSET = offsetof(NativeArguments, x87top);
+        static_assert(X87TOP_OFFSET == 0xc8);
+        constexpr size_t X87STACK_OFFSET = offsetof(NativeArguments, x87stack);
+        static_assert(X87STACK_OFFSET == 0xd0);
+        generator_->mov(get32(dst), make32(R64::RDI, X87TOP_OFFSET));
+        if(st != ST::ST0) {
+            // wrap around the 8 slots without touching the flags
+            generator_->lea(get32(dst), make32(get(dst), (i32)(sizeof(X87Slot) * (u32)st)));
+            generator_->movzx(get32(dst), get8(dst));
+        }
+        return make80(R64::RDI, get(dst), 1, X87STACK_OFFSET);
+    }
+
+    M8 Compiler::x87Tag(Reg slot) {
+        constexpr size_t X87STACK_OFFSET = offsetof(NativeArguments, x87stack);
+        return make8(R64::RDI, get(slot), 1, (i32)(X87STACK_OFFSET + offsetof(X87Slot, tag)));
+    }
+
+    void Compiler::loadX87Register(ST src, TmpReg tmp) {
+        generator_->fld(x87Register(tmp.reg, src));
+    }
+
+    void Compiler::storeX87Register(ST dst, TmpReg tmp) {
+        generator_->fstp(x87Register(tmp.reg, dst));
+    }
+
+    void Compiler::pushX87Register(TmpReg tmp1, TmpReg tmp2) {
+        constexpr size_t X87TOP_OFFSET = offsetof(NativeArguments, x87top);
+        // the new top of the stack is the current st(7)
+        M80 top = x87Register(tmp1.reg, ST::ST7);
+        generator_->mov(make32(R64::RDI, X87TOP_OFFSET), get32(tmp1.reg));
+        generator_->fstp(top);
+        loadImm8(tmp2.reg, X87Tag::VALID);
+        generator_->mov(x87Tag(tmp1.reg), get8(tmp2.reg));
+    }
+
+    void Compiler::popX87Register(TmpReg tmp1, TmpReg tmp2) {
+        constexpr size_t X87TOP_OFFSET = offsetof(NativeArguments, x87top);
+        x87Register(tmp1.reg, ST::ST0);
+        loadImm8(tmp2.reg, X87Tag::EMPTY);
+        generator_->mov(x87Tag(tmp1.reg), get8(tmp2.reg));
+        // the new top of the stack is the current st(1)
+        generator_->lea(get32(tmp1.reg), make32(get(tmp1.reg), (i32)sizeof(X87Slot)));
+        generator_->movzx(get32(tmp1.reg), get8(tmp1.reg));
+        generator_->mov(make32(R64::RDI, X87TOP_OFFSET), get32(tmp1.reg));
+    }
+
+    void Compiler::emptyHostX87Stack() {
+        // Jitted mmx code leaves all host x87 registers tagged as valid,
+        // which would make the next load overflow the host stack.
+        if(hostX87StackIsEmpty_) return;
+        generator_->emms();
+        hostX87StackIsEmpty_ = true;
+    }
+
     void Compiler::addTime(u32 amount) {
         constexpr size_t TICKS_OFFSET = offsetof(NativeArguments, ticks);
         static_assert(TICKS_OFFSET == 0x38);
@@ -5821,6 +7362,22 @@ namespace x64 {
         generator_->mov(ticks, get(Reg::GPR0));
     }
 
+    void Compiler::clearIfTickLimitReached(R64 dst, R64 tmp1, R64 tmp2) {
+        // only used where the guest flags have already been saved
+        constexpr size_t TICKS_OFFSET = offsetof(NativeArguments, ticks);
+        static_assert(TICKS_OFFSET == 0x38);
+        constexpr size_t TICK_LIMIT_OFFSET = offsetof(NativeArguments, tickLimit);
+        static_assert(TICK_LIMIT_OFFSET == 0x1d0);
+        generator_->mov(tmp1, make64(R64::RDI, TICKS_OFFSET));
+        generator_->mov(tmp1, make64(tmp1, 0));
+        generator_->mov(tmp2, make64(R64::RDI, TICK_LIMIT_OFFSET));
+        ir::IrGenerator::Label& belowLimit = generator_->label();
+        generator_->cmp(tmp1, tmp2);
+        generator_->jumpCondition(x64::Cond::B, &belowLimit);
+        generator_->xor_(dst, dst);
+        generator_->putLabel(belowLimit);
+    }
+
     void Compiler::incrementCalls() {
         constexpr size_t BBPTR_OFFSET = offsetof(NativeArguments, currentlyExecutingJitBasicBlock);
         static_assert(BBPTR_OFFSET == 0x58);
@@ -5842,21 +7399,21 @@ namespace x64 {
         generator_->mov(get(dst), fsbasePtr);
     }
 
-    void Compiler::writeBasicBlockPtr(u64 basicBlockPtr) {
+    void Compiler::writeBasicBlockPtr(const void* basicBlockPtr, u32 blockInTrace) {
         constexpr size_t SEGMENTPTR_OFFSET = offsetof(NativeArguments, currentlyExecutingSegmentPtr);
         static_assert(SEGMENTPTR_OFFSET == 0x50);
         M64 bbPtrPtr = make64(R64::RDI, SEGMENTPTR_OFFSET);
         generator_->mov(get(Reg::GPR1), bbPtrPtr);
         M64 bbPtr = make64(get(Reg::GPR1), 0);
-        loadImm64(Reg::GPR0, basicBlockPtr);
+        loadHostPointer(get(Reg::GPR0), basicBlockPtr, NativeRelocation::Kind::BASIC_BLOCK, blockInTrace, 0);
         generator_->mov(bbPtr, get(Reg::GPR0));
     }
 
-    void Compiler::writeJitBasicBlockPtr(u64 jitBasicBlockPtr) {
+    void Compiler::writeJitBasicBlockPtr(const void* jitBasicBlockPtr) {
         constexpr size_t JITBBPTR_OFFSET = offsetof(NativeArguments, currentlyExecutingJitBasicBlock);
         static_assert(JITBBPTR_OFFSET == 0x58);
         M64 bbPtr = make64(R64::RDI, JITBBPTR_OFFSET);
-        loadImm64(Reg::GPR0, jitBasicBlockPtr);
+        loadHostPointer(get(Reg::GPR0), jitBasicBlockPtr, NativeRelocation::Kind::JIT_BASIC_BLOCK, 0, 0);
         generator_->mov(bbPtr, get(Reg::GPR0));
     }
 
@@ -5869,18 +7426,82 @@ namespace x64 {
     }
 
     void Compiler::writeJumpTo(const void* address, u8* ptr, size_t size) {
+        size_t regionSize = replaceableJumpSize();
         TmpReg tmp {Reg::GPR0};
         const auto& code = jmpCode(address, tmp);
-        (void)size;
-        assert(code.size() <= size);
-        memcpy(ptr, code.data(), code.size());
+        writeCode(code, ptr, regionSize, size);
     }
 
     size_t Compiler::jmpCodeSize(const void* dst, TmpReg tmp) {
         return jmpCode(dst, tmp).size();
     }
 
-    const std::vector<u8>& Compiler::pushCallstackCode(const void* dst, TmpReg tmp1, TmpReg tmp2) {
+    const std::vector<u8>& Compiler::loopJmpCode(const void* dst, TmpReg tmp) {
+        assembler_->clear();
+        // The guest flags live in the host flags: the ticks are compared to the limit
+        // through the sign of their difference, which only needs flagless instructions.
+        constexpr size_t TICKS_OFFSET = offsetof(NativeArguments, ticks);
+        static_assert(TICKS_OFFSET == 0x38);
+        constexpr size_t TICK_LIMIT_OFFSET = offsetof(NativeArguments, tickLimit);
+        static_assert(TICK_LIMIT_OFFSET == 0x1d0);
+        constexpr size_t MEMORY_OFFSET = offsetof(NativeArguments, memory);
+        static_assert(MEMORY_OFFSET == 0x18);
+        // jrcxz only tests rcx, which holds the memory base and is reloaded afterwards
+        const R64 RCX = get(Reg::MEM_BASE);
+        verify(RCX == R64::RCX);
+        assembler_->mov(get(tmp.reg), make64(R64::RDI, TICKS_OFFSET));
+        assembler_->mov(get(tmp.reg), make64(get(tmp.reg), 0));
+        assembler_->mov(RCX, make64(R64::RDI, TICK_LIMIT_OFFSET));
+        assembler_->not_(RCX);
+        assembler_->lea(RCX, make64(RCX, get(tmp.reg), 1, 1)); // ticks - limit, negative while the limit is not reached
+        assembler_->movq(XMM::XMM0, RCX);
+        assembler_->movmskpd(R32::ECX, XMM::XMM0); // rcx = sign of the difference
+
+        Assembler::Label& limitReached = assembler_->label();
+        assembler_->jrcxz(&limitReached);
+        assembler_->mov(RCX, make64(R64::RDI, MEMORY_OFFSET));
+        assembler_->mov(get(tmp.reg), (u64)dst);
+        assembler_->jump(get(tmp.reg));
+
+        // fall through to the exit of the block
+        assembler_->putLabel(limitReached);
+        assembler_->mov(RCX, make64(R64::RDI, MEMORY_OFFSET));
+        assembler_->patchJumps();
+        return assembler_->code();
+    }
+
+    void Compiler::writeLoopJumpTo(const void* address, u8* ptr, size_t size) {
+        size_t regionSize = replaceableJumpSize();
+        TmpReg tmp {Reg::GPR0};
+        const auto& code = loopJmpCode(address, tmp);
+        writeCode(code, ptr, regionSize, size);
+    }
+
+    void Compiler::writeUnpatchedJump(u8* ptr, size_t size) {
+        // back to the nops that fall through to the exit of the block
+        size_t jumpCodeSize = replaceableJumpSize();
+        assembler_->clear();
+        assembler_->nops(jumpCodeSize);
+        const auto& code = assembler_->code();
+        writeCode(code, ptr, jumpCodeSize, size);
+    }
+
+    void Compiler::writeCode(const std::vector<u8>& code, u8* ptr, size_t regionSize, size_t size) {
+        (void)size;
+        assert(code.size() <= regionSize);
+        assert(regionSize <= size);
+        if(!!codePatcher_) {
+            codePatcher_->write(ptr, regionSize, code);
+        } else {
+            memcpy(ptr, code.data(), code.size());
+        }
+    }
+
+    size_t Compiler::replaceableJumpSize() {
+        return std::max(jmpCode(0x0, TmpReg{Reg::GPR0}).size(), loopJmpCode(0x0, TmpReg{Reg::GPR0}).size());
+    }
+
+    const std::vector<u8>& Compiler::pushCallstackCode(const void* dst, u64 returnAddress, TmpReg tmp1, TmpReg tmp2) {
         assembler_->clear();
         // increment the size
         constexpr size_t JITCALLSTACKIZEPTR_OFFSET = offsetof(NativeArguments, callstackSize);
@@ -5890,29 +7511,40 @@ namespace x64 {
         assembler_->mov(get(tmp1.reg), make64(get(tmp2.reg), 0)); // tmp1.reg holds the u64
         assembler_->lea(get(tmp1.reg), make64(get(tmp1.reg), 1)); // increment the u64
         assembler_->mov(make64(get(tmp2.reg), 0), get(tmp1.reg)); // write the u64 back
-        // tmp1.reg holds the new size
-        
+
+        // the entry is at the low byte of the old size (this leaves the flags untouched)
+        static_assert(CALLSTACK_SIZE == 0x100);
+        static_assert(sizeof(CallstackEntry) == 0x10);
+        assembler_->lea(get(tmp1.reg), make64(get(tmp1.reg), -1)); // tmp1.reg holds the old size
+        assembler_->movzx(get32(tmp1.reg), get8(tmp1.reg)); // tmp1.reg holds the index
+        assembler_->lea(get(tmp1.reg), make64(get(tmp1.reg), get(tmp1.reg), 1, 0)); // tmp1.reg holds twice the index
+
         constexpr size_t JITCALLSTACKPTR_OFFSET = offsetof(NativeArguments, callstack);
         static_assert(JITCALLSTACKPTR_OFFSET == 0x40);
-        M64 callstackPtrPtr = make64(R64::RDI, JITCALLSTACKPTR_OFFSET); // address of the void**
-        assembler_->mov(get(tmp2.reg), callstackPtrPtr); // tmp2.reg holds the void**
-        assembler_->lea(get(tmp2.reg), make64(get(tmp2.reg), get(tmp1.reg), 8, -8)); // tmp2.reg holds the new entry
+        M64 callstackPtrPtr = make64(R64::RDI, JITCALLSTACKPTR_OFFSET); // address of the CallstackEntry*
+        assembler_->mov(get(tmp2.reg), callstackPtrPtr); // tmp2.reg holds the CallstackEntry*
+        assembler_->lea(get(tmp2.reg), make64(get(tmp2.reg), get(tmp1.reg), 8, 0)); // tmp2.reg holds the new entry
+
+        constexpr size_t RETURN_ADDRESS_OFFSET = offsetof(CallstackEntry, returnAddress);
+        static_assert(RETURN_ADDRESS_OFFSET == 0x0);
+        constexpr size_t LANDING_PAD_OFFSET = offsetof(CallstackEntry, landingPad);
+        static_assert(LANDING_PAD_OFFSET == 0x8);
+        assembler_->mov(get(tmp1.reg), returnAddress); // load the guest return address
+        assembler_->mov(make64(get(tmp2.reg), RETURN_ADDRESS_OFFSET), get(tmp1.reg)); // write the guest return address
         assembler_->mov(get(tmp1.reg), (u64)dst); // load the dst
-        assembler_->mov(make64(get(tmp2.reg), 0), get(tmp1.reg)); // write the dst
+        assembler_->mov(make64(get(tmp2.reg), LANDING_PAD_OFFSET), get(tmp1.reg)); // write the dst
 
         return assembler_->code();
     }
 
-    void Compiler::writePushCallstackTo(const void* address, u8* ptr, size_t size) {
+    void Compiler::writePushCallstackTo(const void* address, u64 returnAddress, u8* ptr, size_t size) {
         TmpReg tmp1 {Reg::GPR0};
         TmpReg tmp2 {Reg::GPR1};
-        const auto& code = pushCallstackCode(address, tmp1, tmp2);
-        (void)size;
-        assert(code.size() <= size);
-        memcpy(ptr, code.data(), code.size());
+        const auto& code = pushCallstackCode(address, returnAddress, tmp1, tmp2);
+        writeCode(code, ptr, code.size(), size);
     }
 
-    const std::vector<u8>& Compiler::popCallstackCode(Reg dst, TmpReg tmp1, TmpReg tmp2) {
+    const std::vector<u8>& Compiler::popCallstackCode(Reg dst, TmpReg tmp1, TmpReg tmp2, TmpReg tmp3) {
         assembler_->clear();
         // decrement the size
         constexpr size_t JITCALLSTACKIZEPTR_OFFSET = offsetof(NativeArguments, callstackSize);
@@ -5922,18 +7554,34 @@ namespace x64 {
         assembler_->mov(get(tmp1.reg), make64(get(tmp2.reg), 0)); // tmp1.reg = callstackSize
         assembler_->lea(get(tmp1.reg), make64(get(tmp1.reg), -1)); // --tmp1.reg
         assembler_->mov(make64(get(tmp2.reg), 0), get(tmp1.reg)); // *callstackSizePtr = tmp1.reg
-        
-        // TODO read the value and use it after
+
+        // the entry is at the low byte of the new size
+        static_assert(CALLSTACK_SIZE == 0x100);
+        static_assert(sizeof(CallstackEntry) == 0x10);
+        assembler_->movzx(get32(tmp1.reg), get8(tmp1.reg)); // tmp1.reg holds the index
+        assembler_->lea(get(tmp1.reg), make64(get(tmp1.reg), get(tmp1.reg), 1, 0)); // tmp1.reg holds twice the index
+
         constexpr size_t JITCALLSTACKPTR_OFFSET = offsetof(NativeArguments, callstack);
         static_assert(JITCALLSTACKPTR_OFFSET == 0x40);
-        M64 callstackPtrPtr = make64(R64::RDI, JITCALLSTACKPTR_OFFSET); // address of the void**
-        assembler_->mov(get(tmp2.reg), callstackPtrPtr); // tmp2.reg holds the void**
+        M64 callstackPtrPtr = make64(R64::RDI, JITCALLSTACKPTR_OFFSET); // address of the CallstackEntry*
+        assembler_->mov(get(tmp2.reg), callstackPtrPtr); // tmp2.reg holds the CallstackEntry*
         assembler_->lea(get(tmp2.reg), make64(get(tmp2.reg), get(tmp1.reg), 8, 0)); // tmp2.reg holds the entry
-        assembler_->mov(get(dst), make64(get(tmp2.reg), 0)); // load the dst
-        assembler_->push64(get(dst));
-        assembler_->mov(get(tmp1.reg), (u64)0);
-        assembler_->mov(make64(get(tmp2.reg), 0), get(tmp1.reg)); // zero out the entry
-        assembler_->pop64(get(dst));
+
+        // the entry is only used if the guest returns where the call would have returned (this clobbers the flags)
+        constexpr size_t RETURN_ADDRESS_OFFSET = offsetof(CallstackEntry, returnAddress);
+        static_assert(RETURN_ADDRESS_OFFSET == 0x0);
+        constexpr size_t LANDING_PAD_OFFSET = offsetof(CallstackEntry, landingPad);
+        static_assert(LANDING_PAD_OFFSET == 0x8);
+        assembler_->mov(get(tmp3.reg), make64(get(Reg::REG_BASE), registerOffset(R64::RIP))); // tmp3.reg holds the guest return address
+        assembler_->mov(get(tmp1.reg), make64(get(tmp2.reg), RETURN_ADDRESS_OFFSET)); // tmp1.reg holds the predicted return address
+        assembler_->mov(make64(get(tmp2.reg), RETURN_ADDRESS_OFFSET), (u32)0); // consume the entry
+        Assembler::Label& done = assembler_->label();
+        assembler_->cmp(get(tmp1.reg), get(tmp3.reg));
+        assembler_->mov(get(dst), make64(get(tmp2.reg), LANDING_PAD_OFFSET)); // load the dst
+        assembler_->jumpCondition(Cond::E, &done);
+        assembler_->mov(get(dst), (u64)0);
+        assembler_->putLabel(done);
+        assembler_->patchJumps();
 
         return assembler_->code();
     }
@@ -6346,6 +7994,25 @@ namespace x64 {
         generator_->lea(R64::RSP, make64(R64::RSP, +16));
     }
 
+    template<Size size, typename Func>
+    bool Compiler::forLockedM(const M<size>& dst, Func&& func) {
+        // fetch dst address
+        if(dst.encoding.index == R64::RIP) return false;
+        Mem addr = getAddress(Reg::MEM_ADDR, TmpReg{Reg::GPR0}, dst);
+        // the guest memory is accessed directly, so that the host instruction is atomic
+        M<size> d {
+            Segment::CS,
+            Encoding64 {
+                get(Reg::MEM_BASE),
+                get(addr.base),
+                1,
+                addr.offset,
+            },
+        };
+        func(d);
+        return true;
+    }
+
     template<typename Func>
     bool Compiler::forRM8Imm(const RM8& dst, Imm imm, Func&& func, bool writeResultBack) {
         if(dst.isReg) {
@@ -2,6 +2,8 @@
 #include "host/hostmemory.h"
 #include "verify.h"
 #include <algorithm>
+#include <cassert>
+#include <cstring>
 
 namespace x64 {
 
@@ -9,20 +11,22 @@ namespace x64 {
     ExecutableMemoryAllocator::~ExecutableMemoryAllocator() = default;
 
     std::optional<MemoryBlock> ExecutableMemoryAllocator::allocate(u32 requestedSize) {
-        // look for a free block
-        auto it = std::find_if(freeBlocks_.begin(), freeBlocks_.end(), [&](const MemoryBlock& block) {
-            return block.size >= requestedSize && block.size <= 1.3*requestedSize;
-        });
-        if(it != freeBlocks_.end()) {
-            MemoryBlock block = *it;
-            freeBlocks_.erase(it);
+        // look for the smallest free block that fits
+        auto it = freeBlocks_.lower_bound(requestedSize);
+        if(it != freeBlocks_.end() && it->first <= 1.3*requestedSize) {
+            MemoryBlock block { it->second.back(), it->first, this };
+            it->second.pop_back();
+            if(it->second.empty()) freeBlocks_.erase(it);
+            usedBytes_ += block.size;
             return block;
         }
 
         // look for a spot in an existing range
         for(auto& range : ranges_) {
             auto block = range.tryAllocate(requestedSize, this);
-            if(!!block) return block;
+            if(!block) continue;
+            usedBytes_ += block->size;
+            return block;
         }
 
         // finally try creating a new range
@@ -32,11 +36,52 @@ namespace x64 {
         if(!ptr) return {};
 
         auto& newRange = ranges_.emplace_back(std::move(*ptr));
-        return newRange.tryAllocate(requestedSize, this);
+        auto block = newRange.tryAllocate(requestedSize, this);
+        if(!!block) usedBytes_ += block->size;
+        return block;
     }
 
     void ExecutableMemoryAllocator::free(MemoryBlock block) {
-        if(!!block.ptr && block.size > 0) freeBlocks_.push_back(block);
+        if(!block.ptr || block.size == 0) return;
+        assert(block.allocator == this);
+        assert(usedBytes_ >= block.size);
+        freeBlocks_[block.size].push_back(block.ptr);
+        usedBytes_ -= block.size;
+    }
+
+    bool ExecutableMemoryAllocator::compact(const std::vector<MemoryBlock*>& blocks) {
+        // allocate everything first, so that a failure leaves the blocks where they are
+        std::list<MemRange> ranges;
+        std::vector<MemoryBlock> destinations;
+        destinations.reserve(blocks.size());
+        for(const MemoryBlock* block : blocks) {
+            assert(!!block);
+            assert(block->allocator == this);
+            std::optional<MemoryBlock> destination;
+            if(!ranges.empty()) destination = ranges.back().tryAllocate(block->size, this);
+            if(!destination) {
+                auto ptr = MemRange::tryCreate();
+                if(!ptr) return false;
+                auto& newRange = ranges.emplace_back(std::move(*ptr));
+                destination = newRange.tryAllocate(block->size, this);
+            }
+            if(!destination) return false;
+            assert(destination->size == block->size);
+            destinations.push_back(destination.value());
+        }
+
+        u64 usedBytes = 0;
+        for(size_t i = 0; i < blocks.size(); ++i) {
+            std::memcpy(destinations[i].ptr, blocks[i]->ptr, blocks[i]->size);
+            *blocks[i] = destinations[i];
+            usedBytes += destinations[i].size;
+        }
+
+        // the previous ranges only contain dead code now
+        ranges_ = std::move(ranges);
+        freeBlocks_.clear();
+        usedBytes_ = usedBytes;
+        return true;
     }
 
     std::unique_ptr<ExecutableMemoryAllocator::MemRange> ExecutableMemoryAllocator::MemRange::tryCreate() {
@@ -32,6 +32,8 @@ namespace x64::ir {
         if(asM32) return x64::utils::toString(*asM32);
         auto asM64 = as<M64>();
         if(asM64) return x64::utils::toString(*asM64);
+        auto asM80 = as<M80>();
+        if(asM80) return x64::utils::toString(*asM80);
         auto asMMX = as<MMX>();
         if(asMMX) return x64::utils::toString(*asMMX);
         auto asXMM = as<XMM>();
@@ -52,10 +54,22 @@ namespace x64::ir {
         if(auto asM16 = as<M16>()) { return reg == asM16->encoding.base || reg == asM16->encoding.index; }
         if(auto asM32 = as<M32>()) { return reg == asM32->encoding.base || reg == asM32->encoding.index; }
         if(auto asM64 = as<M64>()) { return reg == asM64->encoding.base || reg == asM64->encoding.index; }
+        if(auto asM80 = as<M80>()) { return reg == asM80->encoding.base || reg == asM80->encoding.index; }
         if(auto asM128 = as<M128>()) { return reg == asM128->encoding.base || reg == asM128->encoding.index; }
         return false;
     }
 
+    Operand Operand::withEncoding(const Encoding64& encoding) const {
+        if(auto m8 = as<M8>()) return Operand(M8 { m8->segment, encoding });
+        if(auto m16 = as<M16>()) return Operand(M16 { m16->segment, encoding });
+        if(auto m32 = as<M32>()) return Operand(M32 { m32->segment, encoding });
+        if(auto m64 = as<M64>()) return Operand(M64 { m64->segment, encoding });
+        if(auto m80 = as<M80>()) return Operand(M80 { m80->segment, encoding });
+        if(auto m128 = as<M128>()) return Operand(M128 { m128->segment, encoding });
+        assert(false);
+        return *this;
+    }
+
     std::string toString(Op op) {
         switch(op) {
             case Op::MOV: return "mov";
@@ -69,6 +83,9 @@ namespace x64::ir {
             case Op::SHL: return "shl";
             case Op::SHR: return "shr";
             case Op::SAR: return "sar";
+            case Op::SHLX: return "shlx";
+            case Op::SHRX: return "shrx";
+            case Op::SARX: return "sarx";
             case Op::ROL: return "rol";
             case Op::ROR: return "ror";
             case Op::MUL: return "mul";
@@ -80,12 +97,20 @@ namespace x64::ir {
             case Op::OR: return "or";
             case Op::XOR: return "xor";
             case Op::NOT: return "not";
+            case Op::ANDN: return "andn";
             case Op::NEG: return "neg";
             case Op::INC: return "inc";
             case Op::DEC: return "dec";
             case Op::XCHG: return "xchg";
             case Op::CMPXCHG: return "cmpxchg";
+            case Op::LOCKADD: return "lockadd";
+            case Op::LOCKSUB: return "locksub";
+            case Op::LOCKOR: return "lockor";
+            case Op::LOCKINC: return "lockinc";
+            case Op::LOCKDEC: return "lockdec";
+            case Op::LOCKBTS: return "lockbts";
             case Op::LOCKCMPXCHG: return "lockcmpxchg";
+            case Op::LOCKCMPXCHG16B: return "lockcmpxchg16b";
             case Op::LOCKXADD: return "lockxadd";
             case Op::CWDE: return "cwde";
             case Op::CDQE: return "cdqe";
@@ -99,6 +124,7 @@ namespace x64::ir {
             case Op::BSF: return "bsf";
             case Op::BSR: return "bsr";
             case Op::TZCNT: return "tzcnt";
+            case Op::POPCNT: return "popcnt";
             case Op::SET: return "set";
             case Op::CMOV: return "cmov";
             case Op::BSWAP: return "bswap";
@@ -253,6 +279,10 @@ namespace x64::ir {
             case Op::PMULHRSW: return "pmulhrsw";
             case Op::PMAXSD: return "pmaxsd";
             case Op::PMINSD: return "pminsd";
+            case Op::PMAXUW: return "pmaxuw";
+            case Op::PMAXUD: return "pmaxud";
+            case Op::PMINUW: return "pminuw";
+            case Op::PMINUD: return "pminud";
             case Op::PMOVZXBW: return "pmovzxbw";
             case Op::ROUNDPS: return "roundps";
             case Op::ROUNDPD: return "roundpd";
@@ -262,6 +292,26 @@ namespace x64::ir {
             case Op::PINSRD: return "pinsrd";
             case Op::BLENDVPS: return "blendvps";
             case Op::PBLENDVB: return "pblendvb";
+            case Op::PCMPISTRI: return "pcmpistri";
+            case Op::PCMPESTRI: return "pcmpestri";
+            case Op::CRC32: return "crc32";
+            case Op::FLD: return "fld";
+            case Op::FILD: return "fild";
+            case Op::FSTP: return "fstp";
+            case Op::FISTTP: return "fisttp";
+            case Op::FPOP: return "fpop";
+            case Op::FLDZ: return "fldz";
+            case Op::FLD1: return "fld1";
+            case Op::FLDLG2: return "fldlg2";
+            case Op::FADDP: return "faddp";
+            case Op::FSUBP: return "fsubp";
+            case Op::FMULP: return "fmulp";
+            case Op::FDIVP: return "fdivp";
+            case Op::FCOMIP: return "fcomip";
+            case Op::FUCOMIP: return "fucomip";
+            case Op::FABS: return "fabs";
+            case Op::FCHS: return "fchs";
+            case Op::EMMS: return "emms";
         }
         return "NO OP";
     }
@@ -293,23 +343,36 @@ namespace x64::ir {
             case Op::OR:
             case Op::XOR:
             case Op::NOT:
+            case Op::ANDN:
             case Op::NEG:
             case Op::INC:
             case Op::DEC:
             case Op::CMPXCHG:
+            case Op::LOCKADD:
+            case Op::LOCKSUB:
+            case Op::LOCKOR:
+            case Op::LOCKINC:
+            case Op::LOCKDEC:
+            case Op::LOCKBTS:
             case Op::LOCKCMPXCHG:
+            case Op::LOCKCMPXCHG16B:
             case Op::LOCKXADD:
             case Op::PUSHF:
             case Op::POPF:
             case Op::BSF:
             case Op::BSR:
             case Op::TZCNT:
+            case Op::POPCNT:
             case Op::BT:
             case Op::BTR:
             case Op::BTS:
             case Op::COMISS:
             case Op::COMISD:
             case Op::UCOMISD:
+            case Op::FCOMIP:
+            case Op::FUCOMIP:
+            case Op::PCMPISTRI:
+            case Op::PCMPESTRI:
                 return true;
             default:
                 return false;
@@ -318,6 +381,8 @@ namespace x64::ir {
 
 
     IR& IR::add(const IR& other) {
+        // labels of the other IR are numbered from 0, shift them after ours
+        u32 labelOffset = (u32)labels.size();
         for(size_t label : other.labels) {
             labels.push_back(instructions.size() + label);
         }
@@ -341,39 +406,45 @@ namespace x64::ir {
             verify(!popCallstack, "Cannot merge blocks with pop from callstack");
             popCallstack = instructions.size() + other.popCallstack.value();
         }
+        size_t firstInstruction = instructions.size();
         instructions.insert(instructions.end(), other.instructions.begin(), other.instructions.end());
+        if(labelOffset != 0) {
+            for(size_t i = firstInstruction; i < instructions.size(); ++i) {
+                auto labelIndex = instructions[i].in1().as<LabelIndex>();
+                if(!labelIndex) continue;
+                instructions[i].setLabelIndex(LabelIndex{labelIndex->index + labelOffset});
+            }
+        }
         return *this;
     }
 
     void IR::removeInstructions(std::vector<size_t>& positions) {
-        // sort in reverse order !
-        std::sort(positions.begin(), positions.end(), [](size_t a, size_t b) {
-            return a > b;
-        });
-
-        auto removeInstruction = [&](size_t position) {
-            for(size_t& label : labels) {
-                if(label > position) --label;
-            }
-            if(jumpLanding && jumpLanding.value() > position) {
-                --jumpLanding.value();
-            }
-            if(jumpToNext && jumpToNext.value() > position) {
-                --jumpToNext.value();
-            }
-            if(jumpToOther && jumpToOther.value() > position) {
-                --jumpToOther.value();
-            }
-            if(pushCallstack && pushCallstack->first > position) {
-                --pushCallstack->first;
-            }
-            if(popCallstack && popCallstack.value() > position) {
-                --popCallstack.value();
-            }
-            instructions.erase(instructions.begin() + (ptrdiff_t)position);
-        };
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
 
-        for(size_t position : positions) removeInstruction(position);
+        // everything after a removed instruction moves up by one
+        auto newPosition = [&](size_t position) {
+            auto nbRemovedBefore = std::lower_bound(positions.begin(), positions.end(), position) - positions.begin();
+            return position - (size_t)nbRemovedBefore;
+        };
+        for(size_t& label : labels) label = newPosition(label);
+        if(jumpLanding) jumpLanding = newPosition(jumpLanding.value());
+        if(jumpToNext) jumpToNext = newPosition(jumpToNext.value());
+        if(jumpToOther) jumpToOther = newPosition(jumpToOther.value());
+        if(pushCallstack) pushCallstack->first = newPosition(pushCallstack->first);
+        if(popCallstack) popCallstack = newPosition(popCallstack.value());
+
+        size_t next = 0;
+        auto removed = positions.begin();
+        for(size_t i = 0; i < instructions.size(); ++i) {
+            if(removed != positions.end() && *removed == i) {
+                ++removed;
+                continue;
+            }
+            if(next != i) instructions[next] = std::move(instructions[i]);
+            ++next;
+        }
+        instructions.erase(instructions.begin() + (ptrdiff_t)next, instructions.end());
     }
 
     bool Instruction::readsFrom(R64 reg) const {
@@ -725,6 +796,9 @@ namespace x64::ir {
         if(auto m64 = as<M64>()) {
             return addressesMayAlias(m64.value(), other);
         }
+        if(auto m80 = as<M80>()) {
+            return addressesMayAlias(m80.value(), other);
+        }
         return false;
     }
 
@@ -741,6 +815,9 @@ namespace x64::ir {
         if(auto m64 = as<M64>()) {
             return addressesMayAlias(m64.value(), other);
         }
+        if(auto m80 = as<M80>()) {
+            return addressesMayAlias(m80.value(), other);
+        }
         return false;
     }
 
@@ -757,6 +834,9 @@ namespace x64::ir {
         if(auto m64 = as<M64>()) {
             return addressesMayAlias(m64.value(), other);
         }
+        if(auto m80 = as<M80>()) {
+            return addressesMayAlias(m80.value(), other);
+        }
         return false;
     }
 
@@ -773,6 +853,28 @@ namespace x64::ir {
         if(auto m64 = as<M64>()) {
             return addressesMayAlias(m64.value(), other);
         }
+        if(auto m80 = as<M80>()) {
+            return addressesMayAlias(m80.value(), other);
+        }
+        return false;
+    }
+
+    bool Operand::mayAlias(const M80& other) const {
+        if(auto m8 = as<M8>()) {
+            return addressesMayAlias(m8.value(), other);
+        }
+        if(auto m16 = as<M16>()) {
+            return addressesMayAlias(m16.value(), other);
+        }
+        if(auto m32 = as<M32>()) {
+            return addressesMayAlias(m32.value(), other);
+        }
+        if(auto m64 = as<M64>()) {
+            return addressesMayAlias(m64.value(), other);
+        }
+        if(auto m80 = as<M80>()) {
+            return addressesMayAlias(m80.value(), other);
+        }
         return false;
     }
 
@@ -789,6 +891,9 @@ namespace x64::ir {
         if(auto m64 = as<M64>()) {
             return addressesMayAlias(m64.value(), other);
         }
+        if(auto m80 = as<M80>()) {
+            return addressesMayAlias(m80.value(), other);
+        }
         return false;
     }
 
@@ -797,7 +902,35 @@ namespace x64::ir {
     }
 
 
+    bool Instruction::usesX87Stack() const {
+        switch(op_) {
+            case Op::FLD:
+            case Op::FILD:
+            case Op::FSTP:
+            case Op::FISTTP:
+            case Op::FPOP:
+            case Op::FLDZ:
+            case Op::FLD1:
+            case Op::FLDLG2:
+            case Op::FADDP:
+            case Op::FSUBP:
+            case Op::FMULP:
+            case Op::FDIVP:
+            case Op::FCOMIP:
+            case Op::FUCOMIP:
+            case Op::FABS:
+            case Op::FCHS:
+            case Op::EMMS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
     bool Instruction::canCommute(const Instruction& a, const Instruction& b) {
+        // the host x87 stack is shared state that does not appear in the operands
+        if(a.usesX87Stack() || b.usesX87Stack()) return false;
+
         // Complicated cases have dedicated path
         if(canMovsCommute(a, b)) return true;
         if(canMovasCommute(a, b)) return true;
@@ -50,6 +50,7 @@ namespace x64::ir {
     void IrGenerator::mov(R32 dst, u32 imm) { emit(Op::MOV, dst, imm); }
     void IrGenerator::mov(R64 dst, R64 src) { emit(Op::MOV, dst, src); }
     void IrGenerator::mov(R64 dst, u64 imm) { emit(Op::MOV, dst, imm); }
+    void IrGenerator::movHostPointer(R64 dst, u64 ptr, u32 relocation) { emit(Op::MOV, dst, ptr).addRelocation(relocation); }
     void IrGenerator::mov(R8 dst, const M8& src) { emit(Op::MOV, dst, src); }
     void IrGenerator::mov(const M8& dst, R8 src) { emit(Op::MOV, dst, src); }
     void IrGenerator::mov(R16 dst, const M16& src) { emit(Op::MOV, dst, src); }
@@ -128,6 +129,12 @@ namespace x64::ir {
     void IrGenerator::sar(R32 lhs, u8 rhs) { emit(Op::SAR, lhs, lhs, rhs); }
     void IrGenerator::sar(R64 lhs, R8 rhs) { emit(Op::SAR, lhs, lhs, rhs); }
     void IrGenerator::sar(R64 lhs, u8 rhs) { emit(Op::SAR, lhs, lhs, rhs); }
+    void IrGenerator::shlx(R32 dst, R32 src, R32 count) { emit(Op::SHLX, dst, src, count); }
+    void IrGenerator::shlx(R64 dst, R64 src, R64 count) { emit(Op::SHLX, dst, src, count); }
+    void IrGenerator::shrx(R32 dst, R32 src, R32 count) { emit(Op::SHRX, dst, src, count); }
+    void IrGenerator::shrx(R64 dst, R64 src, R64 count) { emit(Op::SHRX, dst, src, count); }
+    void IrGenerator::sarx(R32 dst, R32 src, R32 count) { emit(Op::SARX, dst, src, count); }
+    void IrGenerator::sarx(R64 dst, R64 src, R64 count) { emit(Op::SARX, dst, src, count); }
     void IrGenerator::rol(R16 lhs, R8 rhs) { emit(Op::ROL, lhs, lhs, rhs); }
     void IrGenerator::rol(R16 lhs, u8 rhs) { emit(Op::ROL, lhs, lhs, rhs); }
     void IrGenerator::rol(R32 lhs, R8 rhs) { emit(Op::ROL, lhs, lhs, rhs); }
@@ -205,12 +212,60 @@ namespace x64::ir {
     void IrGenerator::xchg(R16 dst, R16 src) { emit(Op::XCHG, dst, dst, src); }
     void IrGenerator::xchg(R32 dst, R32 src) { emit(Op::XCHG, dst, dst, src); }
     void IrGenerator::xchg(R64 dst, R64 src) { emit(Op::XCHG, dst, dst, src); }
+    void IrGenerator::xchg(const M8& dst, R8 src) { emit(Op::XCHG, dst, dst, src); }
+    void IrGenerator::xchg(const M16& dst, R16 src) { emit(Op::XCHG, dst, dst, src); }
+    void IrGenerator::xchg(const M32& dst, R32 src) { emit(Op::XCHG, dst, dst, src); }
+    void IrGenerator::xchg(const M64& dst, R64 src) { emit(Op::XCHG, dst, dst, src); }
     void IrGenerator::cmpxchg(R32 dst, R32 src) { emit(Op::CMPXCHG, dst, dst, src); }
     void IrGenerator::cmpxchg(R64 dst, R64 src) { emit(Op::CMPXCHG, dst, dst, src); }
 
+    void IrGenerator::lockadd(const M8& dst, R8 src) { emit(Op::LOCKADD, dst, dst, src); }
+    void IrGenerator::lockadd(const M8& dst, i8 imm) { emit(Op::LOCKADD, dst, dst, imm); }
+    void IrGenerator::lockadd(const M16& dst, R16 src) { emit(Op::LOCKADD, dst, dst, src); }
+    void IrGenerator::lockadd(const M16& dst, i16 imm) { emit(Op::LOCKADD, dst, dst, imm); }
+    void IrGenerator::lockadd(const M32& dst, R32 src) { emit(Op::LOCKADD, dst, dst, src); }
+    void IrGenerator::lockadd(const M32& dst, i32 imm) { emit(Op::LOCKADD, dst, dst, imm); }
+    void IrGenerator::lockadd(const M64& dst, R64 src) { emit(Op::LOCKADD, dst, dst, src); }
+    void IrGenerator::lockadd(const M64& dst, i32 imm) { emit(Op::LOCKADD, dst, dst, imm); }
+    void IrGenerator::locksub(const M8& dst, R8 src) { emit(Op::LOCKSUB, dst, dst, src); }
+    void IrGenerator::locksub(const M8& dst, i8 imm) { emit(Op::LOCKSUB, dst, dst, imm); }
+    void IrGenerator::locksub(const M16& dst, R16 src) { emit(Op::LOCKSUB, dst, dst, src); }
+    void IrGenerator::locksub(const M16& dst, i16 imm) { emit(Op::LOCKSUB, dst, dst, imm); }
+    void IrGenerator::locksub(const M32& dst, R32 src) { emit(Op::LOCKSUB, dst, dst, src); }
+    void IrGenerator::locksub(const M32& dst, i32 imm) { emit(Op::LOCKSUB, dst, dst, imm); }
+    void IrGenerator::locksub(const M64& dst, R64 src) { emit(Op::LOCKSUB, dst, dst, src); }
+    void IrGenerator::locksub(const M64& dst, i32 imm) { emit(Op::LOCKSUB, dst, dst, imm); }
+    void IrGenerator::lockor(const M8& dst, R8 src) { emit(Op::LOCKOR, dst, dst, src); }
+    void IrGenerator::lockor(const M8& dst, i8 imm) { emit(Op::LOCKOR, dst, dst, imm); }
+    void IrGenerator::lockor(const M16& dst, R16 src) { emit(Op::LOCKOR, dst, dst, src); }
+    void IrGenerator::lockor(const M16& dst, i16 imm) { emit(Op::LOCKOR, dst, dst, imm); }
+    void IrGenerator::lockor(const M32& dst, R32 src) { emit(Op::LOCKOR, dst, dst, src); }
+    void IrGenerator::lockor(const M32& dst, i32 imm) { emit(Op::LOCKOR, dst, dst, imm); }
+    void IrGenerator::lockor(const M64& dst, R64 src) { emit(Op::LOCKOR, dst, dst, src); }
+    void IrGenerator::lockor(const M64& dst, i32 imm) { emit(Op::LOCKOR, dst, dst, imm); }
+    void IrGenerator::lockinc(const M8& dst) { emit(Op::LOCKINC, dst, dst); }
+    void IrGenerator::lockinc(const M16& dst) { emit(Op::LOCKINC, dst, dst); }
+    void IrGenerator::lockinc(const M32& dst) { emit(Op::LOCKINC, dst, dst); }
+    void IrGenerator::lockinc(const M64& dst) { emit(Op::LOCKINC, dst, dst); }
+    void IrGenerator::lockdec(const M8& dst) { emit(Op::LOCKDEC, dst, dst); }
+    void IrGenerator::lockdec(const M16& dst) { emit(Op::LOCKDEC, dst, dst); }
+    void IrGenerator::lockdec(const M32& dst) { emit(Op::LOCKDEC, dst, dst); }
+    void IrGenerator::lockdec(const M64& dst) { emit(Op::LOCKDEC, dst, dst); }
+    void IrGenerator::lockbts(const M16& dst, R16 src) { emit(Op::LOCKBTS, dst, dst, src); }
+    void IrGenerator::lockbts(const M16& dst, u8 imm) { emit(Op::LOCKBTS, dst, dst, imm); }
+    void IrGenerator::lockbts(const M32& dst, R32 src) { emit(Op::LOCKBTS, dst, dst, src); }
+    void IrGenerator::lockbts(const M32& dst, u8 imm) { emit(Op::LOCKBTS, dst, dst, imm); }
+    void IrGenerator::lockbts(const M64& dst, R64 src) { emit(Op::LOCKBTS, dst, dst, src); }
+    void IrGenerator::lockbts(const M64& dst, u8 imm) { emit(Op::LOCKBTS, dst, dst, imm); }
+    void IrGenerator::lockcmpxchg(const M8& dst, R8 src) { emit(Op::LOCKCMPXCHG, dst, dst, src); }
+    void IrGenerator::lockcmpxchg(const M16& dst, R16 src) { emit(Op::LOCKCMPXCHG, dst, dst, src); }
     void IrGenerator::lockcmpxchg(const M32& dst, R32 src) { emit(Op::LOCKCMPXCHG, dst, dst, src); }
     void IrGenerator::lockcmpxchg(const M64& dst, R64 src) { emit(Op::LOCKCMPXCHG, dst, dst, src); }
+    void IrGenerator::lockcmpxchg16b(const M128& dst) { emit(Op::LOCKCMPXCHG16B, dst, dst).addImpactedRegister(R64::RAX).addImpactedRegister(R64::RBX).addImpactedRegister(R64::RCX).addImpactedRegister(R64::RDX); }
+    void IrGenerator::lockxadd(const M8& dst, R8 src) { emit(Op::LOCKXADD, dst, dst, src); }
+    void IrGenerator::lockxadd(const M16& dst, R16 src) { emit(Op::LOCKXADD, dst, dst, src); }
     void IrGenerator::lockxadd(const M32& dst, R32 src) { emit(Op::LOCKXADD, dst, dst, src); }
+    void IrGenerator::lockxadd(const M64& dst, R64 src) { emit(Op::LOCKXADD, dst, dst, src); }
 
     void IrGenerator::cwde() { emit(Op::CWDE, R32::EAX, R16::AX); }
     void IrGenerator::cdqe() { emit(Op::CDQE, R64::RAX, R32::EAX); }
@@ -234,6 +289,9 @@ namespace x64::ir {
     void IrGenerator::bsf(R64 dst, R64 src) { emit(Op::BSF, dst, dst, src); }
     void IrGenerator::bsr(R32 dst, R32 src) { emit(Op::BSR, dst, dst, src); }
     void IrGenerator::tzcnt(R32 dst, R32 src) { emit(Op::TZCNT, dst, dst, src); }
+    void IrGenerator::tzcnt(R64 dst, R64 src) { emit(Op::TZCNT, dst, dst, src); }
+    void IrGenerator::popcnt(R32 dst, R32 src) { emit(Op::POPCNT, dst, dst, src); }
+    void IrGenerator::popcnt(R64 dst, R64 src) { emit(Op::POPCNT, dst, dst, src); }
 
     void IrGenerator::set(Cond cond, R8 dst) { emit(Op::SET, dst, dst).addCond(cond); }
     void IrGenerator::cmov(Cond cond, R32 dst, R32 src) { emit(Op::CMOV, dst, src).addCond(cond).addImpactedRegister(containingRegister(dst)); }
@@ -529,6 +587,10 @@ namespace x64::ir {
 
     void IrGenerator::pmaxsd(XMM dst, XMM src) { emit(Op::PMAXSD, dst, dst, src); }
     void IrGenerator::pminsd(XMM dst, XMM src) { emit(Op::PMINSD, dst, dst, src); }
+    void IrGenerator::pmaxuw(XMM dst, XMM src) { emit(Op::PMAXUW, dst, dst, src); }
+    void IrGenerator::pmaxud(XMM dst, XMM src) { emit(Op::PMAXUD, dst, dst, src); }
+    void IrGenerator::pminuw(XMM dst, XMM src) { emit(Op::PMINUW, dst, dst, src); }
+    void IrGenerator::pminud(XMM dst, XMM src) { emit(Op::PMINUD, dst, dst, src); }
     void IrGenerator::pmovzxbw(XMM dst, XMM src) { emit(Op::PMOVZXBW, dst, src); }
     void IrGenerator::roundps(XMM dst, XMM src, u8 imm) { emit(Op::ROUNDPS, dst, src, imm); }
     void IrGenerator::roundpd(XMM dst, XMM src, u8 imm) { emit(Op::ROUNDPD, dst, src, imm); }
@@ -539,6 +601,39 @@ namespace x64::ir {
     void IrGenerator::blendvps(XMM dst, XMM src) { emit(Op::BLENDVPS, dst, dst, src, XMM::XMM0); }
     void IrGenerator::pblendvb(XMM dst, XMM src) { emit(Op::PBLENDVB, dst, dst, src, XMM::XMM0); }
 
+    void IrGenerator::pcmpistri(XMM dst, XMM src, u8 imm) { emit(Op::PCMPISTRI, R32::ECX, dst, src, imm); }
+    void IrGenerator::pcmpestri(XMM dst, XMM src, u8 imm) { emit(Op::PCMPESTRI, R32::ECX, dst, src, imm).addImpactedRegister(R64::RAX).addImpactedRegister(R64::RDX); }
+    void IrGenerator::crc32(R32 dst, R8 src) { emit(Op::CRC32, dst, dst, src); }
+    void IrGenerator::crc32(R32 dst, R16 src) { emit(Op::CRC32, dst, dst, src); }
+    void IrGenerator::crc32(R32 dst, R32 src) { emit(Op::CRC32, dst, dst, src); }
+    void IrGenerator::crc32(R64 dst, R64 src) { emit(Op::CRC32, dst, dst, src); }
+
+    void IrGenerator::fld(const M32& src) { emit(Op::FLD, Operand{}, src); }
+    void IrGenerator::fld(const M64& src) { emit(Op::FLD, Operand{}, src); }
+    void IrGenerator::fld(const M80& src) { emit(Op::FLD, Operand{}, src); }
+    void IrGenerator::fild(const M16& src) { emit(Op::FILD, Operand{}, src); }
+    void IrGenerator::fild(const M32& src) { emit(Op::FILD, Operand{}, src); }
+    void IrGenerator::fild(const M64& src) { emit(Op::FILD, Operand{}, src); }
+    void IrGenerator::fstp(const M32& dst) { emit(Op::FSTP, dst); }
+    void IrGenerator::fstp(const M64& dst) { emit(Op::FSTP, dst); }
+    void IrGenerator::fstp(const M80& dst) { emit(Op::FSTP, dst); }
+    void IrGenerator::fisttp(const M16& dst) { emit(Op::FISTTP, dst); }
+    void IrGenerator::fisttp(const M32& dst) { emit(Op::FISTTP, dst); }
+    void IrGenerator::fisttp(const M64& dst) { emit(Op::FISTTP, dst); }
+    void IrGenerator::fpop() { emit(Op::FPOP); }
+    void IrGenerator::fldz() { emit(Op::FLDZ); }
+    void IrGenerator::fld1() { emit(Op::FLD1); }
+    void IrGenerator::fldlg2() { emit(Op::FLDLG2); }
+    void IrGenerator::faddp() { emit(Op::FADDP); }
+    void IrGenerator::fsubp() { emit(Op::FSUBP); }
+    void IrGenerator::fmulp() { emit(Op::FMULP); }
+    void IrGenerator::fdivp() { emit(Op::FDIVP); }
+    void IrGenerator::fcomip() { emit(Op::FCOMIP); }
+    void IrGenerator::fucomip() { emit(Op::FUCOMIP); }
+    void IrGenerator::fabs() { emit(Op::FABS); }
+    void IrGenerator::fchs() { emit(Op::FCHS); }
+    void IrGenerator::emms() { emit(Op::EMMS); }
+
     IrGenerator::Label& IrGenerator::label() {
         Label newLabel {
             (u32)labels_.size(),
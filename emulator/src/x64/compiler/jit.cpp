@@ -1,7 +1,9 @@
 #include "x64/compiler/jit.h"
 #include "x64/compiler/compiler.h"
+#include "x64/compiler/jitstats.h"
 #include "x64/cpu.h"
 #include "x64/mmu.h"
+#include <algorithm>
 
 namespace x64 {
 
@@ -14,7 +16,11 @@ namespace x64 {
 
     Jit::Jit() {
         compiler_ = std::make_unique<x64::Compiler>();
-        std::fill(callstack_.begin(), callstack_.end(), nullptr);
+#ifdef MULTIPROCESSING
+        compiler_->setCodePatcher(&codePatcher_);
+#endif
+        indirectBranchCache_ = std::make_unique<IndirectBranchCache>();
+        clearIndirectBranchCache();
     }
 
     Jit::~Jit() {
@@ -22,18 +28,31 @@ namespace x64 {
         fmt::println("Jit stats");
         fmt::println("  {} attempts", compilationAttempts_);
         fmt::println("  {} failed", failedCompilationAttempts_);
+        fmt::println("  {} trace attempts", traceCompilationAttempts_);
+        fmt::println("  {} failed", failedTraceCompilationAttempts_);
 #endif
     }
 
     std::unique_ptr<Jit> Jit::clone() const {
         auto jit = Jit::tryCreate();
         if(!jit) return {};
-        jit->callstackSize_ = callstackSize_;
+#ifndef MULTIPROCESSING
+        // with several workers, the callstack stays with the thread
+        jit->executionState_.callstackSize = executionState_.callstackSize;
+#endif
         jit->jitChainingEnabled_ = jitChainingEnabled_;
         jit->optimizationLevel_ = optimizationLevel_;
+        jit->tieredCompilationEnabled_ = tieredCompilationEnabled_;
+        jit->codeCacheLimit_ = codeCacheLimit_;
+        jit->setCompilationThreads(compilationThreads());
         return jit;
     }
 
+    void Jit::setStats(JitStats* stats) {
+        stats_ = stats;
+        compiler_->setStats(stats);
+    }
+
     void Jit::tryCreateJitTrampoline() {
         if(!!jitTrampoline_) return;
         auto jitBlock = compiler_->tryCompileJitTrampoline();
@@ -44,26 +63,207 @@ namespace x64 {
         jitTrampoline_ = memoryBlock;
     }
 
-    JitBasicBlock* Jit::tryCompile(const x64::BasicBlock& bb, void* currentBb) {
+    JitBasicBlock* Jit::tryCompile(const x64::BasicBlock& bb, void* currentBb, const CodeCacheLocation& location, bool flagsLiveOut, Tier tier) {
         ++compilationAttempts_;
-        auto jbb = JitBasicBlock::tryCreate(bb, currentBb, compiler_.get(), optimizationLevel_, &allocator_);
-        if(!jbb) {
-            ++failedCompilationAttempts_;
-            return nullptr;
-        }
+        JitBasicBlock* jbb = tryCreate({&bb}, {currentBb}, location, flagsLiveOut, tier);
+        if(!jbb) ++failedCompilationAttempts_;
+        return jbb;
+    }
+
+    JitBasicBlock* Jit::tryCompileTrace(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location, bool flagsLiveOut, Tier tier) {
+        ++traceCompilationAttempts_;
+        JitBasicBlock* jbb = tryCreate(trace, currentBbs, location, flagsLiveOut, tier);
+        if(!jbb) ++failedTraceCompilationAttempts_;
+        return jbb;
+    }
+
+    const CompileTelemetry& Jit::lastCompileTelemetry() const {
+        return compiler_->telemetry();
+    }
+
+    JitBasicBlock* Jit::tryCreate(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location, bool flagsLiveOut, Tier tier) {
+        auto dst = std::make_unique<JitBasicBlock>();
+        int optimizationLevel = this->optimizationLevel(tier);
+        auto nativeBasicBlock = compiler_->tryCompileTrace(trace, optimizationLevel, currentBbs, dst.get(), flagsLiveOut);
+        if(!nativeBasicBlock) return nullptr;
+        if(!!location.file) location.file->store(location.regionBase, trace, optimizationLevel, flagsLiveOut, nativeBasicBlock.value());
+        auto jbb = JitBasicBlock::tryCreate(std::move(dst), nativeBasicBlock.value(), &allocator_);
+        if(!jbb) return nullptr;
+        return add(std::move(jbb));
+    }
+
+    JitBasicBlock* Jit::tryLoadFromCache(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location, bool flagsLiveOut) {
+        if(!location.file) return nullptr;
+        auto nativeBasicBlock = location.file->tryLoad(location.regionBase, trace, optimizationLevel_, flagsLiveOut);
+        if(!nativeBasicBlock) return nullptr;
+        auto dst = std::make_unique<JitBasicBlock>();
+        if(!CodeCache::relocate(&nativeBasicBlock.value(), trace, currentBbs, dst.get())) return nullptr;
+        auto jbb = JitBasicBlock::tryCreate(std::move(dst), nativeBasicBlock.value(), &allocator_);
+        if(!jbb) return nullptr;
+        if(!!stats_) ++stats_->cachedCompilations_;
+        return add(std::move(jbb));
+    }
+
+    JitBasicBlock* Jit::add(std::unique_ptr<JitBasicBlock> jbb) {
         JitBasicBlock* ptr = jbb.get();
         verify(!!jbb->callEntrypoint());
+#ifdef MULTIPROCESSING
+        jbb->codePatcher_ = &codePatcher_;
+#endif
         blocks_.push_back(std::move(jbb));
         return ptr;
     }
 
+    void Jit::setCompilationThreads(u32 nbThreads) {
+        if(nbThreads == compilationThreads()) return;
+        compilationPool_.reset();
+        if(nbThreads > 0) compilationPool_ = std::make_unique<CompilationPool>(nbThreads);
+    }
+
+    std::shared_ptr<CompilationRequest> Jit::trySubmitCompilation(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, const CodeCacheLocation& location, bool flagsLiveOut, Tier tier) {
+        if(!compilationPool_) return {};
+        auto request = std::make_shared<CompilationRequest>();
+        request->basicBlocks = trace;
+        request->basicBlockPtrs = currentBbs;
+        request->optimizationLevel = optimizationLevel(tier);
+        request->cacheLocation = location;
+        request->flagsLiveOut = flagsLiveOut;
+        request->jitBasicBlock = std::make_unique<JitBasicBlock>();
+        if(!compilationPool_->trySubmit(request)) return {};
+        return request;
+    }
+
+    JitBasicBlock* Jit::tryInstall(CompilationRequest* request) {
+        assert(!!request);
+        assert(request->isDone());
+        if(isStale(*request)) return nullptr;
+        if(request->basicBlocks.size() > 1) {
+            ++traceCompilationAttempts_;
+            if(request->compiledBasicBlocks != request->basicBlocks.size()) ++failedTraceCompilationAttempts_;
+        }
+        if(request->compiledBasicBlocks <= 1) ++compilationAttempts_;
+        if(request->state.load(std::memory_order_acquire) != CompilationRequest::State::READY) {
+            ++failedCompilationAttempts_;
+            return nullptr;
+        }
+        assert(!!request->nativeBasicBlock);
+        const CodeCacheLocation& location = request->cacheLocation;
+        if(!!location.file && request->compiledBasicBlocks == request->basicBlocks.size()) {
+            location.file->store(location.regionBase, request->basicBlocks, request->optimizationLevel, request->flagsLiveOut, request->nativeBasicBlock.value());
+        }
+        auto jbb = JitBasicBlock::tryCreate(std::move(request->jitBasicBlock), request->nativeBasicBlock.value(), &allocator_);
+        request->nativeBasicBlock.reset();
+        if(!jbb) {
+            ++failedCompilationAttempts_;
+            return nullptr;
+        }
+        if(!!stats_) {
+            stats_->addCompilationStats(request->stats);
+            ++stats_->backgroundCompilations_;
+        }
+        return add(std::move(jbb));
+    }
+
+    void Jit::replace(JitBasicBlock* old, const JitBasicBlock* replacement) {
+        assert(!!old);
+        assert(!!replacement);
+#ifdef MULTIPROCESSING
+        // Other workers may be running the landing code, which is not skippable.
+        // The old code keeps working, and the patched jumps to it are retargeted instead.
+        (void)old;
+        (void)replacement;
+#else
+        old->redirectTo(replacement, compiler_.get());
+#endif
+        // cached entries may point to the old code
+        clearIndirectBranchCache();
+        if(!!stats_) ++stats_->tierUpCompilations_;
+    }
+
+    void Jit::collect(const std::unordered_set<const JitBasicBlock*>& liveBlocks) {
+        auto isDead = [&](const std::unique_ptr<JitBasicBlock>& block) {
+            return liveBlocks.count(block.get()) == 0;
+        };
+        auto firstDead = std::stable_partition(blocks_.begin(), blocks_.end(), [&](const auto& block) { return !isDead(block); });
+        size_t nbDeadBlocks = (size_t)std::distance(firstDead, blocks_.end());
+        if(nbDeadBlocks == 0) return;
+
+        std::unordered_set<const JitBasicBlock*> deadBlocks;
+        for(auto it = firstDead; it != blocks_.end(); ++it) deadBlocks.insert(it->get());
+        for(auto it = blocks_.begin(); it != firstDead; ++it) {
+            (*it)->unlinkDeadBlocks(deadBlocks, compiler_.get());
+        }
+        blocks_.erase(firstDead, blocks_.end());
+
+        // the callstack and the cache may hold the entrypoint of any block
+        clearIndirectBranchCache();
+        nukeCallstack();
+
+        // move the remaining code together, and release the memory of the dead blocks
+        std::vector<MemoryBlock*> memory;
+        memory.reserve(blocks_.size()+1);
+        if(!!jitTrampoline_) memory.push_back(&jitTrampoline_.value());
+        for(auto& block : blocks_) memory.push_back(&block->executableMemory_);
+        bool compacted = allocator_.compact(memory);
+        if(compacted) {
+            for(auto& block : blocks_) {
+                if(!!block->jumpLandingOffset_) block->jumpEntrypoint_ = block->executableMemory_.ptr + block->jumpLandingOffset_.value();
+            }
+            for(auto& block : blocks_) block->relink(compiler_.get());
+        }
+
+        if(!!stats_) {
+            stats_->evictedBlocks_ += nbDeadBlocks;
+            if(compacted) ++stats_->codeCacheCompactions_;
+        }
+    }
+
+    void Jit::discard(const std::unordered_set<const JitBasicBlock*>& deadBlocks) {
+        if(deadBlocks.empty()) return;
+        for(auto& block : blocks_) {
+            if(deadBlocks.count(block.get()) != 0) continue;
+            block->unlinkDeadBlocks(deadBlocks, compiler_.get());
+        }
+        clearIndirectBranchCache();
+        nukeCallstack();
+        if(!!stats_) stats_->invalidatedBlocks_ += deadBlocks.size();
+    }
+
+    void Jit::cancelPendingCompilations() {
+        if(!compilationPool_) return;
+        compilationPool_->cancelAll();
+    }
+
+    static void loadX87State(const X87Fpu& fpu, NativeArguments* arguments) {
+        u8 top = fpu.top();
+        arguments->x87top = (u32)(top * sizeof(X87Slot));
+        for(u8 i = 0; i < 8; ++i) {
+            arguments->x87stack[(top+i) & 0x7].value = fpu.st((ST)i);
+        }
+        for(u8 reg = 0; reg < 8; ++reg) {
+            arguments->x87stack[reg].tag = fpu.tag().get(reg);
+        }
+    }
+
+    static void storeX87State(const NativeArguments& arguments, X87Fpu* fpu) {
+        u8 top = (u8)(arguments.x87top / sizeof(X87Slot));
+        fpu->status().top = top;
+        for(u8 i = 0; i < 8; ++i) {
+            fpu->set((ST)i, arguments.x87stack[(top+i) & 0x7].value);
+        }
+        for(u8 reg = 0; reg < 8; ++reg) {
+            fpu->tag().set(reg, arguments.x87stack[reg].tag);
+        }
+    }
+
     void Jit::exec(Cpu* cpu, Mmu* mmu, NativeExecPtr nativeBasicBlock, u64* ticks,
-            void** currentlyExecutingSegmentPtr, const void* currentlyExecutingJitBasicBlock) {
+            void** currentlyExecutingSegmentPtr, const void* currentlyExecutingJitBasicBlock, u64 tickLimit) {
         assert(!!cpu);
         assert(!!mmu);
         assert(!!ticks);
         assert(!!currentlyExecutingSegmentPtr);
         assert(!!nativeBasicBlock);
+        assert(tickLimit <= NO_TICK_LIMIT);
         u64 rflags = cpu->flags_.toRflags();
         u32 mxcsr = cpu->mxcsr_.asDoubleWord();
         NativeArguments arguments {
@@ -75,40 +275,121 @@ namespace x64 {
             &mxcsr,
             cpu->segmentBase_[(int)Segment::FS],
             ticks,
-            (void**)callstack_.data(),
-            &callstackSize_,
+            executionState().callstack.data(),
+            &executionState().callstackSize,
             currentlyExecutingSegmentPtr,
             currentlyExecutingJitBasicBlock,
             (const void*)nativeBasicBlock,
-            FlaglessCompareBuffer{}
+            FlaglessCompareBuffer{},
+            cpu,
+            this,
+            indirectBranchCache_.get(),
+            0,
+            {},
+            tickLimit,
         };
+        loadX87State(cpu->x87fpu_, &arguments);
+        // leave soon when the code writes to translated code
+        mmu->setJittedCodeTickLimit(&arguments.tickLimit);
         NativeExecPtr jitEntrypoint = (x64::NativeExecPtr)jitTrampoline_->ptr;
+#ifdef MULTIPROCESSING
+        size_t slot = codePatcher_.enter();
+        jitEntrypoint(&arguments);
+        codePatcher_.leave(slot);
+#else
         jitEntrypoint(&arguments);
+#endif
+        mmu->setJittedCodeTickLimit(nullptr);
         cpu->flags_ = Flags::fromRflags(rflags);
+        storeX87State(arguments, &cpu->x87fpu_);
+        std::exception_ptr& pendingException = executionState().pendingException;
+        if(!!pendingException) {
+            std::exception_ptr exception;
+            std::swap(exception, pendingException);
+            std::rethrow_exception(exception);
+        }
+    }
+
+    u64 Jit::interpret(NativeArguments* arguments, const X64Instruction* instruction, CpuExecPtr execPtr) {
+        assert(!!arguments);
+        assert(!!instruction);
+        assert(!!execPtr);
+        Cpu* cpu = arguments->cpu;
+        cpu->flags_ = Flags::fromRflags(*arguments->rflags);
+        storeX87State(*arguments, &cpu->x87fpu_);
+        try {
+            execPtr(*cpu, *instruction);
+        } catch(...) {
+            arguments->jit->executionState().pendingException = std::current_exception();
+            return 1;
+        }
+        *arguments->rflags = cpu->flags_.toRflags();
+        *arguments->mxcsr = cpu->mxcsr_.asDoubleWord();
+        loadX87State(cpu->x87fpu_, arguments);
+        return 0;
+    }
+
+    void Jit::addIndirectBranchTarget(u64 address, const JitBasicBlock* block) {
+        assert(!!block);
+        if(!block->jumpEntrypoint()) return;
+        u64 index = IndirectBranchCache::indexOf(address);
+#ifdef MULTIPROCESSING
+        // Jitted code checks the address again after reading the entrypoint,
+        // so that clearing the address first keeps it from pairing the new entrypoint with the old address.
+        indirectBranchCache_->addresses[index] = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        indirectBranchCache_->entrypoints[index] = block->jumpEntrypoint();
+        std::atomic_thread_fence(std::memory_order_release);
+        indirectBranchCache_->addresses[index] = address;
+#else
+        indirectBranchCache_->addresses[index] = address;
+        indirectBranchCache_->entrypoints[index] = block->jumpEntrypoint();
+#endif
+    }
+
+    void Jit::clearIndirectBranchCache() {
+        std::fill(indirectBranchCache_->addresses.begin(), indirectBranchCache_->addresses.end(), 0);
+        std::fill(indirectBranchCache_->entrypoints.begin(), indirectBranchCache_->entrypoints.end(), nullptr);
     }
 
+#ifdef MULTIPROCESSING
+    Jit::ExecutionState& Jit::executionState() {
+        thread_local ExecutionState executionState;
+        return executionState;
+    }
+
+    std::unique_lock<std::mutex> Jit::lock() {
+        std::unique_lock lock(guard_);
+        codePatcher_.synchronize();
+        return lock;
+    }
+#else
+    Jit::ExecutionState& Jit::executionState() {
+        return executionState_;
+    }
+#endif
+
     void Jit::notifyCall() {
-        assert(callstackSize_+2 < callstack_.size());
-        callstack_[callstackSize_] = nullptr;
-        ++callstackSize_;
+        ExecutionState& state = executionState();
+        state.callstack[state.callstackSize % CALLSTACK_SIZE] = CallstackEntry{};
+        ++state.callstackSize;
     }
 
     void Jit::notifyRet() {
-        assert(callstackSize_ > 0);
-        callstack_[callstackSize_] = nullptr;
-        --callstackSize_;
+        ExecutionState& state = executionState();
+        --state.callstackSize;
+        state.callstack[state.callstackSize % CALLSTACK_SIZE] = CallstackEntry{};
     }
 
     void Jit::nukeCallstack() {
-        assert(callstackSize_ < callstack_.size());
-        std::fill(callstack_.begin(), callstack_.begin() + callstackSize_, nullptr);
+        ExecutionState& state = executionState();
+        std::fill(state.callstack.begin(), state.callstack.end(), CallstackEntry{});
     }
 
-    void Jit::setCallstack(void** blocks, u64 size) {
-        verify(size < callstack_.size());
-        JitBasicBlock** ptr = (JitBasicBlock**)blocks;
-        std::copy(ptr, ptr+size, callstack_.data());
-        callstackSize_ = size;
+    void Jit::setCallstack(const std::array<CallstackEntry, CALLSTACK_SIZE>& entries, u64 size) {
+        ExecutionState& state = executionState();
+        state.callstack = entries;
+        state.callstackSize = size;
     }
 
     JitBasicBlock::JitBasicBlock() = default;
@@ -121,15 +402,24 @@ namespace x64 {
     }
 
     std::unique_ptr<JitBasicBlock> JitBasicBlock::tryCreate(const x64::BasicBlock& bb, const void* currentBb, x64::Compiler* compiler, int optimizationLevel, ExecutableMemoryAllocator* allocator) {
+        return tryCreate(std::vector<const x64::BasicBlock*>{&bb}, std::vector<const void*>{currentBb}, compiler, optimizationLevel, allocator);
+    }
+
+    std::unique_ptr<JitBasicBlock> JitBasicBlock::tryCreate(const std::vector<const x64::BasicBlock*>& trace, const std::vector<const void*>& currentBbs, x64::Compiler* compiler, int optimizationLevel, ExecutableMemoryAllocator* allocator) {
         assert(!!compiler);
         assert(!!allocator);
         auto dst = std::make_unique<JitBasicBlock>();
-        auto nativeBasicBlock = compiler->tryCompile(bb, optimizationLevel, currentBb, (void*)dst.get());
+        auto nativeBasicBlock = compiler->tryCompileTrace(trace, optimizationLevel, currentBbs, (void*)dst.get());
         if(!nativeBasicBlock) {
             return {};
         }
+        return tryCreate(std::move(dst), nativeBasicBlock.value(), allocator);
+    }
 
-        auto executableMemory = allocator->allocate((u32)nativeBasicBlock->nativecode.size());
+    std::unique_ptr<JitBasicBlock> JitBasicBlock::tryCreate(std::unique_ptr<JitBasicBlock> dst, const NativeBasicBlock& nativeBasicBlock, ExecutableMemoryAllocator* allocator) {
+        assert(!!dst);
+        assert(!!allocator);
+        auto executableMemory = allocator->allocate((u32)nativeBasicBlock.nativecode.size());
         if(!executableMemory) {
             return {};
         }
@@ -137,33 +427,93 @@ namespace x64 {
             return {};
         }
 
-        std::memcpy(executableMemory->ptr, nativeBasicBlock->nativecode.data(), nativeBasicBlock->nativecode.size());
+        std::memcpy(executableMemory->ptr, nativeBasicBlock.nativecode.data(), nativeBasicBlock.nativecode.size());
 
         dst->setExecutableMemory(executableMemory.value());
         
-        if(!!nativeBasicBlock->offsetOfReplaceableJumpToContinuingBlock) {
-            dst->setPendingPatchToContinuingBlock(nativeBasicBlock->offsetOfReplaceableJumpToContinuingBlock.value());
+        if(!!nativeBasicBlock.offsetOfReplaceableJumpToContinuingBlock) {
+            dst->setPendingPatchToContinuingBlock(nativeBasicBlock.offsetOfReplaceableJumpToContinuingBlock.value());
         }
-        if(!!nativeBasicBlock->offsetOfReplaceableJumpToConditionalBlock) {
-            dst->setPendingPatchToConditionalBlock(nativeBasicBlock->offsetOfReplaceableJumpToConditionalBlock.value());
+        if(!!nativeBasicBlock.offsetOfReplaceableJumpToConditionalBlock) {
+            dst->setPendingPatchToConditionalBlock(nativeBasicBlock.offsetOfReplaceableJumpToConditionalBlock.value());
         }
-        if(!!nativeBasicBlock->offsetOfReplaceableCallstackPush) {
-            dst->setPendingPatchToCallstackPush(nativeBasicBlock->offsetOfReplaceableCallstackPush.value());
+        if(!!nativeBasicBlock.offsetOfReplaceableCallstackPush) {
+            dst->setPendingPatchToCallstackPush(nativeBasicBlock.offsetOfReplaceableCallstackPush.value());
         }
-        if(!!nativeBasicBlock->offsetOfJumpLandingPad) {
-            dst->setJumpLandingOffset(nativeBasicBlock->offsetOfJumpLandingPad.value());
+        if(!!nativeBasicBlock.offsetOfJumpLandingPad) {
+            dst->setJumpLandingOffset(nativeBasicBlock.offsetOfJumpLandingPad.value());
         }
         return dst;
     }
 
+    namespace {
+        struct PublishedBlockLookupTable {
+            BlockLookupTable table;
+            std::vector<u64> addresses;
+            std::vector<const void*> blocks;
+        };
+
+        struct PublishedJumpTable {
+            JumpTable table;
+            std::vector<u64> targets;
+            std::vector<const void*> blocks;
+        };
+    }
+
     void JitBasicBlock::syncBlockLookupTable(u64 size, const u64* addresses, const JitBasicBlock** blocks, u64* hitCounts) {
-        variableDestinationTable_.size = size;
-        variableDestinationTable_.addresses = addresses;
-        variableDestinationTable_.blocks = (const void**)blocks;
-        variableDestinationTable_.hitCounts = hitCounts;
+        const BlockLookupTable* current = variableDestinationTable_.load(std::memory_order_relaxed);
+        if(current->size == size
+                && current->hitCounts == hitCounts
+                && std::equal(addresses, addresses+size, current->addresses)
+                && std::equal(blocks, blocks+size, current->blocks)) return;
+        if(size == 0) {
+            publishBlockLookupTable({}, &EMPTY_BLOCK_LOOKUP_TABLE);
+            return;
+        }
+        auto published = std::make_shared<PublishedBlockLookupTable>();
+        published->addresses.assign(addresses, addresses+size);
+        published->blocks.assign(blocks, blocks+size);
+        published->table = BlockLookupTable { size, published->addresses.data(), published->blocks.data(), hitCounts };
+        const BlockLookupTable* table = &published->table;
+        publishBlockLookupTable(std::move(published), table);
+    }
+
+    void JitBasicBlock::syncJumpTable(u64 base, u64 size, const u64* targets, const JitBasicBlock** blocks) {
+        const JumpTable* current = jumpTable_.load(std::memory_order_relaxed);
+        if(current->base == base
+                && current->size == size
+                && std::equal(targets, targets+size, current->targets)
+                && std::equal(blocks, blocks+size, current->blocks)) return;
+        if(size == 0) {
+            publishJumpTable({}, &EMPTY_JUMP_TABLE);
+            return;
+        }
+        auto published = std::make_shared<PublishedJumpTable>();
+        published->targets.assign(targets, targets+size);
+        published->blocks.assign(blocks, blocks+size);
+        published->table = JumpTable { base, size, published->targets.data(), published->blocks.data() };
+        const JumpTable* table = &published->table;
+        publishJumpTable(std::move(published), table);
     }
 
-    void JitBasicBlock::tryPatchJump(std::optional<size_t>* pendingPatch, const JitBasicBlock* next, x64::Compiler* compiler) {
+    void JitBasicBlock::publishBlockLookupTable(std::shared_ptr<const void> owner, const BlockLookupTable* table) {
+        variableDestinationTable_.store(table, std::memory_order_release);
+        std::swap(blockLookupTableOwner_, owner);
+        retire(std::move(owner));
+    }
+
+    void JitBasicBlock::publishJumpTable(std::shared_ptr<const void> owner, const JumpTable* table) {
+        jumpTable_.store(table, std::memory_order_release);
+        std::swap(jumpTableOwner_, owner);
+        retire(std::move(owner));
+    }
+
+    void JitBasicBlock::retire(std::shared_ptr<const void> owner) {
+        if(!owner || !codePatcher_) return;
+        codePatcher_->retire(std::move(owner));
+    }
+
+    void JitBasicBlock::tryPatchJump(std::optional<size_t>* pendingPatch, const JitBasicBlock* next, bool closesLoop, x64::Compiler* compiler) {
         assert(!!pendingPatch);
         assert(!!next);
         assert(!!compiler);
@@ -172,7 +522,13 @@ namespace x64 {
         assert(offset <= executableMemory_.size);
         size_t replacementSize = executableMemory_.size - offset;
         const u8* jumpLocation = next->jumpEntrypoint();
-        compiler->writeJumpTo(jumpLocation, replacementLocation, replacementSize);
+        if(closesLoop) {
+            compiler->writeLoopJumpTo(jumpLocation, replacementLocation, replacementSize);
+        } else {
+            compiler->writeJumpTo(jumpLocation, replacementLocation, replacementSize);
+        }
+        bool continuing = (pendingPatch == &pendingPatches_.offsetOfReplaceableJumpToContinuingBlock);
+        patchedJumps_.push_back(PatchedJump{offset, next, closesLoop, continuing});
         pendingPatch->reset();
     }
 
@@ -180,12 +536,104 @@ namespace x64 {
         assert(!!pendingPatch);
         assert(!!next);
         assert(!!compiler);
-        size_t offset = pendingPatch->value().first;
+        auto [offset, returnAddress] = pendingPatch->value();
         u8* replacementLocation = mutableExecutableMemory() + offset;
         assert(offset <= executableMemory_.size);
         size_t replacementSize = executableMemory_.size - offset;
         const u8* jumpLocation = next->jumpEntrypoint();
-        compiler->writePushCallstackTo(jumpLocation, replacementLocation, replacementSize);
+        compiler->writePushCallstackTo(jumpLocation, returnAddress, replacementLocation, replacementSize);
+        patchedCallstackPushes_.push_back(PatchedCallstackPush{offset, returnAddress, next});
         pendingPatch->reset();
     }
+
+    void JitBasicBlock::retarget(const JitBasicBlock* from, const JitBasicBlock* to, x64::Compiler* compiler) {
+        assert(!!from);
+        assert(!!to);
+        assert(!!compiler);
+        for(auto& patch : patchedJumps_) {
+            if(patch.next != from) continue;
+            u8* replacementLocation = mutableExecutableMemory() + patch.offset;
+            if(patch.closesLoop) {
+                compiler->writeLoopJumpTo(to->jumpEntrypoint(), replacementLocation, executableMemory_.size - patch.offset);
+            } else {
+                compiler->writeJumpTo(to->jumpEntrypoint(), replacementLocation, executableMemory_.size - patch.offset);
+            }
+            patch.next = to;
+        }
+        for(auto& patch : patchedCallstackPushes_) {
+            if(patch.next != from) continue;
+            u8* replacementLocation = mutableExecutableMemory() + patch.offset;
+            compiler->writePushCallstackTo(to->jumpEntrypoint(), patch.returnAddress, replacementLocation, executableMemory_.size - patch.offset);
+            patch.next = to;
+        }
+    }
+
+    void JitBasicBlock::unlinkDeadBlocks(const std::unordered_set<const JitBasicBlock*>& deadBlocks, x64::Compiler* compiler) {
+        assert(!!compiler);
+        auto isDead = [&](const JitBasicBlock* block) {
+            return deadBlocks.count(block) != 0;
+        };
+        for(const auto& patch : patchedJumps_) {
+            if(!isDead(patch.next)) continue;
+            compiler->writeUnpatchedJump(mutableExecutableMemory() + patch.offset, executableMemory_.size - patch.offset);
+            if(patch.continuing) {
+                setPendingPatchToContinuingBlock(patch.offset);
+            } else {
+                setPendingPatchToConditionalBlock(patch.offset);
+            }
+        }
+        patchedJumps_.erase(std::remove_if(patchedJumps_.begin(), patchedJumps_.end(), [&](const PatchedJump& patch) {
+            return isDead(patch.next);
+        }), patchedJumps_.end());
+        for(const auto& patch : patchedCallstackPushes_) {
+            if(!isDead(patch.next)) continue;
+            compiler->writePushCallstackTo(nullptr, patch.returnAddress, mutableExecutableMemory() + patch.offset, executableMemory_.size - patch.offset);
+            setPendingPatchToCallstackPush(std::make_pair(patch.offset, patch.returnAddress));
+        }
+        patchedCallstackPushes_.erase(std::remove_if(patchedCallstackPushes_.begin(), patchedCallstackPushes_.end(), [&](const PatchedCallstackPush& patch) {
+            return isDead(patch.next);
+        }), patchedCallstackPushes_.end());
+        // the lookup table misses until the owner of the block syncs it again
+        const BlockLookupTable* blockLookupTable = variableDestinationTable_.load(std::memory_order_relaxed);
+        for(u64 i = 0; i < blockLookupTable->size; ++i) {
+            const JitBasicBlock* block = (const JitBasicBlock*)blockLookupTable->blocks[i];
+            if(!block || !isDead(block)) continue;
+            publishBlockLookupTable({}, &EMPTY_BLOCK_LOOKUP_TABLE);
+            break;
+        }
+        const JumpTable* jumpTable = jumpTable_.load(std::memory_order_relaxed);
+        for(u64 i = 0; i < jumpTable->size; ++i) {
+            const JitBasicBlock* block = (const JitBasicBlock*)jumpTable->blocks[i];
+            if(!block || !isDead(block)) continue;
+            publishJumpTable({}, &EMPTY_JUMP_TABLE);
+            break;
+        }
+    }
+
+    void JitBasicBlock::relink(x64::Compiler* compiler) {
+        assert(!!compiler);
+        for(const auto& patch : patchedJumps_) {
+            u8* replacementLocation = mutableExecutableMemory() + patch.offset;
+            if(patch.closesLoop) {
+                compiler->writeLoopJumpTo(patch.next->jumpEntrypoint(), replacementLocation, executableMemory_.size - patch.offset);
+            } else {
+                compiler->writeJumpTo(patch.next->jumpEntrypoint(), replacementLocation, executableMemory_.size - patch.offset);
+            }
+        }
+        for(const auto& patch : patchedCallstackPushes_) {
+            u8* replacementLocation = mutableExecutableMemory() + patch.offset;
+            compiler->writePushCallstackTo(patch.next->jumpEntrypoint(), patch.returnAddress, replacementLocation, executableMemory_.size - patch.offset);
+        }
+    }
+
+    void JitBasicBlock::redirectTo(const JitBasicBlock* next, x64::Compiler* compiler) {
+        assert(!!next);
+        assert(!!compiler);
+        if(!jumpLandingOffset_) return;
+        // Jumps and returns land here through the jump entrypoint.
+        // The landing code does not touch the guest state yet, it can be replaced by a jump.
+        size_t offset = jumpLandingOffset_.value();
+        assert(offset <= executableMemory_.size);
+        compiler->writeJumpTo(next->jumpEntrypoint(), mutableExecutableMemory() + offset, executableMemory_.size - offset);
+    }
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "x64/tostring.h"
 #include "bitmask.h"
 #include <algorithm>
+#include <limits>
+#include <unordered_map>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 
@@ -69,15 +71,26 @@ namespace x64::ir {
     using LiveAddresses64 = LiveAddresses<M64>;
     using LiveAddresses128 = LiveAddresses<M128>;
 
+    static u64 addressKey(Segment segment, const Encoding64& encoding) {
+        return ((u64)segment << 56)
+             | ((u64)encoding.base << 48)
+             | ((u64)encoding.index << 40)
+             | ((u64)encoding.scale << 32)
+             | (u64)(u32)encoding.displacement;
+    }
+
     struct LivenessAnalysis {
         std::vector<BitMask<3>> gprs;
         std::vector<BitMask<3>> mmxs;
         std::vector<BitMask<3>> xmms;
 
+        // distinct addresses written to, and their position in the list
         std::vector<M64> allAddresses64;
+        std::unordered_map<u64, u32> address64Indices;
         std::vector<BitMask<16>> addresses64;
 
         std::vector<M128> allAddresses128;
+        std::unordered_map<u64, u32> address128Indices;
         std::vector<BitMask<16>> addresses128;
 
         void clear() {
@@ -85,10 +98,24 @@ namespace x64::ir {
             xmms.clear();
             mmxs.clear();
             allAddresses64.clear();
+            address64Indices.clear();
             addresses64.clear();
             allAddresses128.clear();
+            address128Indices.clear();
             addresses128.clear();
         }
+
+        std::optional<u32> address64Index(const M64& address) const {
+            auto it = address64Indices.find(addressKey(address.segment, address.encoding));
+            if(it == address64Indices.end()) return {};
+            return it->second;
+        }
+
+        std::optional<u32> address128Index(const M128& address) const {
+            auto it = address128Indices.find(addressKey(address.segment, address.encoding));
+            if(it == address128Indices.end()) return {};
+            return it->second;
+        }
     };
 
     void computeLiveRegistersAndAddresses(const IR& ir, LivenessAnalysis* analysis) {
@@ -104,50 +131,29 @@ namespace x64::ir {
             R64::RDX,
         }};
 
-        // All addresses written to are live at the end of the block
+        // All addresses written to are live at the end of the block.
+        // Each address is only listed once, so that the analysis does not grow with the number of writes.
         for(const auto& ins : ir.instructions) {
             if(auto m64out = ins.out().as<M64>()) {
-                a.allAddresses64.push_back(m64out.value());
+                u64 key = addressKey(m64out->segment, m64out->encoding);
+                if(a.address64Indices.emplace(key, (u32)a.allAddresses64.size()).second) {
+                    a.allAddresses64.push_back(m64out.value());
+                }
             }
             if(auto m128out = ins.out().as<M128>()) {
-                a.allAddresses128.push_back(m128out.value());
+                u64 key = addressKey(m128out->segment, m128out->encoding);
+                if(a.address128Indices.emplace(key, (u32)a.allAddresses128.size()).second) {
+                    a.allAddresses128.push_back(m128out.value());
+                }
             }
         }
-        // static_assert(sizeof(M64) == 12);
-        // static_assert(sizeof(M128) == 12);
-        // std::sort(a.allAddresses64.begin(), a.allAddresses64.end(), [](const M64& a, const M64& b) {
-        //     std::array<uint32_t, 3> sa;
-        //     memcpy(sa.data(), &a, sizeof(a));
-        //     std::array<uint32_t, 3> sb;
-        //     memcpy(sb.data(), &b, sizeof(b));
-        //     return std::lexicographical_compare(sa.begin(), sa.end(), sb.begin(), sb.end());
-        // });
-        // std::sort(a.allAddresses128.begin(), a.allAddresses128.end(), [](const M128& a, const M128& b) {
-        //     std::array<uint32_t, 3> sa;
-        //     memcpy(sa.data(), &a, sizeof(a));
-        //     std::array<uint32_t, 3> sb;
-        //     memcpy(sb.data(), &b, sizeof(b));
-        //     return std::lexicographical_compare(sa.begin(), sa.end(), sb.begin(), sb.end());
-        // });
-        // a.allAddresses64.erase(std::unique(a.allAddresses64.begin(), a.allAddresses64.end()), a.allAddresses64.end());
-        // a.allAddresses128.erase(std::unique(a.allAddresses128.begin(), a.allAddresses128.end()), a.allAddresses128.end());
 
         auto address64Index = [&](const M64& address) -> std::optional<u32> {
-            auto it = std::find(a.allAddresses64.begin(), a.allAddresses64.end(), address);
-            if(it == a.allAddresses64.end()) {
-                return {};
-            } else {
-                return (u32)std::distance(a.allAddresses64.begin(), it);
-            }
+            return a.address64Index(address);
         };
 
         auto address128Index = [&](const M128& address) -> std::optional<u32> {
-            auto it = std::find(a.allAddresses128.begin(), a.allAddresses128.end(), address);
-            if(it == a.allAddresses128.end()) {
-                return {};
-            } else {
-                return (u32)std::distance(a.allAddresses128.begin(), it);
-            }
+            return a.address128Index(address);
         };
 
         a.gprs.resize(ir.instructions.size()+1);
@@ -267,6 +273,9 @@ namespace x64::ir {
                     }
                     a.gprs[i].set((u32)arg.encoding.base);
                     a.gprs[i].set((u32)arg.encoding.index);
+                } else if constexpr(std::is_same_v<T, M80>) {
+                    a.gprs[i].set((u32)arg.encoding.base);
+                    a.gprs[i].set((u32)arg.encoding.index);
                 } else if constexpr(std::is_same_v<T, M128>) {
                     if(auto index = address128Index(arg)) {
                         a.addresses128[i].reset(index.value());
@@ -346,6 +355,10 @@ namespace x64::ir {
                     a.gprs[i].set((u32)arg.encoding.base);
                     a.gprs[i].set((u32)arg.encoding.index);
                     markAllAddressesClashingWithEncodingAsAlive(Size::XWORD, arg.encoding);
+                } else if constexpr(std::is_same_v<T, M80>) {
+                    a.gprs[i].set((u32)arg.encoding.base);
+                    a.gprs[i].set((u32)arg.encoding.index);
+                    markAllAddressesClashingWithEncodingAsAlive(Size::TWORD, arg.encoding);
                 } else {
                     // do nothing
                 }
@@ -377,21 +390,22 @@ namespace x64::ir {
         computeLiveRegistersAndAddresses(*ir, analysis_.get());
 
         auto address64Index = [&](const M64& address) -> u32 {
-            auto it = std::find(analysis_->allAddresses64.begin(), analysis_->allAddresses64.end(), address);
-            assert(it != analysis_->allAddresses64.end());
-            return (u32)std::distance(analysis_->allAddresses64.begin(), it);
+            auto index = analysis_->address64Index(address);
+            assert(!!index);
+            return index.value();
         };
 
         auto address128Index = [&](const M128& address) -> u32 {
-            auto it = std::find(analysis_->allAddresses128.begin(), analysis_->allAddresses128.end(), address);
-            assert(it != analysis_->allAddresses128.end());
-            return (u32)std::distance(analysis_->allAddresses128.begin(), it);
+            auto index = analysis_->address128Index(address);
+            assert(!!index);
+            return index.value();
         };
 
         removableInstructions_.clear();
         for(size_t i = ir->instructions.size(); i --> 0;) {
             const auto& ins = ir->instructions[i];
             if(ins.canModifyFlags()) continue;
+            if(ins.usesX87Stack()) continue;
             bool skipInstruction = false;
             ins.forEachImpactedRegister([&](R64 impactedReg) {
                 skipInstruction |= analysis_->gprs[i+1].test((u32)impactedReg);
@@ -452,32 +466,205 @@ namespace x64::ir {
         }
     }
 
+    // Instructions whose effect on the registers is not entirely described by their operands,
+    // or that leave the straight-line code.
+    static bool hasOpaqueEffects(const Instruction& ins) {
+        switch(ins.op()) {
+            // exchanges also write to their source
+            case Op::XCHG:
+            case Op::CMPXCHG:
+            case Op::LOCKCMPXCHG:
+            case Op::LOCKCMPXCHG16B:
+            case Op::LOCKXADD:
+            // atomics order the memory accesses around them
+            case Op::LOCKADD:
+            case Op::LOCKSUB:
+            case Op::LOCKOR:
+            case Op::LOCKINC:
+            case Op::LOCKDEC:
+            case Op::LOCKBTS:
+            // the stack operand is implicit
+            case Op::PUSH:
+            case Op::POP:
+            case Op::PUSHF:
+            case Op::POPF:
+            // the code may go anywhere, and placeholders are patched with unknown code
+            case Op::JMP:
+            case Op::JMP_IND:
+            case Op::CALL:
+            case Op::RET:
+            case Op::NOP_N:
+            case Op::UD_N:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static u16 memorySize(const Operand& op) {
+        if(op.as<M8>()) return 1;
+        if(op.as<M16>()) return 2;
+        if(op.as<M32>()) return 4;
+        if(op.as<M64>()) return 8;
+        if(op.as<M80>()) return 10;
+        return 16;
+    }
+
+    // Def-use links of the IR: where each location read by an instruction was last written.
+    // The instructions are recorded in order, and positions are instruction indices plus one,
+    // so that position 0 means "before the IR".
+    // Memory is tracked per base register, as everywhere else in the optimizer: accesses through
+    // different base registers never alias in the jit, while indexed accesses may alias anything on their base.
+    class ReachingDefinitions {
+    public:
+        void clear() {
+            position_ = 0;
+            gprs_.fill(0);
+            mmxs_.fill(0);
+            xmms_.fill(0);
+            memory_ = 0;
+            baseWrites_.fill(0);
+            indexedBaseWrites_.fill(0);
+            slotWrites_.clear();
+        }
+
+        // Last position where the value of the operand may have been written.
+        // The value of a memory operand also depends on the registers used to compute its address.
+        size_t lastWrite(const Operand& op) const {
+            if(auto gpr = op.containingGpr()) return gprs_[(u32)gpr.value()];
+            if(auto mmx = op.as<MMX>()) return mmxs_[(u32)mmx.value()];
+            if(auto xmm = op.as<XMM>()) return xmms_[(u32)xmm.value()];
+            auto memory = op.memory();
+            if(!memory) return 0;
+            // don't trust the fs segment
+            if(memory->segment == Segment::FS) return position_;
+            const Encoding64& encoding = memory->encoding;
+            size_t last = std::max(memory_, indexedBaseWrites_[(u32)encoding.base]);
+            last = std::max(last, std::max(gprs_[(u32)encoding.base], gprs_[(u32)encoding.index]));
+            if(encoding.index != R64::ZERO) return std::max(last, baseWrites_[(u32)encoding.base]);
+            forEachSlot(encoding, memorySize(op), [&](u64 slot) {
+                auto it = slotWrites_.find(slot);
+                if(it != slotWrites_.end()) last = std::max(last, it->second);
+            });
+            return last;
+        }
+
+        // Moves past an instruction that will be removed, and does not write anything.
+        void skip() {
+            ++position_;
+        }
+
+        // Records the writes of the next instruction.
+        void record(const Instruction& ins) {
+            ++position_;
+            if(hasOpaqueEffects(ins) || writesMemoryImplicitly(ins)) {
+                if(ins.op() == Op::PUSH || ins.op() == Op::PUSHF) {
+                    // only the stack is written
+                    gprs_[(u32)R64::RSP] = position_;
+                    indexedBaseWrites_[(u32)R64::RSP] = position_;
+                    return;
+                }
+                gprs_.fill(position_);
+                mmxs_.fill(position_);
+                xmms_.fill(position_);
+                memory_ = position_;
+                return;
+            }
+            ins.forEachImpactedRegister([&](R64 reg) {
+                gprs_[(u32)reg] = position_;
+            });
+            const Operand& out = ins.out();
+            if(auto gpr = out.containingGpr()) {
+                gprs_[(u32)gpr.value()] = position_;
+            } else if(auto mmx = out.as<MMX>()) {
+                mmxs_[(u32)mmx.value()] = position_;
+            } else if(auto xmm = out.as<XMM>()) {
+                xmms_[(u32)xmm.value()] = position_;
+            } else if(auto memory = out.memory()) {
+                const Encoding64& encoding = memory->encoding;
+                if(memory->segment == Segment::FS) {
+                    memory_ = position_;
+                } else if(encoding.index != R64::ZERO) {
+                    baseWrites_[(u32)encoding.base] = position_;
+                    indexedBaseWrites_[(u32)encoding.base] = position_;
+                } else {
+                    baseWrites_[(u32)encoding.base] = position_;
+                    forEachSlot(encoding, memorySize(out), [&](u64 slot) {
+                        slotWrites_[slot] = position_;
+                    });
+                }
+            }
+        }
+
+    private:
+        static bool writesMemoryImplicitly(const Instruction& ins) {
+            switch(ins.op()) {
+                case Op::REPSTOS8:
+                case Op::REPSTOS32:
+                case Op::REPSTOS64:
+                case Op::REPMOVS8:
+                case Op::REPMOVS16:
+                case Op::REPMOVS32:
+                case Op::REPMOVS64:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // Memory is split in 8-byte slots, an access touches at most 3 of them.
+        template<typename Func>
+        static void forEachSlot(const Encoding64& encoding, u16 size, Func&& func) {
+            i64 first = (i64)encoding.displacement >> 3;
+            i64 last = ((i64)encoding.displacement + size - 1) >> 3;
+            for(i64 slot = first; slot <= last; ++slot) {
+                func(((u64)encoding.base << 40) | ((u64)slot & 0xFFFFFFFFFF));
+            }
+        }
+
+        size_t position_ { 0 };
+        std::array<size_t, (u32)R64::ZERO+1> gprs_ {};
+        std::array<size_t, 8> mmxs_ {};
+        std::array<size_t, 16> xmms_ {};
+        size_t memory_ { 0 };
+        std::array<size_t, (u32)R64::ZERO+1> baseWrites_ {};
+        std::array<size_t, (u32)R64::ZERO+1> indexedBaseWrites_ {};
+        std::unordered_map<u64, size_t> slotWrites_;
+    };
+
+    DelayedReadBackElimination::DelayedReadBackElimination() = default;
+    DelayedReadBackElimination::~DelayedReadBackElimination() = default;
+
     bool DelayedReadBackElimination::optimize(IR* ir, Optimizer::Stats* stats) {
         if(!ir) return false;
+        if(!definitions_) definitions_ = std::make_unique<ReachingDefinitions>();
 
         auto isMov = [](Op op) {
             return op == Op::MOV
                 || op == Op::MOVA;
         };
 
+        // A mov reading back what an earlier mov wrote, into the location the earlier mov read from,
+        // is useless as long as neither location has been written to in between.
         removableInstructions_.clear();
-        for(size_t i = 0; i < ir->instructions.size(); ++i) {
-            const auto& curr = ir->instructions[i];
-            if(!isMov(curr.op())) continue;
-            for(size_t j = i+1; j < ir->instructions.size(); ++j) {
-                const auto& next = ir->instructions[j];
-                if(isMov(next.op())
-                        && next.in1() == curr.out()
-                        && next.out() == curr.in1()) {
-                    removableInstructions_.push_back(j);
-                    i = j+1;
-                    break;
-                } else if(Instruction::canCommute(curr, next)) {
-                    continue;
-                } else {
-                    break;
+        definitions_->clear();
+        for(size_t j = 0; j < ir->instructions.size(); ++j) {
+            const auto& next = ir->instructions[j];
+            if(isMov(next.op())) {
+                size_t position = definitions_->lastWrite(next.in1());
+                if(position > 0) {
+                    const auto& curr = ir->instructions[position-1];
+                    if(isMov(curr.op())
+                            && next.in1() == curr.out()
+                            && next.out() == curr.in1()
+                            && definitions_->lastWrite(next.out()) < position) {
+                        removableInstructions_.push_back(j);
+                        definitions_->skip();
+                        continue;
+                    }
                 }
             }
+            definitions_->record(next);
         }
         if(removableInstructions_.empty()) {
             return false;
@@ -488,44 +675,35 @@ namespace x64::ir {
         }
     }
 
+    DuplicateInstructionElimination::DuplicateInstructionElimination() = default;
+    DuplicateInstructionElimination::~DuplicateInstructionElimination() = default;
+
     bool DuplicateInstructionElimination::optimize(IR* ir, Optimizer::Stats* stats) {
         if(!ir) return false;
+        if(!definitions_) definitions_ = std::make_unique<ReachingDefinitions>();
 
+        // A load into a register is useless when the register still holds the result of the same load
         removableInstructions_.clear();
-        for(size_t i = 0; i < ir->instructions.size(); ++i) {
-            const auto& curr = ir->instructions[i];
+        definitions_->clear();
+        for(size_t j = 0; j < ir->instructions.size(); ++j) {
+            const auto& next = ir->instructions[j];
             // don't trust any other instruction than movs for now
-            if(curr.op() != Op::MOV) continue;
-            // only eliminate duplicate writes to registers
-            if(!curr.out().isRegister()) continue;
-            // don't optimize register-register movs (yet)
-            if(!curr.in1().isMemory()) continue;
-            auto srcMem = curr.in1().memory();
-            assert(!!srcMem);
-
-            // look ahead for a duplicate mov
-            for(size_t j = i+1; j < ir->instructions.size(); ++j) {
-                const auto& next = ir->instructions[j];
-                // abort if we encounter something that is not a mov
-                if(next.op() != Op::MOV) break;
-                // remove the next duplicate only
-                if(next.out() == curr.out() && next.in1() == curr.in1()) {
-                    removableInstructions_.push_back(j);
-                    i = j+1;
-                    break;
-                }
-                bool writesToDst = next.writesTo(curr.out());
-                bool writesToMemBase = next.writesTo(srcMem->encoding.base);
-                bool writesToMemIndex = next.writesTo(srcMem->encoding.index);
-                bool mayWriteToSrc = next.writesTo(curr.in1());
-                // if the mov impacts the src or dst, we need to abort
-                if(writesToDst || writesToMemBase || writesToMemIndex || mayWriteToSrc) {
-                    break;
-                } else {
-                    // otherwise, continue
-                    continue;
+            // only eliminate duplicate writes of memory to registers
+            if(next.op() == Op::MOV && next.out().isRegister() && next.in1().isMemory()) {
+                size_t position = definitions_->lastWrite(next.out());
+                if(position > 0) {
+                    const auto& curr = ir->instructions[position-1];
+                    if(curr.op() == Op::MOV
+                            && curr.out() == next.out()
+                            && curr.in1() == next.in1()
+                            && definitions_->lastWrite(next.in1()) < position) {
+                        removableInstructions_.push_back(j);
+                        definitions_->skip();
+                        continue;
+                    }
                 }
             }
+            definitions_->record(next);
         }
 
         if(removableInstructions_.empty()) {
@@ -537,4 +715,558 @@ namespace x64::ir {
         }
     }
 
+    // What is known about the value of each general purpose register at some point of the IR.
+    template<typename Fact>
+    class RegisterFacts {
+    public:
+        const std::optional<Fact>& get(R64 reg) const {
+            return facts_[(u32)reg];
+        }
+
+        void set(R64 reg, const Fact& fact) {
+            if(reg == R64::ZERO) return;
+            facts_[(u32)reg] = fact;
+        }
+
+        void clear() {
+            for(auto& fact : facts_) fact.reset();
+        }
+
+        // Forgets the value of the register, and the facts that were relying on it.
+        void kill(R64 reg) {
+            for(u32 r = 0; r < (u32)facts_.size(); ++r) {
+                if(!facts_[r]) continue;
+                if(r == (u32)reg || dependsOn(facts_[r].value(), reg)) facts_[r].reset();
+            }
+        }
+
+    private:
+        static bool dependsOn(u64, R64) { return false; }
+        static bool dependsOn(R64 source, R64 reg) { return source == reg; }
+        static bool dependsOn(const Encoding64& address, R64 reg) { return address.base == reg || address.index == reg; }
+
+        std::array<std::optional<Fact>, (u32)R64::ZERO+1> facts_;
+    };
+
+    // Hands the instructions to `transfer` in order, with the facts that hold before each of them.
+    // The transfer function may rewrite the instruction, and returns the fact that holds for its destination.
+    // Facts do not survive labels, where control flow merges, so the analysis never needs to iterate.
+    template<typename Fact, typename Transfer>
+    static void forwardDataflow(IR* ir, Transfer&& transfer) {
+        std::vector<bool> isLabel(ir->instructions.size()+1, false);
+        for(size_t label : ir->labels) {
+            if(label < isLabel.size()) isLabel[label] = true;
+        }
+        RegisterFacts<Fact> facts;
+        for(size_t i = 0; i < ir->instructions.size(); ++i) {
+            if(isLabel[i]) facts.clear();
+            if(hasOpaqueEffects(ir->instructions[i])) {
+                facts.clear();
+                continue;
+            }
+            std::optional<std::pair<R64, Fact>> generated = transfer(i, facts);
+            const Instruction& ins = ir->instructions[i];
+            for(u32 r = 0; r < (u32)R64::ZERO; ++r) {
+                if(ins.writesTo((R64)r)) facts.kill((R64)r);
+            }
+            if(!!generated) facts.set(generated->first, generated->second);
+        }
+    }
+
+    // Rewrites the address of every memory operand of the instruction, returns the number of rewritten operands.
+    template<typename Rewrite>
+    static u32 rewriteAddresses(Instruction* ins, Rewrite&& rewrite) {
+        u32 rewritten = 0;
+        auto tryRewrite = [&](Operand op, void(Instruction::*setter)(Operand)) {
+            auto memory = op.memory();
+            if(!memory) return;
+            std::optional<Encoding64> encoding = rewrite(memory->encoding);
+            if(!encoding) return;
+            (ins->*setter)(op.withEncoding(encoding.value()));
+            ++rewritten;
+        };
+        tryRewrite(ins->out(), &Instruction::setOut);
+        tryRewrite(ins->in1(), &Instruction::setIn1);
+        tryRewrite(ins->in2(), &Instruction::setIn2);
+        tryRewrite(ins->in3(), &Instruction::setIn3);
+        return rewritten;
+    }
+
+    // The flags of an instruction are not observable when the next instructions overwrite them before reading them
+    static void computeFlagsOverwritten(const IR& ir, std::vector<bool>* flagsOverwritten) {
+        size_t nbInstructions = ir.instructions.size();
+        flagsOverwritten->assign(nbInstructions+1, false);
+        for(size_t i = nbInstructions; i --> 0;) {
+            switch(ir.instructions[i].op()) {
+                case Op::MOV:
+                case Op::MOVZX:
+                case Op::MOVSX:
+                case Op::LEA:
+                case Op::SHLX:
+                case Op::SHRX:
+                case Op::SARX: {
+                    (*flagsOverwritten)[i] = (*flagsOverwritten)[i+1];
+                    break;
+                }
+                case Op::ADD:
+                case Op::SUB:
+                case Op::CMP:
+                case Op::TEST:
+                case Op::AND:
+                case Op::OR:
+                case Op::XOR:
+                case Op::ANDN: {
+                    (*flagsOverwritten)[i] = true;
+                    break;
+                }
+                default: {
+                    (*flagsOverwritten)[i] = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    bool ConstantPropagation::optimize(IR* ir, Optimizer::Stats* stats) {
+        if(!ir) return false;
+
+        computeFlagsOverwritten(*ir, &flagsOverwritten_);
+
+        auto constantOf = [](const RegisterFacts<u64>& constants, const Operand& op) -> std::optional<u64> {
+            if(auto r64 = op.as<R64>()) return constants.get(r64.value());
+            if(auto r32 = op.as<R32>()) {
+                if(auto value = constants.get(containingRegister(r32.value()))) return (u64)(u32)value.value();
+            }
+            return {};
+        };
+
+        auto evaluate = [](Op op, u64 lhs, u64 rhs) -> std::optional<u64> {
+            switch(op) {
+                case Op::ADD: return lhs + rhs;
+                case Op::SUB: return lhs - rhs;
+                case Op::AND: return lhs & rhs;
+                case Op::OR: return lhs | rhs;
+                case Op::XOR: return lhs ^ rhs;
+                default: return {};
+            }
+        };
+
+        u32 propagated = 0;
+        u32 folded = 0;
+        forwardDataflow<u64>(ir, [&](size_t i, const RegisterFacts<u64>& constants) -> std::optional<std::pair<R64, u64>> {
+            Instruction& ins = ir->instructions[i];
+            switch(ins.op()) {
+                case Op::MOV: {
+                    if(auto dst = ins.out().as<R64>()) {
+                        // copies of a host pointer would not be relocated
+                        if(!!ins.relocation()) return {};
+                        if(auto imm = ins.in1().as<u64>()) return std::make_pair(dst.value(), imm.value());
+                        if(!ins.in1().as<R64>()) return {};
+                        auto value = constantOf(constants, ins.in1());
+                        if(!value) return {};
+                        ins.setIn1(Operand(value.value()));
+                        ++propagated;
+                        return std::make_pair(dst.value(), value.value());
+                    }
+                    if(auto dst = ins.out().as<R32>()) {
+                        if(auto imm = ins.in1().as<u32>()) return std::make_pair(containingRegister(dst.value()), (u64)imm.value());
+                        if(!ins.in1().as<R32>()) return {};
+                        auto value = constantOf(constants, ins.in1());
+                        if(!value) return {};
+                        ins.setIn1(Operand((u32)value.value()));
+                        ++propagated;
+                        return std::make_pair(containingRegister(dst.value()), value.value());
+                    }
+                    return {};
+                }
+                case Op::LEA: {
+                    auto address = ins.in1().as<M64>();
+                    if(!address) return {};
+                    auto valueOf = [&](R64 reg) -> std::optional<u64> {
+                        if(reg == R64::ZERO) return 0;
+                        return constants.get(reg);
+                    };
+                    const Encoding64& encoding = address->encoding;
+                    auto base = valueOf(encoding.base);
+                    auto index = valueOf(encoding.index);
+                    if(!base || !index) return {};
+                    u64 value = base.value() + index.value() * encoding.scale + (u64)(i64)encoding.displacement;
+                    if(auto dst = ins.out().as<R64>()) {
+                        ins = Instruction(Op::MOV, Operand(dst.value()), Operand(value));
+                        ++folded;
+                        return std::make_pair(dst.value(), value);
+                    }
+                    if(auto dst = ins.out().as<R32>()) {
+                        ins = Instruction(Op::MOV, Operand(dst.value()), Operand((u32)value));
+                        ++folded;
+                        return std::make_pair(containingRegister(dst.value()), (u64)(u32)value);
+                    }
+                    return {};
+                }
+                case Op::ADD:
+                case Op::SUB:
+                case Op::AND:
+                case Op::OR:
+                case Op::XOR: {
+                    auto dst64 = ins.out().as<R64>();
+                    auto dst32 = ins.out().as<R32>();
+                    if(!dst64 && !dst32) return {};
+                    std::optional<u64> result;
+                    if(ins.in1() == ins.in2() && (ins.op() == Op::SUB || ins.op() == Op::XOR)) {
+                        result = 0;
+                    } else {
+                        auto lhs = constantOf(constants, ins.in1());
+                        auto rhs = constantOf(constants, ins.in2());
+                        if(auto imm = ins.in2().as<u32>()) {
+                            // 32-bit immediates are sign extended by 64-bit operations
+                            rhs = !!dst64 ? (u64)(i64)(i32)imm.value() : (u64)imm.value();
+                        }
+                        if(!lhs || !rhs) return {};
+                        result = evaluate(ins.op(), lhs.value(), rhs.value());
+                    }
+                    if(!result) return {};
+                    if(!!dst32) result = (u64)(u32)result.value();
+                    // the operation stays when its flags may be used
+                    if(flagsOverwritten_[i+1]) {
+                        if(!!dst64) {
+                            ins = Instruction(Op::MOV, Operand(dst64.value()), Operand(result.value()));
+                        } else {
+                            ins = Instruction(Op::MOV, Operand(dst32.value()), Operand((u32)result.value()));
+                        }
+                        ++folded;
+                    }
+                    return std::make_pair(ins.out().containingGpr().value(), result.value());
+                }
+                default: return {};
+            }
+        });
+
+        if(!!stats) {
+            stats->constantPropagation += propagated;
+            stats->constantFolding += folded;
+        }
+        return propagated + folded > 0;
+    }
+
+    bool CopyPropagation::optimize(IR* ir, Optimizer::Stats* stats) {
+        if(!ir) return false;
+
+        removableInstructions_.clear();
+        u32 propagated = 0;
+        forwardDataflow<R64>(ir, [&](size_t i, const RegisterFacts<R64>& copies) -> std::optional<std::pair<R64, R64>> {
+            Instruction& ins = ir->instructions[i];
+            auto sourceOf = [&](R64 reg) -> std::optional<R64> {
+                if(reg == R64::ZERO) return {};
+                return copies.get(reg);
+            };
+            auto tryPropagate = [&](const Operand& op, void(Instruction::*setter)(Operand)) {
+                auto reg = op.as<R64>();
+                if(!reg) return;
+                auto source = sourceOf(reg.value());
+                if(!source) return;
+                (ins.*setter)(Operand(source.value()));
+                ++propagated;
+            };
+
+            propagated += rewriteAddresses(&ins, [&](Encoding64 encoding) -> std::optional<Encoding64> {
+                auto base = sourceOf(encoding.base);
+                auto index = sourceOf(encoding.index);
+                // the stack pointer cannot be used as an index
+                if(!!index && index.value() == R64::RSP) index.reset();
+                if(!base && !index) return {};
+                if(!!base) encoding.base = base.value();
+                if(!!index) encoding.index = index.value();
+                return encoding;
+            });
+
+            switch(ins.op()) {
+                case Op::MOV: {
+                    auto dst = ins.out().as<R64>();
+                    if(!dst) return {};
+                    if(!ins.in1().as<R64>()) return {};
+                    tryPropagate(ins.in1(), &Instruction::setIn1);
+                    R64 src = ins.in1().as<R64>().value();
+                    if(src == dst.value() || copies.get(dst.value()) == src) {
+                        // the destination already holds the source
+                        removableInstructions_.push_back(i);
+                    }
+                    if(src == dst.value()) return {};
+                    return std::make_pair(dst.value(), src);
+                }
+                case Op::ADD:
+                case Op::SUB:
+                case Op::AND:
+                case Op::OR:
+                case Op::XOR: {
+                    tryPropagate(ins.in2(), &Instruction::setIn2);
+                    return {};
+                }
+                case Op::CMP:
+                case Op::TEST: {
+                    tryPropagate(ins.in1(), &Instruction::setIn1);
+                    tryPropagate(ins.in2(), &Instruction::setIn2);
+                    return {};
+                }
+                default: return {};
+            }
+        });
+
+        if(!!stats) stats->copyPropagation += propagated;
+        if(removableInstructions_.empty()) return propagated > 0;
+        ir->removeInstructions(removableInstructions_);
+        if(!!stats) stats->copyPropagation += (u32)removableInstructions_.size();
+        return true;
+    }
+
+    bool AddressFolding::optimize(IR* ir, Optimizer::Stats* stats) {
+        if(!ir) return false;
+
+        auto fitsDisplacement = [](i64 displacement) {
+            return displacement >= std::numeric_limits<i32>::min() && displacement <= std::numeric_limits<i32>::max();
+        };
+
+        u32 folded = 0;
+        forwardDataflow<Encoding64>(ir, [&](size_t i, const RegisterFacts<Encoding64>& addresses) -> std::optional<std::pair<R64, Encoding64>> {
+            Instruction& ins = ir->instructions[i];
+            folded += rewriteAddresses(&ins, [&](const Encoding64& encoding) -> std::optional<Encoding64> {
+                if(encoding.base != R64::ZERO) {
+                    if(const auto& address = addresses.get(encoding.base)) {
+                        i64 displacement = (i64)encoding.displacement + (i64)address->displacement;
+                        if(fitsDisplacement(displacement)) {
+                            // [lea + index*scale + disp]
+                            if(encoding.index == R64::ZERO) {
+                                return Encoding64 { address->base, address->index, address->scale, (i32)displacement };
+                            }
+                            if(address->index == R64::ZERO) {
+                                return Encoding64 { address->base, encoding.index, encoding.scale, (i32)displacement };
+                            }
+                        }
+                    }
+                }
+                if(encoding.index != R64::ZERO && encoding.scale == 1) {
+                    // [base + lea + disp]: guest memory accesses look like this
+                    if(const auto& address = addresses.get(encoding.index)) {
+                        i64 displacement = (i64)encoding.displacement + (i64)address->displacement;
+                        if(address->index == R64::ZERO && address->base != R64::RSP && fitsDisplacement(displacement)) {
+                            return Encoding64 { encoding.base, address->base, 1, (i32)displacement };
+                        }
+                    }
+                }
+                return {};
+            });
+
+            if(ins.op() != Op::LEA) return {};
+            auto dst = ins.out().as<R64>();
+            auto address = ins.in1().as<M64>();
+            if(!dst || !address) return {};
+            const Encoding64& encoding = address->encoding;
+            if(encoding.base == R64::ZERO) return {};
+            if(encoding.base == dst.value() || encoding.index == dst.value()) return {};
+            return std::make_pair(dst.value(), encoding);
+        });
+
+        if(!!stats) stats->addressFolding += folded;
+        return folded > 0;
+    }
+
+    bool AndnFusion::optimize(IR* ir, Optimizer::Stats* stats) {
+        if(!ir) return false;
+
+        computeFlagsOverwritten(*ir, &flagsOverwritten_);
+        removableInstructions_.clear();
+
+        auto isJump = [](Op op) {
+            return op == Op::JCC || op == Op::JMP || op == Op::JMP_IND || op == Op::CALL || op == Op::RET;
+        };
+        auto isLabel = [&](size_t position) {
+            return std::find(ir->labels.begin(), ir->labels.end(), position) != ir->labels.end();
+        };
+        auto mentions = [](const Instruction& ins, R64 reg) {
+            return ins.readsFrom(reg) || ins.writesTo(reg) || ins.out().readsFrom(reg) || ins.in3().readsFrom(reg);
+        };
+        auto sameRegister = [](const Operand& a, const Operand& b) {
+            if(auto r32 = a.as<R32>()) return r32 == b.as<R32>();
+            if(auto r64 = a.as<R64>()) return r64 == b.as<R64>();
+            return false;
+        };
+
+        // not x ; ... ; and x, x, s  =>  ... ; andn x, x, s
+        for(size_t i = 0; i < ir->instructions.size(); ++i) {
+            const Instruction& notIns = ir->instructions[i];
+            if(notIns.op() != Op::NOT) continue;
+            if(!sameRegister(notIns.out(), notIns.in1())) continue;
+            auto x = notIns.out().containingGpr();
+            if(!x) continue;
+            for(size_t j = i+1; j < ir->instructions.size(); ++j) {
+                Instruction& ins = ir->instructions[j];
+                if(isJump(ins.op()) || isLabel(j)) break;
+                if(ins.op() == Op::AND
+                        && sameRegister(ins.out(), notIns.out())
+                        && sameRegister(ins.in1(), notIns.out())
+                        && (ins.in2().as<R32>() || ins.in2().as<R64>())
+                        && ins.in2().containingGpr() != x) {
+                    // andn leaves the parity flag undefined
+                    if(!flagsOverwritten_[j+1]) break;
+                    ins = Instruction(Op::ANDN, ins.out(), ins.in1(), ins.in2());
+                    removableInstructions_.push_back(i);
+                    break;
+                }
+                if(mentions(ins, x.value())) break;
+            }
+        }
+
+        if(removableInstructions_.empty()) return false;
+        ir->removeInstructions(removableInstructions_);
+        if(!!stats) stats->andnFusion += (u32)removableInstructions_.size();
+        return true;
+    }
+
+    MemoryOperandFolding::MemoryOperandFolding() = default;
+    MemoryOperandFolding::~MemoryOperandFolding() = default;
+
+    bool MemoryOperandFolding::optimize(IR* ir, Optimizer::Stats* stats) {
+        if(!ir) return false;
+        if(!analysis_) analysis_ = std::make_unique<LivenessAnalysis>();
+        computeLiveRegistersAndAddresses(*ir, analysis_.get());
+        removableInstructions_.clear();
+
+        // code is jumped to or patched at these positions, instructions cannot move across them
+        auto isMarked = [&](size_t position) {
+            if(std::find(ir->labels.begin(), ir->labels.end(), position) != ir->labels.end()) return true;
+            return ir->jumpLanding == position
+                || ir->jumpToNext == position
+                || ir->jumpToOther == position
+                || (!!ir->pushCallstack && ir->pushCallstack->first == position)
+                || ir->popCallstack == position;
+        };
+        auto mentions = [](const Instruction& ins, R64 reg) {
+            return ins.readsFrom(reg) || ins.writesTo(reg) || ins.out().readsFrom(reg) || ins.in3().readsFrom(reg);
+        };
+        auto isDeadAfter = [&](size_t position, R64 reg) {
+            return !analysis_->gprs[position+1].test((u32)reg);
+        };
+        auto isArithmetic = [](Op op) {
+            return op == Op::ADD || op == Op::SUB || op == Op::AND || op == Op::OR || op == Op::XOR;
+        };
+        // loads can be moved past instructions that only write a register
+        auto onlyWritesRegister = [](const Instruction& ins) {
+            bool impactsRegisters = false;
+            ins.forEachImpactedRegister([&](R64) { impactsRegisters = true; });
+            if(impactsRegisters || !!ins.condition()) return false;
+            switch(ins.op()) {
+                case Op::MOV:
+                case Op::MOVZX:
+                case Op::MOVSX:
+                case Op::LEA: return ins.out().isRegister();
+                default: return false;
+            }
+        };
+        auto sameSizeRegister = [](const Operand& op, const Operand& temporary) -> bool {
+            if(temporary.as<R32>()) return !!op.as<R32>();
+            return !!op.as<R64>();
+        };
+        auto sameSizeSource = [&](const Operand& op, const Operand& temporary) -> bool {
+            return sameSizeRegister(op, temporary) || !!op.as<u32>();
+        };
+
+        u32 folded = 0;
+        u32 merged = 0;
+        for(size_t i = 0; i < ir->instructions.size(); ++i) {
+            Instruction& first = ir->instructions[i];
+
+            // lea d, [a] ; lea d, [d + index*scale + disp]  =>  lea d, [a + index*scale + disp]
+            if(first.op() == Op::LEA && i+1 < ir->instructions.size() && !isMarked(i+1)) {
+                Instruction& second = ir->instructions[i+1];
+                auto dst = first.out().as<R64>();
+                auto inner = first.in1().as<M64>();
+                auto outer = second.in1().as<M64>();
+                if(second.op() == Op::LEA && !!dst && second.out().as<R64>() == dst && !!inner && !!outer
+                        && outer->encoding.base == dst.value() && outer->encoding.index != dst.value()
+                        && (inner->encoding.index == R64::ZERO || outer->encoding.index == R64::ZERO)) {
+                    i64 displacement = (i64)inner->encoding.displacement + (i64)outer->encoding.displacement;
+                    if(displacement >= std::numeric_limits<i32>::min() && displacement <= std::numeric_limits<i32>::max()) {
+                        Encoding64 encoding = inner->encoding;
+                        if(outer->encoding.index != R64::ZERO) {
+                            encoding.index = outer->encoding.index;
+                            encoding.scale = outer->encoding.scale;
+                        }
+                        encoding.displacement = (i32)displacement;
+                        second.setIn1(Operand(M64 { outer->segment, encoding }));
+                        removableInstructions_.push_back(i);
+                        ++merged;
+                        ++i;
+                        continue;
+                    }
+                }
+            }
+
+            // mov t, [m] ; ... ; op t, t, s ; mov [m], t  =>  ... ; op [m], [m], s
+            // mov t, [m] ; ... ; op d, d, t               =>  ... ; op d, d, [m]
+            // mov t, [m] ; ... ; cmp t, s                 =>  ... ; cmp [m], s
+            if(first.op() != Op::MOV) continue;
+            Operand temporary = first.out();
+            Operand memory = first.in1();
+            std::optional<R64> tmp;
+            if(temporary.as<R32>() && memory.as<M32>()) tmp = temporary.containingGpr();
+            if(temporary.as<R64>() && memory.as<M64>()) tmp = temporary.as<R64>();
+            if(!tmp) continue;
+            Encoding64 encoding = memory.memory()->encoding;
+            if(encoding.base == tmp || encoding.index == tmp) continue;
+
+            size_t j = i+1;
+            for(; j < ir->instructions.size(); ++j) {
+                const Instruction& ins = ir->instructions[j];
+                if(isMarked(j) || mentions(ins, tmp.value())) break;
+                if(!onlyWritesRegister(ins)) break;
+                if(encoding.base != R64::ZERO && ins.writesTo(encoding.base)) break;
+                if(encoding.index != R64::ZERO && ins.writesTo(encoding.index)) break;
+            }
+            if(j == ir->instructions.size() || isMarked(j)) continue;
+            Instruction& use = ir->instructions[j];
+            if(!mentions(use, tmp.value()) || !!use.condition()) continue;
+
+            if(isArithmetic(use.op()) && use.out() == temporary && use.in1() == temporary) {
+                if(!sameSizeSource(use.in2(), temporary) || use.in2().readsFrom(tmp.value())) continue;
+                if(j+1 == ir->instructions.size() || isMarked(j+1)) continue;
+                const Instruction& store = ir->instructions[j+1];
+                if(store.op() != Op::MOV || store.out() != memory || store.in1() != temporary) continue;
+                if(!isDeadAfter(j+1, tmp.value())) continue;
+                use = Instruction(use.op(), memory, memory, use.in2());
+                removableInstructions_.push_back(i);
+                removableInstructions_.push_back(j+1);
+                ++folded;
+                i = j+1;
+            } else if(isArithmetic(use.op()) && use.in2() == temporary && use.out() == use.in1()) {
+                if(!sameSizeRegister(use.out(), temporary) || use.out().readsFrom(tmp.value())) continue;
+                if(!isDeadAfter(j, tmp.value())) continue;
+                use.setIn2(memory);
+                removableInstructions_.push_back(i);
+                ++folded;
+                i = j;
+            } else if(use.op() == Op::CMP && use.in1() == temporary) {
+                if(!sameSizeSource(use.in2(), temporary) || use.in2().readsFrom(tmp.value())) continue;
+                if(!isDeadAfter(j, tmp.value())) continue;
+                use.setIn1(memory);
+                removableInstructions_.push_back(i);
+                ++folded;
+                i = j;
+            } else if(use.op() == Op::CMP && use.in2() == temporary) {
+                if(!sameSizeRegister(use.in1(), temporary) || use.in1().readsFrom(tmp.value())) continue;
+                if(!isDeadAfter(j, tmp.value())) continue;
+                use.setIn2(memory);
+                removableInstructions_.push_back(i);
+                ++folded;
+                i = j;
+            }
+        }
+
+        if(removableInstructions_.empty()) return false;
+        ir->removeInstructions(removableInstructions_);
+        if(!!stats) {
+            stats->memoryOperandFolding += folded;
+            stats->leaMerging += merged;
+        }
+        return true;
+    }
+
 }
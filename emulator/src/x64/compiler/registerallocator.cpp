@@ -0,0 +1,436 @@
+#include "x64/compiler/registerallocator.h"
+#include <algorithm>
+#include <cassert>
+
+namespace x64::ir {
+
+    namespace {
+        R32 lowerHalf(R64 reg) {
+            return (R32)(u8)reg;
+        }
+
+        bool mentions(const Operand& op, R64 reg) {
+            if(auto gpr = op.containingGpr()) return gpr == reg;
+            if(auto mem = op.memory()) return mem->encoding.base == reg || mem->encoding.index == reg;
+            return false;
+        }
+
+        bool mentions(const Instruction& ins, R64 reg) {
+            bool impacted = false;
+            ins.forEachImpactedRegister([&](R64 r) {
+                impacted |= (r == reg);
+            });
+            return impacted
+                || mentions(ins.out(), reg)
+                || mentions(ins.in1(), reg)
+                || mentions(ins.in2(), reg)
+                || mentions(ins.in3(), reg);
+        }
+
+        bool isHostRegister(R64 reg) {
+            const auto& hosts = RegisterAllocator::HOST_REGISTERS;
+            return std::find(hosts.begin(), hosts.end(), reg) != hosts.end();
+        }
+
+        // Only these forms are known to be encoded for any general purpose register by the assembler
+        bool isPlainGprOperand(const Operand& op) {
+            return op == Operand{}
+                || op.as<u8>() || op.as<u16>() || op.as<u32>() || op.as<u64>()
+                || op.as<R32>() || op.as<R64>()
+                || op.as<M32>() || op.as<M64>();
+        }
+
+        bool canRenameRegisters(const Instruction& ins) {
+            if(!!ins.condition() || !!ins.fcondition()) return false;
+            switch(ins.op()) {
+                case Op::MOV:
+                case Op::LEA:
+                case Op::ADD:
+                case Op::SUB:
+                case Op::AND:
+                case Op::OR:
+                case Op::XOR:
+                case Op::CMP:
+                case Op::INC:
+                case Op::DEC:
+                case Op::NEG:
+                case Op::NOT:
+                    break;
+                case Op::TEST: {
+                    if(ins.out().as<R32>() && ins.in1().as<u32>()) return false;
+                    break;
+                }
+                default: return false;
+            }
+            return isPlainGprOperand(ins.out())
+                && isPlainGprOperand(ins.in1())
+                && isPlainGprOperand(ins.in2())
+                && isPlainGprOperand(ins.in3());
+        }
+
+        // Register operands may be renamed, anything else is left untouched
+        std::optional<Operand> renamed(const Operand& op, R64 from, R64 to) {
+            if(auto r64 = op.as<R64>()) {
+                if(r64 == from) return Operand(to);
+                return op;
+            }
+            if(auto r32 = op.as<R32>()) {
+                if(containingRegister(r32.value()) == from) return Operand(lowerHalf(to));
+                return op;
+            }
+            if(mentions(op, from)) return {};
+            return op;
+        }
+
+        std::optional<Instruction> renamed(const Instruction& ins, R64 from, R64 to) {
+            bool impacted = false;
+            ins.forEachImpactedRegister([&](R64 r) {
+                impacted |= (r == from);
+            });
+            if(impacted) return {};
+            auto out = renamed(ins.out(), from, to);
+            auto in1 = renamed(ins.in1(), from, to);
+            auto in2 = renamed(ins.in2(), from, to);
+            auto in3 = renamed(ins.in3(), from, to);
+            if(!out || !in1 || !in2 || !in3) return {};
+            Instruction result(ins.op(), out.value(), in1.value(), in2.value(), in3.value());
+            ins.forEachImpactedRegister([&](R64 r) {
+                result.addImpactedRegister(r);
+            });
+            return result;
+        }
+
+        // Returns true if the instruction overwrites the whole register without reading it first
+        bool fullyDefines(const Instruction& ins, R64 reg) {
+            if(ins.op() != Op::MOV && ins.op() != Op::LEA) return false;
+            bool definesRegister = (ins.out().as<R64>() == reg)
+                                || (ins.out().as<R32>() && containingRegister(ins.out().as<R32>().value()) == reg);
+            if(!definesRegister) return false;
+            return !mentions(ins.in1(), reg) && !mentions(ins.in2(), reg) && !mentions(ins.in3(), reg);
+        }
+
+        bool isDeadAfter(const std::vector<Instruction>& instructions, const std::vector<bool>& removed, size_t pos, R64 reg) {
+            for(size_t k = pos+1; k < instructions.size(); ++k) {
+                if(removed[k]) continue;
+                const Instruction& ins = instructions[k];
+                if(fullyDefines(ins, reg)) return true;
+                if(mentions(ins, reg)) return false;
+            }
+            // Temporaries do not outlive the basic block body
+            return true;
+        }
+    }
+
+    RegisterAllocator::RegisterAllocator(R64 registerFileBase) : registerFileBase_(registerFileBase) { }
+
+    std::optional<u32> RegisterAllocator::guestRegisterOf(const Operand& op) const {
+        auto mem = op.memory();
+        if(!mem) return {};
+        if(mem->encoding.base != registerFileBase_) return {};
+        if(mem->encoding.index != R64::ZERO) return {};
+        if(mem->encoding.displacement < 0) return {};
+        u32 guestRegister = (u32)mem->encoding.displacement / 8;
+        if(guestRegister >= NB_GUEST_REGISTERS) return {};
+        return guestRegister;
+    }
+
+    std::optional<RegisterAllocator::Access> RegisterAllocator::accessOf(const Instruction& ins) const {
+        if(ins.op() != Op::MOV) return {};
+        if(ins.out().as<R64>()) {
+            auto guestRegister = guestRegisterOf(ins.in1());
+            if(!guestRegister || !ins.in1().as<M64>()) return {};
+            if(ins.in1().as<M64>()->encoding.displacement % 8 != 0) return {};
+            return Access { guestRegister.value(), AccessKind::READ64 };
+        }
+        if(ins.out().as<R32>()) {
+            auto guestRegister = guestRegisterOf(ins.in1());
+            if(!guestRegister || !ins.in1().as<M32>()) return {};
+            if(ins.in1().as<M32>()->encoding.displacement % 8 != 0) return {};
+            return Access { guestRegister.value(), AccessKind::READ32 };
+        }
+        if(auto dst = ins.out().as<M64>()) {
+            auto guestRegister = guestRegisterOf(ins.out());
+            if(!guestRegister) return {};
+            if(dst->encoding.displacement % 8 != 0) return {};
+            if(ins.in1().as<R64>()) return Access { guestRegister.value(), AccessKind::WRITE64 };
+            if(ins.in1().as<u32>()) return Access { guestRegister.value(), AccessKind::WRITE64_IMM };
+            return {};
+        }
+        return {};
+    }
+
+    bool RegisterAllocator::analyze(const std::vector<IR*>& runs) {
+        for(auto& guestRegister : guestRegisters_) guestRegister = GuestRegister{};
+        std::fill(availableHostRegisters_.begin(), availableHostRegisters_.end(), true);
+        runBoundaries_.assign(runs.size(), RunBoundary{});
+
+        auto markIneligible = [&](const Operand& op) {
+            auto mem = op.memory();
+            if(!mem) return true;
+            if(mem->encoding.index == registerFileBase_) return false;
+            if(mem->encoding.base != registerFileBase_) return true;
+            if(mem->encoding.index != R64::ZERO) return false;
+            u32 size = op.as<M128>() ? 16 : 8;
+            for(i32 disp = mem->encoding.displacement; disp < mem->encoding.displacement + (i32)size; disp += 8) {
+                if(disp < 0) continue;
+                u32 guestRegister = (u32)disp / 8;
+                if(guestRegister < NB_GUEST_REGISTERS) guestRegisters_[guestRegister].eligible = false;
+            }
+            return true;
+        };
+
+        for(size_t r = 0; r < runs.size(); ++r) {
+            const IR& ir = *runs[r];
+            RunBoundary& boundary = runBoundaries_[r];
+
+            // Code that is patched after generation must keep its exact layout
+            if(!!ir.jumpLanding || !!ir.jumpToNext || !!ir.jumpToOther || !!ir.pushCallstack || !!ir.popCallstack) return false;
+
+            bool straightLine = ir.labels.empty();
+
+            for(const Instruction& ins : ir.instructions) {
+                switch(ins.op()) {
+                    // Calls are only expected between runs, where the allocated registers are spilled
+                    case Op::CALL:
+                    case Op::RET:
+                    case Op::JMP_IND:
+                    case Op::REPSTOS8:
+                    case Op::REPSTOS32:
+                    case Op::REPSTOS64:
+                    case Op::REPMOVS8:
+                    case Op::REPMOVS16:
+                    case Op::REPMOVS32:
+                    case Op::REPMOVS64:
+                        return false;
+                    default: break;
+                }
+
+                bool touchesRegisterFileBase = false;
+                ins.forEachImpactedRegister([&](R64 reg) {
+                    touchesRegisterFileBase |= (reg == registerFileBase_);
+                    for(size_t h = 0; h < HOST_REGISTERS.size(); ++h) {
+                        if(HOST_REGISTERS[h] == reg) availableHostRegisters_[h] = false;
+                    }
+                });
+                if(touchesRegisterFileBase) return false;
+
+                std::array<const Operand*, 4> operands {{ &ins.out(), &ins.in1(), &ins.in2(), &ins.in3() }};
+                for(const Operand* op : operands) {
+                    if(op->containingGpr() == registerFileBase_) return false;
+                    for(size_t h = 0; h < HOST_REGISTERS.size(); ++h) {
+                        if(mentions(*op, HOST_REGISTERS[h])) availableHostRegisters_[h] = false;
+                    }
+                }
+
+                auto access = accessOf(ins);
+                if(!!access) {
+                    u32 g = access->guestRegister;
+                    bool isRead = access->kind == AccessKind::READ32 || access->kind == AccessKind::READ64;
+                    bool firstAccessInRun = !boundary.loadNeeded[g] && !boundary.written[g];
+                    if(!straightLine || (firstAccessInRun && isRead)) boundary.loadNeeded[g] = true;
+                    if(!isRead) boundary.written[g] = true;
+                    ++guestRegisters_[g].accesses;
+                    continue;
+                }
+
+                for(const Operand* op : operands) {
+                    if(!markIneligible(*op)) return false;
+                }
+            }
+        }
+
+        std::vector<u32> candidates;
+        for(u32 i = 0; i < NB_GUEST_REGISTERS; ++i) {
+            const GuestRegister& guestRegister = guestRegisters_[i];
+            if(!guestRegister.eligible) continue;
+            if(guestRegister.accesses < 2) continue;
+            candidates.push_back(i);
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [&](u32 a, u32 b) {
+            return guestRegisters_[a].accesses > guestRegisters_[b].accesses;
+        });
+
+        bool allocatedSomething = false;
+        size_t nextHost = 0;
+        for(u32 candidate : candidates) {
+            while(nextHost < HOST_REGISTERS.size() && !availableHostRegisters_[nextHost]) ++nextHost;
+            if(nextHost == HOST_REGISTERS.size()) break;
+            guestRegisters_[candidate].host = HOST_REGISTERS[nextHost];
+            ++nextHost;
+            allocatedSomething = true;
+        }
+        return allocatedSomething;
+    }
+
+    void RegisterAllocator::rewrite(const IR& ir, const RunBoundary& boundary, IR* result) const {
+        assert(!!result);
+        auto registerFileSlot = [&](u32 guestRegister) {
+            return M64 { Segment::CS, Encoding64 { registerFileBase_, R64::ZERO, 1, 8*(i32)guestRegister } };
+        };
+
+        std::vector<Instruction> instructions;
+        instructions.reserve(ir.instructions.size() + 2*HOST_REGISTERS.size());
+
+        for(u32 i = 0; i < NB_GUEST_REGISTERS; ++i) {
+            const GuestRegister& guestRegister = guestRegisters_[i];
+            if(!guestRegister.host || !boundary.loadNeeded[i]) continue;
+            instructions.push_back(Instruction(Op::MOV, Operand(guestRegister.host.value()), Operand(registerFileSlot(i))));
+        }
+        size_t nbLoads = instructions.size();
+
+        for(const Instruction& ins : ir.instructions) {
+            auto access = accessOf(ins);
+            if(!access || !guestRegisters_[access->guestRegister].host) {
+                instructions.push_back(ins);
+                continue;
+            }
+            R64 host = guestRegisters_[access->guestRegister].host.value();
+            switch(access->kind) {
+                case AccessKind::READ32: {
+                    instructions.push_back(Instruction(Op::MOV, ins.out(), Operand(lowerHalf(host))));
+                    break;
+                }
+                case AccessKind::READ64: {
+                    instructions.push_back(Instruction(Op::MOV, ins.out(), Operand(host)));
+                    break;
+                }
+                case AccessKind::WRITE64: {
+                    instructions.push_back(Instruction(Op::MOV, Operand(host), ins.in1()));
+                    break;
+                }
+                case AccessKind::WRITE64_IMM: {
+                    // the register file is written with a sign-extended 32-bit immediate
+                    u64 imm = (u64)(i64)(i32)ins.in1().as<u32>().value();
+                    instructions.push_back(Instruction(Op::MOV, Operand(host), Operand(imm)));
+                    break;
+                }
+            }
+        }
+
+        for(u32 i = 0; i < NB_GUEST_REGISTERS; ++i) {
+            const GuestRegister& guestRegister = guestRegisters_[i];
+            if(!guestRegister.host || !boundary.written[i]) continue;
+            instructions.push_back(Instruction(Op::MOV, Operand(registerFileSlot(i)), Operand(guestRegister.host.value())));
+        }
+
+        result->instructions = std::move(instructions);
+        result->labels = ir.labels;
+        for(size_t& label : result->labels) label += nbLoads;
+    }
+
+    u32 RegisterAllocator::coalesce(IR* ir) const {
+        // Look for values computed in a temporary and only then copied into an allocated register:
+        //    mov tmp, host (or any other definition of tmp)
+        //    op tmp, ...
+        //    mov host, tmp
+        // and compute them directly into the allocated register instead.
+        // Jumps inside the body would require a real liveness analysis, so only straight-line code is handled.
+        assert(!!ir);
+        if(!ir->labels.empty()) return 0;
+        std::vector<Instruction>& instructions = ir->instructions;
+        std::vector<bool> removed(instructions.size(), false);
+        u32 coalescedMoves = 0;
+
+        for(size_t j = 0; j < instructions.size(); ++j) {
+            if(removed[j]) continue;
+            const Instruction& copy = instructions[j];
+            if(copy.op() != Op::MOV) continue;
+            auto host = copy.out().as<R64>();
+            auto tmp = copy.in1().as<R64>();
+            if(!host || !tmp) continue;
+            if(!isHostRegister(host.value())) continue;
+            if(tmp != R64::R8 && tmp != R64::R9 && tmp != R64::R10) continue;
+            if(!isDeadAfter(instructions, removed, j, tmp.value())) continue;
+
+            // Find where the temporary is defined, and check that everything in between can use the host register instead
+            std::optional<size_t> definition;
+            for(size_t i = j; i-- > 0;) {
+                if(removed[i]) continue;
+                const Instruction& ins = instructions[i];
+                bool isCopyIn = ins.op() == Op::MOV && ins.out().as<R64>() == tmp && ins.in1().as<R64>() == host;
+                if(mentions(ins, host.value()) && !isCopyIn) break;
+                if(!mentions(ins, tmp.value())) continue;
+                if(!canRenameRegisters(ins)) break;
+                if(fullyDefines(ins, tmp.value())) {
+                    definition = i;
+                    break;
+                }
+            }
+            if(!definition) continue;
+
+            std::vector<std::pair<size_t, Instruction>> replacements;
+            bool success = true;
+            for(size_t k = definition.value(); k < j; ++k) {
+                if(removed[k]) continue;
+                if(!mentions(instructions[k], tmp.value())) continue;
+                auto replacement = renamed(instructions[k], tmp.value(), host.value());
+                if(!replacement) {
+                    success = false;
+                    break;
+                }
+                replacements.push_back(std::make_pair(k, replacement.value()));
+            }
+            if(!success) continue;
+
+            for(auto& replacement : replacements) {
+                instructions[replacement.first] = std::move(replacement.second);
+            }
+            removed[j] = true;
+            ++coalescedMoves;
+
+            const Instruction& def = instructions[definition.value()];
+            if(def.op() == Op::MOV && def.out().as<R64>() == host && def.in1().as<R64>() == host) {
+                removed[definition.value()] = true;
+                ++coalescedMoves;
+            }
+        }
+
+        std::vector<size_t> positions;
+        for(size_t i = 0; i < removed.size(); ++i) {
+            if(removed[i]) positions.push_back(i);
+        }
+        ir->removeInstructions(positions);
+        return coalescedMoves;
+    }
+
+    bool RegisterAllocator::allocate(IR& ir, Stats* stats) {
+        return allocate(std::vector<IR*>{&ir}, stats);
+    }
+
+    bool RegisterAllocator::allocate(const std::vector<IR*>& runs, Stats* stats) {
+        if(!analyze(runs)) return false;
+
+        std::vector<IR> results(runs.size());
+        u32 coalescedMoves = 0;
+        size_t sizeBefore = 0;
+        size_t sizeAfter = 0;
+        for(size_t r = 0; r < runs.size(); ++r) {
+            rewrite(*runs[r], runBoundaries_[r], &results[r]);
+            coalescedMoves += coalesce(&results[r]);
+            sizeBefore += runs[r]->instructions.size();
+            sizeAfter += results[r].instructions.size();
+        }
+
+        // Only keep the allocation when it does not make the body longer
+        if(sizeAfter > sizeBefore) return false;
+
+        if(!!stats) {
+            for(u32 i = 0; i < NB_GUEST_REGISTERS; ++i) {
+                const GuestRegister& guestRegister = guestRegisters_[i];
+                if(!guestRegister.host) continue;
+                ++stats->allocatedRegisters;
+                u32 addedAccesses = 0;
+                for(const RunBoundary& boundary : runBoundaries_) {
+                    addedAccesses += (boundary.loadNeeded[i] ? 1 : 0) + (boundary.written[i] ? 1 : 0);
+                }
+                if(guestRegister.accesses > addedAccesses) stats->removedRegisterFileAccesses += guestRegister.accesses - addedAccesses;
+            }
+            stats->coalescedMoves += coalescedMoves;
+        }
+        for(size_t r = 0; r < runs.size(); ++r) {
+            runs[r]->instructions = std::move(results[r].instructions);
+            runs[r]->labels = std::move(results[r].labels);
+        }
+        return true;
+    }
+}
@@ -1863,18 +1863,144 @@ namespace x64 {
     }
 
     BasicBlock Cpu::createBasicBlock(const X64Instruction* instructions, size_t count) {
-        std::vector<std::pair<X64Instruction, CpuExecPtr>> vec;
+        std::vector<std::pair<X64Instruction, ThreadedInstruction>> vec;
         vec.reserve(count);
         for(size_t i = 0; i < count; ++i) {
-            vec.push_back(std::make_pair(instructions[i], execFunctions_[(size_t)instructions[i].insn()]));
+            vec.push_back(std::make_pair(instructions[i], threadedForm(instructions[i])));
         }
         return BasicBlock(std::move(vec));
     }
 
     void Cpu::exec(const BasicBlock& bb) {
         for(const auto& p : bb.instructions()) {
-            set(R64::RIP, p.first.nextAddress());
-            p.second(*this, p.first);
+            if(p.second.updatesRip) regs_.rip() = p.first.nextAddress();
+            p.second.exec(*this, p.first);
+        }
+    }
+
+    template<Size size, U<size>(*op)(U<size>, U<size>, Flags*)>
+    void Cpu::execOpRegReg(Cpu& cpu, const X64Instruction& ins) {
+        R<size> dst = ins.op0<RM<size>>().reg;
+        R<size> src = ins.op1<RM<size>>().reg;
+        cpu.set(dst, op(cpu.get(dst), cpu.get(src), &cpu.flags_));
+    }
+
+    template<Size size, U<size>(*op)(U<size>, U<size>, Flags*)>
+    void Cpu::execOpRegImm(Cpu& cpu, const X64Instruction& ins) {
+        R<size> dst = ins.op0<RM<size>>().reg;
+        U<size> src = cpu.get<U<size>>(ins.op1<Imm>());
+        cpu.set(dst, op(cpu.get(dst), src, &cpu.flags_));
+    }
+
+    template<Size size, U<size>(*op)(U<size>, U<size>, Flags*)>
+    void Cpu::execOpRegMem(Cpu& cpu, const X64Instruction& ins) {
+        R<size> dst = ins.op0<RM<size>>().reg;
+        U<size> src = cpu.get(cpu.resolve(ins.op1<RM<size>>().mem));
+        cpu.set(dst, op(cpu.get(dst), src, &cpu.flags_));
+    }
+
+    template<Size size, U<size>(*op)(U<size>, Flags*)>
+    void Cpu::execOpReg(Cpu& cpu, const X64Instruction& ins) {
+        R<size> dst = ins.op0<RM<size>>().reg;
+        cpu.set(dst, op(cpu.get(dst), &cpu.flags_));
+    }
+
+    template<Size size, void(*op)(U<size>, U<size>, Flags*)>
+    void Cpu::execCompareRegReg(Cpu& cpu, const X64Instruction& ins) {
+        R<size> src1 = ins.op0<RM<size>>().reg;
+        R<size> src2 = ins.op1<RM<size>>().reg;
+        op(cpu.get(src1), cpu.get(src2), &cpu.flags_);
+    }
+
+    template<Size size, void(*op)(U<size>, U<size>, Flags*)>
+    void Cpu::execCompareRegImm(Cpu& cpu, const X64Instruction& ins) {
+        R<size> src1 = ins.op0<RM<size>>().reg;
+        op(cpu.get(src1), cpu.get<U<size>>(ins.op1<Imm>()), &cpu.flags_);
+    }
+
+    template<Size size, void(*op)(U<size>, U<size>, Flags*)>
+    void Cpu::execCompareRegMem(Cpu& cpu, const X64Instruction& ins) {
+        R<size> src1 = ins.op0<RM<size>>().reg;
+        U<size> src2 = cpu.get(cpu.resolve(ins.op1<RM<size>>().mem));
+        op(cpu.get(src1), src2, &cpu.flags_);
+    }
+
+    template<Size size>
+    void Cpu::execTestRegReg(Cpu& cpu, const X64Instruction& ins) {
+        R<size> src1 = ins.op0<RM<size>>().reg;
+        R<size> src2 = ins.op1<R<size>>();
+        if constexpr(size == Size::DWORD) {
+            Impl::test32(cpu.get(src1), cpu.get(src2), &cpu.flags_);
+        } else {
+            Impl::test64(cpu.get(src1), cpu.get(src2), &cpu.flags_);
+        }
+    }
+
+    // Register-only forms neither read rip nor fault, so rip is only updated before the other instructions.
+    // Memory forms are specialized as well, but they may fault and address memory relative to rip.
+    ThreadedInstruction Cpu::threadedForm(const X64Instruction& ins) {
+        ThreadedInstruction generic { execFunctions_[(size_t)ins.insn()], true };
+        auto regOrMem = [&](bool dstIsReg, bool srcIsReg, CpuExecPtr regReg, CpuExecPtr regMem) {
+            if(!dstIsReg) return generic;
+            if(srcIsReg) return ThreadedInstruction{regReg, false};
+            return ThreadedInstruction{regMem, true};
+        };
+        auto rr32 = [&](CpuExecPtr regReg, CpuExecPtr regMem) {
+            return regOrMem(ins.op0<RM32>().isReg, ins.op1<RM32>().isReg, regReg, regMem);
+        };
+        auto rr64 = [&](CpuExecPtr regReg, CpuExecPtr regMem) {
+            return regOrMem(ins.op0<RM64>().isReg, ins.op1<RM64>().isReg, regReg, regMem);
+        };
+        auto reg32 = [&](CpuExecPtr regOnly) {
+            return ins.op0<RM32>().isReg ? ThreadedInstruction{regOnly, false} : generic;
+        };
+        auto reg64 = [&](CpuExecPtr regOnly) {
+            return ins.op0<RM64>().isReg ? ThreadedInstruction{regOnly, false} : generic;
+        };
+
+        switch(ins.insn()) {
+            case Insn::ADD_RM32_RM32: return rr32(&execOpRegReg<Size::DWORD, Impl::add32>, &execOpRegMem<Size::DWORD, Impl::add32>);
+            case Insn::ADD_RM64_RM64: return rr64(&execOpRegReg<Size::QWORD, Impl::add64>, &execOpRegMem<Size::QWORD, Impl::add64>);
+            case Insn::ADD_RM32_IMM: return reg32(&execOpRegImm<Size::DWORD, Impl::add32>);
+            case Insn::ADD_RM64_IMM: return reg64(&execOpRegImm<Size::QWORD, Impl::add64>);
+            case Insn::SUB_RM32_RM32: return rr32(&execOpRegReg<Size::DWORD, Impl::sub32>, &execOpRegMem<Size::DWORD, Impl::sub32>);
+            case Insn::SUB_RM64_RM64: return rr64(&execOpRegReg<Size::QWORD, Impl::sub64>, &execOpRegMem<Size::QWORD, Impl::sub64>);
+            case Insn::SUB_RM32_IMM: return reg32(&execOpRegImm<Size::DWORD, Impl::sub32>);
+            case Insn::SUB_RM64_IMM: return reg64(&execOpRegImm<Size::QWORD, Impl::sub64>);
+            case Insn::AND_RM32_RM32: return rr32(&execOpRegReg<Size::DWORD, Impl::and32>, &execOpRegMem<Size::DWORD, Impl::and32>);
+            case Insn::AND_RM64_RM64: return rr64(&execOpRegReg<Size::QWORD, Impl::and64>, &execOpRegMem<Size::QWORD, Impl::and64>);
+            case Insn::AND_RM32_IMM: return reg32(&execOpRegImm<Size::DWORD, Impl::and32>);
+            case Insn::AND_RM64_IMM: return reg64(&execOpRegImm<Size::QWORD, Impl::and64>);
+            case Insn::OR_RM32_RM32: return rr32(&execOpRegReg<Size::DWORD, Impl::or32>, &execOpRegMem<Size::DWORD, Impl::or32>);
+            case Insn::OR_RM64_RM64: return rr64(&execOpRegReg<Size::QWORD, Impl::or64>, &execOpRegMem<Size::QWORD, Impl::or64>);
+            case Insn::OR_RM32_IMM: return reg32(&execOpRegImm<Size::DWORD, Impl::or32>);
+            case Insn::OR_RM64_IMM: return reg64(&execOpRegImm<Size::QWORD, Impl::or64>);
+            case Insn::XOR_RM32_RM32: return rr32(&execOpRegReg<Size::DWORD, Impl::xor32>, &execOpRegMem<Size::DWORD, Impl::xor32>);
+            case Insn::XOR_RM64_RM64: return rr64(&execOpRegReg<Size::QWORD, Impl::xor64>, &execOpRegMem<Size::QWORD, Impl::xor64>);
+            case Insn::XOR_RM32_IMM: return reg32(&execOpRegImm<Size::DWORD, Impl::xor32>);
+            case Insn::XOR_RM64_IMM: return reg64(&execOpRegImm<Size::QWORD, Impl::xor64>);
+            case Insn::CMP_RM32_RM32: return rr32(&execCompareRegReg<Size::DWORD, Impl::cmp32>, &execCompareRegMem<Size::DWORD, Impl::cmp32>);
+            case Insn::CMP_RM64_RM64: return rr64(&execCompareRegReg<Size::QWORD, Impl::cmp64>, &execCompareRegMem<Size::QWORD, Impl::cmp64>);
+            case Insn::CMP_RM32_IMM: return reg32(&execCompareRegImm<Size::DWORD, Impl::cmp32>);
+            case Insn::CMP_RM64_IMM: return reg64(&execCompareRegImm<Size::QWORD, Impl::cmp64>);
+            case Insn::TEST_RM32_R32: return reg32(&execTestRegReg<Size::DWORD>);
+            case Insn::TEST_RM64_R64: return reg64(&execTestRegReg<Size::QWORD>);
+            case Insn::TEST_RM32_IMM: return reg32(&execCompareRegImm<Size::DWORD, Impl::test32>);
+            case Insn::TEST_RM64_IMM: return reg64(&execCompareRegImm<Size::QWORD, Impl::test64>);
+            case Insn::INC_RM32: return reg32(&execOpReg<Size::DWORD, Impl::inc32>);
+            case Insn::INC_RM64: return reg64(&execOpReg<Size::QWORD, Impl::inc64>);
+            case Insn::DEC_RM32: return reg32(&execOpReg<Size::DWORD, Impl::dec32>);
+            case Insn::DEC_RM64: return reg64(&execOpReg<Size::QWORD, Impl::dec64>);
+            case Insn::MOV_R8_R8:
+            case Insn::MOV_R8_IMM:
+            case Insn::MOV_R16_R16:
+            case Insn::MOV_R16_IMM:
+            case Insn::MOV_R32_R32:
+            case Insn::MOV_R32_IMM:
+            case Insn::MOV_R64_R64:
+            case Insn::MOV_R64_IMM: return ThreadedInstruction{generic.exec, false};
+            case Insn::LEA_R64_ENCODING64: return ThreadedInstruction{generic.exec, ins.op1<Encoding64>().base == R64::RIP};
+            default: return generic;
         }
     }
 
@@ -1923,7 +2049,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
         const auto& src = ins.op1<RM8>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::add8(oldValue, get(src), &flags_);
         });
     }
@@ -1931,7 +2057,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::add8(oldValue, get<u8>(src), &flags_);
         });
     }
@@ -1939,7 +2065,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& src = ins.op1<RM16>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::add16(oldValue, get(src), &flags_);
         });
     }
@@ -1947,7 +2073,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::add16(oldValue, get<u16>(src), &flags_);
         });
     }
@@ -1955,7 +2081,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& src = ins.op1<RM32>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::add32(oldValue, get(src), &flags_);
         });
     }
@@ -1963,7 +2089,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::add32(oldValue, get<u32>(src), &flags_);
         });
     }
@@ -1971,7 +2097,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& src = ins.op1<RM64>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::add64(oldValue, get(src), &flags_);
         });
     }
@@ -1979,7 +2105,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::add64(oldValue, get<u64>(src), &flags_);
         });
     }
@@ -2070,7 +2196,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
         const auto& src = ins.op1<RM8>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::sub8(oldValue, get(src), &flags_);
         });
     }
@@ -2078,7 +2204,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::sub8(oldValue, get<u8>(src), &flags_);
         });
     }
@@ -2086,7 +2212,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& src = ins.op1<RM16>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::sub16(oldValue, get(src), &flags_);
         });
     }
@@ -2094,7 +2220,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::sub16(oldValue, get<u16>(src), &flags_);
         });
     }
@@ -2102,7 +2228,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& src = ins.op1<RM32>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::sub32(oldValue, get(src), &flags_);
         });
     }
@@ -2110,7 +2236,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::sub32(oldValue, get<u32>(src), &flags_);
         });
     }
@@ -2118,7 +2244,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& src = ins.op1<RM64>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::sub64(oldValue, get(src), &flags_);
         });
     }
@@ -2126,7 +2252,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::sub64(oldValue, get<u64>(src), &flags_);
         });
     }
@@ -2402,7 +2528,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
         const auto& src = ins.op1<RM8>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::or8(oldValue, get(src), &flags_);
         });
     }
@@ -2410,7 +2536,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::or8(oldValue, get<u8>(src), &flags_);
         });
     }
@@ -2418,7 +2544,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& src = ins.op1<RM16>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::or16(oldValue, get(src), &flags_);
         });
     }
@@ -2426,7 +2552,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::or16(oldValue, get<u16>(src), &flags_);
         });
     }
@@ -2434,7 +2560,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& src = ins.op1<RM32>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::or32(oldValue, get(src), &flags_);
         });
     }
@@ -2442,7 +2568,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::or32(oldValue, get<u32>(src), &flags_);
         });
     }
@@ -2450,7 +2576,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& src = ins.op1<RM64>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::or64(oldValue, get(src), &flags_);
         });
     }
@@ -2458,7 +2584,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& src = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::or64(oldValue, get<u64>(src), &flags_);
         });
     }
@@ -2593,11 +2719,10 @@ namespace x64 {
         const auto& src = ins.op1<R8>();
         Ptr8 address = resolve(dst);
         u8 srcValue = get(src);
-        mmu_->withExclusiveRegion(address, [&](u8 oldValue) -> u8 {
-            u8 newValue = Impl::add8(oldValue, srcValue, &flags_);
-            set(src, oldValue);
-            return newValue;
+        u8 oldValue = mmu_->atomicModify(address, [&](u8 oldValue) -> u8 {
+            return Impl::add8(oldValue, srcValue, &flags_);
         });
+        set(src, oldValue);
     }
     void Cpu::execLockXaddM16R16(const X64Instruction& ins) {
         assert(ins.lock());
@@ -2605,11 +2730,10 @@ namespace x64 {
         const auto& src = ins.op1<R16>();
         Ptr16 address = resolve(dst);
         u16 srcValue = get(src);
-        mmu_->withExclusiveRegion(address, [&](u16 oldValue) -> u16 {
-            u16 newValue = Impl::add16(oldValue, srcValue, &flags_);
-            set(src, oldValue);
-            return newValue;
+        u16 oldValue = mmu_->atomicModify(address, [&](u16 oldValue) -> u16 {
+            return Impl::add16(oldValue, srcValue, &flags_);
         });
+        set(src, oldValue);
     }
     void Cpu::execLockXaddM32R32(const X64Instruction& ins) {
         assert(ins.lock());
@@ -2617,11 +2741,10 @@ namespace x64 {
         const auto& src = ins.op1<R32>();
         Ptr32 address = resolve(dst);
         u32 srcValue = get(src);
-        mmu_->withExclusiveRegion(address, [&](u32 oldValue) -> u32 {
-            u32 newValue = Impl::add32(oldValue, srcValue, &flags_);
-            set(src, oldValue);
-            return newValue;
+        u32 oldValue = mmu_->atomicModify(address, [&](u32 oldValue) -> u32 {
+            return Impl::add32(oldValue, srcValue, &flags_);
         });
+        set(src, oldValue);
     }
     void Cpu::execLockXaddM64R64(const X64Instruction& ins) {
         assert(ins.lock());
@@ -2629,11 +2752,10 @@ namespace x64 {
         const auto& src = ins.op1<R64>();
         Ptr64 address = resolve(dst);
         u64 srcValue = get(src);
-        mmu_->withExclusiveRegion(address, [&](u64 oldValue) -> u64 {
-            u64 newValue = Impl::add64(oldValue, srcValue, &flags_);
-            set(src, oldValue);
-            return newValue;
+        u64 oldValue = mmu_->atomicModify(address, [&](u64 oldValue) -> u64 {
+            return Impl::add64(oldValue, srcValue, &flags_);
         });
+        set(src, oldValue);
     }
 
     template<typename T, typename U> T narrow(const U& val);
@@ -2977,28 +3099,28 @@ namespace x64 {
     void Cpu::execLockIncM8(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::inc8(oldValue, &flags_);
         });
     }
     void Cpu::execLockIncM16(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::inc16(oldValue, &flags_);
         });
     }
     void Cpu::execLockIncM32(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::inc32(oldValue, &flags_);
         });
     }
     void Cpu::execLockIncM64(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::inc64(oldValue, &flags_);
         });
     }
@@ -3023,28 +3145,28 @@ namespace x64 {
     void Cpu::execLockDecM8(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M8>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u8 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u8 oldValue) {
             return Impl::dec8(oldValue, &flags_);
         });
     }
     void Cpu::execLockDecM16(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::dec16(oldValue, &flags_);
         });
     }
     void Cpu::execLockDecM32(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::dec32(oldValue, &flags_);
         });
     }
     void Cpu::execLockDecM64(const X64Instruction& ins) {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::dec64(oldValue, &flags_);
         });
     }
@@ -3573,7 +3695,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& bit = ins.op1<R16>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::bts16(oldValue, get(bit), &flags_);
         });
     }
@@ -3581,7 +3703,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M16>();
         const auto& bit = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u16 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u16 oldValue) {
             return Impl::bts16(oldValue, get<u16>(bit), &flags_);
         });
     }
@@ -3589,7 +3711,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& bit = ins.op1<R32>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::bts32(oldValue, get(bit), &flags_);
         });
     }
@@ -3597,7 +3719,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M32>();
         const auto& bit = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u32 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u32 oldValue) {
             return Impl::bts32(oldValue, get<u32>(bit), &flags_);
         });
     }
@@ -3605,7 +3727,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& bit = ins.op1<R64>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::bts64(oldValue, get(bit), &flags_);
         });
     }
@@ -3613,7 +3735,7 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M64>();
         const auto& bit = ins.op1<Imm>();
-        mmu_->withExclusiveRegion(resolve(dst), [&](u64 oldValue) {
+        mmu_->atomicModify(resolve(dst), [&](u64 oldValue) {
             return Impl::bts64(oldValue, get<u64>(bit), &flags_);
         });
     }
@@ -3705,7 +3827,7 @@ namespace x64 {
         u8 eax = get(R8::AL);
         u8 dest = get(dst);
         Impl::cmpxchg8(eax, dest, &flags_);
-        if(flags_.zero == 1) {
+        if(flags_.zero() == 1) {
             set(dst, src);
         } else {
             set(R8::AL, dest);
@@ -3717,7 +3839,7 @@ namespace x64 {
         u16 eax = get(R16::AX);
         u16 dest = get(dst);
         Impl::cmpxchg16(eax, dest, &flags_);
-        if(flags_.zero == 1) {
+        if(flags_.zero() == 1) {
             set(dst, src);
         } else {
             set(R16::AX, dest);
@@ -3729,7 +3851,7 @@ namespace x64 {
         u32 eax = get(R32::EAX);
         u32 dest = get(dst);
         Impl::cmpxchg32(eax, dest, &flags_);
-        if(flags_.zero == 1) {
+        if(flags_.zero() == 1) {
             set(dst, src);
         } else {
             set(R32::EAX, dest);
@@ -3741,7 +3863,7 @@ namespace x64 {
         u64 rax = get(R64::RAX);
         u64 dest = get(dst);
         Impl::cmpxchg64(rax, dest, &flags_);
-        if(flags_.zero == 1) {
+        if(flags_.zero() == 1) {
             set(dst, src);
         } else {
             set(R64::RAX, dest);
@@ -3750,54 +3872,38 @@ namespace x64 {
 
     void Cpu::execLockCmpxchg8Impl(Ptr8 dst, u8 src) {
         u8 eax = get(R8::AL);
-        mmu_->withExclusiveRegion(dst, [&](u8 oldValue) {
+        u8 oldValue = mmu_->atomicModify(dst, [&](u8 oldValue) {
             Impl::cmpxchg8(eax, oldValue, &flags_);
-            if(flags_.zero == 1) {
-                return src;
-            } else {
-                set(R8::AL, oldValue);
-                return oldValue;
-            }
+            return flags_.zero() == 1 ? src : oldValue;
         });
+        if(flags_.zero() == 0) set(R8::AL, oldValue);
     }
 
     void Cpu::execLockCmpxchg16Impl(Ptr16 dst, u16 src) {
         u16 eax = get(R16::AX);
-        mmu_->withExclusiveRegion(dst, [&](u16 oldValue) {
+        u16 oldValue = mmu_->atomicModify(dst, [&](u16 oldValue) {
             Impl::cmpxchg16(eax, oldValue, &flags_);
-            if(flags_.zero == 1) {
-                return src;
-            } else {
-                set(R16::AX, oldValue);
-                return oldValue;
-            }
+            return flags_.zero() == 1 ? src : oldValue;
         });
+        if(flags_.zero() == 0) set(R16::AX, oldValue);
     }
 
     void Cpu::execLockCmpxchg32Impl(Ptr32 dst, u32 src) {
         u32 eax = get(R32::EAX);
-        mmu_->withExclusiveRegion(dst, [&](u32 oldValue) {
+        u32 oldValue = mmu_->atomicModify(dst, [&](u32 oldValue) {
             Impl::cmpxchg32(eax, oldValue, &flags_);
-            if(flags_.zero == 1) {
-                return src;
-            } else {
-                set(R32::EAX, oldValue);
-                return oldValue;
-            }
+            return flags_.zero() == 1 ? src : oldValue;
         });
+        if(flags_.zero() == 0) set(R32::EAX, oldValue);
     }
 
     void Cpu::execLockCmpxchg64Impl(Ptr64 dst, u64 src) {
         u64 eax = get(R64::RAX);
-        mmu_->withExclusiveRegion(dst, [&](u64 oldValue) {
+        u64 oldValue = mmu_->atomicModify(dst, [&](u64 oldValue) {
             Impl::cmpxchg64(eax, oldValue, &flags_);
-            if(flags_.zero == 1) {
-                return src;
-            } else {
-                set(R64::RAX, oldValue);
-                return oldValue;
-            }
+            return flags_.zero() == 1 ? src : oldValue;
         });
+        if(flags_.zero() == 0) set(R64::RAX, oldValue);
     }
 
     void Cpu::execCmpxchgRM8R8(const X64Instruction& ins) {
@@ -3826,11 +3932,11 @@ namespace x64 {
         u128 regs { get(R64::RAX), get(R64::RDX) };
         u128 dest = get(resolve(dst));
         if(dest == regs) {
-            flags_.zero = true;
+            flags_.setZero(true);
             u128 newValue { get(R64::RBX), get(R64::RCX) };
             set(resolve(dst), newValue);
         } else {
-            flags_.zero = false;
+            flags_.setZero(false);
             set(R64::RAX, dest.lo);
             set(R64::RDX, dest.hi);
         }
@@ -3864,18 +3970,16 @@ namespace x64 {
         assert(ins.lock());
         const auto& dst = ins.op0<M128>();
         auto ptr = resolve(dst);
-        mmu_->withExclusiveRegion(ptr, [&](u128 oldValue) -> u128 {
-            u128 regs { get(R64::RAX), get(R64::RDX) };
-            if(oldValue == regs) {
-                flags_.zero = true;
-                return u128 { get(R64::RBX), get(R64::RCX) };
-            } else {
-                flags_.zero = false;
-                set(R64::RAX, oldValue.lo);
-                set(R64::RDX, oldValue.hi);
-                return oldValue;
-            }
+        u128 regs { get(R64::RAX), get(R64::RDX) };
+        u128 newValue { get(R64::RBX), get(R64::RCX) };
+        u128 oldValue = mmu_->atomicModify(ptr, [&](u128 oldValue) -> u128 {
+            flags_.setZero(oldValue == regs);
+            return flags_.zero() ? newValue : oldValue;
         });
+        if(!flags_.zero()) {
+            set(R64::RAX, oldValue.lo);
+            set(R64::RDX, oldValue.hi);
+        }
     }
 
     template<typename Dst>
@@ -4170,7 +4274,7 @@ namespace x64 {
             ++s2ptr;
             --counter;
             Impl::cmp8(s1, s2, &flags_);
-            if(flags_.zero == 0) break;
+            if(flags_.zero() == 0) break;
         }
         set(R64::RCX, counter);
         verify(src1.encoding.base == R64::RSI);
@@ -4300,7 +4404,7 @@ namespace x64 {
             Impl::cmp8(src1Value, src2Value, &flags_);
             ++ptr2;
             --counter;
-            if(flags_.zero) break;
+            if(flags_.zero()) break;
         }
         set(R64::RCX, counter);
         set(R64::RDI, ptr2.address());
@@ -4319,7 +4423,7 @@ namespace x64 {
             Impl::cmp16(src1Value, src2Value, &flags_);
             ++ptr2;
             --counter;
-            if(flags_.zero) break;
+            if(flags_.zero()) break;
         }
         set(R64::RCX, counter);
         set(R64::RDI, ptr2.address());
@@ -4338,7 +4442,7 @@ namespace x64 {
             Impl::cmp32(src1Value, src2Value, &flags_);
             ++ptr2;
             --counter;
-            if(flags_.zero) break;
+            if(flags_.zero()) break;
         }
         set(R64::RCX, counter);
         set(R64::RDI, ptr2.address());
@@ -4357,7 +4461,7 @@ namespace x64 {
             Impl::cmp64(src1Value, src2Value, &flags_);
             ++ptr2;
             --counter;
-            if(flags_.zero) break;
+            if(flags_.zero()) break;
         }
         set(R64::RCX, counter);
         set(R64::RDI, ptr2.address());
@@ -4580,7 +4684,7 @@ namespace x64 {
     }
 
     void Cpu::execFaddM64(const X64Instruction& ins) {
-        const auto& src = ins.op0<M32>();
+        const auto& src = ins.op0<M64>();
         f80 topValue = x87fpu_.st(ST::ST0);
         f80 srcValue = F80::bitcastFromU64(get(resolve(src)));
         x87fpu_.set(ST::ST0, Impl::fadd(topValue, srcValue, &x87fpu_)); // NOLINT(readability-suspicious-call-argument)
@@ -17,34 +17,29 @@ namespace x64 {
     using i128 = __int128_t;
 #endif
 
-    template<typename U, typename I>
+    template<typename U>
     static U add(U dst, U src, Flags* flags) {
         U res = dst + src;
-        flags->zero = res == 0;
-        flags->carry = (dst > std::numeric_limits<U>::max() - src);
-        I sres = (I)((i128)dst + (i128)src);
-        flags->overflow = ((I)dst >= 0 && (I)src >= 0 && sres < 0) || ((I)dst < 0 && (I)src < 0 && sres >= 0);
-        flags->sign = (sres < 0);
-        flags->deferParity((u8)res);
+        flags->setLazy(Flags::LazyOp::ADD, dst, src, res);
         return res;
     }
 
-    u8 CpuImpl::add8(u8 dst, u8 src, Flags* flags) { return add<u8, i8>(dst, src, flags); }
-    u16 CpuImpl::add16(u16 dst, u16 src, Flags* flags) { return add<u16, i16>(dst, src, flags); }
-    u32 CpuImpl::add32(u32 dst, u32 src, Flags* flags) { return add<u32, i32>(dst, src, flags); }
-    u64 CpuImpl::add64(u64 dst, u64 src, Flags* flags) { return add<u64, i64>(dst, src, flags); }
+    u8 CpuImpl::add8(u8 dst, u8 src, Flags* flags) { return add<u8>(dst, src, flags); }
+    u16 CpuImpl::add16(u16 dst, u16 src, Flags* flags) { return add<u16>(dst, src, flags); }
+    u32 CpuImpl::add32(u32 dst, u32 src, Flags* flags) { return add<u32>(dst, src, flags); }
+    u64 CpuImpl::add64(u64 dst, u64 src, Flags* flags) { return add<u64>(dst, src, flags); }
 
 
 
     template<typename U, typename I>
     static U adc(U dst, U src, Flags* flags) {
-        U c = flags->carry;
+        U c = flags->carry();
         U res = (U)(dst + src + c);
-        flags->zero = res == 0;
-        flags->carry = (c == 1 && src == (U)(-1)) || (dst > std::numeric_limits<U>::max() - (U)(src + c));
+        flags->setZero(res == 0);
+        flags->setCarry((c == 1 && src == (U)(-1)) || (dst > std::numeric_limits<U>::max() - (U)(src + c)));
         I sres = (I)((i128)dst + (i128)src + (i128)c);
-        flags->overflow = ((I)dst >= 0 && (I)src >= 0 && sres < 0) || ((I)dst < 0 && (I)src < 0 && sres >= 0);
-        flags->sign = (sres < 0);
+        flags->setOverflow(((I)dst >= 0 && (I)src >= 0 && sres < 0) || ((I)dst < 0 && (I)src < 0 && sres >= 0));
+        flags->setSign(sres < 0);
         flags->deferParity((u8)res);
         return res;
     }
@@ -54,32 +49,27 @@ namespace x64 {
     u32 CpuImpl::adc32(u32 dst, u32 src, Flags* flags) { return adc<u32, i32>(dst, src, flags); }
     u64 CpuImpl::adc64(u64 dst, u64 src, Flags* flags) { return adc<u64, i64>(dst, src, flags); }
 
-    template<typename U, typename I>
+    template<typename U>
     static U sub(U dst, U src, Flags* flags) {
         U res = dst - src;
-        flags->zero = res == 0;
-        flags->carry = (dst < src);
-        I sres = (I)((i128)dst - (i128)src);
-        flags->overflow = ((I)dst >= 0 && (I)src < 0 && sres < 0) || ((I)dst < 0 && (I)src >= 0 && sres >= 0);
-        flags->sign = (sres < 0);
-        flags->deferParity((u8)res);
+        flags->setLazy(Flags::LazyOp::SUB, dst, src, res);
         return res;
     }
 
-    u8 CpuImpl::sub8(u8 dst, u8 src, Flags* flags) { return sub<u8, i8>(dst, src, flags); }
-    u16 CpuImpl::sub16(u16 dst, u16 src, Flags* flags) { return sub<u16, i16>(dst, src, flags); }
-    u32 CpuImpl::sub32(u32 dst, u32 src, Flags* flags) { return sub<u32, i32>(dst, src, flags); }
-    u64 CpuImpl::sub64(u64 dst, u64 src, Flags* flags) { return sub<u64, i64>(dst, src, flags); }
+    u8 CpuImpl::sub8(u8 dst, u8 src, Flags* flags) { return sub<u8>(dst, src, flags); }
+    u16 CpuImpl::sub16(u16 dst, u16 src, Flags* flags) { return sub<u16>(dst, src, flags); }
+    u32 CpuImpl::sub32(u32 dst, u32 src, Flags* flags) { return sub<u32>(dst, src, flags); }
+    u64 CpuImpl::sub64(u64 dst, u64 src, Flags* flags) { return sub<u64>(dst, src, flags); }
 
     template<typename U, typename I>
     static U sbb(U dst, U src, Flags* flags) {
-        U c = flags->carry;
+        U c = flags->carry();
         U res = dst - (U)(src + c);
-        flags->zero = res == 0;
-        flags->carry = (c == 1 && src == (U)(-1)) || (dst < src + c);
+        flags->setZero(res == 0);
+        flags->setCarry((c == 1 && src == (U)(-1)) || (dst < src + c));
         I sres = (I)((i128)dst - (I)((i128)src + (i128)c));
-        flags->overflow = ((I)dst >= 0 && (I)src < 0 && sres < 0) || ((I)dst < 0 && (I)src >= 0 && sres >= 0);
-        flags->sign = (sres < 0);
+        flags->setOverflow(((I)dst >= 0 && (I)src < 0 && sres < 0) || ((I)dst < 0 && (I)src >= 0 && sres >= 0));
+        flags->setSign(sres < 0);
         flags->deferParity((u8)res);
         return res;
     }
@@ -115,8 +105,8 @@ namespace x64 {
         u16 prod = (u16)src1 * (u16)src2;
         u8 upper = static_cast<u8>(prod >> 8);
         u8 lower = (u8)prod;
-        flags->overflow = !!upper;
-        flags->carry = !!upper;
+        flags->setOverflow(!!upper);
+        flags->setCarry(!!upper);
         return std::make_pair(upper, lower);
     }
 
@@ -124,8 +114,8 @@ namespace x64 {
         u32 prod = (u32)src1 * (u32)src2;
         u16 upper = static_cast<u16>(prod >> 16);
         u16 lower = (u16)prod;
-        flags->overflow = !!upper;
-        flags->carry = !!upper;
+        flags->setOverflow(!!upper);
+        flags->setCarry(!!upper);
         return std::make_pair(upper, lower);
     }
 
@@ -133,8 +123,8 @@ namespace x64 {
         u64 prod = (u64)src1 * (u64)src2;
         u32 upper = static_cast<u32>(prod >> 32);
         u32 lower = (u32)prod;
-        flags->overflow = !!upper;
-        flags->carry = !!upper;
+        flags->setOverflow(!!upper);
+        flags->setCarry(!!upper);
         return std::make_pair(upper, lower);
     }
 
@@ -154,29 +144,29 @@ namespace x64 {
         u64 lower = bd + (adbc << 32);
         u64 upper = ac + (adbc >> 32) + ((u64)adbc_carry << 32) + lower_carry;
 
-        flags->overflow = !!upper;
-        flags->carry = !!upper;
+        flags->setOverflow(!!upper);
+        flags->setCarry(!!upper);
         return std::make_pair(upper, lower);
     }
 
     std::pair<u16, u16> CpuImpl::imul16(u16 src1, u16 src2, Flags* flags) {
         i32 tmp = (i32)(i16)src1 * (i32)(i16)src2;
-        flags->carry = (tmp != (i32)(i16)tmp);
-        flags->overflow = (tmp != (i32)(i16)tmp);
+        flags->setCarry(tmp != (i32)(i16)tmp);
+        flags->setOverflow(tmp != (i32)(i16)tmp);
         return std::make_pair((u16)(tmp >> 16), (u16)tmp);
     }
 
     std::pair<u32, u32> CpuImpl::imul32(u32 src1, u32 src2, Flags* flags) {
         i64 tmp = (i64)(i32)src1 * (i64)(i32)src2;
-        flags->carry = (tmp != (i64)(i32)tmp);
-        flags->overflow = (tmp != (i64)(i32)tmp);
+        flags->setCarry(tmp != (i64)(i32)tmp);
+        flags->setOverflow(tmp != (i64)(i32)tmp);
         return std::make_pair((u32)(tmp >> 32), (u32)tmp);
     }
 
     std::pair<u64, u64> CpuImpl::imul64(u64 src1, u64 src2, Flags* flags) {
         if(src1 == 0 || src2 == 0) {
-            flags->carry = false;
-            flags->overflow = false;
+            flags->setCarry(false);
+            flags->setOverflow(false);
             return std::make_pair(0, 0);
         }
 
@@ -199,8 +189,8 @@ namespace x64 {
         bool differentSignExtention = ((i64)lower < 0 && upper != (u64)(-1))
                                 || ((i64)lower >= 0 && upper != 0);
         
-        flags->carry = differentSignExtention;
-        flags->overflow = differentSignExtention;
+        flags->setCarry(differentSignExtention);
+        flags->setOverflow(differentSignExtention);
         return std::make_pair(upper, lower);
     }
 
@@ -251,11 +241,7 @@ namespace x64 {
     template<typename U>
     static U and_(U dst, U src, Flags* flags) {
         U tmp = dst & src;
-        flags->overflow = false;
-        flags->carry = false;
-        flags->sign = signBit<U>(tmp);
-        flags->zero = (tmp == 0);
-        flags->deferParity((u8)tmp);
+        flags->setLazy(Flags::LazyOp::LOGIC, dst, src, tmp);
         return tmp;
     }
 
@@ -267,11 +253,7 @@ namespace x64 {
     template<typename U>
     static U or_(U dst, U src, Flags* flags) {
         U tmp = dst | src;
-        flags->overflow = false;
-        flags->carry = false;
-        flags->sign = signBit<U>(tmp);
-        flags->zero = (tmp == 0);
-        flags->deferParity((u8)tmp);
+        flags->setLazy(Flags::LazyOp::LOGIC, dst, src, tmp);
         return tmp;
     }
 
@@ -283,11 +265,7 @@ namespace x64 {
     template<typename U>
     static U xor_(U dst, U src, Flags* flags) {
         U tmp = dst ^ src;
-        flags->overflow = false;
-        flags->carry = false;
-        flags->sign = signBit<U>(tmp);
-        flags->zero = (tmp == 0);
-        flags->deferParity((u8)tmp);
+        flags->setLazy(Flags::LazyOp::LOGIC, dst, src, tmp);
         return tmp;
     }
 
@@ -298,11 +276,8 @@ namespace x64 {
 
     template<typename U>
     static U inc(U src, Flags* flags) {
-        flags->overflow = (src == (U)std::numeric_limits<std::make_signed_t<U>>::max());
         U res = src+1;
-        flags->sign = signBit<U>(res);
-        flags->zero = (res == 0);
-        flags->deferParity((u8)res);
+        flags->setLazy(Flags::LazyOp::INC, src, (U)1, res);
         return res;
     }
 
@@ -313,11 +288,8 @@ namespace x64 {
 
     template<typename U>
     static U dec(U src, Flags* flags) {
-        flags->overflow = (src == (U)std::numeric_limits<std::make_signed_t<U>>::min());
         U res = src-1;
-        flags->sign = signBit<U>(res);
-        flags->zero = (res == 0);
-        flags->deferParity((u8)res);
+        flags->setLazy(Flags::LazyOp::DEC, src, (U)1, res);
         return res;
     }
 
@@ -332,12 +304,12 @@ namespace x64 {
         src = src & srcMask;
         U res = static_cast<U>(dst << src);
         if(src) {
-            flags->carry = dst & ((U)1 << (8*sizeof(U) - src));
+            flags->setCarry(dst & ((U)1 << (8*sizeof(U) - src)));
             if(src == 1) {
-                flags->overflow = signBit<U>(res) != flags->carry;
+                flags->setOverflow(signBit<U>(res) != flags->carry());
             }
-            flags->sign = signBit<U>(res);
-            flags->zero = (res == 0);
+            flags->setSign(signBit<U>(res));
+            flags->setZero(res == 0);
             flags->deferParity((u8)res);
         }
         return res;
@@ -354,12 +326,12 @@ namespace x64 {
         src = src & srcMask;
         U res = static_cast<U>(dst >> src);
         if(src) {
-            flags->carry = dst & ((U)1 << (src-1));
+            flags->setCarry(dst & ((U)1 << (src-1)));
             if(src == 1) {
-                flags->overflow = signBit<U>(dst);
+                flags->setOverflow(signBit<U>(dst));
             }
-            flags->sign = signBit<U>(res);
-            flags->zero = (res == 0);
+            flags->setSign(signBit<U>(res));
+            flags->setZero(res == 0);
             flags->deferParity((u8)res);
         }
         return res;
@@ -376,13 +348,13 @@ namespace x64 {
         count = count % size;
         if(count == 0) return dst;
         U res = (U)(dst << count) | (U)(src >> (size-count));
-        flags->carry = dst & (size-count);
-        flags->sign = (res & ((U)1 << (size-1)));
-        flags->zero = (res == 0);
+        flags->setCarry(dst & (size-count));
+        flags->setSign(res & ((U)1 << (size-1)));
+        flags->setZero(res == 0);
         flags->deferParity((u8)res);
         if(count == 1) {
             U signMask = (U)1 << (size-1);
-            flags->overflow = (dst & signMask) ^ (res & signMask);
+            flags->setOverflow((dst & signMask) ^ (res & signMask));
         }
         return res;
     }
@@ -396,13 +368,13 @@ namespace x64 {
         count = count % size;
         if(count == 0) return dst;
         U res = (U)(dst >> count) | (U)(src << (size-count));
-        flags->carry = dst & (count-1);
-        flags->sign = (res & ((U)1 << (size-1)));
-        flags->zero = (res == 0);
+        flags->setCarry(dst & (count-1));
+        flags->setSign(res & ((U)1 << (size-1)));
+        flags->setZero(res == 0);
         flags->deferParity((u8)res);
         if(count == 1) {
             U signMask = (U)1 << (size-1);
-            flags->overflow = (dst & signMask) ^ (res & signMask);
+            flags->setOverflow((dst & signMask) ^ (res & signMask));
         }
         return res;
     }
@@ -418,12 +390,12 @@ namespace x64 {
         using I = std::make_signed_t<U>;
         I res = (I)(((I)dst) >> src);
         if(src == 1) {
-            flags->overflow = 0;
+            flags->setOverflow(false);
         }
         if(src) {
-            flags->carry = ((I)dst) & ((I)1 << (src-1));
-            flags->sign = signBit<U>((U)res);
-            flags->zero = (res == 0);
+            flags->setCarry(((I)dst) & ((I)1 << (src-1)));
+            flags->setSign(signBit<U>((U)res));
+            flags->setZero(res == 0);
             flags->deferParity((u8)res);
         }
         return (U)res;
@@ -439,16 +411,16 @@ namespace x64 {
         constexpr u8 size = sizeof(U)*8;
         u8 tmpcount = (count & (size == 64 ? 0x3F : 0x1F)) % (size+1);
         U res = val;
-        bool cf = flags->carry;
+        bool cf = flags->carry();
         while(tmpcount != 0) {
             bool tmpcf = (res & (U)((U)1 << (size-1)));
             res = (U)(2*(U)res+(U)cf);
             cf = tmpcf;
             --tmpcount;
         }
-        flags->carry = cf;
+        flags->setCarry(cf);
         if(count == 1) {
-            flags->overflow = (res >> (size-1)) ^ flags->carry;
+            flags->setOverflow((res >> (size-1)) ^ flags->carry());
         }
         return res;
     }
@@ -462,18 +434,18 @@ namespace x64 {
     U rcr(U val, u8 count, Flags* flags) {
         constexpr u8 size = sizeof(U)*8;
         if(count == 1) {
-            flags->overflow = (val & (U)((U)1 << (size-1))) ^ flags->carry;
+            flags->setOverflow((val & (U)((U)1 << (size-1))) ^ flags->carry());
         }
         u8 tmpcount = (count & (size == 64 ? 0x3F : 0x1F)) % (size+1);
         U res = val;
-        bool cf = flags->carry;
+        bool cf = flags->carry();
         while(tmpcount != 0) {
             bool tmpcf = (res & (U)1);
             res = (U)((U)res/2 | (U)((U)cf << (size-1)));
             cf = tmpcf;
             --tmpcount;
         }
-        flags->carry = cf;
+        flags->setCarry(cf);
         return res;
     }
  
@@ -489,10 +461,10 @@ namespace x64 {
         U res = val;
         if(count) res = (U)(val << count) | (U)(val >> (size-count));
         if(count) {
-            flags->carry = res & 0x1;
+            flags->setCarry(res & 0x1);
         }
         if(count == 1) {
-            flags->overflow = (res >> (size-1)) ^ flags->carry;
+            flags->setOverflow((res >> (size-1)) ^ flags->carry());
         }
         return res;
     }
@@ -508,10 +480,10 @@ namespace x64 {
         count = (count & (size == 64 ? 0x3F : 0x1F)) % size;
         U res = (U)(val >> count) | (U)(val << (size-count));
         if(count) {
-            flags->carry = res & ((U)1 << (size-1));
+            flags->setCarry(res & ((U)1 << (size-1)));
         }
         if(count == 1) {
-            flags->overflow = (res >> (size-1)) ^ ((res >> (size-2)) & 0x1);;
+            flags->setOverflow((res >> (size-1)) ^ ((res >> (size-2)) & 0x1));;
         }
         return res;
     }
@@ -529,8 +501,8 @@ namespace x64 {
             ++tmp;
             ++res;
         }
-        flags->carry = (res == 8*sizeof(U));
-        flags->zero = (res == 0);
+        flags->setCarry(res == 8*sizeof(U));
+        flags->setZero(res == 0);
         return res;
     }
 
@@ -553,11 +525,11 @@ namespace x64 {
 
     template<typename U>
     U popcnt(U src, Flags* flags) {
-        flags->overflow = 0;
-        flags->sign = 0;
-        flags->zero = (src == 0);
+        flags->setOverflow(false);
+        flags->setSign(false);
+        flags->setZero(src == 0);
         flags->setParity(false);
-        flags->carry = 0;
+        flags->setCarry(false);
         U res = (U)0;
         for(size_t i = 0; i < 8*sizeof(U); ++i) {
             res += src & 0x1;
@@ -574,7 +546,7 @@ namespace x64 {
     void bt(U base, U index, Flags* flags) {
         U size = 8*sizeof(U);
         index = index % size;
-        flags->carry = (base >> index) & 0x1;
+        flags->setCarry((base >> index) & 0x1);
     }
 
     void CpuImpl::bt16(u16 base, u16 index, Flags* flags) { return bt<u16>(base, index, flags); }
@@ -585,7 +557,7 @@ namespace x64 {
     U btr(U base, U index, Flags* flags) {
         U size = 8*sizeof(U);
         index = index % size;
-        flags->carry = (base >> index) & 0x1;
+        flags->setCarry((base >> index) & 0x1);
         return (U)(base & ~((U)1 << index));
     }
 
@@ -597,7 +569,7 @@ namespace x64 {
     U btc(U base, U index, Flags* flags) {
         U size = 8*sizeof(U);
         index = index % size;
-        flags->carry = (base >> index) & 0x1;
+        flags->setCarry((base >> index) & 0x1);
         U mask = (U)((U)1 << index);
         return (base & ~mask) | (~base & mask);
     }
@@ -610,7 +582,7 @@ namespace x64 {
     U bts(U base, U index, Flags* flags) {
         U size = 8*sizeof(U);
         index = index % size;
-        flags->carry = (base >> index) & 0x1;
+        flags->setCarry((base >> index) & 0x1);
         U mask = (U)((U)1 << index);
         return (base & ~mask) | mask;
     }
@@ -622,10 +594,10 @@ namespace x64 {
     template<typename U>
     void test(U src1, U src2, Flags* flags) {
         U tmp = src1 & src2;
-        flags->sign = signBit<U>(tmp);
-        flags->zero = (tmp == 0);
-        flags->overflow = 0;
-        flags->carry = 0;
+        flags->setSign(signBit<U>(tmp));
+        flags->setZero(tmp == 0);
+        flags->setOverflow(false);
+        flags->setCarry(false);
         flags->deferParity((u8)tmp);
     }
 
@@ -637,42 +609,42 @@ namespace x64 {
     void CpuImpl::cmpxchg8(u8 al, u8 dest, Flags* flags) {
         CpuImpl::cmp8(al, dest, flags);
         if(al == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     void CpuImpl::cmpxchg16(u16 ax, u16 dest, Flags* flags) {
         CpuImpl::cmp16(ax, dest, flags);
         if(ax == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     void CpuImpl::cmpxchg32(u32 eax, u32 dest, Flags* flags) {
         CpuImpl::cmp32(eax, dest, flags);
         if(eax == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     void CpuImpl::cmpxchg64(u64 rax, u64 dest, Flags* flags) {
         CpuImpl::cmp64(rax, dest, flags);
         if(rax == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     template<typename U>
     U bsr(U val, Flags* flags) {
-        flags->zero = (val == 0);
+        flags->setZero(val == 0);
         if(!val) return (U)(-1); // [NS] return value is undefined
         U mssb = 8*sizeof(U)-1;
         while(mssb > 0 && !(val & ((U)1 << mssb))) {
@@ -687,7 +659,7 @@ namespace x64 {
 
     template<typename U>
     U bsf(U val, Flags* flags) {
-        flags->zero = (val == 0);
+        flags->setZero(val == 0);
         if(!val) return (U)(-1); // [NS] return value is undefined
         U mssb = 0;
         while(mssb < 8*sizeof(U) && !(val & ((U)1 << mssb))) {
@@ -759,25 +731,25 @@ namespace x64 {
         long double d = F80::toLongDouble(dst);
         long double s = F80::toLongDouble(src);
         if(d > s) {
-            flags->zero = 0;
+            flags->setZero(false);
             flags->setParity(false);
-            flags->carry = 0;
+            flags->setCarry(false);
         }
         if(d < s) {
-            flags->zero = 0;
+            flags->setZero(false);
             flags->setParity(false);
-            flags->carry = 1;
+            flags->setCarry(true);
         }
         if(d == s) {
-            flags->zero = 1;
+            flags->setZero(true);
             flags->setParity(false);
-            flags->carry = 0;
+            flags->setCarry(false);
         }
         if(d != d || s != s) {
             if(x87fpu->control().im) {
-                flags->zero = 1;
+                flags->setZero(true);
                 flags->setParity(1);
-                flags->carry = 1;
+                flags->setCarry(true);
             }
         }
     }
@@ -870,24 +842,24 @@ namespace x64 {
         std::memcpy(&s, &src, sizeof(s));
         float res = d - s;
         if(d == s) {
-            flags->zero = true;
+            flags->setZero(true);
             flags->setParity(false);
-            flags->carry = false;
+            flags->setCarry(false);
         } else if(res != res) {
-            flags->zero = true;
+            flags->setZero(true);
             flags->setParity(true);
-            flags->carry = true;
+            flags->setCarry(true);
         } else if(res > 0.0) {
-            flags->zero = false;
+            flags->setZero(false);
             flags->setParity(false);
-            flags->carry = false;
+            flags->setCarry(false);
         } else if(res < 0.0) {
-            flags->zero = false;
+            flags->setZero(false);
             flags->setParity(false);
-            flags->carry = true;
+            flags->setCarry(true);
         }
-        flags->overflow = false;
-        flags->sign = false;
+        flags->setOverflow(false);
+        flags->setSign(false);
     }
 
     void CpuImpl::comisd(u128 dst, u128 src, SIMD_ROUNDING, Flags* flags) {
@@ -898,24 +870,24 @@ namespace x64 {
         std::memcpy(&s, &src, sizeof(s));
         double res = d - s;
         if(d == s) {
-            flags->zero = true;
+            flags->setZero(true);
             flags->setParity(false);
-            flags->carry = false;
+            flags->setCarry(false);
         } else if(res != res) {
-            flags->zero = true;
+            flags->setZero(true);
             flags->setParity(true);
-            flags->carry = true;
+            flags->setCarry(true);
         } else if(res > 0.0) {
-            flags->zero = false;
+            flags->setZero(false);
             flags->setParity(false);
-            flags->carry = false;
+            flags->setCarry(false);
         } else if(res < 0.0) {
-            flags->zero = false;
+            flags->setZero(false);
             flags->setParity(false);
-            flags->carry = true;
+            flags->setCarry(true);
         }
-        flags->overflow = false;
-        flags->sign = false;
+        flags->setOverflow(false);
+        flags->setSign(false);
     }
 
     u128 CpuImpl::sqrtps(u128 dst, u128 src, SIMD_ROUNDING) {
@@ -2483,8 +2455,8 @@ namespace x64 {
     }
 
     void CpuImpl::ptest(u128 dst, u128 src, Flags* flags) {
-        flags->zero = (dst.lo & src.lo) == 0 && (dst.hi & src.hi) == 0;
-        flags->carry = (~dst.lo & src.lo) == 0 && (~dst.hi & src.hi) == 0;
+        flags->setZero((dst.lo & src.lo) == 0 && (dst.hi & src.hi) == 0);
+        flags->setCarry((~dst.lo & src.lo) == 0 && (~dst.hi & src.hi) == 0);
     }
 
     template<typename I>
@@ -2757,10 +2729,10 @@ namespace x64 {
             __builtin_unreachable();
         }
         assert(format == SIGNED_BYTE || format == UNSIGNED_BYTE);
-        flags->carry = (intres2 != 0);
-        flags->overflow = (intres2 & 1);
-        flags->sign = std::any_of(DST8.begin(), DST8.end(), [](UI8 val) { return val == 0; });
-        flags->zero = std::any_of(SRC8.begin(), SRC8.end(), [](UI8 val) { return val == 0; });
+        flags->setCarry(intres2 != 0);
+        flags->setOverflow(intres2 & 1);
+        flags->setSign(std::any_of(DST8.begin(), DST8.end(), [](UI8 val) { return val == 0; }));
+        flags->setZero(std::any_of(SRC8.begin(), SRC8.end(), [](UI8 val) { return val == 0; }));
         flags->setParity(false);
 
         return out;
@@ -2877,11 +2849,11 @@ namespace x64 {
             assert(!"not implemented");
             __builtin_unreachable();
         }
-        flags->carry = (intres2 != 0);
-        flags->overflow = (intres2 & 1);
+        flags->setCarry(intres2 != 0);
+        flags->setOverflow(intres2 & 1);
         assert(format == SIGNED_WORD || format == UNSIGNED_WORD);
-        flags->sign = std::any_of(DST16.begin(), DST16.end(), [](UI16 val) { return val == 0; });
-        flags->zero = std::any_of(SRC16.begin(), SRC16.end(), [](UI16 val) { return val == 0; });
+        flags->setSign(std::any_of(DST16.begin(), DST16.end(), [](UI16 val) { return val == 0; }));
+        flags->setZero(std::any_of(SRC16.begin(), SRC16.end(), [](UI16 val) { return val == 0; }));
         flags->setParity(false);
 
         return out;
@@ -3015,10 +2987,10 @@ namespace x64 {
             __builtin_unreachable();
         }
         assert(format == SIGNED_BYTE || format == UNSIGNED_BYTE);
-        flags->carry = (intres2 != 0);
-        flags->overflow = (intres2 & 1);
-        flags->sign = (invaliddst < 16);
-        flags->zero = (invalidsrc < 16);
+        flags->setCarry(intres2 != 0);
+        flags->setOverflow(intres2 & 1);
+        flags->setSign(invaliddst < 16);
+        flags->setZero(invalidsrc < 16);
         flags->setParity(false);
 
         return out;
@@ -3135,11 +3107,11 @@ namespace x64 {
             assert(!"not implemented");
             __builtin_unreachable();
         }
-        flags->carry = (intres2 != 0);
-        flags->overflow = (intres2 & 1);
+        flags->setCarry(intres2 != 0);
+        flags->setOverflow(intres2 & 1);
         assert(format == SIGNED_WORD || format == UNSIGNED_WORD);
-        flags->sign = (invaliddst < 8);
-        flags->zero = (invalidsrc < 8);
+        flags->setSign(invaliddst < 8);
+        flags->setZero(invalidsrc < 8);
         flags->setParity(false);
 
         return out;
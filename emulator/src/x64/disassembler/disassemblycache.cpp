@@ -112,39 +112,29 @@ namespace x64 {
         // if executable flag didn't change, we don't need to to anything
         if(protBefore.test(x64::PROT::EXEC) == protAfter.test(x64::PROT::EXEC)) return;
 
-        if(!protAfter.test(x64::PROT::EXEC)) {
-            {
-                auto left = executableSectionsByBegin_.lower_bound(base);
-                auto right = executableSectionsByBegin_.upper_bound(base+length);
-                executableSectionsByBegin_.erase(left, right);
-            }
-            {
-                auto left = executableSectionsByEnd_.lower_bound(base);
-                auto right = executableSectionsByEnd_.upper_bound(base+length);
-                executableSectionsByEnd_.erase(left, right);
-            }
-            executableSections_.erase(std::remove_if(executableSections_.begin(), executableSections_.end(), [=](const auto& section) {
-                return base <= section->begin && section->end <= base+length;
-            }), executableSections_.end());
-        }
+        if(!protAfter.test(x64::PROT::EXEC)) invalidate(base, base+length);
     }
 
     void DisassemblyCache::onRegionDestruction(u64 base, u64 length, BitFlags<x64::PROT> prot) {
         if(!prot.test(x64::PROT::EXEC)) return;
+        invalidate(base, base+length);
+    }
 
-        {
-            auto left = executableSectionsByBegin_.lower_bound(base);
-            auto right = executableSectionsByBegin_.upper_bound(base+length);
-            executableSectionsByBegin_.erase(left, right);
-        }
-        {
-            auto left = executableSectionsByEnd_.lower_bound(base);
-            auto right = executableSectionsByEnd_.upper_bound(base+length);
-            executableSectionsByEnd_.erase(left, right);
+    void DisassemblyCache::invalidate(u64 begin, u64 end) {
+        LOCK_CACHE();
+        auto intersects = [=](const std::unique_ptr<ExecutableSection>& section) {
+            return section->begin < end && begin < section->end;
+        };
+        auto eraseEntry = [](std::map<u64, ExecutableSection*>& sections, u64 key, const ExecutableSection* section) {
+            auto it = sections.find(key);
+            if(it != sections.end() && it->second == section) sections.erase(it);
+        };
+        for(const auto& section : executableSections_) {
+            if(!intersects(section)) continue;
+            eraseEntry(executableSectionsByBegin_, section->begin, section.get());
+            eraseEntry(executableSectionsByEnd_, section->end, section.get());
         }
-        executableSections_.erase(std::remove_if(executableSections_.begin(), executableSections_.end(), [=](const auto& section) {
-            return base <= section->begin && section->end <= base+length;
-        }), executableSections_.end());
+        executableSections_.erase(std::remove_if(executableSections_.begin(), executableSections_.end(), intersects), executableSections_.end());
     }
 
     void ExecutableSection::trim() {
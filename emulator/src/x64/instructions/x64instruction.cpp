@@ -936,4 +936,251 @@ namespace x64 {
         }
     }
 
+    bool X64Instruction::readsFlags() const {
+        switch(insn()) {
+            case Insn::ADC_RM8_RM8:
+            case Insn::ADC_RM8_IMM:
+            case Insn::ADC_RM16_RM16:
+            case Insn::ADC_RM16_IMM:
+            case Insn::ADC_RM32_RM32:
+            case Insn::ADC_RM32_IMM:
+            case Insn::ADC_RM64_RM64:
+            case Insn::ADC_RM64_IMM:
+            case Insn::SBB_RM8_RM8:
+            case Insn::SBB_RM8_IMM:
+            case Insn::SBB_RM16_RM16:
+            case Insn::SBB_RM16_IMM:
+            case Insn::SBB_RM32_RM32:
+            case Insn::SBB_RM32_IMM:
+            case Insn::SBB_RM64_RM64:
+            case Insn::SBB_RM64_IMM:
+            case Insn::RCL_RM8_R8:
+            case Insn::RCL_RM8_IMM:
+            case Insn::RCL_RM16_R8:
+            case Insn::RCL_RM16_IMM:
+            case Insn::RCL_RM32_R8:
+            case Insn::RCL_RM32_IMM:
+            case Insn::RCL_RM64_R8:
+            case Insn::RCL_RM64_IMM:
+            case Insn::RCR_RM8_R8:
+            case Insn::RCR_RM8_IMM:
+            case Insn::RCR_RM16_R8:
+            case Insn::RCR_RM16_IMM:
+            case Insn::RCR_RM32_R8:
+            case Insn::RCR_RM32_IMM:
+            case Insn::RCR_RM64_R8:
+            case Insn::RCR_RM64_IMM:
+            case Insn::PUSHFQ:
+            case Insn::SET_RM8:
+            case Insn::CMOV_R16_RM16:
+            case Insn::CMOV_R32_RM32:
+            case Insn::CMOV_R64_RM64:
+            case Insn::FCMOV_ST:
+            case Insn::JE:
+            case Insn::JNE:
+            case Insn::JCC:
+                return true;
+            // the state of the cpu may be observed after these
+            case Insn::SYSCALL:
+            case Insn::HALT:
+            case Insn::UD2:
+            case Insn::UNKNOWN:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool X64Instruction::writesFlags() const {
+        switch(insn()) {
+            case Insn::ADD_RM8_RM8:
+            case Insn::ADD_RM8_IMM:
+            case Insn::ADD_RM16_RM16:
+            case Insn::ADD_RM16_IMM:
+            case Insn::ADD_RM32_RM32:
+            case Insn::ADD_RM32_IMM:
+            case Insn::ADD_RM64_RM64:
+            case Insn::ADD_RM64_IMM:
+            case Insn::LOCK_ADD_M8_RM8:
+            case Insn::LOCK_ADD_M8_IMM:
+            case Insn::LOCK_ADD_M16_RM16:
+            case Insn::LOCK_ADD_M16_IMM:
+            case Insn::LOCK_ADD_M32_RM32:
+            case Insn::LOCK_ADD_M32_IMM:
+            case Insn::LOCK_ADD_M64_RM64:
+            case Insn::LOCK_ADD_M64_IMM:
+            case Insn::ADC_RM8_RM8:
+            case Insn::ADC_RM8_IMM:
+            case Insn::ADC_RM16_RM16:
+            case Insn::ADC_RM16_IMM:
+            case Insn::ADC_RM32_RM32:
+            case Insn::ADC_RM32_IMM:
+            case Insn::ADC_RM64_RM64:
+            case Insn::ADC_RM64_IMM:
+            case Insn::SUB_RM8_RM8:
+            case Insn::SUB_RM8_IMM:
+            case Insn::SUB_RM16_RM16:
+            case Insn::SUB_RM16_IMM:
+            case Insn::SUB_RM32_RM32:
+            case Insn::SUB_RM32_IMM:
+            case Insn::SUB_RM64_RM64:
+            case Insn::SUB_RM64_IMM:
+            case Insn::LOCK_SUB_M8_RM8:
+            case Insn::LOCK_SUB_M8_IMM:
+            case Insn::LOCK_SUB_M16_RM16:
+            case Insn::LOCK_SUB_M16_IMM:
+            case Insn::LOCK_SUB_M32_RM32:
+            case Insn::LOCK_SUB_M32_IMM:
+            case Insn::LOCK_SUB_M64_RM64:
+            case Insn::LOCK_SUB_M64_IMM:
+            case Insn::SBB_RM8_RM8:
+            case Insn::SBB_RM8_IMM:
+            case Insn::SBB_RM16_RM16:
+            case Insn::SBB_RM16_IMM:
+            case Insn::SBB_RM32_RM32:
+            case Insn::SBB_RM32_IMM:
+            case Insn::SBB_RM64_RM64:
+            case Insn::SBB_RM64_IMM:
+            case Insn::NEG_RM8:
+            case Insn::NEG_RM16:
+            case Insn::NEG_RM32:
+            case Insn::NEG_RM64:
+            case Insn::MUL_RM8:
+            case Insn::MUL_RM16:
+            case Insn::MUL_RM32:
+            case Insn::MUL_RM64:
+            case Insn::IMUL1_RM16:
+            case Insn::IMUL2_R16_RM16:
+            case Insn::IMUL3_R16_RM16_IMM:
+            case Insn::IMUL1_RM32:
+            case Insn::IMUL2_R32_RM32:
+            case Insn::IMUL3_R32_RM32_IMM:
+            case Insn::IMUL1_RM64:
+            case Insn::IMUL2_R64_RM64:
+            case Insn::IMUL3_R64_RM64_IMM:
+            case Insn::DIV_RM8:
+            case Insn::DIV_RM16:
+            case Insn::DIV_RM32:
+            case Insn::DIV_RM64:
+            case Insn::IDIV_RM32:
+            case Insn::IDIV_RM64:
+            case Insn::AND_RM8_RM8:
+            case Insn::AND_RM8_IMM:
+            case Insn::AND_RM16_RM16:
+            case Insn::AND_RM16_IMM:
+            case Insn::AND_RM32_RM32:
+            case Insn::AND_RM32_IMM:
+            case Insn::AND_RM64_RM64:
+            case Insn::AND_RM64_IMM:
+            case Insn::OR_RM8_RM8:
+            case Insn::OR_RM8_IMM:
+            case Insn::OR_RM16_RM16:
+            case Insn::OR_RM16_IMM:
+            case Insn::OR_RM32_RM32:
+            case Insn::OR_RM32_IMM:
+            case Insn::OR_RM64_RM64:
+            case Insn::OR_RM64_IMM:
+            case Insn::LOCK_OR_M8_RM8:
+            case Insn::LOCK_OR_M8_IMM:
+            case Insn::LOCK_OR_M16_RM16:
+            case Insn::LOCK_OR_M16_IMM:
+            case Insn::LOCK_OR_M32_RM32:
+            case Insn::LOCK_OR_M32_IMM:
+            case Insn::LOCK_OR_M64_RM64:
+            case Insn::LOCK_OR_M64_IMM:
+            case Insn::XOR_RM8_RM8:
+            case Insn::XOR_RM8_IMM:
+            case Insn::XOR_RM16_RM16:
+            case Insn::XOR_RM16_IMM:
+            case Insn::XOR_RM32_RM32:
+            case Insn::XOR_RM32_IMM:
+            case Insn::XOR_RM64_RM64:
+            case Insn::XOR_RM64_IMM:
+            case Insn::XADD_RM8_R8:
+            case Insn::XADD_RM16_R16:
+            case Insn::XADD_RM32_R32:
+            case Insn::XADD_RM64_R64:
+            case Insn::LOCK_XADD_M8_R8:
+            case Insn::LOCK_XADD_M16_R16:
+            case Insn::LOCK_XADD_M32_R32:
+            case Insn::LOCK_XADD_M64_R64:
+            case Insn::TZCNT_R16_RM16:
+            case Insn::TZCNT_R32_RM32:
+            case Insn::TZCNT_R64_RM64:
+            case Insn::TEST_RM8_R8:
+            case Insn::TEST_RM8_IMM:
+            case Insn::TEST_RM16_R16:
+            case Insn::TEST_RM16_IMM:
+            case Insn::TEST_RM32_R32:
+            case Insn::TEST_RM32_IMM:
+            case Insn::TEST_RM64_R64:
+            case Insn::TEST_RM64_IMM:
+            case Insn::CMP_RM8_RM8:
+            case Insn::CMP_RM8_IMM:
+            case Insn::CMP_RM16_RM16:
+            case Insn::CMP_RM16_IMM:
+            case Insn::CMP_RM32_RM32:
+            case Insn::CMP_RM32_IMM:
+            case Insn::CMP_RM64_RM64:
+            case Insn::CMP_RM64_IMM:
+            case Insn::CMPXCHG_RM8_R8:
+            case Insn::CMPXCHG_RM16_R16:
+            case Insn::CMPXCHG_RM32_R32:
+            case Insn::CMPXCHG_RM64_R64:
+            case Insn::LOCK_CMPXCHG_M8_R8:
+            case Insn::LOCK_CMPXCHG_M16_R16:
+            case Insn::LOCK_CMPXCHG_M32_R32:
+            case Insn::LOCK_CMPXCHG_M64_R64:
+            case Insn::BSR_R16_R16:
+            case Insn::BSR_R16_M16:
+            case Insn::BSR_R32_R32:
+            case Insn::BSR_R32_M32:
+            case Insn::BSR_R64_R64:
+            case Insn::BSR_R64_M64:
+            case Insn::BSF_R16_R16:
+            case Insn::BSF_R16_M16:
+            case Insn::BSF_R32_R32:
+            case Insn::BSF_R32_M32:
+            case Insn::BSF_R64_R64:
+            case Insn::BSF_R64_M64:
+            case Insn::POPCNT_R16_RM16:
+            case Insn::POPCNT_R32_RM32:
+            case Insn::POPCNT_R64_RM64:
+            case Insn::POPFQ:
+            case Insn::COMISS_XMM_XMM:
+            case Insn::COMISS_XMM_M32:
+            case Insn::COMISD_XMM_XMM:
+            case Insn::COMISD_XMM_M64:
+            case Insn::UCOMISS_XMM_XMM:
+            case Insn::UCOMISS_XMM_M32:
+            case Insn::UCOMISD_XMM_XMM:
+            case Insn::UCOMISD_XMM_M64:
+            case Insn::PTEST_XMM_XMMM128:
+            case Insn::FCOMI_ST_ST:
+            case Insn::FCOMIP_ST_ST:
+            case Insn::FUCOMI_ST_ST:
+            case Insn::FUCOMIP_ST_ST:
+            case Insn::PCMPISTRI_XMM_XMMM128_IMM:
+            case Insn::PCMPESTRI_XMM_XMMM128_IMM:
+                return true;
+            // a shift by 0 leaves the flags untouched
+            case Insn::SHL_RM8_IMM:
+            case Insn::SHL_RM16_IMM:
+            case Insn::SHL_RM32_IMM:
+            case Insn::SHR_RM8_IMM:
+            case Insn::SHR_RM16_IMM:
+            case Insn::SHR_RM32_IMM:
+            case Insn::SAR_RM8_IMM:
+            case Insn::SAR_RM16_IMM:
+            case Insn::SAR_RM32_IMM:
+                return (op1<Imm>().as<u8>() & 0x1f) != 0;
+            case Insn::SHL_RM64_IMM:
+            case Insn::SHR_RM64_IMM:
+            case Insn::SAR_RM64_IMM:
+                return (op1<Imm>().as<u8>() & 0x3f) != 0;
+            default:
+                return false;
+        }
+    }
+
 }
\ No newline at end of file
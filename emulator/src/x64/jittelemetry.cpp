@@ -0,0 +1,125 @@
+#include "x64/jittelemetry.h"
+#include "x64/codesegment.h"
+#include <fmt/format.h>
+#include <fstream>
+
+namespace x64 {
+
+    std::optional<JitTelemetryReport::Format> JitTelemetryReport::formatOf(const std::string& path) {
+        auto endsWith = [&](const std::string& extension) {
+            return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+        };
+        if(endsWith(".json")) return Format::JSON;
+        if(endsWith(".csv")) return Format::CSV;
+        return {};
+    }
+
+    void JitTelemetryReport::add(const CodeSegment& segment, std::string source) {
+        Entry entry;
+        entry.address = segment.start();
+        entry.source = std::move(source);
+        entry.calls = segment.calls();
+        entry.guestInstructions = (u32)segment.basicBlock().instructions().size();
+        entry.jitted = !!segment.jitBasicBlock();
+        entry.telemetry = segment.telemetry();
+        entries_.push_back(std::move(entry));
+    }
+
+    u64 JitTelemetryReport::Entry::interpretedExecutions() const {
+        if(!jitted) return calls * guestInstructions;
+        if(!telemetry) return 0;
+        return calls * telemetry->interpretedInstructions;
+    }
+
+    bool JitTelemetryReport::tryWrite(const std::string& path) const {
+        auto format = formatOf(path);
+        if(!format) return false;
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if(!file) return false;
+        write(file, format.value());
+        return !!file;
+    }
+
+    void JitTelemetryReport::write(std::ostream& stream, Format format) const {
+        switch(format) {
+            case Format::JSON: writeJson(stream); break;
+            case Format::CSV: writeCsv(stream); break;
+        }
+    }
+
+    static std::string jsonString(const std::string& s) {
+        std::string escaped = "\"";
+        for(char c : s) {
+            switch(c) {
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\t': escaped += "\\t"; break;
+                default: {
+                    if((u8)c < 0x20) {
+                        escaped += fmt::format("\\u{:04x}", (u32)(u8)c);
+                    } else {
+                        escaped += c;
+                    }
+                    break;
+                }
+            }
+        }
+        escaped += "\"";
+        return escaped;
+    }
+
+    static std::string csvString(const std::string& s) {
+        std::string escaped = "\"";
+        for(char c : s) {
+            if(c == '"') escaped += '"';
+            escaped += c;
+        }
+        escaped += "\"";
+        return escaped;
+    }
+
+    void JitTelemetryReport::writeJson(std::ostream& stream) const {
+        stream << "[\n";
+        for(size_t i = 0; i < entries_.size(); ++i) {
+            const Entry& entry = entries_[i];
+            stream << fmt::format("  {{\"address\": {}, \"source\": {}, \"calls\": {}, \"guest_instructions\": {}, \"jitted\": {}, \"interpreted_executions\": {}",
+                    entry.address, jsonString(entry.source), entry.calls, entry.guestInstructions, entry.jitted, entry.interpretedExecutions());
+            if(const auto& telemetry = entry.telemetry) {
+                stream << fmt::format(", \"compiled\": {}, \"ir_before_optimization\": {}, \"ir_after_optimization\": {}, \"interpreted_instructions\": {}, \"native_code_size\": {}, \"compile_time_ns\": {}",
+                        telemetry->compiled, telemetry->irInstructionsBeforeOptimization, telemetry->irInstructionsAfterOptimization,
+                        telemetry->interpretedInstructions, telemetry->nativeCodeSize, telemetry->compileTimeNs);
+                if(const auto& unsupported = telemetry->firstUnsupportedInstruction) {
+                    stream << fmt::format(", \"unsupported_insn\": {}, \"unsupported_instruction\": {}",
+                            (u32)unsupported->insn(), jsonString(unsupported->toString()));
+                }
+            }
+            stream << (i+1 < entries_.size() ? "},\n" : "}\n");
+        }
+        stream << "]\n";
+    }
+
+    void JitTelemetryReport::writeCsv(std::ostream& stream) const {
+        stream << "address,source,calls,guest_instructions,jitted,interpreted_executions,compiled,"
+                  "ir_before_optimization,ir_after_optimization,interpreted_instructions,native_code_size,compile_time_ns,"
+                  "unsupported_insn,unsupported_instruction\n";
+        for(const Entry& entry : entries_) {
+            stream << fmt::format("{:#x},{},{},{},{},{}", entry.address, csvString(entry.source), entry.calls, entry.guestInstructions, (int)entry.jitted, entry.interpretedExecutions());
+            if(const auto& telemetry = entry.telemetry) {
+                stream << fmt::format(",{},{},{},{},{},{}", (int)telemetry->compiled,
+                        telemetry->irInstructionsBeforeOptimization, telemetry->irInstructionsAfterOptimization,
+                        telemetry->interpretedInstructions, telemetry->nativeCodeSize, telemetry->compileTimeNs);
+            } else {
+                stream << ",,,,,,";
+            }
+            if(!!entry.telemetry && !!entry.telemetry->firstUnsupportedInstruction) {
+                const X64Instruction& unsupported = entry.telemetry->firstUnsupportedInstruction.value();
+                stream << fmt::format(",{},{}", (u32)unsupported.insn(), csvString(unsupported.toString()));
+            } else {
+                stream << ",,";
+            }
+            stream << '\n';
+        }
+    }
+
+}
@@ -141,7 +141,10 @@ namespace x64 {
 
     int Mmu::mprotect(u64 address, u64 length, BitFlags<PROT> prot) {
         verify(address % PAGE_SIZE == 0, "mprotect with non-page_size aligned address not supported");
+#ifdef MULTIPROCESSING
+        // writes to code are only detected with a single thread
         if(prot.test(PROT::EXEC) && prot.test(PROT::WRITE)) return -EACCES;
+#endif
         length = pageRoundUp(length);
         {
             // Check that all impacted regions are contiguous, i.e. we don't mprotect a hole
@@ -552,6 +555,36 @@ namespace x64 {
         }
         bool didProtect = host::HostMemory::tryProtectVirtualMemoryRange(ptr, region->size(), toHostProtection(prot));
         verify(didProtect, "Unable to set memory protection");
+        if(!!addressSpace_.codeWriteWatch) {
+            if(!prot.test(PROT::EXEC)) {
+                addressSpace_.codeWriteWatch->unwatch(region->base(), region->end());
+            } else if(prot.test(PROT::WRITE)) {
+                addressSpace_.codeWriteWatch->rewatch(region->base(), region->end());
+            }
+        }
+    }
+
+    void Mmu::protectCode(u64 begin, u64 end) {
+        if(!addressSpace_.codeWriteWatch) addressSpace_.codeWriteWatch = std::make_unique<CodeWriteWatch>(addressSpace_);
+        for(u64 page = pageRoundDown(begin); page < end; page += PAGE_SIZE) {
+            const MmuRegion* region = findAddress(page);
+            if(!region || !region->prot().test(PROT::EXEC)) continue;
+            addressSpace_.codeWriteWatch->watch(page, region->prot().test(PROT::WRITE));
+        }
+    }
+
+    bool Mmu::hasWrittenCode() const {
+        return !!addressSpace_.codeWriteWatch && addressSpace_.codeWriteWatch->hasWrittenPages();
+    }
+
+    void Mmu::takeWrittenCodePages(std::vector<u64>* pages) {
+        if(!addressSpace_.codeWriteWatch) return;
+        addressSpace_.codeWriteWatch->takeWrittenPages(pages);
+    }
+
+    void Mmu::setJittedCodeTickLimit(u64* tickLimit) {
+        if(!addressSpace_.codeWriteWatch) return;
+        addressSpace_.codeWriteWatch->setTickLimit(tickLimit);
     }
 
     void Mmu::fillRegionLookup(MmuRegion* region) {
@@ -909,11 +909,11 @@ namespace x64 {
         static constexpr u64 SIGN_MASK = 0x80;
         static constexpr u64 OVERFLOW_MASK = 0x800;
         Flags flags;
-        flags.carry = rflags & CARRY_MASK;
+        flags.setCarry(rflags & CARRY_MASK);
         flags.setParity(rflags & PARITY_MASK);
-        flags.zero = rflags & ZERO_MASK;
-        flags.sign = rflags & SIGN_MASK;
-        flags.overflow = rflags & OVERFLOW_MASK;
+        flags.setZero(rflags & ZERO_MASK);
+        flags.setSign(rflags & SIGN_MASK);
+        flags.setOverflow(rflags & OVERFLOW_MASK);
         return flags;
     }
 
@@ -936,11 +936,11 @@ namespace x64 {
         static constexpr u64 SIGN_MASK = 0x80;
         static constexpr u64 OVERFLOW_MASK = 0x800;
         u64 rflags = readRflags();
-        rflags = (rflags & ~CARRY_MASK) | (flags.carry ? CARRY_MASK : 0);
+        rflags = (rflags & ~CARRY_MASK) | (flags.carry() ? CARRY_MASK : 0);
         rflags = (rflags & ~PARITY_MASK) | (flags.parity() ? PARITY_MASK : 0);
-        rflags = (rflags & ~ZERO_MASK) | (flags.zero ? ZERO_MASK : 0);
-        rflags = (rflags & ~SIGN_MASK) | (flags.sign ? SIGN_MASK : 0);
-        rflags = (rflags & ~OVERFLOW_MASK) | (flags.overflow ? OVERFLOW_MASK : 0);
+        rflags = (rflags & ~ZERO_MASK) | (flags.zero() ? ZERO_MASK : 0);
+        rflags = (rflags & ~SIGN_MASK) | (flags.sign() ? SIGN_MASK : 0);
+        rflags = (rflags & ~OVERFLOW_MASK) | (flags.overflow() ? OVERFLOW_MASK : 0);
         return rflags;
     }
 }
@@ -1568,36 +1568,36 @@ namespace x64 {
     void NativeCpuImpl::cmpxchg8(u8 al, u8 dest, Flags* flags) {
         NativeCpuImpl::cmp8(al, dest, flags);
         if(al == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     void NativeCpuImpl::cmpxchg16(u16 ax, u16 dest, Flags* flags) {
         NativeCpuImpl::cmp16(ax, dest, flags);
         if(ax == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     void NativeCpuImpl::cmpxchg32(u32 eax, u32 dest, Flags* flags) {
         NativeCpuImpl::cmp32(eax, dest, flags);
         if(eax == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
     void NativeCpuImpl::cmpxchg64(u64 rax, u64 dest, Flags* flags) {
         NativeCpuImpl::cmp64(rax, dest, flags);
         if(rax == dest) {
-            flags->zero = 1;
+            flags->setZero(true);
         } else {
-            flags->zero = 0;
+            flags->setZero(false);
         }
     }
 
@@ -3287,22 +3287,22 @@ namespace x64 {
             CALL_2_WITH_IMM8(_mm_cmpistri, mdst, msrc);
         }(control);
 
-        flags->carry = [&](u8 imm) -> u32 {
+        flags->setCarry([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_2_WITH_IMM8(_mm_cmpistrc, mdst, msrc);
-        }(control);
-        flags->overflow = [&](u8 imm) -> u32 {
+        }(control));
+        flags->setOverflow([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_2_WITH_IMM8(_mm_cmpistro, mdst, msrc);
-        }(control);
-        flags->sign = [&](u8 imm) -> u32 {
+        }(control));
+        flags->setSign([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_2_WITH_IMM8(_mm_cmpistrs, mdst, msrc);
-        }(control);
-        flags->zero = [&](u8 imm) -> u32 {
+        }(control));
+        flags->setZero([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_2_WITH_IMM8(_mm_cmpistrz, mdst, msrc);
-        }(control);
+        }(control));
         flags->setParity(false);
         
         return res;
@@ -3323,22 +3323,22 @@ namespace x64 {
             CALL_4_WITH_IMM8(_mm_cmpestri, mdst, lendst, msrc, lensrc);
         }(control);
 
-        flags->carry = [&](u8 imm) -> u32 {
+        flags->setCarry([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_4_WITH_IMM8(_mm_cmpestrc, mdst, lendst, msrc, lensrc);
-        }(control);
-        flags->overflow = [&](u8 imm) -> u32 {
+        }(control));
+        flags->setOverflow([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_4_WITH_IMM8(_mm_cmpestro, mdst, lendst, msrc, lensrc);
-        }(control);
-        flags->sign = [&](u8 imm) -> u32 {
+        }(control));
+        flags->setSign([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_4_WITH_IMM8(_mm_cmpestrs, mdst, lendst, msrc, lensrc);
-        }(control);
-        flags->zero = [&](u8 imm) -> u32 {
+        }(control));
+        flags->setZero([&](u8 imm) -> u32 {
             u8 order = imm;
             CALL_4_WITH_IMM8(_mm_cmpestrz, mdst, lendst, msrc, lensrc);
-        }(control);
+        }(control));
         flags->setParity(false);
         
         return res;
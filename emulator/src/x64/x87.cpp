@@ -11,10 +11,12 @@ namespace x64 {
     void X87Fpu::push(f80 val) {
         decrTop();
         stack_[status_.top] = val;
+        tag_.set(status_.top, X87Tag::VALID);
     }
 
     f80 X87Fpu::pop() {
         f80 val = stack_[status_.top];
+        tag_.set(status_.top, X87Tag::EMPTY);
         incrTop();
         return val;
     }
@@ -0,0 +1,109 @@
+#include "x64/compiler/jit.h"
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+
+using namespace x64;
+
+template<Size size>
+static M<size> at(i32 offset) {
+    return M<size> { Segment::DS, Encoding64 { R64::RDI, R64::ZERO, 1, offset } };
+}
+
+static RM32 reg32(R32 reg) { return RM32{true, reg, {}}; }
+static RM64 reg64(R64 reg) { return RM64{true, reg, {}}; }
+
+static BasicBlock create(Cpu* cpu) {
+    std::vector<X64Instruction> instructions;
+    u64 address = 0;
+    // shifts whose flags are overwritten before being read
+    instructions.push_back(X64Instruction::make(address++, Insn::SHL_RM64_R8, 1, reg64(R64::RAX), R8::CL));
+    instructions.push_back(X64Instruction::make(address++, Insn::SHR_RM32_R8, 1, reg32(R32::EBX), R8::CL));
+    instructions.push_back(X64Instruction::make(address++, Insn::SAR_RM64_R8, 1, reg64(R64::RDX), R8::CL));
+    instructions.push_back(X64Instruction::make(address++, Insn::SHLX_R64_RM64_R64, 1, R64::R8, reg64(R64::RAX), R64::RCX));
+    instructions.push_back(X64Instruction::make(address++, Insn::SARX_R32_RM32_R32, 1, R32::R9D, RM32{false, R32::EAX, at<Size::DWORD>(0x0)}, R32::ECX));
+    instructions.push_back(X64Instruction::make(address++, Insn::SHRX_R64_RM64_R64, 1, R64::R10, reg64(R64::RDX), R64::RCX));
+    instructions.push_back(X64Instruction::make(address++, Insn::POPCNT_R64_RM64, 1, R64::R11, reg64(R64::RBX)));
+    instructions.push_back(X64Instruction::make(address++, Insn::POPCNT_R32_RM32, 1, R32::R12D, RM32{false, R32::EAX, at<Size::DWORD>(0x8)}));
+    instructions.push_back(X64Instruction::make(address++, Insn::TZCNT_R64_RM64, 1, R64::R13, reg64(R64::RAX)));
+    instructions.push_back(X64Instruction::make(address++, Insn::TZCNT_R64_RM64, 1, R64::R14, reg64(R64::R15)));
+    // not followed by and, whose flags are overwritten
+    instructions.push_back(X64Instruction::make(address++, Insn::NOT_RM64, 1, reg64(R64::RSI)));
+    instructions.push_back(X64Instruction::make(address++, Insn::AND_RM64_RM64, 1, reg64(R64::RSI), reg64(R64::RBX)));
+    instructions.push_back(X64Instruction::make(address++, Insn::CMP_RM64_RM64, 1, reg64(R64::RAX), reg64(R64::RBX)));
+    instructions.push_back(X64Instruction::make(address++, Insn::JMP_U32, 1, (u32)0xaaaa));
+    return cpu->createBasicBlock(instructions.data(), instructions.size());
+}
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rw = BitFlags<PROT>(PROT::READ, PROT::WRITE);
+    auto flags = BitFlags<MAP>(MAP::ANONYMOUS, MAP::PRIVATE);
+    auto maybe_data = mmu.mmap(0x0, 0x1000, rw, flags);
+    if(!maybe_data) return 1;
+    u64 data = maybe_data.value();
+    Cpu cpu(mmu);
+
+    const std::array<R64, 15> registers {{
+        R64::RAX, R64::RBX, R64::RCX, R64::RDX, R64::RSI, R64::RDI,
+        R64::R8, R64::R9, R64::R10, R64::R11, R64::R12, R64::R13, R64::R14, R64::R15, R64::RBP,
+    }};
+
+    auto reset = [&]() {
+        mmu.write64(Ptr64{data+0x0}, 0x80000000f0f0f0f0);
+        mmu.write64(Ptr64{data+0x8}, 0x00000000ffff0001);
+        Cpu::State state;
+        for(R64 reg : registers) state.regs.set(reg, 0x5a5a5a5a5a5a5a5a);
+        state.regs.set(R64::RDI, data);
+        state.regs.set(R64::RAX, 0x0000000012345678);
+        state.regs.set(R64::RBX, 0xfedcba9876543210);
+        state.regs.set(R64::RCX, 0x0000000000000144);
+        state.regs.set(R64::RDX, 0x8000000000001234);
+        state.regs.set(R64::RSI, 0x00ff00ff00ff00ff);
+        state.regs.set(R64::R15, 0x0);
+        cpu.load(state);
+    };
+
+    // reference run in the interpreter
+    reset();
+    auto bb = create(&cpu);
+    cpu.exec(bb);
+    Cpu::State expectedState;
+    cpu.save(&expectedState);
+
+    if(expectedState.regs.get(R64::RAX) != 0x0000000123456780) return 1;
+    if(expectedState.regs.get(R64::RBX) != 0x0000000007654321) return 1;
+    if(expectedState.regs.get(R64::R8) != 0x0000001234567800) return 1;
+    if(expectedState.regs.get(R64::R9) != 0x00000000ff0f0f0f) return 1;
+    if(expectedState.regs.get(R64::R11) != 12) return 1;
+    if(expectedState.regs.get(R64::R12) != 17) return 1;
+    if(expectedState.regs.get(R64::R13) != 7) return 1;
+    if(expectedState.regs.get(R64::R14) != 64) return 1;
+    if(expectedState.regs.get(R64::RSI) != 0x0000000007004300) return 1;
+
+    // the jitted block computes the same values
+    reset();
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    auto* jbb = jit->tryCompile(bb, nullptr);
+    if(!jbb) return 1;
+
+    u64 ticks { 0 };
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    void* basicBlockPtr = &basicBlockData;
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+    jit->exec(&cpu, &mmu, (NativeExecPtr)jbb->callEntrypoint(), &ticks, &basicBlockPtr, &jitBasicBlockData);
+    Cpu::State state;
+    cpu.save(&state);
+
+    for(R64 reg : registers) {
+        if(state.regs.get(reg) != expectedState.regs.get(reg)) return 1;
+    }
+    if(state.flags.toRflags() != expectedState.flags.toRflags()) return 1;
+
+    return 0;
+}
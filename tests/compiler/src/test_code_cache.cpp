@@ -0,0 +1,171 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/codecache.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include "x64/codesegment.h"
+#include <cstdlib>
+#include <filesystem>
+
+namespace {
+
+    int run(const std::string& directory) {
+        using namespace x64;
+        auto addressSpace = AddressSpace::tryCreate(1);
+        if(!addressSpace) return 1;
+        Mmu mmu(*addressSpace);
+        Cpu cpu(mmu);
+
+        std::array<X64Instruction, 3> instructions {{
+            X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{0x10}),
+            X64Instruction::make(0x1, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+            X64Instruction::make(0x2, Insn::JMP_U32, 1, (u32)0x100),
+        }};
+
+        // the first run compiles the segment and fills the cache
+        {
+            auto cache = CodeCache::tryCreate(directory);
+            if(!cache) return 1;
+            CodeCacheFile* file = cache->tryOpen("/proc/self/exe");
+            if(!file) return 1;
+            auto jit = Jit::tryCreate();
+            if(!jit) return 1;
+            JitStats stats;
+            jit->setStats(&stats);
+            jit->setCompilationThreads(0);
+            CodeSegment segment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+            segment.setCacheLocation(CodeCacheLocation{file, 0x0});
+            CompilationQueue compilationQueue;
+            for(int i = 0; i < 100 && !segment.jitBasicBlock(); ++i) segment.onCall(jit.get(), compilationQueue);
+            if(!segment.jitBasicBlock()) return 1;
+            if(stats.cachedCompilations_ != 0) return 1;
+            if(stats.compiledGuestInstructions_ != instructions.size()) return 1;
+            if(!file->isDirty()) return 1;
+        }
+
+        // the second run loads the code from disk, relocated for the new segment
+        auto cache = CodeCache::tryCreate(directory);
+        if(!cache) return 1;
+        CodeCacheFile* file = cache->tryOpen("/proc/self/exe");
+        if(!file) return 1;
+        auto jit = Jit::tryCreate();
+        if(!jit) return 1;
+        JitStats stats;
+        jit->setStats(&stats);
+        jit->setCompilationThreads(0);
+        CodeSegment segment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+        segment.setCacheLocation(CodeCacheLocation{file, 0x0});
+        CompilationQueue compilationQueue;
+        for(int i = 0; i < 100 && !segment.jitBasicBlock(); ++i) segment.onCall(jit.get(), compilationQueue);
+        if(!segment.jitBasicBlock()) return 1;
+        if(stats.cachedCompilations_ != 1) return 1;
+        if(stats.compiledGuestInstructions_ != 0) return 1;
+
+        cpu.set(R64::RAX, 0x0);
+        cpu.set(R64::RCX, 0x1);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        CodeSegment* segptr = &segment;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)segment.jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, segment.jitBasicBlock());
+        if(ticks != 3) return 1;
+        if(cpu.get(R64::RAX) != 0x10) return 1;
+        if(cpu.get(R64::RCX) != 0x2) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+
+        // code compiled for another mapping of the same file is not reused
+        CodeSegment other(cpu.createBasicBlock(instructions.data(), instructions.size()));
+        other.setCacheLocation(CodeCacheLocation{file, 0x1000});
+        for(int i = 0; i < 100 && !other.jitBasicBlock(); ++i) other.onCall(jit.get(), compilationQueue);
+        if(!other.jitBasicBlock()) return 1;
+        if(stats.cachedCompilations_ != 1) return 1;
+
+        return 0;
+    }
+
+    int runInMemory() {
+        using namespace x64;
+        auto addressSpace = AddressSpace::tryCreate(1);
+        if(!addressSpace) return 1;
+        Mmu mmu(*addressSpace);
+        Cpu cpu(mmu);
+
+        std::array<X64Instruction, 2> instructions {{
+            X64Instruction::make(0x0, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+            X64Instruction::make(0x1, Insn::JMP_U32, 1, (u32)0x100),
+        }};
+
+        auto cache = CodeCache::createInMemory(0x100000);
+        CodeCacheFile* file = cache->tryOpen("/proc/self/exe");
+        if(!file) return 1;
+        if(file->isPersistent()) return 1;
+
+        // the parent process compiles the segment
+        auto parentJit = Jit::tryCreate();
+        if(!parentJit) return 1;
+        parentJit->setCompilationThreads(0);
+        parentJit->setTieredCompilation(false);
+        CodeSegment parentSegment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+        parentSegment.setCacheLocation(CodeCacheLocation{file, 0x0});
+        CompilationQueue compilationQueue;
+        for(int i = 0; i < 100 && !parentSegment.jitBasicBlock(); ++i) parentSegment.onCall(parentJit.get(), compilationQueue);
+        if(!parentSegment.jitBasicBlock()) return 1;
+
+        // the child process gets its own copy of that code on the first call, without interpreting the segment first
+        auto childJit = Jit::tryCreate();
+        if(!childJit) return 1;
+        JitStats stats;
+        childJit->setStats(&stats);
+        childJit->setCompilationThreads(0);
+        CodeSegment childSegment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+        childSegment.setCacheLocation(CodeCacheLocation{file, 0x0});
+        childSegment.onCall(childJit.get(), compilationQueue);
+        if(!childSegment.jitBasicBlock()) return 1;
+        if(stats.cachedCompilations_ != 1) return 1;
+        if(childSegment.jitBasicBlock()->callEntrypoint() == parentSegment.jitBasicBlock()->callEntrypoint()) return 1;
+
+        cpu.set(R64::RCX, 0x1);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        CodeSegment* segptr = &childSegment;
+        childJit->exec(&cpu, &mmu, (NativeExecPtr)childSegment.jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, childSegment.jitBasicBlock());
+        if(cpu.get(R64::RCX) != 0x2) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+
+        // code rewritten in place with the same opcodes but other operands does not get the old translation
+        std::array<X64Instruction, 2> rewritten {{
+            X64Instruction::make(0x0, Insn::INC_RM64, 1, RM64{true, R64::RDX, {}}),
+            X64Instruction::make(0x1, Insn::JMP_U32, 1, (u32)0x100),
+        }};
+        CodeSegment rewrittenSegment(cpu.createBasicBlock(rewritten.data(), rewritten.size()));
+        rewrittenSegment.setCacheLocation(CodeCacheLocation{file, 0x0});
+        rewrittenSegment.onCall(childJit.get(), compilationQueue);
+        if(stats.cachedCompilations_ != 1) return 1;
+
+        // a cache that is full does not take more code
+        auto fullCache = CodeCache::createInMemory(0);
+        CodeCacheFile* fullFile = fullCache->tryOpen("/proc/self/exe");
+        if(!fullFile) return 1;
+        auto otherJit = Jit::tryCreate();
+        if(!otherJit) return 1;
+        otherJit->setCompilationThreads(0);
+        otherJit->setTieredCompilation(false);
+        CodeSegment otherSegment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+        otherSegment.setCacheLocation(CodeCacheLocation{fullFile, 0x0});
+        for(int i = 0; i < 100 && !otherSegment.jitBasicBlock(); ++i) otherSegment.onCall(otherJit.get(), compilationQueue);
+        if(!otherSegment.jitBasicBlock()) return 1;
+        if(fullFile->isDirty()) return 1;
+
+        return 0;
+    }
+
+}
+
+int main() {
+    if(runInMemory() != 0) return 1;
+    char directory[] = "/tmp/x64jitcacheXXXXXX";
+    if(!::mkdtemp(directory)) return 1;
+    int ret = run(directory);
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+    return ret;
+}
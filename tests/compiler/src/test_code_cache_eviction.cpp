@@ -0,0 +1,103 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/executablememoryallocator.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+
+int main() {
+    using namespace x64;
+
+    // freed blocks are reused by size
+    {
+        ExecutableMemoryAllocator allocator;
+        auto small = allocator.allocate(0x40);
+        auto large = allocator.allocate(0x400);
+        if(!small || !large) return 1;
+        if(allocator.usedBytes() != 0x440) return 1;
+        allocator.free(small.value());
+        allocator.free(large.value());
+        if(allocator.usedBytes() != 0) return 1;
+        auto reused = allocator.allocate(0x3f0);
+        if(!reused || reused->ptr != large->ptr) return 1;
+        if(allocator.usedBytes() != 0x400) return 1;
+    }
+
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    // a loop over two segments
+    std::array<X64Instruction, 2> first {{
+        X64Instruction::make(0x10, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x11, Insn::JMP_U32, 1, (u32)0x20),
+    }};
+    std::array<X64Instruction, 3> second {{
+        X64Instruction::make(0x20, Insn::INC_RM64, 1, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(0x21, Insn::INC_RM64, 1, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(0x22, Insn::JMP_U32, 1, (u32)0x10),
+    }};
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    jit->setTieredCompilation(false);
+    CompilationQueue compilationQueue;
+
+    auto compile = [&](CodeSegment* segment) {
+        for(int i = 0; i < 10000 && !segment->jitBasicBlock(); ++i) {
+            segment->onCall(jit.get(), compilationQueue);
+        }
+        return !!segment->jitBasicBlock();
+    };
+
+    auto run = [&](CodeSegment* segment, u64 tickLimit) {
+        cpu.set(R64::RCX, 0x0);
+        cpu.set(R64::RDX, 0x0);
+        cpu.set(R64::RIP, segment->start());
+        u64 ticks { 0 };
+        CodeSegment* segptr = segment;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)segment->jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, segment->jitBasicBlock(), tickLimit);
+    };
+
+    CodeSegment head(cpu.createBasicBlock(first.data(), first.size()));
+    CodeSegment tail(cpu.createBasicBlock(second.data(), second.size()));
+    if(!compile(&head)) return 1;
+    if(!compile(&tail)) return 1;
+    head.addSuccessor(&tail);
+    tail.addSuccessor(&head);
+    head.tryPatch(*jit);
+    tail.tryPatch(*jit);
+    if(head.jitBasicBlock()->needsJumpPatching()) return 1;
+
+    run(&head, 1000);
+    if(cpu.get(R64::RCX) != 200) return 1;
+    if(cpu.get(R64::RDX) != 400) return 1;
+
+    // evicting the tail unlinks the jump of the head
+    u64 sizeBeforeEviction = jit->codeCacheSize();
+    const u8* headCodeBeforeEviction = head.jitBasicBlock()->callEntrypoint();
+    tail.evictJitBasicBlock();
+    if(!!tail.jitBasicBlock()) return 1;
+    jit->collect({head.jitBasicBlock()});
+    if(jit->codeCacheSize() >= sizeBeforeEviction) return 1;
+    if(!head.jitBasicBlock()->needsJumpPatching()) return 1;
+    // the surviving code has been compacted into a new range
+    if(head.jitBasicBlock()->callEntrypoint() == headCodeBeforeEviction) return 1;
+
+    // the head now leaves the jitted code after one iteration
+    run(&head, 1000);
+    if(cpu.get(R64::RCX) != 1) return 1;
+    if(cpu.get(R64::RDX) != 0) return 1;
+    if(cpu.get(R64::RIP) != 0x20) return 1;
+
+    // the tail is compiled again, into a trace that goes on with the head, and the loop is chained again
+    if(!compile(&tail)) return 1;
+    head.tryPatch(*jit);
+    tail.tryPatch(*jit);
+    if(head.jitBasicBlock()->needsJumpPatching()) return 1;
+    run(&head, 1000);
+    if(cpu.get(R64::RCX) != 200 && cpu.get(R64::RCX) != 201) return 1;
+    if(cpu.get(R64::RDX) != 400) return 1;
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "x64/compiler/codepatcher.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+using namespace x64;
+
+int main() {
+    CodePatcher patcher;
+    alignas(CodePatcher::REGION_ALIGNMENT) std::array<u8, 0x20> region;
+    std::fill(region.begin(), region.end(), 0xcc);
+    std::vector<u8> code(0x10);
+    for(size_t i = 0; i < code.size(); ++i) code[i] = (u8)(0x10+i);
+
+    // while a worker may be in the region, it is only skipped
+    size_t slot = patcher.enter();
+    patcher.write(region.data(), region.size(), code);
+    if(region[0] != 0xeb) return 1;
+    if(region[1] != region.size()-2) return 1;
+    if(std::any_of(region.begin()+2, region.end(), [](u8 byte) { return byte != 0xcc; })) return 1;
+    if(!patcher.hasPendingChanges()) return 1;
+
+    // the code is written once the worker has left
+    patcher.synchronize();
+    if(region[0] != 0xeb) return 1;
+    patcher.leave(slot);
+    patcher.synchronize();
+    if(patcher.hasPendingChanges()) return 1;
+    if(!std::equal(code.begin(), code.end(), region.begin())) return 1;
+    if(std::any_of(region.begin()+code.size(), region.end(), [](u8 byte) { return byte != 0xcc; })) return 1;
+
+    // workers entering after the write do not hold it back
+    std::reverse(code.begin(), code.end());
+    patcher.write(region.data(), region.size(), code);
+    slot = patcher.enter();
+    patcher.synchronize();
+    patcher.leave(slot);
+    if(patcher.hasPendingChanges()) return 1;
+    if(!std::equal(code.begin(), code.end(), region.begin())) return 1;
+
+    // retired memory lives as long as the workers that could read it
+    auto memory = std::make_shared<u64>(0);
+    std::weak_ptr<u64> observer = memory;
+    slot = patcher.enter();
+    patcher.retire(std::move(memory));
+    size_t late = patcher.enter();
+    patcher.synchronize();
+    if(observer.expired()) return 1;
+    patcher.leave(slot);
+    patcher.synchronize();
+    if(!observer.expired()) return 1;
+    patcher.leave(late);
+
+    return 0;
+}
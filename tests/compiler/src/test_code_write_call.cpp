@@ -0,0 +1,89 @@
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+
+using namespace x64;
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(0x10);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rwx = BitFlags<PROT>{PROT::READ, PROT::WRITE, PROT::EXEC};
+    auto rw = BitFlags<PROT>{PROT::READ, PROT::WRITE};
+    auto flags = BitFlags<MAP>{MAP::ANONYMOUS, MAP::PRIVATE};
+    auto code = mmu.mmap(0, 2*Mmu::PAGE_SIZE, rwx, flags);
+    if(!code) return 1;
+    auto stack = mmu.mmap(0, Mmu::PAGE_SIZE, rw, flags);
+    if(!stack) return 1;
+    u64 stackTop = stack.value() + Mmu::PAGE_SIZE;
+    Cpu cpu(mmu);
+
+    // mov byte [rdi], 0x90; call f; jmp 0, where f is inc rdx; ret and lives on a page of its own
+    u64 caller = code.value() + 0x10;
+    u64 next = caller + 0x8;
+    u64 f = code.value() + Mmu::PAGE_SIZE;
+    std::vector<X64Instruction> vecCaller {
+        X64Instruction::make(caller, Insn::MOV_M8_IMM, 3, M8{Segment::DS, Encoding64{R64::RDI, R64::ZERO, 1, 0}}, Imm{0x90}),
+        X64Instruction::make(caller+3, Insn::CALLDIRECT, 5, f),
+    };
+    std::vector<X64Instruction> vecNext { X64Instruction::make(next, Insn::JMP_U32, 5, (u32)0) };
+    std::vector<X64Instruction> vecf {
+        X64Instruction::make(f, Insn::INC_RM64, 3, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(f+3, Insn::RET, 1),
+    };
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    CodeSegment callerSeg(Cpu::createBasicBlock(vecCaller.data(), vecCaller.size()));
+    CodeSegment nextSeg(Cpu::createBasicBlock(vecNext.data(), vecNext.size()));
+    CodeSegment fSeg(Cpu::createBasicBlock(vecf.data(), vecf.size()));
+    callerSeg.setWritable();
+    nextSeg.setWritable();
+    fSeg.setWritable();
+
+    auto compile = [&](CodeSegment* seg) {
+        CompilationQueue compilationQueue;
+        for(int i = 0; i < 10000 && !seg->jitBasicBlock(); ++i) {
+            seg->onCall(jit.get(), compilationQueue);
+        }
+        return !!seg->jitBasicBlock();
+    };
+    for(CodeSegment* seg : { &callerSeg, &nextSeg, &fSeg }) {
+        if(!compile(seg)) return 1;
+    }
+    callerSeg.addSuccessor(&fSeg);
+    callerSeg.addReturn(&nextSeg);
+    for(CodeSegment* seg : { &callerSeg, &nextSeg, &fSeg }) seg->tryPatch(*jit);
+    if(callerSeg.jitBasicBlock()->needsPatching()) return 1;
+    mmu.protectCode(f, f+4);
+
+    auto run = [&](u64 written) {
+        Cpu::State state;
+        state.regs.set(R64::RIP, caller);
+        state.regs.set(R64::RSP, stackTop);
+        state.regs.set(R64::RDI, written);
+        state.regs.set(R64::RDX, 0);
+        cpu.load(state);
+        u64 ticks = 0;
+        CodeSegment* segptr = &callerSeg;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)callerSeg.jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, callerSeg.jitBasicBlock());
+    };
+
+    // the call is chained to f
+    run(stack.value());
+    if(mmu.hasWrittenCode()) return 1;
+    if(cpu.get(R64::RDX) != 1) return 1;
+    if(cpu.get(R64::RIP) != 0) return 1;
+
+    // once the code of f is written to, the call leaves the jitted code instead of running the old f
+    run(f+0x80);
+    if(!mmu.hasWrittenCode()) return 1;
+    if(mmu.read8(Ptr8{f+0x80}) != 0x90) return 1;
+    if(cpu.get(R64::RDX) != 0) return 1;
+    if(cpu.get(R64::RIP) != f) return 1;
+
+    return 0;
+}
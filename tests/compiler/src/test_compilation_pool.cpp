@@ -0,0 +1,64 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include "x64/codesegment.h"
+#include <chrono>
+#include <thread>
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<X64Instruction, 3> instructions {{
+        X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{0x10}),
+        X64Instruction::make(0x1, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x2, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    JitStats stats;
+    jit->setStats(&stats);
+    jit->setCompilationThreads(2);
+    if(jit->compilationThreads() != 2) return 1;
+
+    // the guest keeps interpreting until the background compilation is installed
+    CodeSegment segment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+    CompilationQueue compilationQueue;
+    for(int i = 0; i < 10000 && !segment.jitBasicBlock(); ++i) {
+        segment.onCall(jit.get(), compilationQueue);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if(!segment.jitBasicBlock()) return 1;
+    if(stats.backgroundCompilations_ != 1) return 1;
+    if(stats.compiledGuestInstructions_ != instructions.size()) return 1;
+
+    cpu.set(R64::RAX, 0x0);
+    cpu.set(R64::RCX, 0x1);
+    cpu.set(R64::RIP, 0x0);
+    u64 ticks { 0 };
+    CodeSegment* segptr = &segment;
+    jit->exec(&cpu, &mmu, (NativeExecPtr)segment.jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, segment.jitBasicBlock());
+    if(ticks != 3) return 1;
+    if(cpu.get(R64::RAX) != 0x10) return 1;
+    if(cpu.get(R64::RCX) != 0x2) return 1;
+    if(cpu.get(R64::RIP) != 0x100) return 1;
+
+    // cancelled requests are never installed, the segment is submitted again
+    CodeSegment other(cpu.createBasicBlock(instructions.data(), instructions.size()));
+    for(int i = 0; i < 100; ++i) {
+        other.onCall(jit.get(), compilationQueue);
+        jit->cancelPendingCompilations();
+    }
+    for(int i = 0; i < 10000 && !other.jitBasicBlock(); ++i) {
+        other.onCall(jit.get(), compilationQueue);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if(!other.jitBasicBlock()) return 1;
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+
+using namespace x64;
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    // p jumps to a, which drops the flags of its cmp because b overwrites them before returning
+    std::vector<X64Instruction> vecp { X64Instruction::make(0x10, Insn::JMP_U32, 5, (u32)0x20) };
+    std::vector<X64Instruction> veca {
+        X64Instruction::make(0x20, Insn::CMP_RM64_IMM, 4, RM64{true, R64::RAX, {}}, Imm{0x1}),
+        X64Instruction::make(0x24, Insn::JMP_U32, 5, (u32)0x30),
+    };
+    std::vector<X64Instruction> vecb {
+        X64Instruction::make(0x30, Insn::XOR_RM64_RM64, 3, RM64{true, R64::RAX, {}}, RM64{true, R64::RAX, {}}),
+        X64Instruction::make(0x33, Insn::RET, 1),
+    };
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    CodeSegment p(Cpu::createBasicBlock(vecp.data(), vecp.size()));
+    CodeSegment a(Cpu::createBasicBlock(veca.data(), veca.size()));
+    CodeSegment b(Cpu::createBasicBlock(vecb.data(), vecb.size()));
+    p.addSuccessor(&a);
+    a.addSuccessor(&b);
+
+    auto compile = [&](CodeSegment* seg) {
+        CompilationQueue compilationQueue;
+        for(int i = 0; i < 10000 && !seg->jitBasicBlock(); ++i) {
+            seg->onCall(jit.get(), compilationQueue);
+        }
+        return !!seg->jitBasicBlock();
+    };
+    if(!compile(&a)) return 1;
+    if(!compile(&p)) return 1;
+    p.tryPatch(*jit);
+    if(p.jitBasicBlock()->needsPatching()) return 1;
+
+    // another segment may show up where b was, and read the flags: the code of a is dropped with b
+    const JitBasicBlock* stale = a.jitBasicBlock();
+    std::unordered_set<const JitBasicBlock*> droppedBlocks;
+    b.removeFromCaches(&droppedBlocks);
+    if(droppedBlocks.count(stale) != 1) return 1;
+    if(!!a.jitBasicBlock()) return 1;
+    jit->discard(droppedBlocks);
+    if(!p.jitBasicBlock()->needsPatching()) return 1;
+
+    // p does not enter the stale code anymore and leaves the jitted code at a
+    cpu.set(R64::RAX, 0x5);
+    cpu.set(R64::RIP, 0x10);
+    u64 ticks = 0;
+    CodeSegment* segptr = &p;
+    jit->exec(&cpu, &mmu, (NativeExecPtr)p.jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, p.jitBasicBlock());
+    if(cpu.get(R64::RIP) != 0x20) return 1;
+    if(cpu.get(R64::RAX) != 0x5) return 1;
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include <sys/mman.h>
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<X64Instruction, 4> instructions {{
+        X64Instruction::make(0x0, Insn::CMP_RM64_IMM, 1, RM64{true, R64::RAX, {}}, Imm{0x1}),
+        X64Instruction::make(0x1, Insn::ADD_RM64_IMM, 1, RM64{true, R64::RAX, {}}, Imm{0x2}),
+        X64Instruction::make(0x2, Insn::TEST_RM64_R64, 1, RM64{true, R64::RCX, {}}, R64::RCX),
+        X64Instruction::make(0x3, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+
+    Compiler compiler;
+    JitStats stats;
+    compiler.setStats(&stats);
+
+    // the cmp is overwritten by the add, the test may be read after the jump
+    auto liveOut = compiler.tryCompileTrace({&bb}, 1, {&basicBlockData}, &jitBasicBlockData, true);
+    if(!liveOut) return 1;
+    if(stats.eliminatedFlagUpdates_ != 1) return 1;
+
+    // nobody reads the flags after the jump
+    stats = JitStats{};
+    auto deadOut = compiler.tryCompileTrace({&bb}, 1, {&basicBlockData}, &jitBasicBlockData, false);
+    if(!deadOut) return 1;
+    if(stats.eliminatedFlagUpdates_ != 2) return 1;
+    if(deadOut->nativecode.size() >= liveOut->nativecode.size()) return 1;
+
+    void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+    if(bbptr == (void*)MAP_FAILED) return 1;
+    ::memcpy(bbptr, deadOut->nativecode.data(), deadOut->nativecode.size());
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    cpu.set(R64::RAX, 0x20);
+    cpu.set(R64::RCX, 0x0);
+    cpu.set(R64::RIP, 0x0);
+    u64 ticks { 0 };
+    void* basicBlockPtr = nullptr;
+    jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+    if(ticks != 4) return 1;
+    if(basicBlockPtr != &basicBlockData) return 1;
+    if(cpu.get(R64::RAX) != 0x22) return 1;
+    if(cpu.get(R64::RIP) != 0x100) return 1;
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<X64Instruction, 1> jmpInstructions {{
+        X64Instruction::make(0x0, Insn::JMP_RM64, 1, RM64{true, R64::RAX, {}}),
+    }};
+    std::array<X64Instruction, 2> targetInstructions {{
+        X64Instruction::make(0x100, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x101, Insn::JMP_U32, 1, (u32)0x200),
+    }};
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    CodeSegment jmpSegment(cpu.createBasicBlock(jmpInstructions.data(), jmpInstructions.size()));
+    CodeSegment targetSegment(cpu.createBasicBlock(targetInstructions.data(), targetInstructions.size()));
+
+    auto forceCompilation = [&](CodeSegment* seg) {
+        CompilationQueue compilationQueue;
+        for(int i = 0; i < 100 && !seg->jitBasicBlock(); ++i) {
+            seg->onCall(jit.get(), compilationQueue);
+        }
+        return !!seg->jitBasicBlock();
+    };
+    if(!forceCompilation(&jmpSegment)) return 1;
+    if(!forceCompilation(&targetSegment)) return 1;
+
+    auto run = [&](u64* ticks, CodeSegment** segptr) {
+        cpu.set(R64::RAX, 0x100);
+        cpu.set(R64::RCX, 0x1);
+        cpu.set(R64::RIP, 0x0);
+        *ticks = 0;
+        *segptr = &jmpSegment;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)jmpSegment.jitBasicBlock()->callEntrypoint(), ticks, (void**)segptr, jmpSegment.jitBasicBlock());
+    };
+
+    // unknown target: leave the jit
+    {
+        u64 ticks { 0 };
+        CodeSegment* segptr = nullptr;
+        run(&ticks, &segptr);
+        if(ticks != 1) return 1;
+        if(segptr != &jmpSegment) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+        if(cpu.get(R64::RCX) != 0x1) return 1;
+    }
+
+    // cached target: go straight to its native code
+    jit->addIndirectBranchTarget(targetSegment.start(), targetSegment.jitBasicBlock());
+    {
+        u64 ticks { 0 };
+        CodeSegment* segptr = nullptr;
+        run(&ticks, &segptr);
+        if(ticks != 3) return 1;
+        if(segptr != &targetSegment) return 1;
+        if(cpu.get(R64::RIP) != 0x200) return 1;
+        if(cpu.get(R64::RCX) != 0x2) return 1;
+    }
+
+    // another address in the same entry does not match
+    {
+        u64 other = targetSegment.start() + (IndirectBranchCache::SIZE << 16);
+        if(IndirectBranchCache::indexOf(other) != IndirectBranchCache::indexOf(targetSegment.start())) return 1;
+        cpu.set(R64::RAX, other);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        CodeSegment* segptr = &jmpSegment;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)jmpSegment.jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, jmpSegment.jitBasicBlock());
+        if(segptr != &jmpSegment) return 1;
+        if(cpu.get(R64::RIP) != other) return 1;
+    }
+
+    // cleared cache: leave the jit again
+    jit->clearIndirectBranchCache();
+    {
+        u64 ticks { 0 };
+        CodeSegment* segptr = nullptr;
+        run(&ticks, &segptr);
+        if(ticks != 1) return 1;
+        if(segptr != &jmpSegment) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+    }
+
+    return 0;
+}
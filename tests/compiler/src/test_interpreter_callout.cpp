@@ -0,0 +1,62 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include <sys/mman.h>
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    // BTC is not supported by the compiler and goes through the interpreter
+    std::array<X64Instruction, 5> instructions {{
+        X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{0x10}),
+        X64Instruction::make(0x1, Insn::BTC_RM64_IMM, 1, RM64{true, R64::RAX, {}}, Imm{0x4}),
+        X64Instruction::make(0x2, Insn::SET_RM8, 1, Cond::B, RM8{true, R8::DL, {}}),
+        X64Instruction::make(0x3, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x4, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    for(int optimizationLevel : {0, 1}) {
+        JitStats stats;
+        Compiler compiler;
+        compiler.setStats(&stats);
+        auto nativebb = compiler.tryCompile(bb, optimizationLevel, &basicBlockData, &jitBasicBlockData);
+        if(!nativebb) return 1;
+        if(stats.interpretedInstructions_ != 1) return 1;
+
+        void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+        if(bbptr == (void*)MAP_FAILED) return 1;
+        ::memcpy(bbptr, nativebb->nativecode.data(), nativebb->nativecode.size());
+
+        cpu.set(R64::RAX, 0x0);
+        cpu.set(R64::RCX, 0x1);
+        cpu.set(R64::RDX, 0x0);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        void* basicBlockPtr = nullptr;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+        if(ticks != 5) return 1;
+        if(cpu.get(R64::RAX) != 0x0) return 1;
+        if(cpu.get(R64::RCX) != 0x2) return 1;
+        if(cpu.get(R64::RDX) != 0x1) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+        ::munmap(bbptr, 0x1000);
+    }
+
+    return 0;
+}
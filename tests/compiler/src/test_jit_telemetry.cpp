@@ -0,0 +1,91 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+#include "x64/jittelemetry.h"
+#include <sstream>
+
+int main() {
+    using namespace x64;
+
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    // cpuid is left to the interpreter, ud2 cannot be
+    std::array<X64Instruction, 4> delegated {{
+        X64Instruction::make(0x10, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x11, Insn::CPUID, 1),
+        X64Instruction::make(0x12, Insn::INC_RM64, 1, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(0x13, Insn::JMP_U32, 1, (u32)0x10),
+    }};
+    std::array<X64Instruction, 2> failing {{
+        X64Instruction::make(0x20, Insn::UD2, 1),
+        X64Instruction::make(0x21, Insn::JMP_U32, 1, (u32)0x10),
+    }};
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    jit->setTieredCompilation(false);
+    jit->setOptimizationLevel(1);
+    CompilationQueue compilationQueue;
+
+    auto compile = [&](CodeSegment* segment) {
+        for(int i = 0; i < 10000 && !segment->telemetry(); ++i) {
+            segment->onCpuCall();
+            segment->onCall(jit.get(), compilationQueue);
+        }
+        return segment->telemetry();
+    };
+
+    CodeSegment head(cpu.createBasicBlock(delegated.data(), delegated.size()));
+    auto telemetry = compile(&head);
+    if(!telemetry || !telemetry->compiled) return 1;
+    if(!head.jitBasicBlock()) return 1;
+    if(telemetry->guestInstructions != 4) return 1;
+    if(telemetry->interpretedInstructions != 1) return 1;
+    if(telemetry->nativeCodeSize == 0 || telemetry->nativeCodeSize > head.jitBasicBlock()->codeSize()) return 1;
+    if(telemetry->irInstructionsBeforeOptimization == 0) return 1;
+    if(telemetry->irInstructionsAfterOptimization > telemetry->irInstructionsBeforeOptimization) return 1;
+    if(!telemetry->firstUnsupportedInstruction) return 1;
+    if(telemetry->firstUnsupportedInstruction->insn() != Insn::CPUID) return 1;
+
+    CodeSegment tail(cpu.createBasicBlock(failing.data(), failing.size()));
+    telemetry = compile(&tail);
+    if(!telemetry || telemetry->compiled) return 1;
+    if(!!tail.jitBasicBlock()) return 1;
+    if(!telemetry->firstUnsupportedInstruction) return 1;
+    if(telemetry->firstUnsupportedInstruction->insn() != Insn::UD2) return 1;
+
+    if(JitTelemetryReport::formatOf("report.json") != JitTelemetryReport::Format::JSON) return 1;
+    if(JitTelemetryReport::formatOf("report.csv") != JitTelemetryReport::Format::CSV) return 1;
+    if(!!JitTelemetryReport::formatOf("report.txt")) return 1;
+
+    JitTelemetryReport report;
+    report.add(head, "head");
+    report.add(tail, "tail \"quoted\"");
+    if(report.size() != 2) return 1;
+
+    std::stringstream csv;
+    report.write(csv, JitTelemetryReport::Format::CSV);
+    std::string line;
+    if(!std::getline(csv, line)) return 1;
+    if(line.rfind("address,source,calls,", 0) != 0) return 1;
+    if(!std::getline(csv, line)) return 1;
+    if(line.rfind("0x10,\"head\",", 0) != 0) return 1;
+    if(line.find(std::to_string((u32)Insn::CPUID) + ",\"cpuid") == std::string::npos) return 1;
+    if(!std::getline(csv, line)) return 1;
+    if(line.rfind("0x20,\"tail \"\"quoted\"\"\",", 0) != 0) return 1;
+    if(std::getline(csv, line)) return 1;
+
+    std::stringstream json;
+    report.write(json, JitTelemetryReport::Format::JSON);
+    std::string text = json.str();
+    if(text.front() != '[') return 1;
+    if(text.find("\"source\": \"tail \\\"quoted\\\"\"") == std::string::npos) return 1;
+    if(text.find("\"compiled\": false") == std::string::npos) return 1;
+    if(text.find("\"interpreted_instructions\": 1,") == std::string::npos) return 1;
+
+    return 0;
+}
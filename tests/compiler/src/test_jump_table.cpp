@@ -0,0 +1,133 @@
+#include "x64/compiler/jit.h"
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+
+using namespace x64;
+
+static M64 tableEntry() {
+    return M64 { Segment::DS, Encoding64 { R64::RDI, R64::RAX, 8, 0 } };
+}
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rw = BitFlags<PROT>(PROT::READ, PROT::WRITE);
+    auto flags = BitFlags<MAP>(MAP::ANONYMOUS, MAP::PRIVATE);
+    auto maybe_data = mmu.mmap(0x0, 0x1000, rw, flags);
+    if(!maybe_data) return 1;
+    u64 data = maybe_data.value();
+    Cpu cpu(mmu);
+
+    // the table is found through the base register
+    {
+        std::array<X64Instruction, 2> instructions {{
+            X64Instruction::make(0x10, Insn::LEA_R64_ENCODING64, 7, R64::RDI, Encoding64 { R64::RIP, R64::ZERO, 1, 0x100 }),
+            X64Instruction::make(0x17, Insn::JMP_RM64, 3, RM64{false, R64::ZERO, tableEntry()}),
+        }};
+        auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+        if(bb.jumpTableAddress() != std::optional<u64>(0x117)) return 1;
+    }
+    // but not once the base has been written to again
+    {
+        std::array<X64Instruction, 3> instructions {{
+            X64Instruction::make(0x10, Insn::LEA_R64_ENCODING64, 7, R64::RDI, Encoding64 { R64::RIP, R64::ZERO, 1, 0x100 }),
+            X64Instruction::make(0x17, Insn::ADD_RM64_RM64, 3, RM64{true, R64::RDI, {}}, RM64{true, R64::RCX, {}}),
+            X64Instruction::make(0x1a, Insn::JMP_RM64, 3, RM64{false, R64::ZERO, tableEntry()}),
+        }};
+        auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+        if(!!bb.jumpTableAddress()) return 1;
+    }
+    {
+        std::array<X64Instruction, 3> instructions {{
+            X64Instruction::make(0x10, Insn::LEA_R64_ENCODING64, 7, R64::RDI, Encoding64 { R64::RIP, R64::ZERO, 1, 0x100 }),
+            X64Instruction::make(0x17, Insn::CMP_RM64_IMM, 4, RM64{true, R64::RAX, {}}, Imm{0x3}),
+            X64Instruction::make(0x1b, Insn::JMP_RM64, 3, RM64{false, R64::ZERO, tableEntry()}),
+        }};
+        auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+        if(bb.jumpTableAddress() != std::optional<u64>(0x117)) return 1;
+    }
+    {
+        std::array<X64Instruction, 1> instructions {{
+            X64Instruction::make(0x10, Insn::JMP_RM64, 3, RM64{false, R64::ZERO, tableEntry()}),
+        }};
+        auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+        if(!!bb.jumpTableAddress()) return 1;
+    }
+
+    // a switch over three cases, each of which adds its own value to RDX
+    std::array<X64Instruction, 1> head {{
+        X64Instruction::make(0x10, Insn::JMP_RM64, 3, RM64{false, R64::ZERO, tableEntry()}),
+    }};
+    std::vector<std::vector<X64Instruction>> cases;
+    for(u32 i = 0; i < 3; ++i) {
+        u64 start = 0x100*(i+1);
+        cases.push_back({
+            X64Instruction::make(start, Insn::ADD_RM64_IMM, 4, RM64{true, R64::RDX, {}}, Imm{0x10*(i+1)}),
+            X64Instruction::make(start+4, Insn::JMP_U32, 5, (u32)0x1000),
+        });
+    }
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+
+    auto headBb = cpu.createBasicBlock(head.data(), head.size());
+    auto* headJbb = jit->tryCompile(headBb, &basicBlockData);
+    if(!headJbb) return 1;
+
+    std::vector<BasicBlock> caseBbs;
+    for(const auto& c : cases) caseBbs.push_back(cpu.createBasicBlock(c.data(), c.size()));
+    std::array<u64, 3> targets { 0x100, 0x200, 0x300 };
+    std::array<const JitBasicBlock*, 3> blocks;
+    for(size_t i = 0; i < caseBbs.size(); ++i) {
+        blocks[i] = jit->tryCompile(caseBbs[i], &basicBlockData);
+        if(!blocks[i]) return 1;
+    }
+
+    // only the jump table knows about the cases
+    headJbb->syncJumpTable(data, targets.size(), targets.data(), blocks.data());
+    for(u64 i = 0; i < 8; ++i) mmu.write64(Ptr64{data+8*i}, 0x100*(i%3+1));
+
+    auto run = [&](u64 index) {
+        Cpu::State state;
+        state.regs.set(R64::RDI, data);
+        state.regs.set(R64::RAX, index);
+        state.regs.set(R64::RDX, 0);
+        state.regs.set(R64::RIP, 0x10);
+        cpu.load(state);
+        u64 ticks { 0 };
+        void* basicBlockPtr = &basicBlockData;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)headJbb->callEntrypoint(), &ticks, &basicBlockPtr, headJbb);
+    };
+
+    // each entry leads to its case without leaving the jitted code
+    for(u64 i = 0; i < targets.size(); ++i) {
+        run(i);
+        if(cpu.get(R64::RIP) != 0x1000) return 1;
+        if(cpu.get(R64::RDX) != 0x10*(i+1)) return 1;
+    }
+
+    // entries outside of the table leave the jitted code
+    run(4);
+    if(cpu.get(R64::RIP) != 0x200) return 1;
+    if(cpu.get(R64::RDX) != 0) return 1;
+
+    // so do entries that the guest has changed since
+    mmu.write64(Ptr64{data+8}, 0x300);
+    run(1);
+    if(cpu.get(R64::RIP) != 0x300) return 1;
+    if(cpu.get(R64::RDX) != 0) return 1;
+
+    // and entries whose block is gone
+    mmu.write64(Ptr64{data+8}, 0x200);
+    blocks[1] = nullptr;
+    headJbb->syncJumpTable(data, targets.size(), targets.data(), blocks.data());
+    run(1);
+    if(cpu.get(R64::RIP) != 0x200) return 1;
+    if(cpu.get(R64::RDX) != 0) return 1;
+
+    return 0;
+}
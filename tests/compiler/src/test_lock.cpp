@@ -0,0 +1,116 @@
+#include "x64/compiler/jit.h"
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+
+using namespace x64;
+
+template<Size size>
+static M<size> at(i32 offset) {
+    return M<size> { Segment::DS, Encoding64 { R64::RDI, R64::ZERO, 1, offset } };
+}
+
+static BasicBlock create(Cpu* cpu) {
+    std::vector<X64Instruction> instructions;
+    auto lock = [&](X64Instruction ins) {
+        ins.setLock();
+        instructions.push_back(ins);
+    };
+    u64 address = 0;
+    lock(X64Instruction::make(address++, Insn::LOCK_ADD_M64_IMM, 1, at<Size::QWORD>(0x0), Imm{5}));
+    lock(X64Instruction::make(address++, Insn::LOCK_XADD_M32_R32, 1, at<Size::DWORD>(0x8), R32::ECX));
+    lock(X64Instruction::make(address++, Insn::LOCK_INC_M16, 1, at<Size::WORD>(0xc)));
+    lock(X64Instruction::make(address++, Insn::LOCK_BTS_M64_IMM, 1, at<Size::QWORD>(0x10), Imm{3}));
+    lock(X64Instruction::make(address++, Insn::LOCK_CMPXCHG_M64_R64, 1, at<Size::QWORD>(0x18), R64::RBX));
+    lock(X64Instruction::make(address++, Insn::LOCK_CMPXCHG_M32_R32, 1, at<Size::DWORD>(0x20), R32::EBX));
+    instructions.push_back(X64Instruction::make(address++, Insn::XCHG_RM64_R64, 1, RM64{false, R64::ZERO, at<Size::QWORD>(0x28)}, R64::RDX));
+    lock(X64Instruction::make(address++, Insn::LOCK_SUB_M8_RM8, 1, at<Size::BYTE>(0x30), RM8{true, R8::CL, {}}));
+    lock(X64Instruction::make(address++, Insn::LOCK_CMPXCHG16B_M128, 1, at<Size::XWORD>(0x40)));
+    lock(X64Instruction::make(address++, Insn::LOCK_DEC_M8, 1, at<Size::BYTE>(0x31)));
+    instructions.push_back(X64Instruction::make(address++, Insn::JMP_U32, 1, (u32)0xaaaa));
+    return cpu->createBasicBlock(instructions.data(), instructions.size());
+}
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rw = BitFlags<PROT>(PROT::READ, PROT::WRITE);
+    auto flags = BitFlags<MAP>(MAP::ANONYMOUS, MAP::PRIVATE);
+    auto maybe_data = mmu.mmap(0x0, 0x1000, rw, flags);
+    if(!maybe_data) return 1;
+    u64 data = maybe_data.value();
+    Cpu cpu(mmu);
+
+    auto reset = [&]() {
+        mmu.write64(Ptr64{data+0x0}, 0x10);
+        mmu.write64(Ptr64{data+0x8}, 0x0000000100000020);
+        mmu.write64(Ptr64{data+0x10}, 0x1);
+        mmu.write64(Ptr64{data+0x18}, 0x1234);
+        mmu.write64(Ptr64{data+0x20}, 0x5678);
+        mmu.write64(Ptr64{data+0x28}, 0xabcd);
+        mmu.write64(Ptr64{data+0x30}, 0x0110);
+        mmu.write64(Ptr64{data+0x40}, 0x5678);
+        mmu.write64(Ptr64{data+0x48}, 0xabcd);
+        Cpu::State state;
+        state.regs.set(R64::RDI, data);
+        state.regs.set(R64::RAX, 0x1234);
+        state.regs.set(R64::RBX, 0xcafe);
+        state.regs.set(R64::RCX, 0x3);
+        state.regs.set(R64::RDX, 0x2222);
+        cpu.load(state);
+    };
+
+    auto read = [&]() {
+        std::array<u64, 10> values;
+        for(u64 i = 0; i < values.size(); ++i) values[i] = mmu.read64(Ptr64{data+8*i});
+        return values;
+    };
+
+    // reference run in the interpreter
+    reset();
+    auto bb = create(&cpu);
+    cpu.exec(bb);
+    Cpu::State expectedState;
+    cpu.save(&expectedState);
+    auto expectedValues = read();
+
+    if(expectedValues[0] != 0x15) return 1;
+    if(expectedValues[1] != 0x0000000200000023) return 1;
+    if(expectedValues[2] != 0x9) return 1;
+    if(expectedValues[3] != 0xcafe) return 1;
+    if(expectedValues[4] != 0x5678) return 1;
+    if(expectedValues[5] != 0x2222) return 1;
+    if(expectedValues[6] != 0x00f0) return 1;
+    if(expectedValues[8] != 0xcafe) return 1;
+    if(expectedValues[9] != 0x20) return 1;
+    if(expectedState.regs.get(R64::RCX) != 0x20) return 1;
+    if(expectedState.regs.get(R64::RAX) != 0x5678) return 1;
+    if(expectedState.regs.get(R64::RDX) != 0xabcd) return 1;
+    if(!expectedState.flags.zero()) return 1;
+
+    // the jitted block performs the same accesses
+    reset();
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    auto* jbb = jit->tryCompile(bb, nullptr);
+    if(!jbb) return 1;
+
+    u64 ticks { 0 };
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    void* basicBlockPtr = &basicBlockData;
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+    jit->exec(&cpu, &mmu, (NativeExecPtr)jbb->callEntrypoint(), &ticks, &basicBlockPtr, &jitBasicBlockData);
+    Cpu::State state;
+    cpu.save(&state);
+
+    if(read() != expectedValues) return 1;
+    for(R64 reg : { R64::RAX, R64::RBX, R64::RCX, R64::RDX, R64::RDI }) {
+        if(state.regs.get(reg) != expectedState.regs.get(reg)) return 1;
+    }
+    if(state.flags.toRflags() != expectedState.flags.toRflags()) return 1;
+
+    return 0;
+}
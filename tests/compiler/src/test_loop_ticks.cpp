@@ -0,0 +1,89 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    // a self loop
+    std::array<X64Instruction, 2> loop {{
+        X64Instruction::make(0x0, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x1, Insn::JMP_U32, 1, (u32)0x0),
+    }};
+
+    // a loop over two segments
+    std::array<X64Instruction, 2> first {{
+        X64Instruction::make(0x10, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x11, Insn::JMP_U32, 1, (u32)0x20),
+    }};
+    std::array<X64Instruction, 3> second {{
+        X64Instruction::make(0x20, Insn::INC_RM64, 1, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(0x21, Insn::INC_RM64, 1, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(0x22, Insn::JMP_U32, 1, (u32)0x10),
+    }};
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    CompilationQueue compilationQueue;
+
+    auto compile = [&](CodeSegment* segment) {
+        for(int i = 0; i < 10000 && !segment->jitBasicBlock(); ++i) {
+            segment->onCall(jit.get(), compilationQueue);
+        }
+        return !!segment->jitBasicBlock();
+    };
+
+    auto run = [&](CodeSegment* segment, u64 tickLimit, u64* ticks) {
+        cpu.set(R64::RCX, 0x0);
+        cpu.set(R64::RDX, 0x0);
+        cpu.set(R64::RIP, segment->start());
+        CodeSegment* segptr = segment;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)segment->jitBasicBlock()->callEntrypoint(), ticks, (void**)&segptr, segment->jitBasicBlock(), tickLimit);
+    };
+
+    CodeSegment self(cpu.createBasicBlock(loop.data(), loop.size()));
+    if(!compile(&self)) return 1;
+    self.addSuccessor(&self);
+    self.tryPatch(*jit);
+
+    // the chained loop returns once the limit is reached, after a whole iteration
+    {
+        u64 ticks { 0 };
+        run(&self, 1000, &ticks);
+        if(ticks != 1000) return 1;
+        if(cpu.get(R64::RCX) != 500) return 1;
+        if(cpu.get(R64::RIP) != 0x0) return 1;
+    }
+    {
+        u64 ticks { 5 };
+        run(&self, 1000, &ticks);
+        if(ticks != 1001) return 1;
+        if(cpu.get(R64::RCX) != 498) return 1;
+    }
+
+    CodeSegment head(cpu.createBasicBlock(first.data(), first.size()));
+    CodeSegment tail(cpu.createBasicBlock(second.data(), second.size()));
+    if(!compile(&head)) return 1;
+    if(!compile(&tail)) return 1;
+    head.addSuccessor(&tail);
+    tail.addSuccessor(&head);
+    head.tryPatch(*jit);
+    tail.tryPatch(*jit);
+
+    // the loop is found across segments
+    {
+        u64 ticks { 0 };
+        run(&head, 1000, &ticks);
+        if(ticks < 1000 || ticks >= 1000 + 5) return 1;
+        if(cpu.get(R64::RCX) != 200) return 1;
+        if(cpu.get(R64::RDX) != 400) return 1;
+        if(cpu.get(R64::RIP) != 0x10 && cpu.get(R64::RIP) != 0x20) return 1;
+    }
+
+    return 0;
+}
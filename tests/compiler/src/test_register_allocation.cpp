@@ -0,0 +1,98 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include <sys/mman.h>
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<X64Instruction, 7> instructions {{
+        X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{0x5}),
+        X64Instruction::make(0x1, Insn::ADD_RM64_RM64, 1, RM64{true, R64::RAX, {}}, RM64{true, R64::RBX, {}}),
+        X64Instruction::make(0x2, Insn::INC_RM64, 1, RM64{true, R64::RAX, {}}),
+        X64Instruction::make(0x3, Insn::ADD_RM64_IMM, 1, RM64{true, R64::RCX, {}}, Imm{0x10}),
+        X64Instruction::make(0x4, Insn::XOR_RM64_RM64, 1, RM64{true, R64::RCX, {}}, RM64{true, R64::RAX, {}}),
+        X64Instruction::make(0x5, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x6, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+
+    JitStats stats;
+    Compiler compiler;
+    compiler.setStats(&stats);
+    auto nativebb = compiler.tryCompile(bb, 1, &basicBlockData, &jitBasicBlockData);
+    if(!nativebb) return 1;
+
+    // RAX and RCX are both accessed often enough to be kept in host registers
+    if(stats.allocatedGuestRegisters_ != 2) return 1;
+    if(stats.compiledGuestInstructions_ != instructions.size()) return 1;
+
+    void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+    if(bbptr == (void*)MAP_FAILED) return 1;
+    ::memcpy(bbptr, nativebb->nativecode.data(), nativebb->nativecode.size());
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    cpu.set(R64::RAX, 0x0);
+    cpu.set(R64::RBX, 0x7);
+    cpu.set(R64::RCX, 0x1);
+    cpu.set(R64::RIP, 0x0);
+    u64 ticks { 0 };
+    void* basicBlockPtr = nullptr;
+    jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+    if(ticks != 7) return 1;
+    if(cpu.get(R64::RAX) != 0xd) return 1;
+    if(cpu.get(R64::RBX) != 0x7) return 1;
+    if(cpu.get(R64::RCX) != 0x1d) return 1;
+    if(cpu.get(R64::RIP) != 0x100) return 1;
+
+    // BTC goes through the interpreter: RAX is spilled before it and reloaded after it
+    std::array<X64Instruction, 6> calloutInstructions {{
+        X64Instruction::make(0x0, Insn::ADD_RM64_RM64, 1, RM64{true, R64::RAX, {}}, RM64{true, R64::RBX, {}}),
+        X64Instruction::make(0x1, Insn::INC_RM64, 1, RM64{true, R64::RAX, {}}),
+        X64Instruction::make(0x2, Insn::BTC_RM64_IMM, 1, RM64{true, R64::RAX, {}}, Imm{0x4}),
+        X64Instruction::make(0x3, Insn::INC_RM64, 1, RM64{true, R64::RAX, {}}),
+        X64Instruction::make(0x4, Insn::ADD_RM64_RM64, 1, RM64{true, R64::RAX, {}}, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x5, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto calloutBb = cpu.createBasicBlock(calloutInstructions.data(), calloutInstructions.size());
+
+    JitStats calloutStats;
+    compiler.setStats(&calloutStats);
+    auto calloutNativebb = compiler.tryCompile(calloutBb, 1, &basicBlockData, &jitBasicBlockData);
+    if(!calloutNativebb) return 1;
+    if(calloutStats.interpretedInstructions_ != 1) return 1;
+
+    // both sides of the callout share the same host register
+    if(calloutStats.allocatedGuestRegisters_ != 1) return 1;
+
+    ::memcpy(bbptr, calloutNativebb->nativecode.data(), calloutNativebb->nativecode.size());
+
+    cpu.set(R64::RAX, 0x0);
+    cpu.set(R64::RBX, 0x7);
+    cpu.set(R64::RCX, 0x7);
+    cpu.set(R64::RIP, 0x0);
+    ticks = 0;
+    jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+    if(ticks != 6) return 1;
+    if(cpu.get(R64::RAX) != 0x20) return 1;
+    if(cpu.get(R64::RBX) != 0x7) return 1;
+    if(cpu.get(R64::RCX) != 0x7) return 1;
+    if(cpu.get(R64::RIP) != 0x100) return 1;
+
+    return 0;
+}
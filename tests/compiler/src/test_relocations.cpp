@@ -0,0 +1,92 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/codecache.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include <algorithm>
+#include <sys/mman.h>
+
+namespace {
+
+    // Runs the code relocated for other blocks, as another process would after loading it from the cache
+    bool runRelocated(x64::Cpu* cpu, x64::Mmu* mmu, x64::Jit* jit, const x64::BasicBlock& bb, x64::NativeBasicBlock nativebb, void* basicBlockData, void* jitBasicBlockData) {
+        using namespace x64;
+        if(!CodeCache::relocate(&nativebb, {&bb}, {basicBlockData}, jitBasicBlockData)) return false;
+        void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+        if(bbptr == (void*)MAP_FAILED) return false;
+        ::memcpy(bbptr, nativebb.nativecode.data(), nativebb.nativecode.size());
+        cpu->set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        void* basicBlockPtr = nullptr;
+        jit->exec(cpu, mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, jitBasicBlockData);
+        ::munmap(bbptr, 0x1000);
+        return basicBlockPtr == basicBlockData;
+    }
+
+}
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+    std::array<u64, 0x100> otherBasicBlockData;
+    std::fill(otherBasicBlockData.begin(), otherBasicBlockData.end(), 0);
+    std::array<u64, 0x100> otherJitBasicBlockData;
+    std::fill(otherJitBasicBlockData.begin(), otherJitBasicBlockData.end(), 0);
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    // BTC goes through the interpreter: the code refers to the instruction, its handler and the interpreter
+    std::array<X64Instruction, 3> callout {{
+        X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{0x10}),
+        X64Instruction::make(0x1, Insn::BTC_RM64_IMM, 1, RM64{true, R64::RAX, {}}, Imm{0x4}),
+        X64Instruction::make(0x2, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+    auto calloutbb = cpu.createBasicBlock(callout.data(), callout.size());
+
+    // a guest immediate that happens to be a host pointer of the block
+    std::array<X64Instruction, 2> lookalike {{
+        X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{(u64)&jitBasicBlockData}),
+        X64Instruction::make(0x1, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+    auto lookalikebb = cpu.createBasicBlock(lookalike.data(), lookalike.size());
+
+    for(int optimizationLevel : {0, 1}) {
+        Compiler compiler;
+        auto nativebb = compiler.tryCompile(calloutbb, optimizationLevel, &basicBlockData, &jitBasicBlockData);
+        if(!nativebb) return 1;
+        if(!nativebb->relocatable) return 1;
+        for(auto kind : {NativeRelocation::Kind::BASIC_BLOCK,
+                         NativeRelocation::Kind::JIT_BASIC_BLOCK,
+                         NativeRelocation::Kind::INSTRUCTION,
+                         NativeRelocation::Kind::INSTRUCTION_HANDLER,
+                         NativeRelocation::Kind::INTERPRETER_ENTRYPOINT}) {
+            if(std::none_of(nativebb->relocations.begin(), nativebb->relocations.end(), [&](const NativeRelocation& relocation) {
+                return relocation.kind == kind;
+            })) return 1;
+        }
+        cpu.set(R64::RAX, 0x0);
+        if(!runRelocated(&cpu, &mmu, jit.get(), calloutbb, nativebb.value(), &otherBasicBlockData, &otherJitBasicBlockData)) return 1;
+        if(cpu.get(R64::RAX) != 0x0) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+
+        // the immediate is left alone, and the code is kept out of the cache
+        nativebb = compiler.tryCompile(lookalikebb, optimizationLevel, &basicBlockData, &jitBasicBlockData);
+        if(!nativebb) return 1;
+        if(nativebb->relocatable) return 1;
+        cpu.set(R64::RAX, 0x0);
+        if(!runRelocated(&cpu, &mmu, jit.get(), lookalikebb, nativebb.value(), &otherBasicBlockData, &otherJitBasicBlockData)) return 1;
+        if(cpu.get(R64::RAX) != (u64)&jitBasicBlockData) return 1;
+        if(cpu.get(R64::RIP) != 0x100) return 1;
+    }
+
+    return 0;
+}
@@ -98,7 +98,7 @@ int main() {
             
         cpu.save(&state);
         fmt::println("ticks={}", ticks);
-        fmt::println("callstack size={} [{:#x}]", jit->callstackSize(), (u64)(jit->callstack()[0]));
+        fmt::println("callstack size={} [{:#x}]", jit->callstackSize(), (u64)jit->callstack()[0].landingPad);
         fmt::println("rip={:#x}", cpu.get(R64::RIP));
         fmt::println("rsp={:#x}", cpu.get(R64::RSP));
         fmt::println("rflags={:#x}", state.flags.toRflags());
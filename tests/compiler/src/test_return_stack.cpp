@@ -0,0 +1,108 @@
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/codesegment.h"
+
+using namespace x64;
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(0x10);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rwx = BitFlags<PROT>{PROT::READ, PROT::WRITE, PROT::EXEC};
+    auto rw = BitFlags<PROT>{PROT::READ, PROT::WRITE};
+    auto flags = BitFlags<MAP>{MAP::ANONYMOUS, MAP::PRIVATE};
+    auto code = mmu.mmap(0, Mmu::PAGE_SIZE, rwx, flags);
+    if(!code) return 1;
+    auto stack = mmu.mmap(0, Mmu::PAGE_SIZE, rw, flags);
+    if(!stack) return 1;
+    u64 stackTop = stack.value() + Mmu::PAGE_SIZE;
+    Cpu cpu(mmu);
+
+    // call f (or g); inc rdx; jmp 0, where f returns normally and g returns past the inc.
+    // Both calls return to the same block, so that they share its landing pad.
+    u64 call = code.value() + 0x10;
+    u64 next = call + 5;
+    u64 f = code.value() + 0x100;
+    u64 g = code.value() + 0x200;
+    std::vector<X64Instruction> vecCallf { X64Instruction::make(call, Insn::CALLDIRECT, 5, f) };
+    std::vector<X64Instruction> vecCallg { X64Instruction::make(call, Insn::CALLDIRECT, 5, g) };
+    std::vector<X64Instruction> vecf { X64Instruction::make(f, Insn::RET, 1) };
+    std::vector<X64Instruction> vecg {
+        X64Instruction::make(g, Insn::ADD_RM64_IMM, 5, RM64{false, R64::ZERO, M64{Segment::SS, Encoding64{R64::RSP, R64::ZERO, 1, 0}}}, Imm{0x10}),
+        X64Instruction::make(g+5, Insn::RET, 1),
+    };
+    std::vector<X64Instruction> vecNext {
+        X64Instruction::make(next, Insn::INC_RM64, 3, RM64{true, R64::RDX, {}}),
+        X64Instruction::make(next+3, Insn::JMP_U32, 5, (u32)0),
+    };
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    CodeSegment callfSeg(Cpu::createBasicBlock(vecCallf.data(), vecCallf.size()));
+    CodeSegment callgSeg(Cpu::createBasicBlock(vecCallg.data(), vecCallg.size()));
+    CodeSegment fSeg(Cpu::createBasicBlock(vecf.data(), vecf.size()));
+    CodeSegment gSeg(Cpu::createBasicBlock(vecg.data(), vecg.size()));
+    CodeSegment nextSeg(Cpu::createBasicBlock(vecNext.data(), vecNext.size()));
+
+    auto compile = [&](CodeSegment* seg) {
+        CompilationQueue compilationQueue;
+        for(int i = 0; i < 10000 && !seg->jitBasicBlock(); ++i) {
+            seg->onCall(jit.get(), compilationQueue);
+        }
+        return !!seg->jitBasicBlock();
+    };
+    for(CodeSegment* seg : { &callfSeg, &callgSeg, &fSeg, &gSeg, &nextSeg }) {
+        if(!compile(seg)) return 1;
+    }
+    callfSeg.addSuccessor(&fSeg);
+    callfSeg.addReturn(&nextSeg);
+    callgSeg.addSuccessor(&gSeg);
+    callgSeg.addReturn(&nextSeg);
+    for(CodeSegment* seg : { &callfSeg, &callgSeg, &fSeg, &gSeg, &nextSeg }) seg->tryPatch(*jit);
+    if(callfSeg.jitBasicBlock()->needsPatching()) return 1;
+    if(callgSeg.jitBasicBlock()->needsPatching()) return 1;
+
+    auto run = [&](CodeSegment* seg) {
+        Cpu::State state;
+        state.regs.set(R64::RIP, seg->start());
+        state.regs.set(R64::RSP, stackTop);
+        state.regs.set(R64::RDX, 0);
+        cpu.load(state);
+        u64 ticks = 0;
+        CodeSegment* segptr = seg;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)seg->jitBasicBlock()->callEntrypoint(), &ticks, (void**)&segptr, seg->jitBasicBlock());
+    };
+
+    // the return is predicted, and goes on in the jitted code
+    run(&callfSeg);
+    if(cpu.get(R64::RDX) != 1) return 1;
+    if(cpu.get(R64::RIP) != 0) return 1;
+    if(cpu.get(R64::RSP) != stackTop) return 1;
+    if(jit->callstackSize() != 0) return 1;
+
+    // the return address was changed: the prediction is dropped and the jitted code is left
+    run(&callgSeg);
+    if(cpu.get(R64::RDX) != 0) return 1;
+    if(cpu.get(R64::RIP) != next+0x10) return 1;
+    if(cpu.get(R64::RSP) != stackTop) return 1;
+    if(jit->callstackSize() != 0) return 1;
+
+    // deep callstacks wrap around instead of overflowing
+    for(size_t i = 0; i < CALLSTACK_SIZE+1; ++i) jit->notifyCall();
+    run(&callfSeg);
+    if(cpu.get(R64::RDX) != 1) return 1;
+    for(size_t i = 0; i < CALLSTACK_SIZE+1; ++i) jit->notifyRet();
+    if(jit->callstackSize() != 0) return 1;
+
+    // calls made after the callstack has been nuked are predicted again
+    jit->notifyCall();
+    jit->nukeCallstack();
+    jit->notifyRet();
+    run(&callfSeg);
+    if(cpu.get(R64::RDX) != 1) return 1;
+
+    return 0;
+}
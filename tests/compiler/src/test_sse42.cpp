@@ -0,0 +1,151 @@
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "host/hostinstructions.h"
+#include <sys/mman.h>
+
+using namespace x64;
+
+template<Size size>
+static M<size> at(i32 offset) {
+    return M<size> { Segment::DS, Encoding64 { R64::RDI, R64::ZERO, 1, offset } };
+}
+
+static XMMM128 xmm(XMM reg) { return XMMM128{true, reg, {}}; }
+static XMMM128 xmmAt(i32 offset) { return XMMM128{false, XMM::XMM0, at<Size::XWORD>(offset)}; }
+
+static BasicBlock create(Cpu* cpu) {
+    std::vector<X64Instruction> instructions;
+    u64 address = 0;
+    // strchr-like search for a set of characters, and strcmp-like comparison of two strings
+    instructions.push_back(X64Instruction::make(address++, Insn::PCMPISTRI_XMM_XMMM128_IMM, 1, XMM::XMM1, xmmAt(0x0), Imm{0x00}));
+    instructions.push_back(X64Instruction::make(address++, Insn::MOV_R32_R32, 1, R32::R8D, R32::ECX));
+    instructions.push_back(X64Instruction::make(address++, Insn::PCMPISTRI_XMM_XMMM128_IMM, 1, XMM::XMM2, xmm(XMM::XMM3), Imm{0x18}));
+    instructions.push_back(X64Instruction::make(address++, Insn::MOV_R32_R32, 1, R32::R9D, R32::ECX));
+    // substring search in strings of explicit length
+    instructions.push_back(X64Instruction::make(address++, Insn::PCMPESTRI_XMM_XMMM128_IMM, 1, XMM::XMM2, xmmAt(0x0), Imm{0x0c}));
+    instructions.push_back(X64Instruction::make(address++, Insn::MOV_R32_R32, 1, R32::R10D, R32::ECX));
+    // hashing
+    instructions.push_back(X64Instruction::make(address++, Insn::CRC32_R32_RM8, 1, R32::R11D, RM8{true, R8::BL, {}}));
+    instructions.push_back(X64Instruction::make(address++, Insn::CRC32_R32_RM16, 1, R32::R11D, RM16{false, R16::AX, at<Size::WORD>(0x20)}));
+    instructions.push_back(X64Instruction::make(address++, Insn::CRC32_R32_RM32, 1, R32::R12D, RM32{true, R32::EBX, {}}));
+    instructions.push_back(X64Instruction::make(address++, Insn::CRC32_R64_RM64, 1, R64::R13, RM64{false, R64::RAX, at<Size::QWORD>(0x28)}));
+    // unsigned min and max, and blends
+    instructions.push_back(X64Instruction::make(address++, Insn::PMAXUW_XMM_XMMM128, 1, XMM::XMM4, xmm(XMM::XMM5)));
+    instructions.push_back(X64Instruction::make(address++, Insn::PMINUW_XMM_XMMM128, 1, XMM::XMM5, xmmAt(0x10)));
+    instructions.push_back(X64Instruction::make(address++, Insn::PMAXUD_XMM_XMMM128, 1, XMM::XMM6, xmmAt(0x0)));
+    instructions.push_back(X64Instruction::make(address++, Insn::PMINUD_XMM_XMMM128, 1, XMM::XMM7, xmm(XMM::XMM4)));
+    instructions.push_back(X64Instruction::make(address++, Insn::PBLENDVB_XMM_XMMM128, 1, XMM::XMM8, xmmAt(0x10)));
+    // the flags of the last search are left to the caller
+    instructions.push_back(X64Instruction::make(address++, Insn::PTEST_XMM_XMMM128, 1, XMM::XMM4, xmm(XMM::XMM5)));
+    instructions.push_back(X64Instruction::make(address++, Insn::PCMPISTRI_XMM_XMMM128_IMM, 1, XMM::XMM1, xmm(XMM::XMM3), Imm{0x08}));
+    instructions.push_back(X64Instruction::make(address++, Insn::JMP_U32, 1, (u32)0xaaaa));
+    return cpu->createBasicBlock(instructions.data(), instructions.size());
+}
+
+int main() {
+    if(!host::hostFeatures().sse42) return 0;
+
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rw = BitFlags<PROT>(PROT::READ, PROT::WRITE);
+    auto flags = BitFlags<MAP>(MAP::ANONYMOUS, MAP::PRIVATE);
+    auto maybe_data = mmu.mmap(0x0, 0x1000, rw, flags);
+    if(!maybe_data) return 1;
+    u64 data = maybe_data.value();
+    Cpu cpu(mmu);
+
+    const std::array<R64, 15> registers {{
+        R64::RAX, R64::RBX, R64::RCX, R64::RDX, R64::RSI, R64::RDI,
+        R64::R8, R64::R9, R64::R10, R64::R11, R64::R12, R64::R13, R64::R14, R64::R15, R64::RBP,
+    }};
+    const std::array<XMM, 9> xmms {{
+        XMM::XMM0, XMM::XMM1, XMM::XMM2, XMM::XMM3, XMM::XMM4, XMM::XMM5, XMM::XMM6, XMM::XMM7, XMM::XMM8,
+    }};
+
+    auto reset = [&]() {
+        // "hello, world!" followed by a null byte
+        mmu.write64(Ptr64{data+0x0}, 0x77202c6f6c6c6568);
+        mmu.write64(Ptr64{data+0x8}, 0x00000021646c726f);
+        mmu.write64(Ptr64{data+0x10}, 0x8000ffff00017fff);
+        mmu.write64(Ptr64{data+0x18}, 0x0123456789abcdef);
+        mmu.write64(Ptr64{data+0x20}, 0x00000000000012ab);
+        mmu.write64(Ptr64{data+0x28}, 0xdeadbeefcafebabe);
+        Cpu::State state;
+        for(R64 reg : registers) state.regs.set(reg, 0x5a5a5a5a5a5a5a5a);
+        state.regs.set(R64::RDI, data);
+        state.regs.set(R64::RAX, 3);
+        state.regs.set(R64::RBX, 0x0123456789abcdef);
+        state.regs.set(R64::RDX, 13);
+        state.regs.set(R64::R11, 0xffffffff);
+        state.regs.set(R64::R12, 0x0);
+        state.regs.set(R64::R13, 0xffffffffffffffff);
+        // "lo" and "wor"
+        state.regs.set(XMM::XMM1, u128{0x6f6c, 0x0});
+        state.regs.set(XMM::XMM2, u128{0x726f77, 0x0});
+        state.regs.set(XMM::XMM3, u128{0x77202c6f6c6c6568, 0x00000021646c726f});
+        state.regs.set(XMM::XMM0, u128{0xff00ff00ff00ff00, 0x00ff00ff00ff00ff});
+        state.regs.set(XMM::XMM4, u128{0x0001800000027fff, 0xffff000012345678});
+        state.regs.set(XMM::XMM5, u128{0x8000000100017ffe, 0x0000ffff87654321});
+        state.regs.set(XMM::XMM6, u128{0x8000000000000001, 0x1234567800000000});
+        state.regs.set(XMM::XMM7, u128{0xfffffffe00000010, 0x00000000ffffffff});
+        state.regs.set(XMM::XMM8, u128{0x1111111111111111, 0x2222222222222222});
+        cpu.load(state);
+    };
+
+    // reference run in the interpreter
+    reset();
+    auto bb = create(&cpu);
+    cpu.exec(bb);
+    Cpu::State expectedState;
+    cpu.save(&expectedState);
+
+    // "lo" is first found at index 2 of "hello, world!"
+    if(expectedState.regs.get(R64::R8) != 2) return 1;
+    if(expectedState.regs.get(R64::R10) != 7) return 1;
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    for(int optimizationLevel : {0, 1}) {
+        reset();
+        std::array<u64, 0x100> basicBlockData;
+        std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+        std::array<u64, 0x100> jitBasicBlockData;
+        std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+
+        // every instruction runs natively
+        JitStats stats;
+        Compiler compiler;
+        compiler.setStats(&stats);
+        auto nativebb = compiler.tryCompile(bb, optimizationLevel, &basicBlockData, &jitBasicBlockData);
+        if(!nativebb) return 1;
+        if(stats.interpretedInstructions_ != 0) return 1;
+
+        void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+        if(bbptr == (void*)MAP_FAILED) return 1;
+        ::memcpy(bbptr, nativebb->nativecode.data(), nativebb->nativecode.size());
+
+        u64 ticks { 0 };
+        void* basicBlockPtr = nullptr;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+        ::munmap(bbptr, 0x1000);
+
+        // and computes the same values
+        Cpu::State state;
+        cpu.save(&state);
+        for(R64 reg : registers) {
+            if(state.regs.get(reg) != expectedState.regs.get(reg)) return 1;
+        }
+        for(XMM reg : xmms) {
+            if(state.regs.get(reg) != expectedState.regs.get(reg)) return 1;
+        }
+        if(state.flags.toRflags() != expectedState.flags.toRflags()) return 1;
+    }
+
+    return 0;
+}
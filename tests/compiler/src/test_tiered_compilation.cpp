@@ -0,0 +1,83 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include "x64/codesegment.h"
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<X64Instruction, 3> instructions {{
+        X64Instruction::make(0x0, Insn::MOV_R64_IMM, 1, R64::RAX, Imm{0x10}),
+        X64Instruction::make(0x1, Insn::INC_RM64, 1, RM64{true, R64::RCX, {}}),
+        X64Instruction::make(0x2, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+    JitStats stats;
+    jit->setStats(&stats);
+    if(!jit->tieredCompilationEnabled()) return 1;
+
+    // the first compilation is a cheap one
+    CodeSegment segment(cpu.createBasicBlock(instructions.data(), instructions.size()));
+    CompilationQueue compilationQueue;
+    for(int i = 0; i < 10000 && !segment.jitBasicBlock(); ++i) {
+        segment.onCall(jit.get(), compilationQueue);
+    }
+    const JitBasicBlock* baseline = segment.jitBasicBlock();
+    if(!baseline) return 1;
+    if(stats.tierUpCompilations_ != 0) return 1;
+
+    auto run = [&](const JitBasicBlock* block) -> bool {
+        cpu.set(R64::RAX, 0x0);
+        cpu.set(R64::RCX, 0x1);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        CodeSegment* segptr = &segment;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)block->callEntrypoint(), &ticks, (void**)&segptr, block);
+        return cpu.get(R64::RAX) == 0x10 && cpu.get(R64::RCX) == 0x2 && cpu.get(R64::RIP) == 0x100;
+    };
+
+    // cold code stays at the baseline tier
+    segment.onCall(jit.get(), compilationQueue);
+    if(segment.jitBasicBlock() != baseline) return 1;
+
+    // hot code is recompiled and replaces the baseline code
+    for(int i = 0; i < 0x4000; ++i) {
+        if(!run(baseline)) return 1;
+    }
+    segment.onCall(jit.get(), compilationQueue);
+    const JitBasicBlock* optimized = segment.jitBasicBlock();
+    if(!optimized || optimized == baseline) return 1;
+    if(stats.tierUpCompilations_ != 1) return 1;
+    if(segment.calls() < 0x4000) return 1;
+
+    // code still entering the baseline block is sent to the optimized one
+    if(!run(optimized)) return 1;
+    if(!run(baseline)) return 1;
+
+    // optimized code is never recompiled
+    for(int i = 0; i < 0x4000; ++i) {
+        if(!run(optimized)) return 1;
+    }
+    segment.onCall(jit.get(), compilationQueue);
+    if(segment.jitBasicBlock() != optimized) return 1;
+    if(stats.tierUpCompilations_ != 1) return 1;
+
+    // without tiers, blocks are compiled once at the requested level
+    auto flatJit = Jit::tryCreate();
+    if(!flatJit) return 1;
+    flatJit->setTieredCompilation(false);
+    CodeSegment other(cpu.createBasicBlock(instructions.data(), instructions.size()));
+    for(int i = 0; i < 10000 && !other.jitBasicBlock(); ++i) {
+        other.onCall(flatJit.get(), compilationQueue);
+    }
+    if(!other.jitBasicBlock()) return 1;
+
+    return 0;
+}
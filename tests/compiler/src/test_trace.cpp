@@ -0,0 +1,73 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include <sys/mman.h>
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    Cpu cpu(mmu);
+
+    std::array<X64Instruction, 2> headInstructions {{
+        X64Instruction::make(0x0, Insn::CMP_RM64_IMM, 1, RM64{true, R64::RAX, {}}, Imm{0x20}),
+        X64Instruction::make(0x1, Insn::JE, 1, (u64)0x10),
+    }};
+    std::array<X64Instruction, 2> tailInstructions {{
+        X64Instruction::make(0x10, Insn::MOVZX_R32_RM8, 1, R32::EAX, RM8{true, R8::CL, {}}),
+        X64Instruction::make(0x11, Insn::JMP_U32, 1, (u32)0x0),
+    }};
+
+    auto head = cpu.createBasicBlock(headInstructions.data(), headInstructions.size());
+    auto tail = cpu.createBasicBlock(tailInstructions.data(), tailInstructions.size());
+
+    std::array<u64, 0x100> headData;
+    std::fill(headData.begin(), headData.end(), 0);
+    std::array<u64, 0x100> tailData;
+    std::fill(tailData.begin(), tailData.end(), 0);
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+
+    Compiler compiler;
+    auto nativebb = compiler.tryCompileTrace({&head, &tail}, 1, {&headData, &tailData}, &jitBasicBlockData);
+    if(!nativebb) return 1;
+
+    void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+    if(bbptr == (void*)MAP_FAILED) return 1;
+    ::memcpy(bbptr, nativebb->nativecode.data(), nativebb->nativecode.size());
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    // stay in the trace
+    {
+        cpu.set(R64::RAX, 0x20);
+        cpu.set(R64::RCX, 0x1055cd58);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        void* basicBlockPtr = nullptr;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+        if(ticks != 4) return 1;
+        if(basicBlockPtr != &tailData) return 1;
+        if(cpu.get(R64::RAX) != 0x58) return 1;
+        if(cpu.get(R64::RIP) != 0x0) return 1;
+    }
+
+    // take the side exit
+    {
+        cpu.set(R64::RAX, 0x21);
+        cpu.set(R64::RCX, 0x1055cd58);
+        cpu.set(R64::RIP, 0x0);
+        u64 ticks { 0 };
+        void* basicBlockPtr = nullptr;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+        if(ticks != 2) return 1;
+        if(basicBlockPtr != &headData) return 1;
+        if(cpu.get(R64::RAX) != 0x21) return 1;
+        if(cpu.get(R64::RIP) != 0x2) return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include "x64/compiler/compiler.h"
+#include "x64/compiler/jit.h"
+#include "x64/compiler/jitstats.h"
+#include <sys/mman.h>
+
+int main() {
+    using namespace x64;
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rw = BitFlags<PROT>(PROT::READ, PROT::WRITE);
+    auto flags = BitFlags<MAP>(MAP::ANONYMOUS, MAP::PRIVATE);
+    auto maybeData = mmu.mmap(0x0, 0x1000, rw, flags);
+    if(!maybeData) return 1;
+    u64 data = maybeData.value();
+    Cpu cpu(mmu);
+
+    auto m16 = [](i32 disp) { return M16 { Segment::DS, Encoding64 { R64::RDI, R64::ZERO, 1, disp } }; };
+    auto m32 = [](i32 disp) { return M32 { Segment::DS, Encoding64 { R64::RDI, R64::ZERO, 1, disp } }; };
+    auto m64 = [](i32 disp) { return M64 { Segment::DS, Encoding64 { R64::RDI, R64::ZERO, 1, disp } }; };
+
+    // The mmx instruction leaves the host x87 stack full before the x87 instructions
+    std::array<X64Instruction, 15> instructions {{
+        X64Instruction::make(0x0, Insn::MOVQ_MMX_RM64, 1, MMX::MM0, RM64{false, {}, m64(0x8)}),
+        X64Instruction::make(0x1, Insn::FILD_M32, 1, m32(0x0)),
+        X64Instruction::make(0x2, Insn::FLD_M64, 1, m64(0x8)),
+        X64Instruction::make(0x3, Insn::FMULP_ST_ST, 1, ST::ST1, ST::ST0),
+        X64Instruction::make(0x4, Insn::FLD1, 1),
+        X64Instruction::make(0x5, Insn::FSUBRP_ST, 1, ST::ST1),
+        X64Instruction::make(0x6, Insn::FCHS, 1),
+        X64Instruction::make(0x7, Insn::FLD_ST, 1, ST::ST0),
+        X64Instruction::make(0x8, Insn::FCOMIP_ST_ST, 1, ST::ST0, ST::ST1),
+        X64Instruction::make(0x9, Insn::SET_RM8, 1, Cond::E, RM8{true, R8::DL, {}}),
+        X64Instruction::make(0xa, Insn::FSTP_M64, 1, m64(0x10)),
+        X64Instruction::make(0xb, Insn::FLD_M64, 1, m64(0x8)),
+        X64Instruction::make(0xc, Insn::FISTP_M16, 1, m16(0x18)),
+        X64Instruction::make(0xd, Insn::FLDZ, 1),
+        X64Instruction::make(0xe, Insn::JMP_U32, 1, (u32)0x100),
+    }};
+
+    auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+
+    std::array<u64, 0x100> basicBlockData;
+    std::fill(basicBlockData.begin(), basicBlockData.end(), 0);
+    std::array<u64, 0x100> jitBasicBlockData;
+    std::fill(jitBasicBlockData.begin(), jitBasicBlockData.end(), 0);
+
+    auto jit = Jit::tryCreate();
+    if(!jit) return 1;
+
+    for(int optimizationLevel : {0, 1}) {
+        JitStats stats;
+        Compiler compiler;
+        compiler.setStats(&stats);
+        auto nativebb = compiler.tryCompile(bb, optimizationLevel, &basicBlockData, &jitBasicBlockData);
+        if(!nativebb) return 1;
+        if(stats.interpretedInstructions_ != 0) return 1;
+
+        void* bbptr = ::mmap(nullptr, 0x1000, PROT_EXEC|PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, 0, 0);
+        if(bbptr == (void*)MAP_FAILED) return 1;
+        ::memcpy(bbptr, nativebb->nativecode.data(), nativebb->nativecode.size());
+
+        mmu.write32(Ptr32{data}, 7);
+        mmu.write64(Ptr64{data+0x8}, F80::bitcastToU64(F80::fromLongDouble(2.5)));
+        mmu.write64(Ptr64{data+0x10}, 0);
+        mmu.write16(Ptr16{data+0x18}, 0);
+
+        Cpu::State state;
+        state.regs.set(R64::RAX, 0x0);
+        state.regs.set(R64::RDX, 0x0);
+        state.regs.set(R64::RDI, data);
+        state.regs.set(R64::RIP, 0x0);
+        cpu.load(state);
+        u64 ticks { 0 };
+        void* basicBlockPtr = nullptr;
+        jit->exec(&cpu, &mmu, (NativeExecPtr)bbptr, &ticks, &basicBlockPtr, &jitBasicBlockData);
+        cpu.save(&state);
+        ::munmap(bbptr, 0x1000);
+
+        // 7*2.5 = 17.5, then -(1-17.5) = 16.5
+        if(F80::toLongDouble(F80::bitcastFromU64(mmu.read64(Ptr64{data+0x10}))) != 16.5) return 1;
+        // the conversion truncates
+        if(mmu.read16(Ptr16{data+0x18}) != 2) return 1;
+        // fcomip compared st(0) with itself
+        if(state.regs.get(R64::RDX) != 0x1) return 1;
+
+        // only the value pushed by fldz remains
+        const X87Fpu& fpu = state.x87fpu;
+        if(fpu.top() != 7) return 1;
+        if(F80::toLongDouble(fpu.st(ST::ST0)) != 0.0) return 1;
+        for(u8 reg = 0; reg < 8; ++reg) {
+            u8 expectedTag = (reg == 7) ? X87Tag::VALID : X87Tag::EMPTY;
+            if(fpu.tag().get(reg) != expectedTag) return 1;
+        }
+        if(state.regs.get(R64::RIP) != 0x100) return 1;
+    }
+
+    return 0;
+}
@@ -10,11 +10,11 @@
     static constexpr u64 SIGN_MASK = 0x80;
     static constexpr u64 OVERFLOW_MASK = 0x800;
     x64::Flags flags;
-    flags.carry = rflags & CARRY_MASK;
+    flags.setCarry(rflags & CARRY_MASK);
     flags.setParity(rflags & PARITY_MASK);
-    flags.zero = rflags & ZERO_MASK;
-    flags.sign = rflags & SIGN_MASK;
-    flags.overflow = rflags & OVERFLOW_MASK;
+    flags.setZero(rflags & ZERO_MASK);
+    flags.setSign(rflags & SIGN_MASK);
+    flags.setOverflow(rflags & OVERFLOW_MASK);
     return flags;
 }
 
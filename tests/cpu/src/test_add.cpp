@@ -26,17 +26,17 @@ int compareAdd8(u8 lhs, u8 rhs) {
     u8 virtDiff = runAdd8Virtual(lhs, rhs, &virtFlags);
 
     if(virtDiff == nativeDiff
-    && virtFlags.carry == nativeFlags.carry
-    && virtFlags.zero == nativeFlags.zero
-    && virtFlags.overflow == nativeFlags.overflow
-    && virtFlags.sign == nativeFlags.sign
+    && virtFlags.carry() == nativeFlags.carry()
+    && virtFlags.zero() == nativeFlags.zero()
+    && virtFlags.overflow() == nativeFlags.overflow()
+    && virtFlags.sign() == nativeFlags.sign()
     && virtFlags.parity() == nativeFlags.parity()) return 0;
 
     fmt::print(stderr, "Add8 {:#x} {:#x} failed\n", lhs, rhs);
     fmt::print(stderr, "native : diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        nativeDiff, nativeFlags.carry, nativeFlags.zero, nativeFlags.overflow, nativeFlags.sign, nativeFlags.parity());
+                        nativeDiff, nativeFlags.carry(), nativeFlags.zero(), nativeFlags.overflow(), nativeFlags.sign(), nativeFlags.parity());
     fmt::print(stderr, "virtual: diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        virtDiff, virtFlags.carry, virtFlags.zero, virtFlags.overflow, virtFlags.sign, virtFlags.parity());
+                        virtDiff, virtFlags.carry(), virtFlags.zero(), virtFlags.overflow(), virtFlags.sign(), virtFlags.parity());
     return 1;
 }
 
@@ -62,17 +62,17 @@ int compareAdd64(u64 lhs, u64 rhs) {
     u64 virtDiff = runAdd64Virtual(lhs, rhs, &virtFlags);
 
     if(virtDiff == nativeDiff
-    && virtFlags.carry == nativeFlags.carry
-    && virtFlags.zero == nativeFlags.zero
-    && virtFlags.overflow == nativeFlags.overflow
-    && virtFlags.sign == nativeFlags.sign
+    && virtFlags.carry() == nativeFlags.carry()
+    && virtFlags.zero() == nativeFlags.zero()
+    && virtFlags.overflow() == nativeFlags.overflow()
+    && virtFlags.sign() == nativeFlags.sign()
     && virtFlags.parity() == nativeFlags.parity()) return 0;
 
     fmt::print(stderr, "Add64 {:#x} {:#x} failed\n", lhs, rhs);
     fmt::print(stderr, "native : diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        nativeDiff, nativeFlags.carry, nativeFlags.zero, nativeFlags.overflow, nativeFlags.sign, nativeFlags.parity());
+                        nativeDiff, nativeFlags.carry(), nativeFlags.zero(), nativeFlags.overflow(), nativeFlags.sign(), nativeFlags.parity());
     fmt::print(stderr, "virtual: diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        virtDiff, virtFlags.carry, virtFlags.zero, virtFlags.overflow, virtFlags.sign, virtFlags.parity());
+                        virtDiff, virtFlags.carry(), virtFlags.zero(), virtFlags.overflow(), virtFlags.sign(), virtFlags.parity());
     return 1;
 }
 
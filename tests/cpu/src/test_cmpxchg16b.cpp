@@ -72,7 +72,7 @@ bool test(u128 initial, u128 expected, u128 replacement) {
         emulatedResult = mmu.read128(ptr);
         Cpu::State state;
         cpu.save(&state);
-        emulatedZeroFlag = state.flags.zero;
+        emulatedZeroFlag = state.flags.zero();
     }
 
     if(nativeResult != emulatedResult) return false;
@@ -36,25 +36,25 @@ int compareRcl32(u32 val, bool initialCarry) {
     u32 nativeRcl = runRcl32Native<count>(val, count, &nativeFlags, initialCarry);
 
     x64::Flags virtFlags;
-    virtFlags.carry = initialCarry;
+    virtFlags.setCarry(initialCarry);
     u32 virtRcl = runRcl32Virtual(val, count, &virtFlags);
 
     if(count == 0) {
         if(virtRcl == nativeRcl) return 0;
     } else  if(count == 1) {
         if(virtRcl == nativeRcl
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtRcl == nativeRcl
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "rcl32 {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : rcl={:#x} carry={} overflow={}\n",
-                        nativeRcl, nativeFlags.carry, nativeFlags.overflow);
+                        nativeRcl, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: rcl={:#x} carry={} overflow={}\n",
-                        virtRcl, virtFlags.carry, virtFlags.overflow);
+                        virtRcl, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
@@ -36,25 +36,25 @@ int compareRcr32(u32 val, bool initialCarry) {
     u32 nativeRcr = runRcr32Native<count>(val, count, &nativeFlags, initialCarry);
 
     x64::Flags virtFlags;
-    virtFlags.carry = initialCarry;
+    virtFlags.setCarry(initialCarry);
     u32 virtRcr = runRcr32Virtual(val, count, &virtFlags);
 
     if(count == 0) {
         if(virtRcr == nativeRcr) return 0;
     } else  if(count == 1) {
         if(virtRcr == nativeRcr
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtRcr == nativeRcr
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "rcr32 {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : rcr={:#x} carry={} overflow={}\n",
-                        nativeRcr, nativeFlags.carry, nativeFlags.overflow);
+                        nativeRcr, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: rcr={:#x} carry={} overflow={}\n",
-                        virtRcr, virtFlags.carry, virtFlags.overflow);
+                        virtRcr, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
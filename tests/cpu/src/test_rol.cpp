@@ -31,18 +31,18 @@ int compareRol32(u32 val) {
         if(virtRol == nativeRol) return 0;
     } else  if(count == 1) {
         if(virtRol == nativeRol
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtRol == nativeRol
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "rol32 {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : rol={:#x} carry={} overflow={}\n",
-                        nativeRol, nativeFlags.carry, nativeFlags.overflow);
+                        nativeRol, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: rol={:#x} carry={} overflow={}\n",
-                        virtRol, virtFlags.carry, virtFlags.overflow);
+                        virtRol, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
@@ -31,18 +31,18 @@ int compareRor32(u32 val) {
         if(virtRor == nativeRor) return 0;
     } else  if(count == 1) {
         if(virtRor == nativeRor
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtRor == nativeRor
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "ror32 {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : ror={:#x} carry={} overflow={}\n",
-                        nativeRor, nativeFlags.carry, nativeFlags.overflow);
+                        nativeRor, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: ror={:#x} carry={} overflow={}\n",
-                        virtRor, virtFlags.carry, virtFlags.overflow);
+                        virtRor, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
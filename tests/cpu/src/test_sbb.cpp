@@ -25,7 +25,7 @@ u8 runSbb8Native(u8 lhs, u8 rhs, x64::Flags* flags, bool carry) {
 }
 
 u8 runSbb8Virtual(u8 lhs, u8 rhs, x64::Flags* flags, bool carry) {
-    flags->carry = carry;
+    flags->setCarry(carry);
     return x64::CpuImpl::sbb8(lhs, rhs, flags);
 }
 
@@ -37,17 +37,17 @@ int compareSbb8(u8 lhs, u8 rhs, bool carry) {
     u8 virtDiff = runSbb8Virtual(lhs, rhs, &virtFlags, carry);
 
     if(virtDiff == nativeDiff
-    && virtFlags.carry == nativeFlags.carry
-    && virtFlags.zero == nativeFlags.zero
-    && virtFlags.overflow == nativeFlags.overflow
-    && virtFlags.sign == nativeFlags.sign
+    && virtFlags.carry() == nativeFlags.carry()
+    && virtFlags.zero() == nativeFlags.zero()
+    && virtFlags.overflow() == nativeFlags.overflow()
+    && virtFlags.sign() == nativeFlags.sign()
     && virtFlags.parity() == nativeFlags.parity()) return 0;
 
     fmt::print(stderr, "sbb8 {:#x} {:#x} carry={} failed\n", lhs, rhs, carry);
     fmt::print(stderr, "native : diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        nativeDiff, nativeFlags.carry, nativeFlags.zero, nativeFlags.overflow, nativeFlags.sign, nativeFlags.parity());
+                        nativeDiff, nativeFlags.carry(), nativeFlags.zero(), nativeFlags.overflow(), nativeFlags.sign(), nativeFlags.parity());
     fmt::print(stderr, "virtual: diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        virtDiff, virtFlags.carry, virtFlags.zero, virtFlags.overflow, virtFlags.sign, virtFlags.parity());
+                        virtDiff, virtFlags.carry(), virtFlags.zero(), virtFlags.overflow(), virtFlags.sign(), virtFlags.parity());
     return 1;
 }
 
@@ -72,7 +72,7 @@ u64 runSbb64Native(u64 lhs, u64 rhs, x64::Flags* flags, bool carry) {
 }
 
 u64 runSbb64Virtual(u64 lhs, u64 rhs, x64::Flags* flags, bool carry) {
-    flags->carry = carry;
+    flags->setCarry(carry);
     return x64::CpuImpl::sbb64(lhs, rhs, flags);
 }
 
@@ -84,17 +84,17 @@ int compareSbb64(u64 lhs, u64 rhs, bool carry) {
     u64 virtDiff = runSbb64Virtual(lhs, rhs, &virtFlags, carry);
 
     if(virtDiff == nativeDiff
-    && virtFlags.carry == nativeFlags.carry
-    && virtFlags.zero == nativeFlags.zero
-    && virtFlags.overflow == nativeFlags.overflow
-    && virtFlags.sign == nativeFlags.sign
+    && virtFlags.carry() == nativeFlags.carry()
+    && virtFlags.zero() == nativeFlags.zero()
+    && virtFlags.overflow() == nativeFlags.overflow()
+    && virtFlags.sign() == nativeFlags.sign()
     && virtFlags.parity() == nativeFlags.parity()) return 0;
 
     fmt::print(stderr, "sbb64 {:#x} {:#x} carry={} failed\n", lhs, rhs, carry);
     fmt::print(stderr, "native : diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        nativeDiff, nativeFlags.carry, nativeFlags.zero, nativeFlags.overflow, nativeFlags.sign, nativeFlags.parity());
+                        nativeDiff, nativeFlags.carry(), nativeFlags.zero(), nativeFlags.overflow(), nativeFlags.sign(), nativeFlags.parity());
     fmt::print(stderr, "virtual: diff={:#x} carry={} zero={} overflow={} sign={} parity={}\n",
-                        virtDiff, virtFlags.carry, virtFlags.zero, virtFlags.overflow, virtFlags.sign, virtFlags.parity());
+                        virtDiff, virtFlags.carry(), virtFlags.zero(), virtFlags.overflow(), virtFlags.sign(), virtFlags.parity());
     return 1;
 }
 
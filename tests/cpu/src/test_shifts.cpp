@@ -33,18 +33,18 @@ int compareSar(u64 val) {
         if(virtRes == nativeRes) return 0;
     } else  if(count == 1) {
         if(virtRes == nativeRes
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtRes == nativeRes
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "op {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : res={:#x} carry={} overflow={}\n",
-                        nativeRes, nativeFlags.carry, nativeFlags.overflow);
+                        nativeRes, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: res={:#x} carry={} overflow={}\n",
-                        virtRes, virtFlags.carry, virtFlags.overflow);
+                        virtRes, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
@@ -31,18 +31,18 @@ int compareShl32(u32 val) {
         if(virtShl == nativeShl) return 0;
     } else  if(count == 1) {
         if(virtShl == nativeShl
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtShl == nativeShl
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "shl32 {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : rol={:#x} carry={} overflow={}\n",
-                        nativeShl, nativeFlags.carry, nativeFlags.overflow);
+                        nativeShl, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: rol={:#x} carry={} overflow={}\n",
-                        virtShl, virtFlags.carry, virtFlags.overflow);
+                        virtShl, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
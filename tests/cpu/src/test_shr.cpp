@@ -31,18 +31,18 @@ int compareShr32(u32 val) {
         if(virtShr == nativeShr) return 0;
     } else  if(count == 1) {
         if(virtShr == nativeShr
-        && virtFlags.carry == nativeFlags.carry
-        && virtFlags.overflow == nativeFlags.overflow) return 0;    
+        && virtFlags.carry() == nativeFlags.carry()
+        && virtFlags.overflow() == nativeFlags.overflow()) return 0;    
     } else {
         if(virtShr == nativeShr
-        && virtFlags.carry == nativeFlags.carry) return 0;
+        && virtFlags.carry() == nativeFlags.carry()) return 0;
     }
 
     fmt::print(stderr, "shr32 {:#x} {:#x} failed\n", val, count);
     fmt::print(stderr, "native : rol={:#x} carry={} overflow={}\n",
-                        nativeShr, nativeFlags.carry, nativeFlags.overflow);
+                        nativeShr, nativeFlags.carry(), nativeFlags.overflow());
     fmt::print(stderr, "virtual: rol={:#x} carry={} overflow={}\n",
-                        virtShr, virtFlags.carry, virtFlags.overflow);
+                        virtShr, virtFlags.carry(), virtFlags.overflow());
     return 1;
 }
 
@@ -27,12 +27,12 @@ int compareTzcnt64(u64 value) {
     u64 virtCount = runTzcnt64Virtual(value, &virtFlags);
 
     if(virtCount == nativeCount
-    && virtFlags.carry == nativeFlags.carry
-    && virtFlags.zero == nativeFlags.zero) return 0;
+    && virtFlags.carry() == nativeFlags.carry()
+    && virtFlags.zero() == nativeFlags.zero()) return 0;
 
     fmt::print(stderr, "tzcnt {:#x} failed\n", value);
-    fmt::print(stderr, "native : count={:#x} carry={} zero={}\n", nativeCount, nativeFlags.carry, nativeFlags.zero);
-    fmt::print(stderr, "virtual: count={:#x} carry={} zero={}\n", virtCount, virtFlags.carry, virtFlags.zero);
+    fmt::print(stderr, "native : count={:#x} carry={} zero={}\n", nativeCount, nativeFlags.carry(), nativeFlags.zero());
+    fmt::print(stderr, "virtual: count={:#x} carry={} zero={}\n", virtCount, virtFlags.carry(), virtFlags.zero());
     return 1;
 }
 
@@ -76,6 +76,21 @@ IR testE() {
     return ir;
 }
 
+IR testF() {
+    M64 addressA { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x8 } };
+    M64 addressB { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x10 } };
+    M64 addressC { Segment::UNK, Encoding64 { R64::RCX, R64::RDX, 1, 0x0 } };
+
+    IrGenerator generator;
+    generator.mov(R64::R8, addressA);
+    generator.add(R64::RDI, R64::RDX);
+    generator.mov(addressB, R64::RDI);
+    generator.mov(addressC, R64::RDI);
+    generator.mov(addressA, R64::R8);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
 Optimizer deadCodeOnly() {
     Optimizer optimizer;
     optimizer.addPass<DeadCodeElimination>();
@@ -106,6 +121,7 @@ int main() {
         IrAndOptimizer{&testC, &deadCodeOnly},
         IrAndOptimizer{&testD, &duplicateInstructionOnly},
         IrAndOptimizer{&testE, &duplicateInstructionOnly},
+        IrAndOptimizer{&testF, &deadCodeAndDelayedReadback},
     };
     for(auto func : irs) {
         IR ir = func.ir();
@@ -0,0 +1,135 @@
+#include "x64/compiler/codegenerator.h"
+#include "x64/compiler/ir.h"
+#include "x64/compiler/irgenerator.h"
+#include "x64/compiler/optimizer.h"
+#include <fmt/format.h>
+
+using namespace x64;
+using namespace x64::ir;
+
+// add [rsi+0x20], rbx through a temporary
+IR testLoadOpStore() {
+    M64 address { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x20 } };
+
+    IrGenerator generator;
+    generator.mov(R64::R8, address);
+    generator.add(R64::R8, R64::RBX);
+    generator.mov(address, R64::R8);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
+// sub dword [rcx+r10+0x10], 0x40 through a temporary
+IR testLoadOpImmStore() {
+    M32 address { Segment::UNK, Encoding64 { R64::RCX, R64::R10, 1, 0x10 } };
+
+    IrGenerator generator;
+    generator.mov(R32::R9D, address);
+    generator.sub(R32::R9D, 0x40);
+    generator.mov(address, R32::R9D);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
+// xor ebx, [rsi+0x8], with an unrelated load in between
+IR testLoadOp() {
+    M32 address { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x8 } };
+    M64 other { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x30 } };
+
+    IrGenerator generator;
+    generator.mov(R32::R8D, address);
+    generator.mov(R64::R10, other);
+    generator.xor_(R32::EBX, R32::R8D);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
+// cmp qword [rcx+r10], 0x7f
+IR testCompare() {
+    M64 address { Segment::UNK, Encoding64 { R64::RCX, R64::R10, 1, 0x0 } };
+
+    IrGenerator generator;
+    generator.mov(R64::R8, address);
+    generator.cmp(R64::R8, 0x7f);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
+// lea r10, [rbx+rdi*4+0x10] ; lea r10, [r10+0x20]
+IR testLeaChain() {
+    IrGenerator generator;
+    generator.lea(R64::R10, M64 { Segment::UNK, Encoding64 { R64::RBX, R64::RDI, 4, 0x10 } });
+    generator.lea(R64::R10, M64 { Segment::UNK, Encoding64 { R64::R10, R64::ZERO, 1, 0x20 } });
+    generator.mov(R64::R8, M64 { Segment::UNK, Encoding64 { R64::RCX, R64::R10, 1, 0x0 } });
+    generator.mov(M64 { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x18 } }, R64::R8);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
+// the temporary is read again after the store: nothing can be folded
+IR testTemporaryStillLive() {
+    M64 address { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x20 } };
+    M64 other { Segment::UNK, Encoding64 { R64::RSI, R64::ZERO, 1, 0x28 } };
+
+    IrGenerator generator;
+    generator.mov(R64::R8, address);
+    generator.add(R64::R8, R64::RBX);
+    generator.mov(address, R64::R8);
+    generator.mov(other, R64::R8);
+    IR ir = generator.generateIR();
+    return ir;
+}
+
+int main() {
+    struct Test {
+        IR(*ir)();
+        bool shouldShrink;
+    };
+    std::vector<Test> tests {
+        Test{&testLoadOpStore, true},
+        Test{&testLoadOpImmStore, true},
+        Test{&testLoadOp, true},
+        Test{&testCompare, true},
+        Test{&testLeaChain, true},
+        Test{&testTemporaryStillLive, false},
+    };
+    for(auto test : tests) {
+        IR ir = test.ir();
+        size_t sizeBefore = ir.instructions.size();
+        auto codeBefore = CodeGenerator().tryGenerate(ir);
+        fmt::print("Before\n");
+        for(const auto& ins : ir.instructions) {
+            fmt::print("  {}\n", ins.toString());
+        }
+
+        Optimizer optimizer;
+        optimizer.addPass<MemoryOperandFolding>();
+        Optimizer::Stats stats;
+        optimizer.optimize(ir, &stats);
+        auto codeAfter = CodeGenerator().tryGenerate(ir);
+
+        size_t sizeAfter = ir.instructions.size();
+        fmt::print("After\n");
+        for(const auto& ins : ir.instructions) {
+            fmt::print("  {}\n", ins.toString());
+        }
+
+        if(!codeBefore || !codeAfter) {
+            fmt::print("Test fail: could not generate code\n");
+            return 1;
+        }
+        size_t codeSizeBefore = codeBefore->nativecode.size();
+        size_t codeSizeAfter = codeAfter->nativecode.size();
+        fmt::print("Native code: {} -> {} bytes\n", codeSizeBefore, codeSizeAfter);
+
+        bool shrunk = sizeAfter < sizeBefore && codeSizeAfter < codeSizeBefore;
+        bool unchanged = sizeAfter == sizeBefore && codeSizeAfter == codeSizeBefore;
+        if(test.shouldShrink ? !shrunk : !unchanged) {
+            fmt::print("Test fail\n");
+            return 1;
+        } else {
+            fmt::print("Test OK\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "x64/compiler/ir.h"
+#include "x64/compiler/irgenerator.h"
+#include "x64/compiler/optimizer.h"
+#include <fmt/format.h>
+
+using namespace x64;
+using namespace x64::ir;
+
+namespace {
+
+    M64 address(R64 base, R64 index, u8 scale, i32 displacement) {
+        return M64 { Segment::UNK, Encoding64 { base, index, scale, displacement } };
+    }
+
+    // constants flow through movs and leas
+    bool testConstantPropagation() {
+        IrGenerator generator;
+        generator.mov(R64::RCX, (u64)0x5);
+        generator.mov(R64::RDI, R64::RCX);
+        generator.lea(R64::RSI, address(R64::RDI, R64::ZERO, 1, 0x8));
+        generator.mov(address(R64::RDX, R64::ZERO, 1, 0x10), R64::RSI);
+        IR ir = generator.generateIR();
+
+        Optimizer optimizer;
+        optimizer.addPass<DeadCodeElimination>();
+        optimizer.addPass<ConstantPropagation>();
+        Optimizer::Stats stats;
+        optimizer.optimize(ir, &stats);
+
+        if(ir.instructions.size() != 2) return false;
+        if(ir.instructions[0].op() != Op::MOV) return false;
+        if(ir.instructions[0].out() != Operand(R64::RSI)) return false;
+        if(ir.instructions[0].in1() != Operand((u64)0xd)) return false;
+        return stats.constantPropagation == 1 && stats.constantFolding == 1;
+    }
+
+    // arithmetic on constants is computed only when its flags are overwritten
+    bool testConstantFolding() {
+        IrGenerator generator;
+        generator.mov(R32::ECX, (u32)0x3);
+        generator.add(R32::ECX, (u32)0x4);
+        generator.mov(address(R64::RDX, R64::ZERO, 1, 0x10), R64::RCX);
+        generator.test(R32::EAX, R32::EAX);
+        generator.mov(R32::ESI, (u32)0x3);
+        generator.add(R32::ESI, (u32)0x4);
+        generator.set(Cond::E, R8::AL);
+        IR ir = generator.generateIR();
+
+        Optimizer optimizer;
+        optimizer.addPass<ConstantPropagation>();
+        Optimizer::Stats stats;
+        optimizer.optimize(ir, &stats);
+
+        if(ir.instructions[1].op() != Op::MOV) return false;
+        if(ir.instructions[1].in1() != Operand((u32)0x7)) return false;
+        if(ir.instructions[5].op() != Op::ADD) return false;
+        return stats.constantFolding == 1;
+    }
+
+    // copies are read from their source
+    bool testCopyPropagation() {
+        IrGenerator generator;
+        generator.mov(R64::RSI, R64::RDX);
+        generator.mov(R64::RAX, address(R64::RSI, R64::ZERO, 1, 0x8));
+        generator.mov(R64::RDI, R64::RSI);
+        generator.mov(R64::RDI, R64::RDX);
+        generator.mov(address(R64::RDI, R64::ZERO, 1, 0x10), R64::RAX);
+        IR ir = generator.generateIR();
+
+        Optimizer optimizer;
+        optimizer.addPass<DeadCodeElimination>();
+        optimizer.addPass<CopyPropagation>();
+        optimizer.optimize(ir);
+
+        if(ir.instructions.size() != 2) return false;
+        if(ir.instructions[0].in1() != Operand(address(R64::RDX, R64::ZERO, 1, 0x8))) return false;
+        if(ir.instructions[1].out() != Operand(address(R64::RDX, R64::ZERO, 1, 0x10))) return false;
+        return true;
+    }
+
+    // computed addresses are merged into the memory operands
+    bool testAddressFolding() {
+        IrGenerator generator;
+        generator.lea(R64::RSI, address(R64::RCX, R64::ZERO, 1, 0x8));
+        generator.mov(R64::RAX, address(R64::RSI, R64::ZERO, 1, 0x8));
+        generator.lea(R64::RDI, address(R64::RCX, R64::ZERO, 1, 0x4));
+        generator.mov(R64::RAX, address(R64::RDX, R64::RDI, 1, 0x0));
+        generator.mov(R64::RCX, address(R64::RDX, R64::ZERO, 1, 0x20));
+        generator.mov(address(R64::RSI, R64::ZERO, 1, 0x0), R64::RCX);
+        IR ir = generator.generateIR();
+
+        Optimizer optimizer;
+        optimizer.addPass<DeadCodeElimination>();
+        optimizer.addPass<AddressFolding>();
+        Optimizer::Stats stats;
+        optimizer.optimize(ir, &stats);
+
+        if(stats.addressFolding != 2) return false;
+        if(ir.instructions.size() != 5) return false;
+        if(ir.instructions[1].in1() != Operand(address(R64::RCX, R64::ZERO, 1, 0x10))) return false;
+        if(ir.instructions[2].in1() != Operand(address(R64::RDX, R64::RCX, 1, 0x4))) return false;
+        // the base of the lea is overwritten before the last access
+        if(ir.instructions[4].out() != Operand(address(R64::RSI, R64::ZERO, 1, 0x0))) return false;
+        return true;
+    }
+
+}
+
+int main() {
+    struct Test {
+        const char* name;
+        bool(*run)();
+    };
+    std::vector<Test> tests {
+        Test{"constant propagation", &testConstantPropagation},
+        Test{"constant folding", &testConstantFolding},
+        Test{"copy propagation", &testCopyPropagation},
+        Test{"address folding", &testAddressFolding},
+    };
+    for(const auto& test : tests) {
+        if(!test.run()) {
+            fmt::print("Test fail: {}\n", test.name);
+            return 1;
+        }
+        fmt::print("Test OK: {}\n", test.name);
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include "x64/mmu.h"
+#include <signal.h>
+#include <sys/mman.h>
+
+using namespace x64;
+
+static u8* hostPage = nullptr;
+static int hostFaults = 0;
+
+static void onHostFault(int, siginfo_t* info, void*) {
+    if(info->si_addr != hostPage) std::abort();
+    ++hostFaults;
+    mprotect(hostPage, Mmu::PAGE_SIZE, PROT_READ | PROT_WRITE);
+}
+
+int main() {
+    // a handler that was there before, for faults that are not code writes
+    hostPage = (u8*)mmap(nullptr, Mmu::PAGE_SIZE, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(hostPage == MAP_FAILED) return 1;
+    struct sigaction action;
+    action.sa_sigaction = &onHostFault;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO;
+    if(sigaction(SIGSEGV, &action, nullptr) != 0) return 1;
+
+    auto addressSpace = AddressSpace::tryCreate(128);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+
+    BitFlags<PROT> rwx(PROT::READ, PROT::WRITE, PROT::EXEC);
+    BitFlags<MAP> flags(MAP::ANONYMOUS, MAP::PRIVATE);
+
+    auto maybeBase = mmu.mmap(0x0, 4*Mmu::PAGE_SIZE, rwx, flags);
+    if(!maybeBase) return 1;
+    u64 base = maybeBase.value();
+    u64 secondPage = base + Mmu::PAGE_SIZE;
+
+    std::vector<u64> pages;
+
+    // nothing is reported before code is watched
+    mmu.write64(Ptr64{base}, 0x1);
+    if(mmu.hasWrittenCode()) return 1;
+
+    // writes through the mmu are detected, once
+    mmu.protectCode(base+0x10, base+0x20);
+    if(mmu.hasWrittenCode()) return 1;
+    mmu.write64(Ptr64{base+0x800}, 0x2);
+    if(mmu.read64(Ptr64{base+0x800}) != 0x2) return 1;
+    if(!mmu.hasWrittenCode()) return 1;
+    mmu.takeWrittenCodePages(&pages);
+    if(pages != std::vector<u64>{base}) return 1;
+    if(mmu.hasWrittenCode()) return 1;
+    mmu.write64(Ptr64{base+0x800}, 0x3);
+    if(mmu.hasWrittenCode()) return 1;
+
+    // writes to the host memory are detected too, and stop jitted code at its next check
+    mmu.protectCode(secondPage-0x4, secondPage+0x4);
+    u64 tickLimit = 1000;
+    mmu.setJittedCodeTickLimit(&tickLimit);
+    u8* hostSecondPage = mmu.base() + secondPage;
+    hostSecondPage[0x100] = 0x4;
+    mmu.setJittedCodeTickLimit(nullptr);
+    if(tickLimit != 0) return 1;
+    if(mmu.read8(Ptr8{secondPage+0x100}) != 0x4) return 1;
+    pages.clear();
+    mmu.takeWrittenCodePages(&pages);
+    if(pages != std::vector<u64>{secondPage}) return 1;
+
+    // code that stays writable after an mprotect is still watched
+    mmu.protectCode(base, base+0x10);
+    BitFlags<PROT> rw(PROT::READ, PROT::WRITE);
+    if(mmu.mprotect(base, 4*Mmu::PAGE_SIZE, rwx) != 0) return 1;
+    mmu.write8(Ptr8{base}, 0x5);
+    pages.clear();
+    mmu.takeWrittenCodePages(&pages);
+    if(pages != std::vector<u64>{base}) return 1;
+
+    // code that is not executable anymore is not watched
+    mmu.protectCode(base, base+0x10);
+    if(mmu.mprotect(base, 4*Mmu::PAGE_SIZE, rw) != 0) return 1;
+    mmu.write8(Ptr8{base}, 0x6);
+    if(mmu.hasWrittenCode()) return 1;
+
+    // other faults go to the previous handler, and code writes are still detected after them
+    for(int i = 1; i <= 2; ++i) {
+        mprotect(hostPage, Mmu::PAGE_SIZE, PROT_READ);
+        *(volatile u8*)hostPage = (u8)i;
+        if(hostFaults != i) return 1;
+    }
+    if(mmu.mprotect(base, 4*Mmu::PAGE_SIZE, rwx) != 0) return 1;
+    mmu.protectCode(base, base+0x10);
+    mmu.base()[base] = 0x7;
+    if(!mmu.hasWrittenCode()) return 1;
+    pages.clear();
+    mmu.takeWrittenCodePages(&pages);
+    if(pages != std::vector<u64>{base}) return 1;
+
+    mmu.munmap(base, 4*Mmu::PAGE_SIZE);
+
+    // there may be any number of address spaces watching their code
+    std::vector<std::unique_ptr<AddressSpace>> addressSpaces;
+    u64 lastCode = 0;
+    for(int i = 0; i < 100; ++i) {
+        auto other = AddressSpace::tryCreate(1);
+        if(!other) return 1;
+        Mmu otherMmu(*other);
+        auto code = otherMmu.mmap(0x0, Mmu::PAGE_SIZE, rwx, flags);
+        if(!code) return 1;
+        otherMmu.protectCode(code.value(), code.value()+0x10);
+        addressSpaces.push_back(std::move(other));
+        lastCode = code.value();
+    }
+    Mmu lastMmu(*addressSpaces.back());
+    lastMmu.base()[lastCode+0x100] = 0x8;
+    if(!lastMmu.hasWrittenCode()) return 1;
+
+    return 0;
+}
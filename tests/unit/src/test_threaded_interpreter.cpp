@@ -0,0 +1,91 @@
+#include "x64/instructions/basicblock.h"
+#include "x64/cpu.h"
+#include "x64/mmu.h"
+#include <array>
+#include <vector>
+
+using namespace x64;
+
+int main() {
+    auto addressSpace = AddressSpace::tryCreate(1);
+    if(!addressSpace) return 1;
+    Mmu mmu(*addressSpace);
+    auto rw = BitFlags<PROT>(PROT::READ, PROT::WRITE);
+    auto flags = BitFlags<MAP>(MAP::ANONYMOUS, MAP::PRIVATE);
+    auto maybe_data = mmu.mmap(0x0, 0x1000, rw, flags);
+    if(!maybe_data) return 1;
+    u64 data = maybe_data.value();
+    mmu.write64(Ptr64{data+0x0}, 0x00ff00ff00ff00ff);
+    mmu.write64(Ptr64{data+0x8}, 0x123456789);
+    Cpu cpu(mmu);
+
+    // the instructions are only decoded, so they can pretend to live next to the data
+    u64 address = data + 0x100;
+    auto next = [&](u16 size) {
+        u64 current = address;
+        address += size;
+        return current;
+    };
+    std::vector<X64Instruction> instructions;
+    instructions.push_back(X64Instruction::make(next(10), Insn::MOV_R64_IMM, 10, R64::RAX, Imm{0x10}));
+    instructions.push_back(X64Instruction::make(next(3), Insn::ADD_RM64_RM64, 3, RM64{true, R64::RAX, {}}, RM64{true, R64::RBX, {}}));
+    // sub rcx, [rip+disp] reads the second qword of the data
+    u64 ripRelative = next(7);
+    i32 displacement = (i32)(data + 0x8 - (ripRelative + 7));
+    instructions.push_back(X64Instruction::make(ripRelative, Insn::SUB_RM64_RM64, 7, RM64{true, R64::RCX, {}}, RM64{false, R64::ZERO, M64{Segment::DS, Encoding64{R64::RIP, R64::ZERO, 1, displacement}}}));
+    instructions.push_back(X64Instruction::make(next(2), Insn::XOR_RM32_RM32, 2, RM32{true, R32::EDX, {}}, RM32{true, R32::EDX, {}}));
+    instructions.push_back(X64Instruction::make(next(4), Insn::CMP_RM64_IMM, 4, RM64{true, R64::RAX, {}}, Imm{0x20}));
+    instructions.push_back(X64Instruction::make(next(2), Insn::INC_RM32, 2, RM32{true, R32::EDX, {}}));
+    instructions.push_back(X64Instruction::make(next(3), Insn::DEC_RM64, 3, RM64{true, R64::RBX, {}}));
+    instructions.push_back(X64Instruction::make(next(3), Insn::TEST_RM64_R64, 3, RM64{true, R64::RAX, {}}, R64::RAX));
+    instructions.push_back(X64Instruction::make(next(3), Insn::AND_RM64_RM64, 3, RM64{true, R64::RSI, {}}, RM64{false, R64::ZERO, M64{Segment::DS, Encoding64{R64::RDI, R64::ZERO, 1, 0}}}));
+    instructions.push_back(X64Instruction::make(next(7), Insn::LEA_R64_ENCODING64, 7, R64::R8, Encoding64{R64::RIP, R64::ZERO, 1, 0x10}));
+    instructions.push_back(X64Instruction::make(next(7), Insn::OR_RM32_IMM, 7, RM32{true, R32::R9D, {}}, Imm{0xff}));
+    auto bb = cpu.createBasicBlock(instructions.data(), instructions.size());
+
+    // rip is only updated for the instructions that need it, and when leaving the block
+    const auto& threaded = bb.instructions();
+    if(threaded.size() != instructions.size()) return 1;
+    std::array<bool, 11> updatesRip {{ false, false, true, false, false, false, false, false, true, true, true }};
+    for(size_t i = 0; i < threaded.size(); ++i) {
+        if(threaded[i].second.updatesRip != updatesRip[i]) return 1;
+    }
+
+    const std::array<R64, 9> registers {{
+        R64::RAX, R64::RBX, R64::RCX, R64::RDX, R64::RSI, R64::RDI, R64::R8, R64::R9, R64::RIP,
+    }};
+    auto reset = [&]() {
+        Cpu::State state;
+        state.regs.set(R64::RBX, 0x30);
+        state.regs.set(R64::RCX, 0x1000000000);
+        state.regs.set(R64::RDX, 0xffffffffffffffff);
+        state.regs.set(R64::RSI, 0x0f0f0f0f0f0f0f0f);
+        state.regs.set(R64::RDI, data);
+        state.regs.set(R64::R9, 0x5a5a5a5a5a5a5a5a);
+        cpu.load(state);
+    };
+
+    // reference run, one instruction at a time
+    reset();
+    for(const auto& ins : instructions) {
+        cpu.set(R64::RIP, ins.nextAddress());
+        cpu.exec(ins);
+    }
+    Cpu::State expectedState;
+    cpu.save(&expectedState);
+    if(expectedState.regs.get(R64::RCX) != 0x1000000000 - 0x123456789) return 1;
+    if(expectedState.regs.get(R64::R8) != instructions[9].nextAddress() + 0x10) return 1;
+
+    // the block computes the same state
+    reset();
+    cpu.exec(bb);
+    Cpu::State state;
+    cpu.save(&state);
+    for(R64 reg : registers) {
+        if(state.regs.get(reg) != expectedState.regs.get(reg)) return 1;
+    }
+    if(state.flags.toRflags() != expectedState.flags.toRflags()) return 1;
+    if(state.regs.get(R64::RIP) != instructions.back().nextAddress()) return 1;
+
+    return 0;
+}